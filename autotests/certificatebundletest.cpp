@@ -0,0 +1,200 @@
+/*
+    autotests/certificatebundletest.cpp
+
+    This file is part of Kleopatra, the KDE keymanager
+    SPDX-FileCopyrightText: 2021 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "utils/certificatebundle.h"
+
+#include <QCryptographicHash>
+#include <QTest>
+
+using namespace Kleo;
+
+namespace
+{
+
+QByteArray packet(int tag, const QByteArray &body)
+{
+    // new format header
+    QByteArray result(1, char(0xc0 | tag));
+    if (body.size() < 192) {
+        result += char(body.size());
+    } else {
+        const int length = body.size() - 192;
+        result += char((length >> 8) + 192);
+        result += char(length & 0xff);
+    }
+    return result + body;
+}
+
+QByteArray publicKeyBody(char seed)
+{
+    // v4, creation time, RSA, 16-bit n and e
+    return QByteArray("\x04\x60\x00\x00\x00\x01", 6) + QByteArray("\x00\x10", 2) + QByteArray(2, seed)
+           + QByteArray("\x00\x11\x01\x00\x01", 5);
+}
+
+QByteArray signatureBody(quint32 created)
+{
+    QByteArray result("\x04\x13\x01\x08\x00\x06\x05\x02", 8);
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        result += char((created >> shift) & 0xff);
+    }
+    // no unhashed subpackets, left 16 bits of the hash, the signature
+    return result + QByteArray("\x00\x00\xab\xcd\x00\x08\xff", 7);
+}
+
+QByteArray certificate(char seed, quint32 created, int userIDs, int subkeys)
+{
+    QByteArray result = packet(6, publicKeyBody(seed));
+    for (int i = 0; i < userIDs; ++i) {
+        result += packet(13, "User " + QByteArray::number(i) + " <user@example.net>");
+        result += packet(2, signatureBody(created + i));
+    }
+    for (int i = 0; i < subkeys; ++i) {
+        result += packet(14, publicKeyBody(seed + 1 + i));
+        result += packet(2, signatureBody(created));
+    }
+    return result;
+}
+
+QByteArray fingerprint(const QByteArray &body)
+{
+    const QByteArray header = QByteArray(1, char(0x99)) + char(body.size() >> 8) + char(body.size() & 0xff);
+    return QCryptographicHash::hash(header + body, QCryptographicHash::Sha1).toHex().toUpper();
+}
+
+QByteArray armor(const QByteArray &type, const QByteArray &data)
+{
+    return "-----BEGIN " + type + "-----\nVersion: test\n\n" + data.toBase64() + "\n=abcd\n-----END " + type + "-----\n";
+}
+
+QByteArray der(uchar tag, const QByteArray &content)
+{
+    QByteArray result(1, char(tag));
+    if (content.size() < 0x80) {
+        result += char(content.size());
+    } else {
+        result += char(0x82);
+        result += char(content.size() >> 8);
+        result += char(content.size() & 0xff);
+    }
+    return result + content;
+}
+
+QByteArray x509Certificate(char seed, const QByteArray &extra = QByteArray())
+{
+    const QByteArray tbs = der(0x30, der(0x02, QByteArray(1, seed)) + QByteArray(200, 'x'));
+    const QByteArray algorithm = der(0x30, der(0x06, "\x2a\x86\x48\x86\xf7\x0d\x01\x01\x0b"));
+    const QByteArray signature = der(0x03, QByteArray(1, '\0') + QByteArray(64, seed));
+    return der(0x30, tbs + algorithm + signature + extra);
+}
+
+}
+
+class CertificateBundleTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testSplitOpenPGPBinary()
+    {
+        const QByteArray first = certificate('a', 1600000000, 2, 1);
+        const QByteArray second = certificate('b', 1600001000, 1, 0);
+        bool ok = false;
+        const auto certs = CertificateBundle::splitOpenPGP(first + second, &ok);
+        QVERIFY(ok);
+        QCOMPARE(certs.size(), size_t(2));
+        QCOMPARE(certs[0].data, first);
+        QCOMPARE(certs[0].fingerprint, fingerprint(publicKeyBody('a')));
+        QCOMPARE(certs[0].digest, QCryptographicHash::hash(first, QCryptographicHash::Sha256));
+        QCOMPARE(certs[1].data, second);
+        QCOMPARE(CertificateBundle::joinOpenPGP(certs), first + second);
+    }
+
+    void testSplitOpenPGPArmored()
+    {
+        const QByteArray first = certificate('a', 1600000000, 1, 1);
+        const QByteArray second = certificate('c', 1600000000, 1, 1);
+        bool ok = false;
+        const auto certs = CertificateBundle::splitOpenPGP(armor("PGP PUBLIC KEY BLOCK", first)
+                                                           + "some text between the blocks\n"
+                                                           + armor("PGP PUBLIC KEY BLOCK", second), &ok);
+        QVERIFY(ok);
+        QCOMPARE(certs.size(), size_t(2));
+        QCOMPARE(certs[0].data, first);
+        QCOMPARE(certs[1].data, second);
+        QCOMPARE(certs[1].fingerprint, fingerprint(publicKeyBody('c')));
+    }
+
+    void testSplitOpenPGPRejects_data()
+    {
+        QTest::addColumn<QByteArray>("data");
+
+        const QByteArray cert = certificate('a', 1600000000, 1, 0);
+        QTest::newRow("secret key") << packet(5, publicKeyBody('a')) + packet(13, "User <user@example.net>");
+        QTest::newRow("user ID first") << packet(13, "User <user@example.net>") + cert;
+        QTest::newRow("truncated") << cert.left(cert.size() - 1);
+        QTest::newRow("private key block") << armor("PGP PRIVATE KEY BLOCK", cert);
+        QTest::newRow("text") << QByteArray("no certificate here\n");
+    }
+
+    void testSplitOpenPGPRejects()
+    {
+        QFETCH(QByteArray, data);
+        bool ok = true;
+        const auto certs = CertificateBundle::splitOpenPGP(data, &ok);
+        QVERIFY(!ok);
+        QVERIFY(certs.empty());
+    }
+
+    void testSplitX509()
+    {
+        const QByteArray first = x509Certificate('1');
+        const QByteArray second = x509Certificate('2');
+        bool ok = false;
+        auto certs = CertificateBundle::splitX509(first + second, &ok);
+        QVERIFY(ok);
+        QCOMPARE(certs.size(), size_t(2));
+        QCOMPARE(certs[0].data, first);
+        QCOMPARE(certs[0].fingerprint, QCryptographicHash::hash(first, QCryptographicHash::Sha1).toHex().toUpper());
+        QCOMPARE(certs[1].data, second);
+
+        const QByteArray pem = CertificateBundle::joinX509(certs);
+        certs = CertificateBundle::splitX509(pem, &ok);
+        QVERIFY(ok);
+        QCOMPARE(certs.size(), size_t(2));
+        QCOMPARE(certs[0].data, first);
+        QCOMPARE(certs[1].data, second);
+    }
+
+    void testSplitX509Rejects_data()
+    {
+        QTest::addColumn<QByteArray>("data");
+
+        const QByteArray cert = x509Certificate('1');
+        // ContentInfo ::= SEQUENCE { contentType OID, content [0] EXPLICIT ANY }
+        QTest::newRow("PKCS#7") << der(0x30, der(0x06, "\x2a\x86\x48\x86\xf7\x0d\x01\x07\x02") + der(0xa0, cert));
+        // PFX ::= SEQUENCE { version INTEGER, authSafe ContentInfo, ... }
+        QTest::newRow("PKCS#12") << der(0x30, der(0x02, "\x03") + der(0x30, der(0x06, "\x2a\x86\x48\x86\xf7\x0d\x01\x07\x01")));
+        QTest::newRow("extra element") << x509Certificate('1', der(0x05, QByteArray()));
+        QTest::newRow("truncated") << cert.left(cert.size() - 1);
+        QTest::newRow("trailing garbage") << cert + "x";
+    }
+
+    void testSplitX509Rejects()
+    {
+        QFETCH(QByteArray, data);
+        bool ok = true;
+        const auto certs = CertificateBundle::splitX509(data, &ok);
+        QVERIFY(!ok);
+        QVERIFY(certs.empty());
+    }
+};
+
+QTEST_GUILESS_MAIN(CertificateBundleTest)
+#include "certificatebundletest.moc"
@@ -0,0 +1,130 @@
+/*
+    autotests/directoryscannertest.cpp
+
+    This file is part of Kleopatra, the KDE keymanager
+    SPDX-FileCopyrightText: 2021 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "utils/directoryscanner.h"
+
+#include <QDir>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QTest>
+
+#include <map>
+
+using namespace Kleo;
+
+namespace
+{
+
+bool createFile(const QString &path, int size)
+{
+    QFile f(path);
+    return f.open(QIODevice::WriteOnly) && f.write(QByteArray(size, 'x')) == size;
+}
+
+}
+
+class DirectoryScannerTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase()
+    {
+        QVERIFY(mDir.isValid());
+        const QDir root(mDir.path());
+        for (int i = 0; i < 10; ++i) {
+            const QString sub = QStringLiteral("d%1/e%1").arg(i);
+            QVERIFY(root.mkpath(sub));
+            QVERIFY(createFile(root.filePath(sub + QStringLiteral("/B.txt")), i));
+            QVERIFY(createFile(root.filePath(sub + QStringLiteral("/a.txt")), 100));
+            QVERIFY(createFile(root.filePath(sub + QStringLiteral("/.hidden")), 1));
+        }
+        QVERIFY(createFile(root.filePath(QStringLiteral("sha256sum.txt")), 64));
+    }
+
+    void testMatcher()
+    {
+        const FileNameMatcher matcher({QStringLiteral("sha256sum.txt"), QStringLiteral("[a-z0-9]+\\.sha1")}, Qt::CaseSensitive);
+        QCOMPARE(matcher.indexOf(QStringLiteral("sha256sum.txt")), 0);
+        QCOMPARE(matcher.indexOf(QStringLiteral("sha256sum_txt")), 0); // '.' matches any character
+        QCOMPARE(matcher.indexOf(QStringLiteral("SHA256SUM.txt")), -1);
+        QCOMPARE(matcher.indexOf(QStringLiteral("sha256sum.txt.bak")), -1);
+        QCOMPARE(matcher.indexOf(QStringLiteral("file1.sha1")), 1);
+        QCOMPARE(matcher.indexOf(QStringLiteral("x-file1.sha1")), -1);
+
+        const FileNameMatcher insensitive({QStringLiteral("sha256sum.txt")}, Qt::CaseInsensitive);
+        QVERIFY(insensitive.matches(QStringLiteral("SHA256SUM.TXT")));
+    }
+
+    void testScan_data()
+    {
+        QTest::addColumn<int>("threads");
+        QTest::newRow("1 thread") << 1;
+        QTest::newRow("4 threads") << 4;
+    }
+
+    void testScan()
+    {
+        QFETCH(int, threads);
+
+        DirectoryScanner scanner;
+        scanner.setMaximumThreadCount(threads);
+        std::map<QString, DirectoryScanner::Directory> dirs;
+        scanner.scan({mDir.path()}, [&dirs](DirectoryScanner::Directory &&dir) {
+            dirs[dir.path] = std::move(dir);
+        });
+
+        QCOMPARE(dirs.size(), size_t(21));
+        const QDir root(mDir.path());
+        const DirectoryScanner::Directory &top = dirs[QDir::cleanPath(root.absolutePath())];
+        QCOMPARE(top.files.size(), size_t(1));
+        QCOMPARE(top.files[0].name, QStringLiteral("sha256sum.txt"));
+        QCOMPARE(top.files[0].size, quint64(64));
+
+        const DirectoryScanner::Directory &leaf = dirs[QDir::cleanPath(root.absoluteFilePath(QStringLiteral("d7/e7")))];
+        QCOMPARE(leaf.files.size(), size_t(2));
+        QCOMPARE(leaf.files[0].name, QStringLiteral("a.txt"));
+        QCOMPARE(leaf.files[0].size, quint64(100));
+        QCOMPARE(leaf.files[1].name, QStringLiteral("B.txt"));
+        QCOMPARE(leaf.files[1].size, quint64(7));
+    }
+
+    void testNonRecursive()
+    {
+        DirectoryScanner scanner;
+        scanner.setRecursive(false);
+        int count = 0;
+        scanner.scan({mDir.path()}, [&count](DirectoryScanner::Directory &&) { ++count; });
+        QCOMPARE(count, 1);
+
+        QStringList subdirectories;
+        const DirectoryScanner::Directory dir = DirectoryScanner::readDirectory(mDir.path(), &subdirectories);
+        QCOMPARE(dir.files.size(), size_t(1));
+        QCOMPARE(subdirectories.size(), 10);
+    }
+
+    void testCancel()
+    {
+        DirectoryScanner scanner;
+        int count = 0;
+        scanner.scan({mDir.path()}, [&](DirectoryScanner::Directory &&) {
+            ++count;
+            scanner.cancel();
+        });
+        QVERIFY(scanner.isCanceled());
+        QVERIFY(count < 21);
+    }
+
+private:
+    QTemporaryDir mDir;
+};
+
+QTEST_GUILESS_MAIN(DirectoryScannerTest)
+
+#include "directoryscannertest.moc"
@@ -0,0 +1,125 @@
+/*
+    autotests/dumpfiletest.cpp
+
+    This file is part of Kleopatra, the KDE keymanager
+    SPDX-FileCopyrightText: 2021 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "utils/dumpfile.h"
+
+#include <QTest>
+
+using namespace Kleo;
+
+namespace
+{
+
+QByteArray crl(const QByteArray &issuer, int firstSerial, int entries)
+{
+    QByteArray result = "--------------------------------------------------------\n"
+                        "Begin CRL dump (retrieved via http://crl.example.com/ca.crl)\n"
+                        " Issuer:\t" + issuer + "\n"
+                        " This Update:\t20210301T000000\n"
+                        "\n";
+    for (int i = 0; i < entries; ++i) {
+        result += "  " + QByteArray::number(firstSerial + i, 16).toUpper().rightJustified(8, '0')
+                  + ":\t reasons( unspecified )  20210201T120000\n";
+    }
+    result += "End CRL dump\n\n";
+    return result;
+}
+
+}
+
+class DumpFileTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testLinesAcrossAppends()
+    {
+        DumpFile file;
+        file.append("first\r\nsec");
+        QCOMPARE(file.lineCount(), 1);
+        file.append("ond\n\nfourth");
+        QCOMPARE(file.lineCount(), 3);
+        file.finish();
+        QCOMPARE(file.lineCount(), 4);
+        QCOMPARE(file.line(0), QByteArray("first"));
+        QCOMPARE(file.line(1), QByteArray("second"));
+        QCOMPARE(file.line(2), QByteArray());
+        QCOMPARE(file.line(3), QByteArray("fourth"));
+        QCOMPARE(file.maximumLineLength(), 6);
+    }
+
+    void testLineAcrossChunks()
+    {
+        DumpFile file;
+        const QByteArray filler(DumpFile::ChunkSize - 5, 'x');
+        file.append(filler + "\nabcdefghij\n");
+        QCOMPARE(file.lineCount(), 2);
+        QCOMPARE(file.line(0), filler);
+        QCOMPARE(file.line(1), QByteArray("abcdefghij"));
+    }
+
+    void testEntryRunsAndIssuers()
+    {
+        DumpFile file;
+        const QByteArray data = crl("CN=First CA", 0x100, 3) + crl("CN=Second CA", 0x200, 0) + crl("CN=Third CA", 0x300, 2);
+        // feed the data in small pieces to exercise the incremental parser
+        for (int i = 0; i < data.size(); i += 7) {
+            file.append(data.mid(i, 7));
+        }
+        file.finish();
+
+        QCOMPARE(file.entryRuns().size(), size_t(2));
+        QCOMPARE(file.entryRuns()[0].count, 3);
+        QCOMPARE(file.entryRuns()[1].count, 2);
+        QCOMPARE(file.issuerLines().size(), size_t(3));
+        QCOMPARE(file.entryRunOf(file.entryRuns()[1].firstLine + 1), 1);
+        QCOMPARE(file.entryRunOf(file.issuerLines()[0]), -1);
+    }
+
+    void testSearch()
+    {
+        DumpFile file;
+        file.append(crl("CN=First CA", 0x100, 1000));
+        file.append(crl("CN=Second CA", 0x2000, 1000));
+        file.finish();
+
+        const int line = file.findSerialNumber("00:00:20:10");
+        QVERIFY(line >= 0);
+        QVERIFY(file.line(line).startsWith("  00002010:"));
+        QCOMPARE(file.findSerialNumber("0000abcd"), -1);
+        QCOMPARE(file.findSerialNumber("not a serial"), -1);
+
+        // serial numbers appended after a search are found as well
+        file.append(crl("CN=Third CA", 0x5000, 10));
+        QVERIFY(file.findSerialNumber("00005009") >= 0);
+
+        QCOMPARE(file.findIssuer("second ca", -1), file.issuerLines()[1]);
+        QCOMPARE(file.findIssuer("CA", file.issuerLines()[2]), file.issuerLines()[0]);
+        QCOMPARE(file.findIssuer("unknown", -1), -1);
+
+        QCOMPARE(file.find("end crl dump", -1), file.entryRuns()[0].firstLine + 1000);
+        QCOMPARE(file.find("nothing like this", -1), -1);
+    }
+
+    void testClear()
+    {
+        DumpFile file;
+        file.append(crl("CN=First CA", 0x100, 10));
+        file.clear();
+        QCOMPARE(file.lineCount(), 0);
+        QVERIFY(file.entryRuns().empty());
+        QCOMPARE(file.findSerialNumber("00000100"), -1);
+        file.append("again\n");
+        QCOMPARE(file.line(0), QByteArray("again"));
+    }
+};
+
+QTEST_GUILESS_MAIN(DumpFileTest)
+
+#include "dumpfiletest.moc"
@@ -0,0 +1,96 @@
+/*
+    autotests/keygenerationbatchtest.cpp
+
+    This file is part of Kleopatra, the KDE keymanager
+    SPDX-FileCopyrightText: 2021 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "utils/keygenerationbatch.h"
+
+#include <QTest>
+
+using namespace Kleo;
+
+class KeyGenerationBatchTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testCsv()
+    {
+        const QByteArray data = "# service identities\n"
+                                "protocol,name,email,algorithm,expires,protect\n"
+                                "openpgp,Backup Service,backup@example.com,ed25519,2030-01-31,no\n"
+                                "\n"
+                                "openpgp,\"Mail, Relay\",relay@example.com,rsa4096,,\n";
+        QString error;
+        const auto requests = parseKeyGenerationRequestsCsv(data, &error);
+        QVERIFY(error.isEmpty());
+        QCOMPARE(requests.size(), size_t(2));
+
+        QCOMPARE(requests[0].name, QStringLiteral("Backup Service"));
+        QCOMPARE(requests[0].expirationDate, QDate(2030, 1, 31));
+        QVERIFY(!requests[0].protect);
+        const QString parameters = requests[0].keyParameters();
+        QVERIFY(parameters.contains(QLatin1String("%no-protection")));
+        QVERIFY(parameters.contains(QLatin1String("Key-Curve:ed25519")));
+        QVERIFY(parameters.contains(QLatin1String("Subkey-Curve:cv25519")));
+        QVERIFY(parameters.contains(QLatin1String("Expire-Date:2030-01-31")));
+
+        QCOMPARE(requests[1].name, QStringLiteral("Mail, Relay"));
+        QVERIFY(requests[1].protect);
+        QVERIFY(requests[1].keyParameters().contains(QLatin1String("Key-Length:4096")));
+        QVERIFY(requests[1].keyParameters().contains(QLatin1String("%ask-passphrase")));
+        QCOMPARE(requests[1].outputBaseName(), QStringLiteral("relay@example.com"));
+    }
+
+    void testCsvErrors()
+    {
+        QString error;
+        QVERIFY(parseKeyGenerationRequestsCsv("protocol;dn\ncms;CN=www.example.com\nsmime;\n", &error).empty());
+        QVERIFY(error.contains(QLatin1Char('3')));
+
+        error.clear();
+        QVERIFY(parseKeyGenerationRequestsCsv("protocol,dn,algorithm\ncms,CN=x,ed25519\n", &error).empty());
+        QVERIFY(!error.isEmpty());
+    }
+
+    void testJson()
+    {
+        const QByteArray data = R"({"keys": [
+            {"protocol": "cms", "dn": "CN=www.example.com,O=Example", "length": 2048, "file": "www"},
+            {"name": "Build Bot", "algorithm": "brainpoolp256r1", "protect": false}
+        ]})";
+        QString error;
+        const auto requests = parseKeyGenerationRequestsJson(data, &error);
+        QVERIFY(error.isEmpty());
+        QCOMPARE(requests.size(), size_t(2));
+
+        QCOMPARE(requests[0].protocol, KeyParameters::CMS);
+        QCOMPARE(requests[0].length, 2048u);
+        QCOMPARE(requests[0].outputBaseName(), QStringLiteral("www"));
+        QVERIFY(requests[0].keyParameters().contains(QLatin1String("Name-DN:CN=www.example.com,O=Example")));
+
+        QCOMPARE(requests[1].protocol, KeyParameters::OpenPGP);
+        QVERIFY(!requests[1].protect);
+        QVERIFY(requests[1].keyParameters().contains(QLatin1String("Key-Curve:brainpoolP256r1")));
+        QCOMPARE(requests[1].outputBaseName(), QStringLiteral("Build_Bot"));
+    }
+
+    void testJsonErrors()
+    {
+        QString error;
+        QVERIFY(parseKeyGenerationRequestsJson("[{\"name\": \"x\", \"expires\": \"tomorrow\"}]", &error).empty());
+        QVERIFY(!error.isEmpty());
+
+        error.clear();
+        QVERIFY(parseKeyGenerationRequestsJson("[1, 2", &error).empty());
+        QVERIFY(!error.isEmpty());
+    }
+};
+
+QTEST_GUILESS_MAIN(KeyGenerationBatchTest)
+
+#include "keygenerationbatchtest.moc"
@@ -0,0 +1,132 @@
+/*
+    autotests/logstoretest.cpp
+
+    This file is part of Kleopatra, the KDE keymanager
+    SPDX-FileCopyrightText: 2021 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "kwatchgnupg/logstore.h"
+
+#include <QTest>
+
+class LogStoreTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testParseLine_data()
+    {
+        QTest::addColumn<QByteArray>("line");
+        QTest::addColumn<int>("client");
+        QTest::addColumn<QByteArray>("component");
+        QTest::addColumn<int>("pid");
+        QTest::addColumn<int>("level");
+        QTest::addColumn<QByteArray>("message");
+
+        QTest::newRow("debug") << QByteArray("  3 - gpg-agent[1234]: DBG: chan_6 -> OK")
+                               << 3 << QByteArray("gpg-agent") << 1234 << int(LogStore::Debug) << QByteArray("DBG: chan_6 -> OK");
+        QTest::newRow("with time") << QByteArray("12 - 2021-03-04 10:11:12 scdaemon[99] Warning: card removed")
+                                   << 12 << QByteArray("scdaemon") << 99 << int(LogStore::Warning) << QByteArray("Warning: card removed");
+        QTest::newRow("fatal") << QByteArray("  5 - dirmngr[7]: Fatal: out of core")
+                               << 5 << QByteArray("dirmngr") << 7 << int(LogStore::Error) << QByteArray("Fatal: out of core");
+        QTest::newRow("unprefixed error") << QByteArray("  5 - dirmngr[7]: error fetching CRL")
+                                          << 5 << QByteArray("dirmngr") << 7 << int(LogStore::Info) << QByteArray("error fetching CRL");
+        QTest::newRow("watchgnupg") << QByteArray("  4 - [client at fd 4 connected (local)]")
+                                    << 4 << QByteArray() << -1 << int(LogStore::Info) << QByteArray("[client at fd 4 connected (local)]");
+        QTest::newRow("plain") << QByteArray("[2021-03-04T10:11:12] Log started")
+                               << -1 << QByteArray() << -1 << int(LogStore::Info) << QByteArray("[2021-03-04T10:11:12] Log started");
+    }
+
+    void testParseLine()
+    {
+        QFETCH(QByteArray, line);
+        const LogStore::ParsedLine parsed = LogStore::parseLine(line.constData(), line.size());
+        QTEST(parsed.client, "client");
+        QTEST(line.mid(parsed.componentBegin, parsed.componentLength), "component");
+        QTEST(parsed.pid, "pid");
+        QTEST(parsed.level, "level");
+        QTEST(line.mid(parsed.messageBegin), "message");
+    }
+
+    void testRingDropsOldestLines()
+    {
+        LogStore store(4096);
+        const QByteArray line = QByteArray("  1 - gpg[1]: ") + QByteArray(100, 'x');
+        int dropped = 0;
+        for (int i = 0; i < 100; ++i) {
+            dropped += store.append(line + QByteArray::number(i), i);
+        }
+        QCOMPARE(store.count() + dropped, 100);
+        QVERIFY(store.count() * line.size() <= store.capacity());
+        // the newest lines survive, also across the wrap-around of the ring
+        QCOMPARE(store.rawLine(store.count() - 1), line + "99");
+        QCOMPARE(store.timestamp(0), qint64(dropped));
+        QCOMPARE(store.component(0), QStringLiteral("gpg"));
+    }
+
+    void testTooManyComponents()
+    {
+        LogStore store(4096);
+        for (int i = 0; i < LogStore::UnknownComponent; ++i) {
+            store.append(QByteArray("  1 - c") + QByteArray::number(i) + "[1]: x", i);
+        }
+        QCOMPARE(store.components().size(), int(LogStore::UnknownComponent));
+        store.append("  1 - other[1]: x", 0);
+        const int row = store.count() - 1;
+        QCOMPARE(store.componentIndex(row), int(LogStore::UnknownComponent));
+        QVERIFY(store.component(row).isEmpty());
+        QCOMPARE(store.component(row - 1), QStringLiteral("c%1").arg(LogStore::UnknownComponent - 1));
+    }
+
+    void testMaximumLineCount()
+    {
+        LogStore store(4096);
+        for (int i = 0; i < 10; ++i) {
+            store.append(QByteArray::number(i), i);
+        }
+        store.setMaximumLineCount(3);
+        QCOMPARE(store.linesToDrop(0, 0), 7);
+        store.dropFront(7);
+        QCOMPARE(store.count(), 3);
+        QCOMPARE(store.rawLine(0), QByteArray("7"));
+        QCOMPARE(store.append("10", 10), 1);
+        QCOMPARE(store.rawLine(2), QByteArray("10"));
+    }
+
+    void testLinesAreDroppedInChunks()
+    {
+        LogStore store(4096);
+        store.setMaximumLineCount(32);
+        for (int i = 0; i < 32; ++i) {
+            store.append(QByteArray::number(i), i);
+        }
+        // one more line makes room for a chunk of them
+        QCOMPARE(store.linesToDrop(1, 2), 1 + 32 / LogStore::TrimChunkDivisor);
+        QCOMPARE(store.linesToDrop(0, 0), 0);
+
+        LogStore full(4096);
+        const QByteArray line(1024, 'x');
+        for (int i = 0; i < 4; ++i) {
+            QCOMPARE(full.linesToDrop(1, line.size()), 0);
+            full.append(line, i);
+        }
+        // the ring is full; the next line needs one line, the chunk another
+        QCOMPARE(full.linesToDrop(1, line.size()), 2);
+    }
+
+    void testFirstLineToKeep()
+    {
+        LogStore store(4096);
+        store.setMaximumLineCount(2);
+        const QVector<QByteArray> lines = {"a", "b", "c"};
+        QCOMPARE(store.firstLineToKeep(lines), 1);
+        store.setMaximumLineCount(0);
+        QCOMPARE(store.firstLineToKeep(lines), 0);
+        QCOMPARE(store.firstLineToKeep({QByteArray(3000, 'x'), QByteArray(3000, 'y')}), 1);
+    }
+};
+
+QTEST_GUILESS_MAIN(LogStoreTest)
+#include "logstoretest.moc"
@@ -0,0 +1,124 @@
+/*
+    This file is part of Kleopatra's test suite.
+    SPDX-FileCopyrightText: 2021 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "view/selectioncounters.h"
+
+#include <Libkleo/DefaultKeyFilter>
+#include <Libkleo/KeyListModel>
+#include <Libkleo/KeyListSortFilterProxyModel>
+
+#include <gpgme++/key.h>
+
+#include <gpgme.h>
+
+#include <QItemSelectionModel>
+#include <QTest>
+
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+using namespace Kleo;
+
+namespace
+{
+
+// a key without user IDs and subkeys; enough for the counters
+GpgME::Key createKey(const char *fingerprint, bool secret)
+{
+    const auto key = static_cast<gpgme_key_t>(std::calloc(1, sizeof(struct _gpgme_key)));
+    key->_refs = 1;
+    key->protocol = GPGME_PROTOCOL_OpenPGP;
+    key->secret = secret;
+    key->fpr = strdup(fingerprint);
+    return GpgME::Key(key, false);
+}
+
+}
+
+class SelectionCountersTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void init()
+    {
+        mModel = AbstractKeyListModel::createFlatKeyListModel(this);
+        mModel->setKeys({
+            createKey("1111111111111111111111111111111111111111", true),
+            createKey("2222222222222222222222222222222222222222", false),
+            createKey("3333333333333333333333333333333333333333", true),
+        });
+        mProxy = new KeyListSortFilterProxyModel(this);
+        mProxy->setSourceModel(mModel);
+        mSelectionModel = new QItemSelectionModel(mProxy, this);
+        mCounters = new SelectionCounters(mSelectionModel);
+    }
+
+    void cleanup()
+    {
+        delete mSelectionModel;
+        delete mProxy;
+        delete mModel;
+    }
+
+    void testSelection()
+    {
+        QCOMPARE(mCounters->restrictions(), Command::Restrictions(Command::NoRestriction));
+
+        select("2222222222222222222222222222222222222222");
+        QVERIFY(mCounters->restrictions() & Command::OnlyOneKey);
+        QVERIFY(mCounters->restrictions() & Command::MustNotBeSecretKey);
+
+        select("3333333333333333333333333333333333333333");
+        QVERIFY(!mCounters->isDirty());
+        QVERIFY(!(mCounters->restrictions() & Command::OnlyOneKey));
+        QVERIFY(!(mCounters->restrictions() & Command::NeedSecretKey));
+        QVERIFY(!(mCounters->restrictions() & Command::MustNotBeSecretKey));
+    }
+
+    void testFilterChangeWhileKeyIsSelected()
+    {
+        select("2222222222222222222222222222222222222222");
+        select("3333333333333333333333333333333333333333");
+        QVERIFY(!(mCounters->restrictions() & Command::OnlyOneKey));
+
+        // filtering out the selected public key must not leave it counted
+        const auto filter = std::make_shared<DefaultKeyFilter>();
+        filter->setHasSecret(DefaultKeyFilter::Set);
+        mProxy->setKeyFilter(filter);
+        QCOMPARE(mProxy->rowCount(), 2);
+        QCOMPARE(mSelectionModel->selectedRows().size(), 1);
+
+        const Command::Restrictions restrictions = mCounters->restrictions();
+        QVERIFY(restrictions & Command::NeedSelection);
+        QVERIFY(restrictions & Command::OnlyOneKey);
+        QVERIFY(restrictions & Command::NeedSecretKey);
+
+        // and showing all keys again must not count anything twice
+        mProxy->setKeyFilter(std::shared_ptr<KeyFilter>());
+        QCOMPARE(mSelectionModel->selectedRows().size(), 1);
+        QVERIFY(mCounters->restrictions() & Command::OnlyOneKey);
+    }
+
+private:
+    void select(const char *fingerprint)
+    {
+        const QModelIndex index = mProxy->index(createKey(fingerprint, false));
+        QVERIFY(index.isValid());
+        mSelectionModel->select(index, QItemSelectionModel::Select | QItemSelectionModel::Rows);
+    }
+
+private:
+    AbstractKeyListModel *mModel = nullptr;
+    KeyListSortFilterProxyModel *mProxy = nullptr;
+    QItemSelectionModel *mSelectionModel = nullptr;
+    SelectionCounters *mCounters = nullptr;
+};
+
+QTEST_MAIN(SelectionCountersTest)
+#include "selectioncounterstest.moc"
@@ -0,0 +1,120 @@
+/*
+    autotests/substringindextest.cpp
+
+    This file is part of Kleopatra, the KDE keymanager
+    SPDX-FileCopyrightText: 2021 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "utils/substringindex.h"
+
+#include <QTest>
+
+#include <algorithm>
+#include <map>
+
+using namespace Kleo;
+
+namespace
+{
+
+// id -> wordStart
+std::map<int, bool> find(const SubstringIndex &index, const QString &query)
+{
+    std::map<int, bool> result;
+    for (const SubstringIndex::Match &match : index.find(query)) {
+        result[match.id] = match.wordStart;
+    }
+    return result;
+}
+
+}
+
+class SubstringIndexTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void init()
+    {
+        mIndex.clear();
+        mIndex.insert(1, QStringLiteral("Alice Example <alice@example.net>"));
+        mIndex.insert(2, QStringLiteral("Bob <bob@example.org>\nA1B2C3D4"));
+        mIndex.insert(3, QStringLiteral("Émilie <emilie@example.net>"));
+    }
+
+    void testFind_data()
+    {
+        QTest::addColumn<QString>("query");
+        QTest::addColumn<QList<int>>("ids");
+        QTest::addColumn<QList<int>>("wordStarts");
+
+        QTest::newRow("one character") << QStringLiteral("b") << QList<int>{2} << QList<int>{2};
+        QTest::newRow("one character inside words") << QStringLiteral("m") << QList<int>{} << QList<int>{};
+        QTest::newRow("two characters at a word start") << QStringLiteral("em") << QList<int>{3} << QList<int>{3};
+        QTest::newRow("two characters inside a word") << QStringLiteral("li") << QList<int>{} << QList<int>{};
+        QTest::newRow("three characters inside a word") << QStringLiteral("lic") << QList<int>{1} << QList<int>{};
+        QTest::newRow("word start") << QStringLiteral("alice") << QList<int>{1} << QList<int>{1};
+        QTest::newRow("inside a word") << QStringLiteral("xampl") << QList<int>{1, 2, 3} << QList<int>{};
+        QTest::newRow("case insensitive") << QStringLiteral("EXAMPLE.NET") << QList<int>{1, 3} << QList<int>{1, 3};
+        QTest::newRow("non-ASCII") << QStringLiteral("émi") << QList<int>{3} << QList<int>{3};
+        QTest::newRow("fingerprint") << QStringLiteral("b2c3") << QList<int>{2} << QList<int>{};
+        QTest::newRow("no match") << QStringLiteral("carol") << QList<int>{} << QList<int>{};
+        QTest::newRow("empty") << QString() << QList<int>{} << QList<int>{};
+    }
+
+    void testFind()
+    {
+        QFETCH(QString, query);
+        QFETCH(QList<int>, ids);
+        QFETCH(QList<int>, wordStarts);
+
+        const auto matches = find(mIndex, query);
+        QList<int> foundIds;
+        QList<int> foundWordStarts;
+        for (const auto &match : matches) {
+            foundIds.push_back(match.first);
+            if (match.second) {
+                foundWordStarts.push_back(match.first);
+            }
+        }
+        QCOMPARE(foundIds, ids);
+        QCOMPARE(foundWordStarts, wordStarts);
+    }
+
+    void testRemove()
+    {
+        mIndex.remove(1);
+        QCOMPARE(mIndex.size(), 2);
+        QCOMPARE(find(mIndex, QStringLiteral("alice")).size(), size_t(0));
+        QCOMPARE(find(mIndex, QStringLiteral("example")).size(), size_t(2));
+
+        // re-indexing uses a new id
+        mIndex.insert(4, QStringLiteral("Alice Example <alice@example.com>"));
+        const auto matches = find(mIndex, QStringLiteral("alice"));
+        QCOMPARE(matches.size(), size_t(1));
+        QCOMPARE(matches.begin()->first, 4);
+    }
+
+    void testCompaction()
+    {
+        for (int id = 10; id < 3010; ++id) {
+            mIndex.insert(id, QStringLiteral("user%1@example.com").arg(id));
+        }
+        for (int id = 10; id < 3000; ++id) {
+            mIndex.remove(id);
+        }
+        QCOMPARE(mIndex.size(), 13);
+        const auto matches = find(mIndex, QStringLiteral("user"));
+        QCOMPARE(matches.size(), size_t(10));
+        QCOMPARE(matches.begin()->first, 3000);
+        QCOMPARE(find(mIndex, QStringLiteral("user10@")).size(), size_t(0));
+    }
+
+private:
+    SubstringIndex mIndex;
+};
+
+QTEST_GUILESS_MAIN(SubstringIndexTest)
+#include "substringindextest.moc"
@@ -26,3 +26,6 @@
 
 /* DBus available */
 #cmakedefine01 HAVE_QDBUS
+
+/* QGpgME installs qgpgmenewcryptoconfig.h */
+#cmakedefine01 HAVE_QGPGME_NEWCRYPTOCONFIG
@@ -0,0 +1,423 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    commands/batchkeygenerationcommand.cpp
+
+    This file is part of Kleopatra, the KDE keymanager
+    SPDX-FileCopyrightText: 2021 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <config-kleopatra.h>
+
+#include "batchkeygenerationcommand.h"
+
+#include "command_p.h"
+
+#include <utils/filedialog.h>
+#include <utils/keygenerationbatch.h>
+
+#include <Libkleo/KeyCache>
+
+#include <QGpgME/ExportJob>
+#include <QGpgME/KeyGenerationJob>
+#include <QGpgME/Protocol>
+
+#include <gpgme++/keygenerationresult.h>
+
+#include <KLocalizedString>
+#include <KMessageBox>
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QPointer>
+#include <QSaveFile>
+#include <QSet>
+#include <QThread>
+
+#include <deque>
+#include <vector>
+
+#include "kleopatra_debug.h"
+
+using namespace Kleo;
+using namespace Kleo::Commands;
+using namespace GpgME;
+
+namespace
+{
+struct Task {
+    KeyGenerationRequest request;
+    QString parameters;
+    QString baseName; // unique within the batch
+};
+
+// gpg-agent asks for the passphrase of protected OpenPGP keys and of all
+// S/MIME keys; only one of these is created at a time, so that the user is
+// not faced with several pinentries at once
+bool asksForPassphrase(const KeyGenerationRequest &request)
+{
+    return request.protocol != KeyParameters::OpenPGP || request.protect;
+}
+
+QString outputFileName(const Task &task)
+{
+    return task.baseName + (task.request.protocol == KeyParameters::OpenPGP ? QLatin1String(".asc") : QLatin1String(".p10"));
+}
+}
+
+class BatchKeyGenerationCommand::Private : public Command::Private
+{
+    friend class ::Kleo::Commands::BatchKeyGenerationCommand;
+    BatchKeyGenerationCommand *q_func() const
+    {
+        return static_cast<BatchKeyGenerationCommand *>(q);
+    }
+public:
+    explicit Private(BatchKeyGenerationCommand *qq, KeyListController *c);
+    ~Private();
+
+private:
+    bool prepare();
+    bool confirmOverwrite();
+    void startJobs();
+    void generationResult(const Task &task, const KeyGenerationResult &result, const QByteArray &request);
+    void exportResult(const Task &task, const GpgME::Error &err, const QByteArray &data);
+    void writeFile(const QString &fileName, const QByteArray &data);
+    void jobFinished();
+    void finishIfDone();
+
+private:
+    QString inputFileName;
+    QString outputDirectory;
+    int maximumParallelJobs = qBound(1, QThread::idealThreadCount() / 2, 4);
+
+    std::deque<Task> pendingTasks;
+    std::vector<QPointer<QGpgME::Job>> jobs;
+    int runningGenerations = 0;
+    int runningInteractiveGenerations = 0;
+    int runningExports = 0;
+    int total = 0;
+    int done = 0;
+    bool haveOpenPGP = false;
+    bool haveCMS = false;
+    bool canceled = false;
+    QStringList generationErrors;
+    QStringList outputErrors;
+};
+
+BatchKeyGenerationCommand::Private *BatchKeyGenerationCommand::d_func()
+{
+    return static_cast<Private *>(d.get());
+}
+const BatchKeyGenerationCommand::Private *BatchKeyGenerationCommand::d_func() const
+{
+    return static_cast<const Private *>(d.get());
+}
+
+#define d d_func()
+#define q q_func()
+
+BatchKeyGenerationCommand::Private::Private(BatchKeyGenerationCommand *qq, KeyListController *c)
+    : Command::Private(qq, c)
+{
+}
+
+BatchKeyGenerationCommand::Private::~Private() {}
+
+BatchKeyGenerationCommand::BatchKeyGenerationCommand()
+    : Command(new Private(this, nullptr))
+{
+}
+
+BatchKeyGenerationCommand::BatchKeyGenerationCommand(KeyListController *c)
+    : Command(new Private(this, c))
+{
+}
+
+BatchKeyGenerationCommand::BatchKeyGenerationCommand(QAbstractItemView *v, KeyListController *c)
+    : Command(v, new Private(this, c))
+{
+}
+
+BatchKeyGenerationCommand::~BatchKeyGenerationCommand() {}
+
+void BatchKeyGenerationCommand::setInputFileName(const QString &fileName)
+{
+    d->inputFileName = fileName;
+}
+
+QString BatchKeyGenerationCommand::inputFileName() const
+{
+    return d->inputFileName;
+}
+
+void BatchKeyGenerationCommand::setOutputDirectory(const QString &path)
+{
+    d->outputDirectory = path;
+}
+
+QString BatchKeyGenerationCommand::outputDirectory() const
+{
+    return d->outputDirectory;
+}
+
+void BatchKeyGenerationCommand::setMaximumParallelJobs(int jobs)
+{
+    d->maximumParallelJobs = std::max(jobs, 1);
+}
+
+int BatchKeyGenerationCommand::maximumParallelJobs() const
+{
+    return d->maximumParallelJobs;
+}
+
+void BatchKeyGenerationCommand::doStart()
+{
+    if (!d->prepare()) {
+        d->finished();
+        return;
+    }
+    if (d->pendingTasks.empty()) {
+        d->information(i18n("The list does not contain any keys to create."),
+                       i18nc("@title:window", "Create Keys"));
+        d->finished();
+        return;
+    }
+
+    // every new key would make the key cache reload the keyring; it is
+    // refreshed once when all keys have been created
+    KeyCache::mutableInstance()->enableFileSystemWatcher(false);
+
+    Q_EMIT info(i18n("Creating keys..."));
+    d->startJobs();
+}
+
+void BatchKeyGenerationCommand::doCancel()
+{
+    d->canceled = true;
+    d->pendingTasks.clear();
+    for (const auto &job : d->jobs) {
+        if (job) {
+            job->slotCancel();
+        }
+    }
+}
+
+bool BatchKeyGenerationCommand::Private::prepare()
+{
+    if (inputFileName.isEmpty()) {
+        inputFileName = FileDialog::getOpenFileName(parentWidgetOrView(),
+                        i18n("Select Key Generation List"),
+                        QStringLiteral("keygenbatch"),
+                        i18n("Key Generation Lists") + QLatin1String(" (*.csv *.json)"));
+        if (inputFileName.isEmpty()) {
+            Q_EMIT q->canceled();
+            return false;
+        }
+    }
+    if (outputDirectory.isEmpty()) {
+        outputDirectory = QFileInfo(inputFileName).absolutePath();
+    }
+    if (!QDir().mkpath(outputDirectory)) {
+        error(i18n("Could not create the folder %1.", outputDirectory),
+              i18nc("@title:window", "Key Creation Failed"));
+        return false;
+    }
+
+    QString errorMessage;
+    const std::vector<KeyGenerationRequest> requests = readKeyGenerationRequests(inputFileName, &errorMessage);
+    if (!errorMessage.isEmpty()) {
+        error(i18n("<qt><p>Could not read the key generation list <b>%1</b>:</p><p>%2</p></qt>",
+                   inputFileName.toHtmlEscaped(), errorMessage.toHtmlEscaped()),
+              i18nc("@title:window", "Key Creation Failed"));
+        return false;
+    }
+
+    QSet<QString> usedNames;
+    for (const KeyGenerationRequest &request : requests) {
+        const QString base = request.outputBaseName();
+        QString name = base;
+        for (int i = 2; usedNames.contains(name.toLower()); ++i) {
+            name = base + QLatin1Char('-') + QString::number(i);
+        }
+        usedNames.insert(name.toLower());
+        pendingTasks.push_back({request, request.keyParameters(), name});
+        (request.protocol == KeyParameters::OpenPGP ? haveOpenPGP : haveCMS) = true;
+    }
+    total = pendingTasks.size();
+    return confirmOverwrite();
+}
+
+bool BatchKeyGenerationCommand::Private::confirmOverwrite()
+{
+    const QDir dir(outputDirectory);
+    QStringList existingFiles;
+    for (const Task &task : pendingTasks) {
+        const QString fileName = dir.absoluteFilePath(outputFileName(task));
+        if (QFile::exists(fileName)) {
+            existingFiles.push_back(fileName);
+        }
+    }
+    if (existingFiles.empty()) {
+        return true;
+    }
+    const auto choice = KMessageBox::warningContinueCancelList(parentWidgetOrView(),
+                        i18np("The following output file already exists. Overwrite it?",
+                              "The following %1 output files already exist. Overwrite them?",
+                              existingFiles.size()),
+                        existingFiles,
+                        i18nc("@title:window", "Create Keys"),
+                        KStandardGuiItem::overwrite());
+    if (choice != KMessageBox::Continue) {
+        pendingTasks.clear();
+        Q_EMIT q->canceled();
+        return false;
+    }
+    return true;
+}
+
+void BatchKeyGenerationCommand::Private::startJobs()
+{
+    for (auto it = pendingTasks.begin(); it != pendingTasks.end() && runningGenerations < maximumParallelJobs;) {
+        const bool interactive = asksForPassphrase(it->request);
+        if (interactive && runningInteractiveGenerations > 0) {
+            ++it;
+            continue;
+        }
+        const Task task = *it;
+        it = pendingTasks.erase(it);
+
+        const bool pgp = task.request.protocol == KeyParameters::OpenPGP;
+        const QGpgME::Protocol *const backend = pgp ? QGpgME::openpgp() : QGpgME::smime();
+        QGpgME::KeyGenerationJob *const job = backend ? backend->keyGenerationJob() : nullptr;
+        if (!job) {
+            generationErrors.push_back(i18n("%1: The backend does not support key creation.", task.baseName));
+            ++done;
+            continue;
+        }
+        connect(job, &QGpgME::KeyGenerationJob::result,
+                q, [this, task](const KeyGenerationResult &result, const QByteArray &request) {
+                    generationResult(task, result, request);
+                });
+        if (const GpgME::Error err = job->start(task.parameters)) {
+            generationErrors.push_back(i18n("%1: Could not start key creation: %2", task.baseName, QString::fromLocal8Bit(err.asString())));
+            ++done;
+            continue;
+        }
+        jobs.emplace_back(job);
+        ++runningGenerations;
+        if (interactive) {
+            ++runningInteractiveGenerations;
+        }
+    }
+    finishIfDone();
+}
+
+void BatchKeyGenerationCommand::Private::generationResult(const Task &task, const KeyGenerationResult &result, const QByteArray &request)
+{
+    --runningGenerations;
+    if (asksForPassphrase(task.request)) {
+        --runningInteractiveGenerations;
+    }
+    const bool pgp = task.request.protocol == KeyParameters::OpenPGP;
+
+    if (result.error().isCanceled()) {
+        // nothing to report
+    } else if (result.error() || (pgp && !result.fingerprint())) {
+        generationErrors.push_back(i18n("%1: Could not create key pair: %2", task.baseName, QString::fromLocal8Bit(result.error().asString())));
+    } else if (!pgp) {
+        writeFile(outputFileName(task), request);
+    } else if (QGpgME::ExportJob *const job = QGpgME::openpgp()->publicKeyExportJob(true)) {
+        const QString fingerprint = QLatin1String(result.fingerprint());
+        connect(job, &QGpgME::ExportJob::result,
+                q, [this, task](const GpgME::Error &err, const QByteArray &data) {
+                    exportResult(task, err, data);
+                });
+        if (const GpgME::Error err = job->start(QStringList(fingerprint))) {
+            outputErrors.push_back(i18n("%1: Could not export the public key: %2", task.baseName, QString::fromLocal8Bit(err.asString())));
+        } else {
+            // counts as done when the public key has been written
+            jobs.emplace_back(job);
+            ++runningExports;
+            startJobs();
+            return;
+        }
+    }
+
+    jobFinished();
+}
+
+void BatchKeyGenerationCommand::Private::exportResult(const Task &task, const GpgME::Error &err, const QByteArray &data)
+{
+    --runningExports;
+    if (err && !err.isCanceled()) {
+        outputErrors.push_back(i18n("%1: Could not export the public key: %2", task.baseName, QString::fromLocal8Bit(err.asString())));
+    } else if (!err) {
+        writeFile(outputFileName(task), data);
+    }
+    jobFinished();
+}
+
+void BatchKeyGenerationCommand::Private::writeFile(const QString &fileName, const QByteArray &data)
+{
+    QSaveFile file(QDir(outputDirectory).absoluteFilePath(fileName));
+    if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size() || !file.commit()) {
+        outputErrors.push_back(i18n("Could not write output file %1: %2", file.fileName(), file.errorString()));
+    }
+}
+
+void BatchKeyGenerationCommand::Private::jobFinished()
+{
+    ++done;
+    Q_EMIT q->progress(i18n("Creating keys..."), done, total);
+    startJobs();
+}
+
+void BatchKeyGenerationCommand::Private::finishIfDone()
+{
+    if (!pendingTasks.empty() || runningGenerations > 0 || runningExports > 0) {
+        return;
+    }
+
+    KeyCache::mutableInstance()->enableFileSystemWatcher(true);
+    // one refresh for the complete batch
+    if (haveOpenPGP && haveCMS) {
+        KeyCache::mutableInstance()->reload();
+    } else if (haveOpenPGP) {
+        KeyCache::mutableInstance()->reload(GpgME::OpenPGP);
+    } else if (haveCMS) {
+        KeyCache::mutableInstance()->reload(GpgME::CMS);
+    }
+
+    const QString caption = i18nc("@title:window", "Create Keys");
+    const auto toHtml = [](const QStringList &lines) {
+        return lines.join(QLatin1String("\n")).toHtmlEscaped().replace(QLatin1Char('\n'), QLatin1String("<br/>"));
+    };
+    if (!generationErrors.empty() || !outputErrors.empty()) {
+        // keys whose output could not be written were created nevertheless
+        QString message;
+        if (!generationErrors.empty()) {
+            message += i18np("<p>One key could not be created:</p><p>%2</p>",
+                             "<p>%1 keys could not be created:</p><p>%2</p>",
+                             generationErrors.size(), toHtml(generationErrors));
+        }
+        if (!outputErrors.empty()) {
+            message += i18np("<p>The output of one key could not be written:</p><p>%2</p>",
+                             "<p>The output of %1 keys could not be written:</p><p>%2</p>",
+                             outputErrors.size(), toHtml(outputErrors));
+        }
+        error(QLatin1String("<qt>") + message + QLatin1String("</qt>"), caption);
+    } else if (!canceled) {
+        information(i18np("One key was created. The results were written to %2.",
+                          "%1 keys were created. The results were written to %2.",
+                          done, outputDirectory),
+                    caption);
+    }
+    finished();
+}
+
+#undef d
+#undef q
+
+#include "moc_batchkeygenerationcommand.cpp"
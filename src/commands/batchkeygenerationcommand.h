@@ -0,0 +1,66 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    commands/batchkeygenerationcommand.h
+
+    This file is part of Kleopatra, the KDE keymanager
+    SPDX-FileCopyrightText: 2021 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef __KLEOPATRA_COMMANDS_BATCHKEYGENERATIONCOMMAND_H__
+#define __KLEOPATRA_COMMANDS_BATCHKEYGENERATIONCOMMAND_H__
+
+#include <commands/command.h>
+
+namespace Kleo
+{
+namespace Commands
+{
+
+/*!
+ * Creates the OpenPGP keys and S/MIME certificate signing requests listed
+ * in a CSV or JSON file (see readKeyGenerationRequests()) without further
+ * interaction, except for the passphrases of protected keys.
+ *
+ * The public keys (<name>.asc) and requests (<name>.p10) are written to
+ * the output directory, which defaults to the directory of the list. The
+ * user is asked once before existing files are overwritten.
+ */
+class BatchKeyGenerationCommand : public Command
+{
+    Q_OBJECT
+public:
+    explicit BatchKeyGenerationCommand(QAbstractItemView *view, KeyListController *parent);
+    explicit BatchKeyGenerationCommand(KeyListController *parent);
+    explicit BatchKeyGenerationCommand();
+    ~BatchKeyGenerationCommand() override;
+
+    /*! If no file is set, the user is asked for one. */
+    void setInputFileName(const QString &fileName);
+    QString inputFileName() const;
+
+    void setOutputDirectory(const QString &path);
+    QString outputDirectory() const;
+
+    /*!
+     * The number of keys that are created at the same time. Keys that need
+     * a passphrase (protected OpenPGP keys and S/MIME keys) are created one
+     * after the other, though.
+     */
+    void setMaximumParallelJobs(int jobs);
+    int maximumParallelJobs() const;
+
+private:
+    void doStart() override;
+    void doCancel() override;
+
+private:
+    class Private;
+    inline Private *d_func();
+    inline const Private *d_func() const;
+};
+
+}
+}
+
+#endif // __KLEOPATRA_COMMANDS_BATCHKEYGENERATIONCOMMAND_H__
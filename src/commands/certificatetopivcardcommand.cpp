@@ -236,7 +236,7 @@ void CertificateToPIVCardCommand::certificateToPIVCardDone(const Error &err)
         KMessageBox::information(d->parentWidgetOrView(),
                                  i18nc("@info", "Writing the certificate to the card succeeded."),
                                  i18nc("@title", "Success"));
-        ReaderStatus::mutableInstance()->updateStatus();
+        ReaderStatus::mutableInstance()->updateCard(d->serialNumber(), PIVCard::AppName);
     }
 
     d->finished();
@@ -166,7 +166,7 @@ void ChangePinCommand::Private::slotResult(const GpgME::Error& err)
               i18nc("@title", "Error"));
     } else if (!err.isCanceled()) {
         information(successMessage(keyRef), i18nc("@title", "Success"));
-        ReaderStatus::mutableInstance()->updateStatus();
+        ReaderStatus::mutableInstance()->updateCard(serialNumber(), appName);
     }
     finished();
 }
@@ -13,6 +13,8 @@
 
 #include "command_p.h"
 
+#include "view/dumpview.h"
+
 #include <Libkleo/GnuPG>
 
 #include <gpgme++/key.h>
@@ -29,8 +31,8 @@
 #include <QPointer>
 #include <QVBoxLayout>
 #include <QHBoxLayout>
-#include <QFontDatabase>
-#include <QTextEdit>
+#include <QApplication>
+#include <QLineEdit>
 
 static const int PROCESS_TERMINATE_TIMEOUT = 5000; // milliseconds
 
@@ -50,41 +52,48 @@ Q_SIGNALS:
     void updateRequested();
 
 public Q_SLOTS:
-    void append(const QString &line)
+    void append(const QByteArray &data)
+    {
+        ui.dumpView.append(data);
+    }
+    void finish()
     {
-        ui.logTextWidget.append(line);
-        ui.logTextWidget.ensureCursorVisible();
+        ui.dumpView.finish();
     }
     void clear()
     {
-        ui.logTextWidget.clear();
+        ui.dumpView.clear();
     }
 
 private:
     struct Ui {
-        QTextEdit   logTextWidget;
+        QLineEdit   searchLineEdit;
+        Kleo::DumpView dumpView;
         QPushButton     updateButton, closeButton;
         QVBoxLayout vlay;
         QHBoxLayout  hlay;
 
         explicit Ui(DumpCertificateDialog *q)
-            : logTextWidget(q),
+            : searchLineEdit(q),
+              dumpView(q),
               updateButton(i18nc("@action:button Update the log text widget", "&Update"), q),
               closeButton(q),
               vlay(q),
               hlay()
         {
             KGuiItem::assign(&closeButton, KStandardGuiItem::close());
-            KDAB_SET_OBJECT_NAME(logTextWidget);
+            KDAB_SET_OBJECT_NAME(searchLineEdit);
+            KDAB_SET_OBJECT_NAME(dumpView);
             KDAB_SET_OBJECT_NAME(updateButton);
             KDAB_SET_OBJECT_NAME(closeButton);
             KDAB_SET_OBJECT_NAME(vlay);
             KDAB_SET_OBJECT_NAME(hlay);
 
-            logTextWidget.setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
-            logTextWidget.setReadOnly(true);
+            searchLineEdit.setClearButtonEnabled(true);
+            searchLineEdit.setPlaceholderText(i18nc("@info:placeholder", "Find..."));
 
-            vlay.addWidget(&logTextWidget, 1);
+            vlay.addWidget(&searchLineEdit);
+            vlay.addWidget(&dumpView, 1);
             vlay.addLayout(&hlay);
 
             hlay.addWidget(&updateButton);
@@ -95,6 +104,12 @@ private:
                     q, &DumpCertificateDialog::updateRequested);
             connect(&closeButton, &QAbstractButton::clicked,
                     q, &QWidget::close);
+            connect(&searchLineEdit, &QLineEdit::returnPressed,
+                    q, [this] () {
+                if (!dumpView.find(searchLineEdit.text())) {
+                    QApplication::beep();
+                }
+            });
         }
     } ui;
 };
@@ -136,12 +151,12 @@ private:
 
     void slotProcessReadyReadStandardOutput()
     {
+        if (dialog) {
+            dialog->append(process.readAllStandardOutput());
+            return;
+        }
         while (process.canReadLine()) {
-            const QString line = Kleo::stringFromGpgOutput(chomped(process.readLine()));
-            if (dialog) {
-                dialog->append(line);
-            }
-            outputBuffer.push_back(line);
+            outputBuffer.push_back(Kleo::stringFromGpgOutput(chomped(process.readLine())));
         }
     }
 
@@ -317,6 +332,9 @@ void DumpCertificateCommand::doCancel()
 
 void DumpCertificateCommand::Private::slotProcessFinished(int code, QProcess::ExitStatus status)
 {
+    if (dialog) {
+        dialog->finish();
+    }
     if (!canceled) {
         if (status == QProcess::CrashExit)
             KMessageBox::error(dialog,
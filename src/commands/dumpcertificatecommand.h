@@ -34,6 +34,7 @@ public:
     void setUseDialog(bool on);
     bool useDialog() const;
 
+    /* the lines of the dump; only collected if no dialog is used */
     QStringList output() const;
 
 private:
@@ -13,6 +13,8 @@
 
 #include "command_p.h"
 
+#include "view/dumpview.h"
+
 #include <Libkleo/GnuPG>
 
 #include <KProcess>
@@ -28,8 +30,8 @@
 #include <QHBoxLayout>
 #include <QVBoxLayout>
 #include <KSharedConfig>
-#include <QFontDatabase>
-#include <QTextEdit>
+#include <QApplication>
+#include <QLineEdit>
 
 static const int PROCESS_TERMINATE_TIMEOUT = 5000; // milliseconds
 
@@ -40,7 +42,7 @@ class DumpCrlCacheDialog : public QDialog
     Q_OBJECT
 public:
     explicit DumpCrlCacheDialog(QWidget *parent = nullptr)
-        : QDialog(parent), ui(this), mWithRevocations(false)
+        : QDialog(parent), ui(this)
     {
         readConfig();
     }
@@ -53,23 +55,17 @@ Q_SIGNALS:
     void updateRequested();
 
 public Q_SLOTS:
-    void append(const QString &line)
+    void append(const QByteArray &data)
     {
-        ui.logTextWidget.append(line);
-        ui.logTextWidget.ensureCursorVisible();
+        ui.dumpView.append(data);
     }
-    void clear()
+    void finish()
     {
-        ui.logTextWidget.clear();
+        ui.dumpView.finish();
     }
-
-public:
-    void setWithRevocations (bool value) {
-        mWithRevocations = value;
-    }
-
-    Q_REQUIRED_RESULT bool withRevocations () {
-        return mWithRevocations;
+    void clear()
+    {
+        ui.dumpView.clear();
     }
 
 private:
@@ -90,29 +86,33 @@ private:
     }
 
     struct Ui {
-        QTextEdit   logTextWidget;
+        QLineEdit   searchLineEdit;
+        Kleo::DumpView dumpView;
         QPushButton     updateButton, closeButton, revocationsButton;
         QVBoxLayout vlay;
         QHBoxLayout  hlay;
 
         explicit Ui(DumpCrlCacheDialog *q)
-            : logTextWidget(q),
+            : searchLineEdit(q),
+              dumpView(q),
               updateButton(i18nc("@action:button Update the log text widget", "&Update"), q),
               closeButton(q),
               vlay(q),
               hlay()
         {
             KGuiItem::assign(&closeButton, KStandardGuiItem::close());
-            KDAB_SET_OBJECT_NAME(logTextWidget);
+            KDAB_SET_OBJECT_NAME(searchLineEdit);
+            KDAB_SET_OBJECT_NAME(dumpView);
             KDAB_SET_OBJECT_NAME(updateButton);
             KDAB_SET_OBJECT_NAME(closeButton);
             KDAB_SET_OBJECT_NAME(vlay);
             KDAB_SET_OBJECT_NAME(hlay);
 
-            logTextWidget.setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
-            logTextWidget.setReadOnly(true);
+            searchLineEdit.setClearButtonEnabled(true);
+            searchLineEdit.setPlaceholderText(i18nc("@info:placeholder", "Find serial number or issuer..."));
 
-            vlay.addWidget(&logTextWidget, 1);
+            vlay.addWidget(&searchLineEdit);
+            vlay.addWidget(&dumpView, 1);
             vlay.addLayout(&hlay);
 
             revocationsButton.setText(i18n("Show Entries"));
@@ -127,29 +127,26 @@ private:
             connect(&closeButton, &QAbstractButton::clicked,
                     q, &QWidget::close);
 
+            // the entries are always read; they are only collapsed in the view
             connect(&revocationsButton, &QAbstractButton::clicked,
-                    q, [q, this] () {
-                q->mWithRevocations = true;
+                    q, [this] () {
+                dumpView.setEntriesExpanded(true);
                 revocationsButton.setEnabled(false);
-                q->updateRequested();
+            });
+            connect(&searchLineEdit, &QLineEdit::returnPressed,
+                    q, [this] () {
+                if (!dumpView.find(searchLineEdit.text())) {
+                    QApplication::beep();
+                }
             });
         }
     } ui;
-    bool mWithRevocations;
 };
 }
 
 using namespace Kleo;
 using namespace Kleo::Commands;
 
-static QByteArray chomped(QByteArray ba)
-{
-    while (ba.endsWith('\n') || ba.endsWith('\r')) {
-        ba.chop(1);
-    }
-    return ba;
-}
-
 class DumpCrlCacheCommand::Private : Command::Private
 {
     friend class ::Kleo::Commands::DumpCrlCacheCommand;
@@ -175,25 +172,9 @@ private:
 
     void slotProcessReadyReadStandardOutput()
     {
-        static int count;
-        while (process.canReadLine()) {
-            if (!dialog) {
-                break;
-            }
-            const QByteArray line = chomped(process.readLine());
-            if (!line.size()) {
-                continue;
-            }
-            if (!dialog->withRevocations() && line.contains("reasons")) {
-                count++;
-                continue;
-            } else if (count) {
-                dialog->append (QLatin1Char(' ') +
-                    i18nc("Count of revocations in a CRL",
-                          "Entries:") + QStringLiteral("\t\t%1\n").arg(count));
-                count = 0;
-            }
-            dialog->append(stringFromGpgOutput(line));
+        const QByteArray data = process.readAllStandardOutput();
+        if (dialog) {
+            dialog->append(data);
         }
     }
 
@@ -329,6 +310,9 @@ void DumpCrlCacheCommand::doCancel()
 
 void DumpCrlCacheCommand::Private::slotProcessFinished(int code, QProcess::ExitStatus status)
 {
+    if (dialog) {
+        dialog->finish();
+    }
     if (!canceled) {
         if (status == QProcess::CrashExit)
             KMessageBox::error(dialog,
@@ -21,24 +21,226 @@
 #include <Libkleo/Classify>
 #include <Libkleo/Formatting>
 
-#include <QGpgME/Protocol>
-#include <QGpgME/ExportJob>
-
+#include <gpgme++/context.h>
+#include <gpgme++/data.h>
+#include <gpgme++/interfaces/dataprovider.h>
+#include <gpgme++/interfaces/progressprovider.h>
 #include <gpgme++/key.h>
 
+#include <gpg-error.h>
+
 #include <KLocalizedString>
+#include <KMessageBox>
 #include <QSaveFile>
 
+#include <QFile>
+#include <QFileInfo>
 #include <QMap>
 #include <QPointer>
+#include <QThread>
 
 #include <algorithm>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
 #include <vector>
 
+#include <errno.h>
+
 using namespace Kleo;
 using namespace Kleo::Dialogs;
 using namespace GpgME;
-using namespace QGpgME;
+
+namespace
+{
+
+// at most this many certificates are passed to one gpg/gpgsm call, which
+// keeps the command line well below the system limits
+const int MaximumKeysPerCall = 1000;
+
+struct ExportTask {
+    QString fileName;
+    QStringList fingerprints;
+};
+
+// Writes the output of gpg(sm) directly to a file instead of collecting it
+// in memory first.
+class DeviceDataProvider : public GpgME::DataProvider
+{
+public:
+    DeviceDataProvider(QIODevice *device, const std::atomic<bool> &canceled)
+        : m_device(device),
+          m_canceled(canceled)
+    {
+    }
+
+    bool writeFailed() const
+    {
+        return m_writeFailed;
+    }
+
+    bool isSupported(Operation op) const override
+    {
+        return op == Write || op == Release;
+    }
+
+    ssize_t read(void *buffer, size_t bufSize) override
+    {
+        Q_UNUSED(buffer)
+        Q_UNUSED(bufSize)
+        errno = EBADF;
+        return -1;
+    }
+
+    ssize_t write(const void *buffer, size_t bufSize) override
+    {
+        if (m_canceled) {
+            errno = ECANCELED;
+            return -1;
+        }
+        const qint64 written = m_device->write(static_cast<const char *>(buffer), bufSize);
+        if (written < 0) {
+            m_writeFailed = true;
+            errno = EIO;
+            return -1;
+        }
+        return written;
+    }
+
+    off_t seek(off_t offset, int whence) override
+    {
+        Q_UNUSED(offset)
+        Q_UNUSED(whence)
+        errno = ESPIPE;
+        return -1;
+    }
+
+    void release() override {}
+
+private:
+    QIODevice *const m_device;
+    const std::atomic<bool> &m_canceled;
+    bool m_writeFailed = false;
+};
+
+// Exports the certificates of one output file in a thread of its own.
+// The progress reported by gpg(sm) is passed to \a progress in the thread
+// of the worker object, i.e. the GUI thread.
+class ExportWorker : public QThread, public GpgME::ProgressProvider
+{
+public:
+    using ProgressHandler = std::function<void(const QString &, int, int)>;
+
+    ExportWorker(GpgME::Protocol protocol, bool armor, const ExportTask &task, const ProgressHandler &progress, QObject *parent)
+        : QThread(parent),
+          m_protocol(protocol),
+          m_armor(armor),
+          m_task(task),
+          m_progress(progress)
+    {
+    }
+
+    void cancel()
+    {
+        m_canceled = true;
+    }
+
+    const ExportTask &task() const
+    {
+        return m_task;
+    }
+
+    // only valid after the thread has finished
+    GpgME::Error error() const
+    {
+        return m_error;
+    }
+    bool writeFailed() const
+    {
+        return m_writeFailed;
+    }
+
+protected:
+    void run() override
+    {
+        const std::unique_ptr<GpgME::Context> ctx(GpgME::Context::createForProtocol(m_protocol));
+        if (!ctx) {
+            m_error = GpgME::Error::fromCode(GPG_ERR_NOT_SUPPORTED);
+            return;
+        }
+        ctx->setArmor(m_armor);
+        ctx->setProgressProvider(this);
+
+        QSaveFile file(m_task.fileName);
+        if (!file.open(QIODevice::WriteOnly)) {
+            m_writeFailed = true;
+            return;
+        }
+        DeviceDataProvider dp(&file, m_canceled);
+        GpgME::Data data(&dp);
+
+        for (int i = 0, end = m_task.fingerprints.size(); i < end && !m_canceled; i += MaximumKeysPerCall) {
+            std::vector<QByteArray> patterns;
+            std::vector<const char *> ptrs;
+            for (const QString &fpr : m_task.fingerprints.mid(i, MaximumKeysPerCall)) {
+                patterns.push_back(fpr.toLatin1());
+            }
+            std::transform(patterns.cbegin(), patterns.cend(), std::back_inserter(ptrs), std::mem_fn(&QByteArray::constData));
+            ptrs.push_back(nullptr);
+            m_error = ctx->exportPublicKeys(ptrs.data(), data);
+            if (m_error || dp.writeFailed()) {
+                break;
+            }
+        }
+
+        if (m_canceled) {
+            m_error = GpgME::Error::fromCode(GPG_ERR_CANCELED);
+        } else if (dp.writeFailed()) {
+            m_writeFailed = true;
+        } else if (!m_error && !file.commit()) {
+            m_writeFailed = true;
+        }
+        // an uncommitted QSaveFile leaves the target file untouched
+    }
+
+    void showProgress(const char *what, int type, int current, int total) override
+    {
+        Q_UNUSED(type)
+        // like QGpgME's jobs; pending calls are dropped with the worker
+        const QString message = QString::fromUtf8(what);
+        QMetaObject::invokeMethod(this, [this, message, current, total]() {
+            if (m_progress) {
+                m_progress(message, current, total);
+            }
+        }, Qt::QueuedConnection);
+    }
+
+private:
+    const GpgME::Protocol m_protocol;
+    const bool m_armor;
+    const ExportTask m_task;
+    const ProgressHandler m_progress;
+    std::atomic<bool> m_canceled{false};
+    GpgME::Error m_error;
+    bool m_writeFailed = false;
+};
+
+// "keys.asc" -> "keys_<fingerprint>.asc" or "keys-0042.asc"
+QString split_file_name(const QString &fileName, int keysPerFile, int index, int count, const QString &fingerprint)
+{
+    const QFileInfo fi(fileName);
+    const QString suffix = fi.suffix();
+    QString name = fi.path() + QLatin1Char('/') + (suffix.isEmpty() ? fi.fileName() : fi.completeBaseName());
+    if (keysPerFile == 1) {
+        name += QLatin1Char('_') + fingerprint;
+    } else {
+        name += QStringLiteral("-%1").arg(index + 1, QString::number(count).size(), 10, QLatin1Char('0'));
+    }
+    return suffix.isEmpty() ? name : name + QLatin1Char('.') + suffix;
+}
+
+}
 
 class ExportCertificateCommand::Private : public Command::Private
 {
@@ -52,18 +254,33 @@ public:
     ~Private();
     void startExportJob(GpgME::Protocol protocol, const std::vector<Key> &keys);
     void cancelJobs();
-    void exportResult(const GpgME::Error &, const QByteArray &);
+    void startWorkers();
+    void workerFinished(ExportWorker *worker);
     void showError(const GpgME::Error &error);
+    void showWriteErrors();
+    bool confirmOverwrite();
 
     bool requestFileNames(GpgME::Protocol prot);
     void finishedIfLastJob();
 
 private:
+    struct PendingTask {
+        GpgME::Protocol protocol;
+        bool armor;
+        ExportTask task;
+    };
+
     QMap<GpgME::Protocol, QString> fileNames;
+    int keysPerFile = FileOperationsPreferences().exportKeysPerFile();
+    int maximumParallelJobs = qBound(1, QThread::idealThreadCount(), 4);
     uint jobsPending = 0;
-    QMap<QObject *, QString> outFileForSender;
-    QPointer<ExportJob> cmsJob;
-    QPointer<ExportJob> pgpJob;
+    std::deque<PendingTask> pendingTasks;
+    std::vector<ExportWorker *> workers;
+    QStringList failedFiles;
+    QStringList existingFiles;
+    int keysTotal = 0;
+    int keysDone = 0;
+    bool errorShown = false;
 };
 
 ExportCertificateCommand::Private *ExportCertificateCommand::d_func()
@@ -84,7 +301,17 @@ ExportCertificateCommand::Private::Private(ExportCertificateCommand *qq, KeyList
 
 }
 
-ExportCertificateCommand::Private::~Private() {}
+ExportCertificateCommand::Private::~Private()
+{
+    pendingTasks.clear();
+    for (ExportWorker *worker : workers) {
+        worker->cancel();
+    }
+    for (ExportWorker *worker : workers) {
+        worker->wait();
+        delete worker;
+    }
+}
 
 ExportCertificateCommand::ExportCertificateCommand(KeyListController *p)
     : Command(new Private(this, p))
@@ -130,6 +357,30 @@ QString ExportCertificateCommand::x509FileName() const
     return d->fileNames[CMS];
 }
 
+void ExportCertificateCommand::setKeysPerFile(int keysPerFile)
+{
+    if (!d->jobsPending) {
+        d->keysPerFile = std::max(keysPerFile, 0);
+    }
+}
+
+int ExportCertificateCommand::keysPerFile() const
+{
+    return d->keysPerFile;
+}
+
+void ExportCertificateCommand::setMaximumParallelJobs(int jobs)
+{
+    if (!d->jobsPending) {
+        d->maximumParallelJobs = std::max(jobs, 1);
+    }
+}
+
+int ExportCertificateCommand::maximumParallelJobs() const
+{
+    return d->maximumParallelJobs;
+}
+
 void ExportCertificateCommand::doStart()
 {
     std::vector<Key> keys = d->keys();
@@ -157,6 +408,18 @@ void ExportCertificateCommand::doStart()
         if (!cms.empty()) {
             d->startExportJob(GpgME::CMS, cms);
         }
+        if (d->pendingTasks.empty()) {
+            d->finished();
+            return;
+        }
+        if (!d->confirmOverwrite()) {
+            d->pendingTasks.clear();
+            Q_EMIT canceled();
+            d->finished();
+            return;
+        }
+        Q_EMIT info(i18n("Exporting certificates..."));
+        d->startWorkers();
     }
 }
 
@@ -216,39 +479,107 @@ void ExportCertificateCommand::Private::startExportJob(GpgME::Protocol protocol,
 {
     Q_ASSERT(protocol != GpgME::UnknownProtocol);
 
-    const QGpgME::Protocol *const backend = (protocol == GpgME::OpenPGP) ? QGpgME::openpgp() : QGpgME::smime();
-    Q_ASSERT(backend);
     const QString fileName = fileNames[protocol];
     const bool binary = protocol == GpgME::OpenPGP
                         ? fileName.endsWith(QLatin1String(".gpg"), Qt::CaseInsensitive) || fileName.endsWith(QLatin1String(".pgp"), Qt::CaseInsensitive)
                         : fileName.endsWith(QLatin1String(".der"), Qt::CaseInsensitive);
-    std::unique_ptr<ExportJob> job(backend->publicKeyExportJob(!binary));
-    Q_ASSERT(job.get());
-
-    connect(job.get(), SIGNAL(result(GpgME::Error,QByteArray)),
-            q, SLOT(exportResult(GpgME::Error,QByteArray)));
-
-    connect(job.get(), &Job::progress,
-            q, &Command::progress);
 
     QStringList fingerprints;
     fingerprints.reserve(keys.size());
     for (const Key &i : keys) {
         fingerprints << QLatin1String(i.primaryFingerprint());
     }
+    keysTotal += fingerprints.size();
 
-    const GpgME::Error err = job->start(fingerprints);
-    if (err) {
-        showError(err);
-        finished();
+    if (keysPerFile <= 0 || keysPerFile >= fingerprints.size()) {
+        pendingTasks.push_back({protocol, !binary, {fileName, fingerprints}});
         return;
     }
-    Q_EMIT q->info(i18n("Exporting certificates..."));
-    ++jobsPending;
-    const QPointer<ExportJob> exportJob(job.release());
 
-    outFileForSender[exportJob.data()] = fileName;
-    (protocol == CMS ? cmsJob : pgpJob) = exportJob;
+    const int count = (fingerprints.size() + keysPerFile - 1) / keysPerFile;
+    for (int i = 0; i < count; ++i) {
+        const QStringList chunk = fingerprints.mid(i * keysPerFile, keysPerFile);
+        const QString chunkFileName = split_file_name(fileName, keysPerFile, i, count, chunk.front());
+        // the user chose only the name of the first file
+        if (QFile::exists(chunkFileName)) {
+            existingFiles.push_back(chunkFileName);
+        }
+        pendingTasks.push_back({protocol, !binary, {chunkFileName, chunk}});
+    }
+}
+
+bool ExportCertificateCommand::Private::confirmOverwrite()
+{
+    if (existingFiles.empty()) {
+        return true;
+    }
+    const auto choice = KMessageBox::warningContinueCancelList(parentWidgetOrView(),
+                        i18np("The following file already exists. Overwrite it?",
+                              "The following %1 files already exist. Overwrite them?",
+                              existingFiles.size()),
+                        existingFiles,
+                        i18n("Overwrite Existing Files?"),
+                        KStandardGuiItem::overwrite());
+    existingFiles.clear();
+    return choice == KMessageBox::Continue;
+}
+
+void ExportCertificateCommand::Private::startWorkers()
+{
+    while (!pendingTasks.empty() && workers.size() < static_cast<unsigned int>(maximumParallelJobs)) {
+        const PendingTask pending = pendingTasks.front();
+        pendingTasks.pop_front();
+
+        auto worker = new ExportWorker(pending.protocol, pending.armor, pending.task,
+                                       [this](const QString &what, int current, int total) {
+                                           Q_EMIT q->progress(what, current, total);
+                                       },
+                                       nullptr);
+        connect(worker, &QThread::finished, q, [this, worker]() {
+            workerFinished(worker);
+        });
+        workers.push_back(worker);
+        ++jobsPending;
+        worker->start();
+    }
+}
+
+void ExportCertificateCommand::Private::workerFinished(ExportWorker *worker)
+{
+    const auto it = std::find(workers.begin(), workers.end(), worker);
+    if (it == workers.end()) {
+        return;
+    }
+    workers.erase(it);
+    worker->wait();
+    Q_ASSERT(jobsPending > 0);
+    --jobsPending;
+
+    const GpgME::Error err = worker->error();
+    if (worker->writeFailed()) {
+        failedFiles.push_back(worker->task().fileName);
+    } else if (err.isCanceled()) {
+        // nothing to report
+    } else if (err) {
+        if (!errorShown) {
+            // the same error is likely to happen for all files
+            errorShown = true;
+            pendingTasks.clear();
+            showError(err);
+        }
+    } else {
+        keysDone += worker->task().fingerprints.size();
+        Q_EMIT q->progress(i18n("Exporting certificates..."), keysDone, keysTotal);
+    }
+    worker->deleteLater();
+
+    if (!errorShown) {
+        startWorkers();
+    }
+    if (jobsPending == 0) {
+        showWriteErrors();
+    }
+    finishedIfLastJob();
 }
 
 void ExportCertificateCommand::Private::showError(const GpgME::Error &err)
@@ -273,58 +604,26 @@ void ExportCertificateCommand::Private::finishedIfLastJob()
     }
 }
 
-static bool write_complete(QIODevice &iod, const QByteArray &data)
+void ExportCertificateCommand::Private::showWriteErrors()
 {
-    qint64 total = 0;
-    qint64 toWrite = data.size();
-    while (total < toWrite) {
-        const qint64 written = iod.write(data.data() + total, toWrite);
-        if (written < 0) {
-            return false;
-        }
-        total += written;
-        toWrite -= written;
-    }
-    return true;
-}
-
-void ExportCertificateCommand::Private::exportResult(const GpgME::Error &err, const QByteArray &data)
-{
-    Q_ASSERT(jobsPending > 0);
-    --jobsPending;
-
-    Q_ASSERT(outFileForSender.contains(q->sender()));
-    const QString outFile = outFileForSender[q->sender()];
-
-    if (err) {
-        showError(err);
-        finishedIfLastJob();
+    if (failedFiles.empty()) {
         return;
     }
-    QSaveFile savefile(outFile);
-    //TODO: use KIO
-    const QString writeErrorMsg = i18n("Could not write to file %1.",  outFile);
     const QString errorCaption = i18n("Certificate Export Failed");
-    if (!savefile.open(QIODevice::WriteOnly)) {
-        error(writeErrorMsg, errorCaption);
-        finishedIfLastJob();
-        return;
-    }
-
-    if (!write_complete(savefile, data) ||
-            !savefile.commit()) {
-        error(writeErrorMsg, errorCaption);
+    if (failedFiles.size() == 1) {
+        error(i18n("Could not write to file %1.", failedFiles.front()), errorCaption);
+    } else {
+        error(i18np("Could not write to file %2.", "Could not write to %1 files, e.g. %2.",
+                    failedFiles.size(), failedFiles.front()), errorCaption);
     }
-    finishedIfLastJob();
+    failedFiles.clear();
 }
 
 void ExportCertificateCommand::Private::cancelJobs()
 {
-    if (cmsJob) {
-        cmsJob->slotCancel();
-    }
-    if (pgpJob) {
-        pgpJob->slotCancel();
+    pendingTasks.clear();
+    for (ExportWorker *worker : workers) {
+        worker->cancel();
     }
 }
 
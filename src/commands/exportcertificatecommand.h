@@ -34,6 +34,19 @@ public:
     void setX509FileName(const QString &fileName);
     QString x509FileName() const;
 
+    /*!
+     * Splits the export into files with at most \a keysPerFile certificates
+     * each, which are named after the file names set above. 0 (the default
+     * unless configured otherwise) exports all certificates of a protocol
+     * into a single file.
+     */
+    void setKeysPerFile(int keysPerFile);
+    int keysPerFile() const;
+
+    /*! The number of files that are exported at the same time. */
+    void setMaximumParallelJobs(int jobs);
+    int maximumParallelJobs() const;
+
 private:
     void doStart() override;
     void doCancel() override;
@@ -42,7 +55,6 @@ private:
     class Private;
     inline Private *d_func();
     inline const Private *d_func() const;
-    Q_PRIVATE_SLOT(d_func(), void exportResult(GpgME::Error, QByteArray))
 };
 }
 
@@ -15,6 +15,8 @@
 
 #include "importcertificatescommand_p.h"
 
+#include <utils/clipboardprobe.h>
+
 #include <Libkleo/Classify>
 
 #include <gpgme++/global.h>
@@ -69,7 +71,7 @@ bool ImportCertificateFromClipboardCommand::canImportCurrentClipboard()
     if (const QClipboard *clip = QApplication::clipboard())
         if (const QMimeData *mime = clip->mimeData())
             return mime->hasText()
-                   && mayBeAnyCertStoreType(classifyContent(mime->text().toUtf8()));
+                   && mayBeAnyCertStoreType(classifyClipboardText(mime->text()));
     return false;
 }
 
@@ -15,6 +15,7 @@
 #include "importcertificatescommand_p.h"
 #include "certifycertificatecommand.h"
 #include "kleopatra_debug.h"
+#include "fileoperationspreferences.h"
 
 #include <Libkleo/KeyListSortFilterProxyModel>
 #include <Libkleo/KeyCache>
@@ -38,7 +39,15 @@
 #include <KMessageBox>
 
 #include <QByteArray>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
 #include <QEventLoop>
+#include <QFile>
+#include <QHash>
+#include <QSaveFile>
+#include <QSet>
+#include <QStandardPaths>
 #include <QString>
 #include <QWidget>
 #include <QTreeView>
@@ -150,6 +159,154 @@ private:
     std::vector<ImportResult> m_results;
 };
 
+// Remembers the SHA-256 digests of the OpenPGP certificate blocks that were
+// imported successfully. Importing an identical block again for a key that
+// is still in the keyring cannot change anything, so it can be skipped.
+// Only the most recently imported MaxEntries blocks are remembered.
+class ImportedDigests
+{
+public:
+    static const int MaxEntries = 100000;
+
+    static ImportedDigests &instance()
+    {
+        static ImportedDigests self;
+        return self;
+    }
+
+    bool contains(const QByteArray &fingerprint, const QByteArray &digest)
+    {
+        load();
+        return m_digests.value(fingerprint).digest == digest;
+    }
+
+    // Remembers the certificates that result reports as imported without error.
+    void insert(const std::vector<CertificateBundle::Certificate> &certificates, const ImportResult &result)
+    {
+        load();
+        QSet<QByteArray> imported;
+        for (const Import &import : result.imports()) {
+            if (import.fingerprint() && !import.error()) {
+                imported.insert(QByteArray(import.fingerprint()).toUpper());
+            }
+        }
+        const qint64 now = QDateTime::currentSecsSinceEpoch();
+        bool changed = false;
+        for (const auto &cert : certificates) {
+            if (!cert.fingerprint.isEmpty() && imported.contains(cert.fingerprint)) {
+                m_digests.insert(cert.fingerprint, {cert.digest, now});
+                changed = true;
+            }
+        }
+        if (changed) {
+            expire();
+            save();
+        }
+    }
+
+private:
+    struct Entry {
+        QByteArray digest;
+        qint64 imported = 0;
+    };
+
+    static QString fileName()
+    {
+        return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation)
+               + QLatin1String("/imported-certificates.digests");
+    }
+
+    // Forgets the keys that were deleted and, if there are still too many
+    // entries, the ones that were imported least recently.
+    void expire()
+    {
+        if (m_digests.size() <= MaxEntries) {
+            return;
+        }
+        const auto cache = KeyCache::instance();
+        for (auto it = m_digests.begin(); it != m_digests.end();) {
+            if (cache->findByFingerprint(it.key().constData()).isNull()) {
+                it = m_digests.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        if (m_digests.size() <= MaxEntries) {
+            return;
+        }
+        std::vector<qint64> times;
+        times.reserve(m_digests.size());
+        for (const Entry &entry : qAsConst(m_digests)) {
+            times.push_back(entry.imported);
+        }
+        // also make room for the next imports
+        const auto drop = times.begin() + (m_digests.size() - MaxEntries + MaxEntries / 10);
+        std::nth_element(times.begin(), drop, times.end());
+        const qint64 threshold = *drop;
+        for (auto it = m_digests.begin(); it != m_digests.end();) {
+            if (it->imported < threshold) {
+                it = m_digests.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    void load()
+    {
+        if (m_loaded) {
+            return;
+        }
+        m_loaded = true;
+        QFile file(fileName());
+        if (!file.open(QIODevice::ReadOnly)) {
+            return;
+        }
+        QDataStream stream(&file);
+        quint32 magic = 0, version = 0;
+        stream >> magic >> version;
+        if (magic != Magic || version != Version) {
+            qCDebug(KLEOPATRA_LOG) << "Ignoring digest store of unknown format" << file.fileName();
+            return;
+        }
+        quint32 count = 0;
+        stream >> count;
+        for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+            QByteArray fingerprint;
+            Entry entry;
+            stream >> fingerprint >> entry.digest >> entry.imported;
+            m_digests.insert(fingerprint, entry);
+        }
+        if (stream.status() != QDataStream::Ok) {
+            qCDebug(KLEOPATRA_LOG) << "Ignoring corrupt digest store" << file.fileName();
+            m_digests.clear();
+        }
+    }
+
+    void save()
+    {
+        QDir().mkpath(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation));
+        QSaveFile file(fileName());
+        if (!file.open(QIODevice::WriteOnly)) {
+            qCDebug(KLEOPATRA_LOG) << "Failed to write" << file.fileName() << ":" << file.errorString();
+            return;
+        }
+        QDataStream stream(&file);
+        stream << Magic << Version << quint32(m_digests.size());
+        for (auto it = m_digests.cbegin(); it != m_digests.cend(); ++it) {
+            stream << it.key() << it->digest << it->imported;
+        }
+        file.commit();
+    }
+
+private:
+    static const quint32 Magic = 0x4b4c4944; // "KLID"
+    static const quint32 Version = 2;
+
+    bool m_loaded = false;
+    QHash<QByteArray, Entry> m_digests;
+};
+
 }
 
 ImportCertificatesCommand::Private::Private(ImportCertificatesCommand *qq, KeyListController *c)
@@ -160,7 +317,8 @@ ImportCertificatesCommand::Private::Private(ImportCertificatesCommand *qq, KeyLi
       idsByJob(),
       jobs(),
       results(),
-      ids()
+      ids(),
+      numSkippedUnchanged(0)
 {
 
 }
@@ -231,7 +389,7 @@ int sum(const std::vector<ImportResult> &res, int (ImportResult::*fun)() const)
     return kdtools::accumulate_transform(res.begin(), res.end(), std::mem_fn(fun), 0);
 }
 
-static QString make_report(const std::vector<ImportResult> &res, const QString &id = QString())
+static QString make_report(const std::vector<ImportResult> &res, int numSkipped, const QString &id = QString())
 {
 
     const KLocalizedString normalLine = ki18n("<tr><td align=\"right\">%1</td><td>%2</td></tr>");
@@ -245,7 +403,7 @@ static QString make_report(const std::vector<ImportResult> &res, const QString &
         lines.push_back(headerLine.subs(id).toString());
     }
     lines.push_back(normalLine.subs(i18n("Total number processed:"))
-                    .subs(SUM(numConsidered)).toString());
+                    .subs(SUM(numConsidered) + numSkipped).toString());
     lines.push_back(normalLine.subs(i18n("Imported:"))
                     .subs(SUM(numImported)).toString());
     if (const int n = SUM(newSignatures))
@@ -269,6 +427,9 @@ static QString make_report(const std::vector<ImportResult> &res, const QString &
     if (const int n = SUM(numUnchanged))
         lines.push_back(normalLine.subs(i18n("Unchanged:"))
                         .subs(n).toString());
+    if (numSkipped)
+        lines.push_back(normalLine.subs(i18n("Unchanged (skipped before import):"))
+                        .subs(numSkipped).toString());
     if (const int n = SUM(numSecretKeysConsidered))
         lines.push_back(normalLine.subs(i18n("Secret keys processed:"))
                         .subs(n).toString());
@@ -291,24 +452,28 @@ static QString make_report(const std::vector<ImportResult> &res, const QString &
     return lines.join(QString());
 }
 
-static QString make_message_report(const std::vector<ImportResult> &res, const QStringList &ids)
+static QString make_message_report(const std::vector<ImportResult> &res, const QStringList &ids, int numSkipped)
 {
 
     Q_ASSERT(res.size() == static_cast<unsigned>(ids.size()));
 
     if (res.empty()) {
+        if (numSkipped) {
+            return i18n("<qt><p>Detailed results of certificate import:</p>"
+                        "<table width=\"100%\">%1</table></qt>", make_report(res, numSkipped));
+        }
         return i18n("No imports (should not happen, please report a bug).");
     }
 
     if (res.size() == 1)
         return ids.front().isEmpty()
                ? i18n("<qt><p>Detailed results of certificate import:</p>"
-                      "<table width=\"100%\">%1</table></qt>", make_report(res))
+                      "<table width=\"100%\">%1</table></qt>", make_report(res, numSkipped))
                : i18n("<qt><p>Detailed results of importing %1:</p>"
-                      "<table width=\"100%\">%2</table></qt>", ids.front(), make_report(res));
+                      "<table width=\"100%\">%2</table></qt>", ids.front(), make_report(res, numSkipped));
 
     return i18n("<qt><p>Detailed results of certificate import:</p>"
-                "<table width=\"100%\">%1</table></qt>", make_report(res, i18n("Totals")));
+                "<table width=\"100%\">%1</table></qt>", make_report(res, numSkipped, i18n("Totals")));
 }
 
 // Returns false on error, true if please certify was shown.
@@ -377,7 +542,7 @@ void ImportCertificatesCommand::Private::showDetails(QWidget *parent, const std:
         }
     }
     setImportResultProxyModel(res, ids);
-    KMessageBox::information(parent, make_message_report(res, ids), i18n("Certificate Import Result"));
+    KMessageBox::information(parent, make_message_report(res, ids, numSkippedUnchanged), i18n("Certificate Import Result"));
 }
 
 void ImportCertificatesCommand::Private::showDetails(const std::vector<ImportResult> &res, const QStringList &ids)
@@ -428,6 +593,14 @@ void ImportCertificatesCommand::Private::importResult(const ImportResult &result
 
     jobs.erase(std::remove(jobs.begin(), jobs.end(), q->sender()), jobs.end());
 
+    const auto it = certificatesByJob.find(q->sender());
+    if (it != certificatesByJob.end()) {
+        if (!result.error()) {
+            ImportedDigests::instance().insert(it->second, result);
+        }
+        certificatesByJob.erase(it);
+    }
+
     importResult(result, idsByJob[q->sender()]);
 }
 
@@ -586,6 +759,54 @@ static std::unique_ptr<ImportJob> get_import_job(GpgME::Protocol protocol)
     }
 }
 
+// Returns the part of data that needs to be imported. Certificates that are
+// known to be unchanged are dropped; the sent ones are returned in sent
+// (without their data). If data cannot be split, then it is returned as is.
+QByteArray ImportCertificatesCommand::Private::dropUnchangedCertificates(GpgME::Protocol protocol, const QByteArray &data,
+                                                                         std::vector<CertificateBundle::Certificate> *sent)
+{
+    Q_ASSERT(sent);
+    const auto cache = KeyCache::instance();
+    if (!FileOperationsPreferences().skipUnchangedCertificates() || !cache->initialized()) {
+        return data;
+    }
+
+    bool ok = false;
+    const std::vector<CertificateBundle::Certificate> certs = protocol == GpgME::OpenPGP
+        ? CertificateBundle::splitOpenPGP(data, &ok)
+        : CertificateBundle::splitX509(data, &ok);
+    if (!ok) {
+        return data;
+    }
+
+    std::vector<CertificateBundle::Certificate> remaining;
+    for (const auto &cert : certs) {
+        const Key key = cert.fingerprint.isEmpty() ? Key() : cache->findByFingerprint(cert.fingerprint.constData());
+        // X.509 certificates are immutable; an OpenPGP certificate is only
+        // unchanged if exactly this block was imported before
+        const bool unchanged = !key.isNull()
+                               && (protocol == GpgME::CMS
+                                   || ImportedDigests::instance().contains(cert.fingerprint, cert.digest));
+        if (unchanged) {
+            ++numSkippedUnchanged;
+        } else {
+            remaining.push_back(cert);
+        }
+    }
+    if (protocol == GpgME::OpenPGP) {
+        for (const auto &cert : remaining) {
+            sent->push_back({cert.fingerprint, cert.digest, QByteArray()});
+        }
+    }
+    if (remaining.size() == certs.size()) {
+        return data;
+    }
+    qCDebug(KLEOPATRA_LOG) << "Skipping" << certs.size() - remaining.size() << "of" << certs.size() << "unchanged certificates";
+    return protocol == GpgME::OpenPGP
+        ? CertificateBundle::joinOpenPGP(remaining)
+        : CertificateBundle::joinX509(remaining);
+}
+
 void ImportCertificatesCommand::Private::startImport(GpgME::Protocol protocol, const QByteArray &data, const QString &id)
 {
     Q_ASSERT(protocol != UnknownProtocol);
@@ -604,16 +825,27 @@ void ImportCertificatesCommand::Private::startImport(GpgME::Protocol protocol, c
         return;
     }
 
+    std::vector<CertificateBundle::Certificate> sent;
+    const QByteArray remaining = dropUnchangedCertificates(protocol, data, &sent);
+    if (remaining.isEmpty() && !data.isEmpty()) {
+        // everything was skipped; there is no result to report for id
+        tryToFinish();
+        return;
+    }
+
     connect(job.get(), SIGNAL(result(GpgME::ImportResult)),
             q, SLOT(importResult(GpgME::ImportResult)));
     connect(job.get(), &Job::progress,
             q, &Command::progress);
-    const GpgME::Error err = job->start(data);
+    const GpgME::Error err = job->start(remaining);
     if (err.code()) {
         importResult(ImportResult(err), id);
     } else {
         jobs.push_back(job.release());
         idsByJob[jobs.back()] = id;
+        if (!sent.empty()) {
+            certificatesByJob[jobs.back()] = std::move(sent);
+        }
     }
 }
 
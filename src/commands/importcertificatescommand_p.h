@@ -13,6 +13,8 @@
 #include "command_p.h"
 #include "importcertificatescommand.h"
 
+#include <utils/certificatebundle.h>
+
 #include <gpgme++/global.h>
 
 #include <vector>
@@ -67,6 +69,8 @@ public:
 private:
     void handleExternalCMSImports();
     void tryToFinish();
+    QByteArray dropUnchangedCertificates(GpgME::Protocol protocol, const QByteArray &data,
+                                         std::vector<CertificateBundle::Certificate> *sent);
 
 private:
     bool waitForMoreJobs;
@@ -74,8 +78,10 @@ private:
     std::vector<GpgME::Protocol> nonWorkingProtocols;
     std::map<QObject *, QString> idsByJob;
     std::vector<QGpgME::AbstractImportJob *> jobs;
+    std::map<QObject *, std::vector<CertificateBundle::Certificate>> certificatesByJob;
     std::vector<GpgME::ImportResult> results;
     QStringList ids;
+    int numSkippedUnchanged;
 };
 
 inline Kleo::ImportCertificatesCommand::Private *Kleo::ImportCertificatesCommand::d_func()
@@ -470,7 +470,7 @@ void KeyToCardCommand::keyToOpenPGPCardDone(const GpgME::Error &err)
         */
         d->information(i18nc("@info", "Successfully copied the key to the card."),
                        i18nc("@title", "Success"));
-        ReaderStatus::mutableInstance()->updateStatus();
+        ReaderStatus::mutableInstance()->updateCard(d->serialNumber(), d->appName);
     }
     d->finished();
 }
@@ -494,7 +494,7 @@ void KeyToCardCommand::keyToPIVCardDone(const GpgME::Error &err)
     } else if (!err.isCanceled()) {
         d->information(i18nc("@info", "Successfully copied the key pair to the card."),
                        i18nc("@title", "Success"));
-        ReaderStatus::mutableInstance()->updateStatus();
+        ReaderStatus::mutableInstance()->updateCard(d->serialNumber(), d->appName);
     }
 
     d->finished();
@@ -19,6 +19,8 @@
 
 #include <dialogs/lookupcertificatesdialog.h>
 
+#include <utils/cryptoconfigcache.h>
+
 #include <Libkleo/Formatting>
 #include <Libkleo/Stl_Util>
 
@@ -372,7 +374,7 @@ void LookupCertificatesCommand::Private::showResult(QWidget *parent, const KeyLi
 
 static bool haveX509DirectoryServerConfigured()
 {
-    const QGpgME::CryptoConfig *const config = QGpgME::cryptoConfig();
+    const QGpgME::CryptoConfig *const config = CryptoConfigCache::instance()->config();
     if (!config) {
         return false;
     }
@@ -216,7 +216,7 @@ void PIVGenerateCardKeyCommand::Private::slotResult(const GpgME::Error& err)
               i18nc("@title", "Error"));
     } else if (!err.isCanceled()) {
         information(i18nc("@info", "Key successfully generated."), i18nc("@title", "Success"));
-        ReaderStatus::mutableInstance()->updateStatus();
+        ReaderStatus::mutableInstance()->updateCard(serialNumber(), PIVCard::AppName);
     }
     finished();
 }
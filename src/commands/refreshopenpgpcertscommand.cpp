@@ -11,102 +11,340 @@
 
 #include "refreshopenpgpcertscommand.h"
 
+#include "command_p.h"
+
 #include <Libkleo/GnuPG>
+#include <Libkleo/KeyCache>
+
+#include <QGpgME/ImportFromKeyserverJob>
+#include <QGpgME/Protocol>
+
+#include <gpgme++/importresult.h>
+#include <gpgme++/key.h>
 
+#include <KConfigGroup>
 #include <KLocalizedString>
 #include <KMessageBox>
+#include <KSharedConfig>
+
+#include <QDateTime>
+#include <QPointer>
+#include <QSet>
+#include <QThread>
+
+#include <algorithm>
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+#include "kleopatra_debug.h"
 
 using namespace Kleo;
 using namespace Kleo::Commands;
+using namespace GpgME;
+
+class RefreshOpenPGPCertsCommand::Private : public Command::Private
+{
+    friend class ::Kleo::Commands::RefreshOpenPGPCertsCommand;
+    RefreshOpenPGPCertsCommand *q_func() const
+    {
+        return static_cast<RefreshOpenPGPCertsCommand *>(q);
+    }
+public:
+    explicit Private(RefreshOpenPGPCertsCommand *qq, KeyListController *c);
+    ~Private();
+
+private:
+    std::vector<Key> keysToRefresh(bool *isSelection) const;
+    bool confirm(bool isSelection, int count) const;
+    void startJobs();
+    void importResult(const std::vector<Key> &batch, const ImportResult &result);
+    void finishIfDone();
+
+private:
+    int minimumAge = 0;
+    int batchSize = 50;
+    // dirmngr serves all of them, so there is little to gain from more
+    int maximumParallelJobs = qBound(1, QThread::idealThreadCount(), 4);
+
+    std::deque<std::vector<Key>> pendingBatches;
+    std::vector<QPointer<QGpgME::ImportFromKeyserverJob>> jobs;
+    int runningJobs = 0;
+    int total = 0;
+    int done = 0;
+    int changed = 0;
+    int unchanged = 0;
+    bool canceled = false;
+    QStringList errors;
+};
+
+RefreshOpenPGPCertsCommand::Private *RefreshOpenPGPCertsCommand::d_func()
+{
+    return static_cast<Private *>(d.get());
+}
+const RefreshOpenPGPCertsCommand::Private *RefreshOpenPGPCertsCommand::d_func() const
+{
+    return static_cast<const Private *>(d.get());
+}
+
+#define d d_func()
+#define q q_func()
+
+RefreshOpenPGPCertsCommand::Private::Private(RefreshOpenPGPCertsCommand *qq, KeyListController *c)
+    : Command::Private(qq, c)
+{
+    const KConfigGroup config(KSharedConfig::openConfig(), "OpenPGPCertificateRefresh");
+    minimumAge = std::max(config.readEntry("MinimumAge", 0), 0);
+    batchSize = std::max(config.readEntry("BatchSize", batchSize), 1);
+    maximumParallelJobs = std::max(config.readEntry("MaximumParallelJobs", maximumParallelJobs), 1);
+}
+
+RefreshOpenPGPCertsCommand::Private::~Private() {}
 
 RefreshOpenPGPCertsCommand::RefreshOpenPGPCertsCommand(KeyListController *c)
-    : GnuPGProcessCommand(c)
+    : Command(new Private(this, c))
 {
-    setShowsOutputWindow(true);
 }
 
 RefreshOpenPGPCertsCommand::RefreshOpenPGPCertsCommand(QAbstractItemView *v, KeyListController *c)
-    : GnuPGProcessCommand(v, c)
+    : Command(v, new Private(this, c))
+{
+}
+
+RefreshOpenPGPCertsCommand::RefreshOpenPGPCertsCommand(const std::vector<Key> &keys)
+    : Command(keys, new Private(this, nullptr))
 {
-    setShowsOutputWindow(true);
 }
 
 RefreshOpenPGPCertsCommand::~RefreshOpenPGPCertsCommand() {}
 
-bool RefreshOpenPGPCertsCommand::preStartHook(QWidget *parent) const
+void RefreshOpenPGPCertsCommand::setMinimumAge(int days)
+{
+    d->minimumAge = std::max(days, 0);
+}
+
+int RefreshOpenPGPCertsCommand::minimumAge() const
+{
+    return d->minimumAge;
+}
+
+void RefreshOpenPGPCertsCommand::setBatchSize(int size)
+{
+    d->batchSize = std::max(size, 1);
+}
+
+int RefreshOpenPGPCertsCommand::batchSize() const
+{
+    return d->batchSize;
+}
+
+void RefreshOpenPGPCertsCommand::setMaximumParallelJobs(int jobs)
+{
+    d->maximumParallelJobs = std::max(jobs, 1);
+}
+
+int RefreshOpenPGPCertsCommand::maximumParallelJobs() const
+{
+    return d->maximumParallelJobs;
+}
+
+std::vector<Key> RefreshOpenPGPCertsCommand::Private::keysToRefresh(bool *isSelection) const
 {
+    std::vector<Key> candidates = keys();
+    *isSelection = !candidates.empty();
+    if (candidates.empty()) {
+        candidates = KeyCache::instance()->keys();
+    }
+
+    const time_t threshold = minimumAge > 0
+                             ? QDateTime::currentDateTime().addDays(-minimumAge).toSecsSinceEpoch()
+                             : 0;
+    std::vector<Key> result;
+    result.reserve(candidates.size());
+    std::copy_if(candidates.cbegin(), candidates.cend(), std::back_inserter(result),
+                 [threshold](const Key &key) {
+                     // keys that were never updated have a last update of 0
+                     return key.protocol() == GpgME::OpenPGP && (!threshold || key.lastUpdate() < threshold);
+                 });
+    return result;
+}
+
+bool RefreshOpenPGPCertsCommand::Private::confirm(bool isSelection, int count) const
+{
+    QWidget *const parent = parentWidgetOrView();
     if (!haveKeyserverConfigured())
         if (KMessageBox::warningContinueCancel(parent,
                                                xi18nc("@info",
                                                        "<para>No OpenPGP directory services have been configured.</para>"
                                                        "<para>If not all of the certificates carry the name of their preferred "
                                                        "certificate server (few do), a fallback server is needed to fetch from.</para>"
-                                                       "<para>Since none is configured, <application>Kleopatra</application> will use "
-                                                       "<resource>keys.gnupg.net</resource> as the fallback.</para>"
+                                                       "<para>Since none is configured, the default keyserver of GnuPG will be used.</para>"
                                                        "<para>You can configure OpenPGP directory servers in Kleopatra's "
                                                        "configuration dialog.</para>"
-                                                       "<para>Do you want to continue with <resource>keys.gnupg.net</resource> "
-                                                       "as fallback server?</para>"),
+                                                       "<para>Do you want to continue with the default keyserver?</para>"),
                                                i18nc("@title:window", "OpenPGP Certificate Refresh"),
                                                KStandardGuiItem::cont(), KStandardGuiItem::cancel(),
                                                QStringLiteral("warn-refresh-openpgp-missing-keyserver"))
                 != KMessageBox::Continue) {
             return false;
         }
+    if (isSelection) {
+        return true;
+    }
     return KMessageBox::warningContinueCancel(parent,
-            xi18nc("@info",
-                   "<para>Refreshing OpenPGP certificates implies downloading all certificates anew, "
-                   "to check if any of them have been revoked in the meantime.</para>"
-                   "<para>This can put a severe strain on your own as well as other people's network "
-                   "connections, and can take up to an hour or more to complete, depending on "
-                   "your network connection, and the number of certificates to check.</para> "
-                   "<para>Are you sure you want to continue?</para>"),
+            xi18ncp("@info",
+                    "<para>Refreshing OpenPGP certificates implies downloading all certificates anew, "
+                    "to check if any of them have been revoked in the meantime.</para>"
+                    "<para>This can put a severe strain on your own as well as other people's network "
+                    "connections, and can take up to an hour or more to complete, depending on "
+                    "your network connection, and the number of certificates to check (one).</para> "
+                    "<para>Are you sure you want to continue?</para>",
+                    "<para>Refreshing OpenPGP certificates implies downloading all certificates anew, "
+                    "to check if any of them have been revoked in the meantime.</para>"
+                    "<para>This can put a severe strain on your own as well as other people's network "
+                    "connections, and can take up to an hour or more to complete, depending on "
+                    "your network connection, and the number of certificates to check (%1).</para> "
+                    "<para>Are you sure you want to continue?</para>",
+                    count),
             i18nc("@title:window", "OpenPGP Certificate Refresh"),
             KStandardGuiItem::cont(), KStandardGuiItem::cancel(),
             QStringLiteral("warn-refresh-openpgp-expensive"))
            == KMessageBox::Continue;
 }
 
-QStringList RefreshOpenPGPCertsCommand::arguments() const
+void RefreshOpenPGPCertsCommand::doStart()
 {
-    QStringList result;
-    result << gpgPath();
-    if (!haveKeyserverConfigured()) {
-        result << QStringLiteral("--keyserver") << QStringLiteral("keys.gnupg.net");
+    bool isSelection = false;
+    const std::vector<Key> keys = d->keysToRefresh(&isSelection);
+    if (keys.empty()) {
+        d->information(i18nc("@info", "There are no OpenPGP certificates to refresh."),
+                       i18nc("@title:window", "OpenPGP Certificate Refresh"));
+        d->finished();
+        return;
+    }
+    if (!d->confirm(isSelection, keys.size())) {
+        Q_EMIT canceled();
+        d->finished();
+        return;
     }
-    result << QStringLiteral("--refresh-keys");
-    return result;
-}
 
-QString RefreshOpenPGPCertsCommand::errorCaption() const
-{
-    return i18nc("@title:window", "OpenPGP Certificate Refresh Error");
+    for (auto it = keys.cbegin(); it != keys.cend();) {
+        const auto end = it + std::min<std::ptrdiff_t>(d->batchSize, keys.cend() - it);
+        d->pendingBatches.emplace_back(it, end);
+        it = end;
+    }
+    d->total = keys.size();
+
+    // updates are applied to the key cache batch by batch; without the
+    // watcher, the cache does not reload the whole keyring every time
+    KeyCache::mutableInstance()->enableFileSystemWatcher(false);
+
+    Q_EMIT info(i18n("Refreshing OpenPGP certificates..."));
+    Q_EMIT progress(i18n("Refreshing OpenPGP certificates..."), 0, d->total);
+    d->startJobs();
 }
 
-QString RefreshOpenPGPCertsCommand::successCaption() const
+void RefreshOpenPGPCertsCommand::doCancel()
 {
-    return i18nc("@title:window", "OpenPGP Certificate Refresh Finished");
+    d->canceled = true;
+    d->pendingBatches.clear();
+    for (const auto &job : d->jobs) {
+        if (job) {
+            job->slotCancel();
+        }
+    }
 }
 
-QString RefreshOpenPGPCertsCommand::crashExitMessage(const QStringList &args) const
+void RefreshOpenPGPCertsCommand::Private::startJobs()
 {
-    return xi18nc("@info",
-                  "<para>The GPG process that tried to refresh OpenPGP certificates "
-                  "ended prematurely because of an unexpected error.</para>"
-                  "<para>Please check the output of <icode>%1</icode> for details.</para>", args.join(QLatin1Char(' ')));
+    while (!pendingBatches.empty() && runningJobs < maximumParallelJobs) {
+        const std::vector<Key> batch = std::move(pendingBatches.front());
+        pendingBatches.pop_front();
+
+        // Unlike "gpg --refresh-keys", this fetches all certificates from
+        // the configured keyserver; the preferred keyserver of a certificate
+        // and the Web Key Directory are not consulted.
+        QGpgME::ImportFromKeyserverJob *const job = QGpgME::openpgp()->importFromKeyserverJob();
+        if (!job) {
+            errors.push_back(i18n("The OpenPGP backend does not support fetching certificates from keyservers."));
+            pendingBatches.clear();
+            break;
+        }
+        connect(job, &QGpgME::ImportFromKeyserverJob::result,
+                q, [this, batch](const ImportResult &result) {
+                    importResult(batch, result);
+                });
+        if (const GpgME::Error err = job->start(batch)) {
+            errors.push_back(QString::fromLocal8Bit(err.asString()));
+            done += batch.size();
+            continue;
+        }
+        jobs.emplace_back(job);
+        ++runningJobs;
+    }
+    finishIfDone();
 }
 
-QString RefreshOpenPGPCertsCommand::errorExitMessage(const QStringList &args) const
+void RefreshOpenPGPCertsCommand::Private::importResult(const std::vector<Key> &batch, const ImportResult &result)
 {
-    return xi18nc("@info",
-                  "<para>An error occurred while trying to refresh OpenPGP certificates.</para> "
-                  "<para>The output from <command>%1</command> was: <bcode>%2</bcode></para>",
-                  args[0], errorString());
+    --runningJobs;
+
+    if (result.error() && !result.error().isCanceled()) {
+        errors.push_back(QString::fromLocal8Bit(result.error().asString()));
+    }
+
+    QSet<QByteArray> updatedFingerprints;
+    for (const Import &import : result.imports()) {
+        if (!import.fingerprint()) {
+            continue;
+        }
+        if (import.error() && !import.error().isCanceled()) {
+            errors.push_back(i18nc("%1: fingerprint, %2: error message", "%1: %2",
+                                   QLatin1String(import.fingerprint()), QString::fromLocal8Bit(import.error().asString())));
+        } else if (import.status() & (Import::NewUserIDs | Import::NewSignatures | Import::NewSubkeys)) {
+            updatedFingerprints.insert(QByteArray(import.fingerprint()));
+        } else {
+            ++unchanged;
+        }
+    }
+
+    if (!updatedFingerprints.empty()) {
+        std::vector<Key> updated;
+        std::copy_if(batch.cbegin(), batch.cend(), std::back_inserter(updated),
+                     [&updatedFingerprints](const Key &key) {
+                         return updatedFingerprints.contains(QByteArray(key.primaryFingerprint()));
+                     });
+        changed += updated.size();
+        KeyCache::mutableInstance()->refresh(updated);
+    }
+
+    done += batch.size();
+    Q_EMIT q->progress(i18n("Refreshing OpenPGP certificates..."), done, total);
+    startJobs();
 }
 
-QString RefreshOpenPGPCertsCommand::successMessage(const QStringList &) const
+void RefreshOpenPGPCertsCommand::Private::finishIfDone()
 {
-    return i18nc("@info", "OpenPGP certificates refreshed successfully.");
-    // ### --check-trustdb
+    if (!pendingBatches.empty() || runningJobs > 0) {
+        return;
+    }
+    KeyCache::mutableInstance()->enableFileSystemWatcher(true);
+
+    if (!errors.empty()) {
+        error(xi18nc("@info",
+                     "<para>An error occurred while trying to refresh OpenPGP certificates.</para> "
+                     "<para>The errors were: <bcode>%1</bcode></para>",
+                     errors.join(QLatin1Char('\n'))),
+              i18nc("@title:window", "OpenPGP Certificate Refresh Error"));
+    } else if (!canceled) {
+        information(i18nc("@info", "OpenPGP certificates refreshed successfully (%1 updated, %2 unchanged).",
+                          changed, unchanged),
+                    i18nc("@title:window", "OpenPGP Certificate Refresh Finished"));
+    }
+    finished();
 }
 
+#undef d
+#undef q
+
+#include "moc_refreshopenpgpcertscommand.cpp"
@@ -10,32 +10,57 @@
 #ifndef __KLEOPATRA_COMMMANDS_REFRESHOPENPGPCERTSCOMMAND_H__
 #define __KLEOPATRA_COMMMANDS_REFRESHOPENPGPCERTSCOMMAND_H__
 
-#include <commands/gnupgprocesscommand.h>
+#include <commands/command.h>
 
 namespace Kleo
 {
 namespace Commands
 {
 
-class RefreshOpenPGPCertsCommand : public GnuPGProcessCommand
+/*!
+ * Fetches the OpenPGP certificates anew from the keyservers.
+ *
+ * If certificates are given (or selected in the view the command was
+ * created for), only these are refreshed, otherwise all OpenPGP
+ * certificates, optionally limited to those that were not updated for
+ * setMinimumAge() days. The certificates are fetched
+ * in batches, several at a time, and the key cache is updated after each
+ * batch.
+ *
+ * In contrast to "gpg --refresh-keys", the certificates are always fetched
+ * from the configured keyserver (or GnuPG's default keyserver). Preferred
+ * keyservers named in the certificates and the Web Key Directory are not
+ * used.
+ */
+class RefreshOpenPGPCertsCommand : public Command
 {
     Q_OBJECT
 public:
     explicit RefreshOpenPGPCertsCommand(QAbstractItemView *view, KeyListController *parent);
     explicit RefreshOpenPGPCertsCommand(KeyListController *parent);
+    explicit RefreshOpenPGPCertsCommand(const std::vector<GpgME::Key> &keys);
     ~RefreshOpenPGPCertsCommand() override;
 
-private:
-    bool preStartHook(QWidget *) const override;
+    /*! Only refresh certificates whose last update is at least \a days old. 0 (the default) refreshes all. */
+    void setMinimumAge(int days);
+    int minimumAge() const;
+
+    /*! The number of certificates fetched with one gpg call. */
+    void setBatchSize(int size);
+    int batchSize() const;
 
-    QStringList arguments() const override;
+    /*! The number of batches that are fetched at the same time. */
+    void setMaximumParallelJobs(int jobs);
+    int maximumParallelJobs() const;
 
-    QString errorCaption() const override;
-    QString successCaption() const override;
+private:
+    void doStart() override;
+    void doCancel() override;
 
-    QString crashExitMessage(const QStringList &) const override;
-    QString errorExitMessage(const QStringList &) const override;
-    QString successMessage(const QStringList &) const override;
+private:
+    class Private;
+    inline Private *d_func();
+    inline const Private *d_func() const;
 };
 
 }
@@ -11,33 +11,198 @@
 
 #include "refreshx509certscommand.h"
 
+#include "command_p.h"
+
 #include <Libkleo/GnuPG>
+#include <Libkleo/KeyCache>
+
+#include <QGpgME/KeyListJob>
+#include <QGpgME/Protocol>
+
+#include <gpgme++/key.h>
+#include <gpgme++/keylistresult.h>
 
+#include <KConfigGroup>
 #include <KLocalizedString>
 #include <KMessageBox>
+#include <KSharedConfig>
+
+#include <QHash>
+#include <QPointer>
+#include <QProcess>
+#include <QThread>
+
+#include <algorithm>
+#include <deque>
+#include <vector>
+
+#include "kleopatra_debug.h"
 
 using namespace Kleo;
 using namespace Kleo::Commands;
+using namespace GpgME;
 
-RefreshX509CertsCommand::RefreshX509CertsCommand(KeyListController *c)
-    : GnuPGProcessCommand(c)
+namespace
 {
 
+QStringList fingerprints(std::vector<Key>::const_iterator begin, std::vector<Key>::const_iterator end)
+{
+    QStringList result;
+    result.reserve(end - begin);
+    std::transform(begin, end, std::back_inserter(result), [](const Key &key) {
+        return QString::fromLatin1(key.primaryFingerprint());
+    });
+    return result;
+}
+
+// the issuer's fingerprint if the issuer is known, otherwise its name
+QString issuer_id(const Key &key)
+{
+    if (const char *const chainID = key.chainID()) {
+        return QString::fromLatin1(chainID);
+    }
+    return QString::fromUtf8(key.issuerName());
+}
+
+}
+
+class RefreshX509CertsCommand::Private : public Command::Private
+{
+    friend class ::Kleo::Commands::RefreshX509CertsCommand;
+    RefreshX509CertsCommand *q_func() const
+    {
+        return static_cast<RefreshX509CertsCommand *>(q);
+    }
+public:
+    explicit Private(RefreshX509CertsCommand *qq, KeyListController *c);
+    ~Private();
+
+private:
+    std::vector<Key> keysToRefresh(bool *isSelection) const;
+    bool confirm(bool isSelection) const;
+    void prepareBatches(const std::vector<Key> &keys);
+    void startCrlRefresh();
+    void crlRefreshFinished(QProcess *process, int representatives);
+    void startValidation();
+    void validationResult(int batchSize, const KeyListResult &result, const std::vector<Key> &keys);
+    void finishIfDone();
+
+private:
+    int batchSize = 100;
+    // dirmngr serves all of them, so there is little to gain from more
+    int maximumParallelJobs = qBound(1, QThread::idealThreadCount(), 4);
+
+    // phase 1: one certificate per issuer, with forced CRL refresh
+    std::deque<QStringList> pendingCrlBatches;
+    std::vector<QPointer<QProcess>> processes;
+    int issuersTotal = 0;
+    int issuersDone = 0;
+
+    // phase 2: all certificates, validated against the CRL cache
+    std::deque<QStringList> pendingValidationBatches;
+    std::vector<QPointer<QGpgME::KeyListJob>> jobs;
+    int total = 0;
+    int done = 0;
+
+    int running = 0;
+    bool canceled = false;
+    QStringList errors;
+};
+
+RefreshX509CertsCommand::Private *RefreshX509CertsCommand::d_func()
+{
+    return static_cast<Private *>(d.get());
+}
+const RefreshX509CertsCommand::Private *RefreshX509CertsCommand::d_func() const
+{
+    return static_cast<const Private *>(d.get());
+}
+
+#define d d_func()
+#define q q_func()
+
+RefreshX509CertsCommand::Private::Private(RefreshX509CertsCommand *qq, KeyListController *c)
+    : Command::Private(qq, c)
+{
+    const KConfigGroup config(KSharedConfig::openConfig(), "X509CertificateRefresh");
+    batchSize = std::max(config.readEntry("BatchSize", batchSize), 1);
+    maximumParallelJobs = std::max(config.readEntry("MaximumParallelJobs", maximumParallelJobs), 1);
+}
+
+RefreshX509CertsCommand::Private::~Private()
+{
+    for (const auto &process : processes) {
+        if (process) {
+            // the finished() and errorOccurred() handlers use this object,
+            // which is being destroyed
+            process->disconnect(q);
+            process->kill();
+            process->waitForFinished();
+        }
+    }
+}
+
+RefreshX509CertsCommand::RefreshX509CertsCommand(KeyListController *c)
+    : Command(new Private(this, c))
+{
 }
 
 RefreshX509CertsCommand::RefreshX509CertsCommand(QAbstractItemView *v, KeyListController *c)
-    : GnuPGProcessCommand(v, c)
+    : Command(v, new Private(this, c))
 {
+}
 
+RefreshX509CertsCommand::RefreshX509CertsCommand(const std::vector<Key> &keys)
+    : Command(keys, new Private(this, nullptr))
+{
 }
 
 RefreshX509CertsCommand::~RefreshX509CertsCommand() {}
 
+void RefreshX509CertsCommand::setBatchSize(int size)
+{
+    d->batchSize = std::max(size, 1);
+}
+
+int RefreshX509CertsCommand::batchSize() const
+{
+    return d->batchSize;
+}
+
+void RefreshX509CertsCommand::setMaximumParallelJobs(int jobs)
+{
+    d->maximumParallelJobs = std::max(jobs, 1);
+}
+
+int RefreshX509CertsCommand::maximumParallelJobs() const
+{
+    return d->maximumParallelJobs;
+}
+
+std::vector<Key> RefreshX509CertsCommand::Private::keysToRefresh(bool *isSelection) const
+{
+    std::vector<Key> candidates = keys();
+    *isSelection = !candidates.empty();
+    if (candidates.empty()) {
+        candidates = KeyCache::instance()->keys();
+    }
+    std::vector<Key> result;
+    result.reserve(candidates.size());
+    std::copy_if(candidates.cbegin(), candidates.cend(), std::back_inserter(result),
+                 [](const Key &key) {
+                     return key.protocol() == GpgME::CMS;
+                 });
+    return result;
+}
+
 /* aheinecke 2020: I think it's ok to use X.509 here in the windows because
  * this is an expert thing and normally not used. */
-bool RefreshX509CertsCommand::preStartHook(QWidget *parent) const
+bool RefreshX509CertsCommand::Private::confirm(bool isSelection) const
 {
-    return KMessageBox::warningContinueCancel(parent,
+    if (isSelection) {
+        return true;
+    }
+    return KMessageBox::warningContinueCancel(parentWidgetOrView(),
             xi18nc("@info",
                    "<para>Refreshing X.509 certificates implies downloading CRLs for all certificates, "
                    "even if they might otherwise still be valid.</para>"
@@ -51,39 +216,212 @@ bool RefreshX509CertsCommand::preStartHook(QWidget *parent) const
            == KMessageBox::Continue;
 }
 
-QStringList RefreshX509CertsCommand::arguments() const
+void RefreshX509CertsCommand::Private::prepareBatches(const std::vector<Key> &keys)
+{
+    // One certificate per issuer is enough to make dirmngr fetch the CRL of
+    // the issuer (and, while validating the chain, the CRLs of the issuers
+    // above it). Prefer certificates that are still valid, because gpgsm
+    // does not check the revocation status of expired ones.
+    QHash<QString, Key> representatives;
+    for (const Key &key : keys) {
+        if (key.isRoot()) {
+            continue;
+        }
+        Key &rep = representatives[issuer_id(key)];
+        if (rep.isNull() || (rep.isExpired() && !key.isExpired())) {
+            rep = key;
+        }
+    }
+    std::vector<Key> reps;
+    reps.reserve(representatives.size());
+    std::copy(representatives.cbegin(), representatives.cend(), std::back_inserter(reps));
+    issuersTotal = reps.size();
+
+    // spread the issuers over all processes; each fetch takes a while
+    const int crlBatchSize = std::max<int>(1, (reps.size() + maximumParallelJobs - 1) / maximumParallelJobs);
+    for (auto it = reps.cbegin(); it != reps.cend();) {
+        const auto end = it + std::min<int>(crlBatchSize, reps.cend() - it);
+        pendingCrlBatches.push_back(fingerprints(it, end));
+        it = end;
+    }
+
+    for (auto it = keys.cbegin(); it != keys.cend();) {
+        const auto end = it + std::min<int>(batchSize, keys.cend() - it);
+        pendingValidationBatches.push_back(fingerprints(it, end));
+        it = end;
+    }
+    total = keys.size();
+}
+
+void RefreshX509CertsCommand::doStart()
+{
+    bool isSelection = false;
+    const std::vector<Key> keys = d->keysToRefresh(&isSelection);
+    if (keys.empty()) {
+        d->information(i18nc("@info", "There are no X.509 certificates to refresh."),
+                       i18nc("@title:window", "X.509 Certificate Refresh"));
+        d->finished();
+        return;
+    }
+    if (!d->confirm(isSelection)) {
+        Q_EMIT canceled();
+        d->finished();
+        return;
+    }
+
+    d->prepareBatches(keys);
+
+    // the validated certificates are inserted into the key cache batch by
+    // batch; without the watcher, the cache does not reload everything
+    KeyCache::mutableInstance()->enableFileSystemWatcher(false);
+
+    Q_EMIT info(i18n("Refreshing X.509 certificates..."));
+    d->startCrlRefresh();
+}
+
+void RefreshX509CertsCommand::doCancel()
 {
-    return QStringList() << gpgSmPath() << QStringLiteral("-k") << QStringLiteral("--with-validation") << QStringLiteral("--force-crl-refresh") << QStringLiteral("--enable-crl-checks");
+    d->canceled = true;
+    d->pendingCrlBatches.clear();
+    d->pendingValidationBatches.clear();
+    for (const auto &process : d->processes) {
+        if (process) {
+            process->terminate();
+        }
+    }
+    for (const auto &job : d->jobs) {
+        if (job) {
+            job->slotCancel();
+        }
+    }
 }
 
-QString RefreshX509CertsCommand::errorCaption() const
+void RefreshX509CertsCommand::Private::startCrlRefresh()
 {
-    return i18nc("@title:window", "X.509 Certificate Refresh Error");
+    if (pendingCrlBatches.empty() && running == 0) {
+        startValidation();
+        return;
+    }
+    Q_EMIT q->progress(i18n("Refreshing revocation lists..."), issuersDone, issuersTotal);
+
+    while (!pendingCrlBatches.empty() && running < maximumParallelJobs) {
+        const QStringList batch = pendingCrlBatches.front();
+        pendingCrlBatches.pop_front();
+
+        auto process = new QProcess(q);
+        process->setStandardOutputFile(QProcess::nullDevice());
+        process->setProgram(gpgSmPath());
+        process->setArguments(QStringList() << QStringLiteral("-k") << QStringLiteral("--with-validation")
+                              << QStringLiteral("--force-crl-refresh") << QStringLiteral("--enable-crl-checks")
+                              << batch);
+        const int count = batch.size();
+        connect(process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
+                q, [this, process, count]() {
+                    crlRefreshFinished(process, count);
+                });
+        connect(process, &QProcess::errorOccurred,
+                q, [this, process, count](QProcess::ProcessError error) {
+                    if (error == QProcess::FailedToStart) {
+                        crlRefreshFinished(process, count);
+                    }
+                });
+        processes.emplace_back(process);
+        ++running;
+        process->start();
+    }
 }
 
-QString RefreshX509CertsCommand::successCaption() const
+void RefreshX509CertsCommand::Private::crlRefreshFinished(QProcess *process, int representatives)
 {
-    return i18nc("@title:window", "X.509 Certificate Refresh Finished");
+    --running;
+    issuersDone += representatives;
+
+    if (process->error() == QProcess::FailedToStart) {
+        errors.push_back(i18n("Could not start %1: %2", gpgSmPath(), process->errorString()));
+        pendingCrlBatches.clear();
+        pendingValidationBatches.clear();
+    } else if (!canceled && process->exitStatus() != QProcess::NormalExit) {
+        errors.push_back(i18n("%1 ended prematurely because of an unexpected error.", gpgSmPath()));
+    } else if (process->exitCode() != 0) {
+        // gpgsm also fails if one of the certificates is not valid, which is
+        // a result of the refresh, not an error
+        qCDebug(KLEOPATRA_LOG) << "gpgsm exited with" << process->exitCode() << ":"
+                               << process->readAllStandardError();
+    }
+    process->deleteLater();
+
+    if (canceled || !errors.empty()) {
+        finishIfDone();
+    } else {
+        startCrlRefresh();
+    }
 }
 
-QString RefreshX509CertsCommand::crashExitMessage(const QStringList &args) const
+void RefreshX509CertsCommand::Private::startValidation()
 {
-    return xi18nc("@info",
-                  "<para>The GpgSM process that tried to refresh X.509 certificates "
-                  "ended prematurely because of an unexpected error.</para>"
-                  "<para>Please check the output of <icode>%1</icode> for details.</para>", args.join(QLatin1Char(' ')));
+    Q_EMIT q->progress(i18n("Validating certificates..."), done, total);
+
+    while (!pendingValidationBatches.empty() && running < maximumParallelJobs) {
+        const QStringList batch = pendingValidationBatches.front();
+        pendingValidationBatches.pop_front();
+
+        QGpgME::KeyListJob *const job = QGpgME::smime()->keyListJob(/*remote*/false, /*includeSigs*/false, /*validate*/true);
+        if (!job) {
+            errors.push_back(i18n("The X.509 backend does not support listing certificates."));
+            pendingValidationBatches.clear();
+            break;
+        }
+        const int count = batch.size();
+        connect(job, &QGpgME::KeyListJob::result,
+                q, [this, count](const KeyListResult &result, const std::vector<Key> &keys) {
+                    validationResult(count, result, keys);
+                });
+        if (const GpgME::Error err = job->start(batch)) {
+            errors.push_back(QString::fromLocal8Bit(err.asString()));
+            done += count;
+            continue;
+        }
+        jobs.emplace_back(job);
+        ++running;
+    }
+    finishIfDone();
 }
 
-QString RefreshX509CertsCommand::errorExitMessage(const QStringList &args) const
+void RefreshX509CertsCommand::Private::validationResult(int batchSize, const KeyListResult &result, const std::vector<Key> &keys)
 {
-    return xi18nc("@info",
-                  "<para>An error occurred while trying to refresh X.509 certificates.</para>"
-                  "<para>The output from <command>%1</command> was: <bcode>%2</bcode></para>",
-                  args[0], errorString());
+    --running;
+    done += batchSize;
+
+    if (result.error() && !result.error().isCanceled()) {
+        errors.push_back(QString::fromLocal8Bit(result.error().asString()));
+    }
+    if (!keys.empty()) {
+        KeyCache::mutableInstance()->insert(keys);
+    }
+    startValidation();
 }
 
-QString RefreshX509CertsCommand::successMessage(const QStringList &) const
+void RefreshX509CertsCommand::Private::finishIfDone()
 {
-    return i18nc("@info", "X.509 certificates refreshed successfully.");
+    if (running > 0 || (!pendingValidationBatches.empty() && !canceled && errors.empty())) {
+        return;
+    }
+    KeyCache::mutableInstance()->enableFileSystemWatcher(true);
+
+    if (!errors.empty()) {
+        error(xi18nc("@info",
+                     "<para>An error occurred while trying to refresh X.509 certificates.</para>"
+                     "<para>The errors were: <bcode>%1</bcode></para>",
+                     errors.join(QLatin1Char('\n'))),
+              i18nc("@title:window", "X.509 Certificate Refresh Error"));
+    } else if (!canceled) {
+        information(i18nc("@info", "X.509 certificates refreshed successfully."),
+                    i18nc("@title:window", "X.509 Certificate Refresh Finished"));
+    }
+    finished();
 }
 
+#undef d
+#undef q
+
+#include "moc_refreshx509certscommand.cpp"
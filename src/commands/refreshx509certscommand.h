@@ -10,32 +10,48 @@
 #ifndef __KLEOPATRA_COMMMANDS_REFRESHX509CERTSCOMMAND_H__
 #define __KLEOPATRA_COMMMANDS_REFRESHX509CERTSCOMMAND_H__
 
-#include <commands/gnupgprocesscommand.h>
+#include <commands/command.h>
 
 namespace Kleo
 {
 namespace Commands
 {
 
-class RefreshX509CertsCommand : public GnuPGProcessCommand
+/*!
+ * Validates the X.509 certificates anew, with fresh CRLs.
+ *
+ * If certificates are given (or selected in the view the command was
+ * created for), only these are refreshed, otherwise all X.509
+ * certificates. The certificates are grouped by issuer, and the
+ * revocation information of each issuer is refreshed only once, using one
+ * of its certificates. Afterwards, all certificates are validated in
+ * parallel batches against the refreshed CRL cache.
+ */
+class RefreshX509CertsCommand : public Command
 {
     Q_OBJECT
 public:
     explicit RefreshX509CertsCommand(QAbstractItemView *view, KeyListController *parent);
     explicit RefreshX509CertsCommand(KeyListController *parent);
+    explicit RefreshX509CertsCommand(const std::vector<GpgME::Key> &keys);
     ~RefreshX509CertsCommand() override;
 
-private:
-    bool preStartHook(QWidget *) const override;
+    /*! The number of certificates validated with one gpgsm call. */
+    void setBatchSize(int size);
+    int batchSize() const;
 
-    QStringList arguments() const override;
+    /*! The number of gpgsm processes that run at the same time. */
+    void setMaximumParallelJobs(int jobs);
+    int maximumParallelJobs() const;
 
-    QString errorCaption() const override;
-    QString successCaption() const override;
+private:
+    void doStart() override;
+    void doCancel() override;
 
-    QString crashExitMessage(const QStringList &) const override;
-    QString errorExitMessage(const QStringList &) const override;
-    QString successMessage(const QStringList &) const override;
+private:
+    class Private;
+    inline Private *d_func();
+    inline const Private *d_func() const;
 };
 
 }
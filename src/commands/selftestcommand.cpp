@@ -14,6 +14,7 @@
 #include "command_p.h"
 
 #include <dialogs/selftestdialog.h>
+#include <utils/cryptoconfigcache.h>
 
 #include "kleopatra_debug.h"
 
@@ -35,8 +36,6 @@
 
 #include <vector>
 
-#include <QGpgME/CryptoConfig>
-#include <QGpgME/Protocol>
 
 using namespace Kleo;
 using namespace Kleo::Commands;
@@ -168,11 +167,17 @@ private:
     }
     void slotUpdateRequested()
     {
-        const auto conf = QGpgME::cryptoConfig();
-        if (conf) {
-            conf->clear();
-        }
-        runTests();
+        CryptoConfigCache::instance()->invalidate();
+        runTestsWhenConfigLoaded();
+    }
+
+    void runTestsWhenConfigLoaded()
+    {
+        // the engine and configuration checks need the gpgconf data; let it
+        // load in the background instead of blocking the GUI
+        CryptoConfigCache::instance()->whenLoaded(q_func(), [this]() {
+            runTests();
+        });
     }
 
 private:
@@ -251,7 +256,7 @@ void SelfTestCommand::doStart()
         d->ensureDialogCreated();
     }
 
-    d->runTests();
+    d->runTestsWhenConfigLoaded();
 
 }
 
@@ -104,7 +104,7 @@ private:
     }
     void slotDialogAccepted()
     {
-        ReaderStatus::mutableInstance()->updateStatus();
+        ReaderStatus::mutableInstance()->updateCard(serialNumber(), NetKeyCard::AppName);
         finished();
     }
 
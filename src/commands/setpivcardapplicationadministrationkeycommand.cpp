@@ -209,7 +209,7 @@ void SetPIVCardApplicationAdministrationKeyCommand::Private::slotResult(const Gp
               i18nc("@title", "Error"));
     } else if (!err.isCanceled()) {
         information(i18nc("@info", "PIV Card Application Administration Key set successfully."), i18nc("@title", "Success"));
-        ReaderStatus::mutableInstance()->updateStatus();
+        ReaderStatus::mutableInstance()->updateCard(serialNumber(), PIVCard::AppName);
     }
     finished();
 }
@@ -17,10 +17,11 @@
 #include "emailoperationspreferences.h"
 #include "fileoperationspreferences.h"
 
+#include <utils/cryptoconfigcache.h>
+
 #include <Libkleo/ChecksumDefinition>
 #include <Libkleo/KeyFilterManager>
 
-#include <QGpgME/Protocol>
 #include <QGpgME/CryptoConfig>
 
 #include <gpgme++/context.h>
@@ -57,7 +58,8 @@ CryptoOperationsConfigWidget::CryptoOperationsConfigWidget(QWidget *p, Qt::Windo
 
 static void resetDefaults()
 {
-    auto config = QGpgME::cryptoConfig();
+    const CryptoConfigCache::Usage usage;
+    auto config = usage.config();
 
     if (!config) {
         qCWarning(KLEOPATRA_LOG) << "Failed to obtain config";
@@ -90,6 +92,7 @@ static void resetDefaults()
         }
     }
     config->sync(true);
+    CryptoConfigCache::instance()->invalidate();
     return;
 }
 
@@ -143,10 +146,8 @@ void CryptoOperationsConfigWidget::applyProfile(const QString &profile)
                          i18nc("%1 is the name of the profile",
                                "The configuration profile \"%1\" was applied.", profile),
                          i18n("GnuPG Profile - Kleopatra"));
-        auto config = QGpgME::cryptoConfig();
-        if (config) {
-            config->clear();
-        }
+        // reload the gpgconf data; snapshots in use stay valid
+        CryptoConfigCache::instance()->invalidate();
         KeyFilterManager::instance()->reload();
     });
     gpgconf->start();
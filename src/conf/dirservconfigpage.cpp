@@ -13,8 +13,6 @@
 #include <Libkleo/DirectoryServicesWidget>
 #include <Libkleo/CryptoConfigModule>
 
-#include <QGpgME/Protocol>
-
 #include <KMessageBox>
 #include <KLocalizedString>
 #include "kleopatra_debug.h"
@@ -131,9 +129,9 @@ static const char s_addnewservers_entryName[] = "add-servers";
 #endif
 
 DirectoryServicesConfigurationPage::DirectoryServicesConfigurationPage(QWidget *parent, const QVariantList &args)
-    : KCModule(parent, args)
+    : KCModule(parent, args),
+      mConfig(nullptr)
 {
-    mConfig = QGpgME::cryptoConfig();
     QGridLayout *glay = new QGridLayout(this);
     glay->setContentsMargins(0, 0, 0, 0);
 
@@ -175,7 +173,14 @@ DirectoryServicesConfigurationPage::DirectoryServicesConfigurationPage(QWidget *
     glay->setRowStretch(++row, 1);
     glay->setColumnStretch(2, 1);
 
-    load();
+    // the gpgconf data is loaded in the background
+    setEnabled(false);
+    Kleo::CryptoConfigCache::instance()->whenLoaded(this, [this]() {
+        mConfigUsage.reset(new Kleo::CryptoConfigCache::Usage);
+        mConfig = mConfigUsage->config();
+        setEnabled(mConfig);
+        load();
+    });
 }
 
 static QList<QUrl> string2urls(const QString &str)
@@ -190,6 +195,9 @@ static QList<QUrl> string2urls(const QString &str)
 
 void DirectoryServicesConfigurationPage::load()
 {
+    if (!mConfig) {
+        return;
+    }
 
     mWidget->clear();
 
@@ -256,6 +264,10 @@ void DirectoryServicesConfigurationPage::load()
 
 void DirectoryServicesConfigurationPage::save()
 {
+    if (!mConfig) {
+        return;
+    }
+
     if (mX509ServicesEntry) {
         mX509ServicesEntry->setURLValueList(mWidget->x509Services());
     }
@@ -309,6 +321,9 @@ void DirectoryServicesConfigurationPage::save()
 
 void DirectoryServicesConfigurationPage::defaults()
 {
+    if (!mConfig) {
+        return;
+    }
     // these guys don't have a default, to clear them:
     if (mX509ServicesEntry) {
         mX509ServicesEntry->setURLValueList(QList<QUrl>());
@@ -14,6 +14,10 @@
 
 #include <QGpgME/CryptoConfig>
 
+#include <utils/cryptoconfigcache.h>
+
+#include <memory>
+
 class QCheckBox;
 class QLabel;
 class QTimeEdit;
@@ -58,6 +62,7 @@ private:
     QGpgME::CryptoConfigEntry *mMaxItemsConfigEntry;
     QGpgME::CryptoConfigEntry *mAddNewServersConfigEntry;
 
+    std::unique_ptr<Kleo::CryptoConfigCache::Usage> mConfigUsage;
     QGpgME::CryptoConfig *mConfig;
 };
 
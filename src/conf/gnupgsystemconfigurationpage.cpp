@@ -14,44 +14,73 @@
 #include <QGpgME/Protocol>
 #include <QGpgME/CryptoConfig>
 
+#include <KLocalizedString>
+
+#include <QLabel>
 #include <QVBoxLayout>
 
+using namespace Kleo;
 using namespace Kleo::Config;
 
 GnuPGSystemConfigurationPage::GnuPGSystemConfigurationPage(QWidget *parent, const QVariantList &args)
-    : KCModule(parent, args)
+    : KCModule(parent, args),
+      mPlaceholder(nullptr),
+      mWidget(nullptr)
 {
     QVBoxLayout *lay = new QVBoxLayout(this);
     lay->setContentsMargins(0, 0, 0, 0);
 
-    QGpgME::CryptoConfig *const config = QGpgME::cryptoConfig();
-
-    mWidget = new CryptoConfigModule(config,
-                                     CryptoConfigModule::TabbedLayout,
-                                     this);
-    lay->addWidget(mWidget);
-
+    // the gpgconf data is loaded in the background
+    mPlaceholder = new QLabel(i18n("Loading the GnuPG configuration..."), this);
+    mPlaceholder->setAlignment(Qt::AlignCenter);
+    lay->addWidget(mPlaceholder);
 
-    connect(mWidget, &CryptoConfigModule::changed, this, &Kleo::Config::GnuPGSystemConfigurationPage::markAsChanged);
-
-    load();
+    CryptoConfigCache::instance()->whenLoaded(this, [this]() {
+        createWidget();
+    });
 }
 
 GnuPGSystemConfigurationPage::~GnuPGSystemConfigurationPage()
 {
-    // ### correct here?
+    // the page works on a snapshot; the configuration dialog invalidates
+    // the cache on commit, but others may use QGpgME::cryptoConfig() directly
     if (QGpgME::CryptoConfig *const config = QGpgME::cryptoConfig()) {
         config->clear();
     }
 }
 
+void GnuPGSystemConfigurationPage::createWidget()
+{
+    mConfigUsage.reset(new CryptoConfigCache::Usage);
+    if (!mConfigUsage->config()) {
+        mPlaceholder->setText(i18n("The GnuPG configuration is not available (gpgconf tool not found)."));
+        return;
+    }
+
+    mWidget = new CryptoConfigModule(mConfigUsage->config(),
+                                     CryptoConfigModule::TabbedLayout,
+                                     this);
+    delete mPlaceholder;
+    mPlaceholder = nullptr;
+    layout()->addWidget(mWidget);
+
+    connect(mWidget, &CryptoConfigModule::changed, this, &Kleo::Config::GnuPGSystemConfigurationPage::markAsChanged);
+
+    load();
+}
+
 void GnuPGSystemConfigurationPage::load()
 {
-    mWidget->reset();
+    if (mWidget) {
+        mWidget->reset();
+    }
 }
 
 void GnuPGSystemConfigurationPage::save()
 {
+    if (!mWidget) {
+        return;
+    }
     mWidget->save();
 #if 0
     // Tell other apps (e.g. kmail) that the gpgconf data might have changed
@@ -63,7 +92,9 @@ void GnuPGSystemConfigurationPage::save()
 
 void GnuPGSystemConfigurationPage::defaults()
 {
-    mWidget->defaults();
+    if (mWidget) {
+        mWidget->defaults();
+    }
 }
 
 extern "C" Q_DECL_EXPORT KCModule *create_kleopatra_config_gnupgsystem(QWidget *parent, const QVariantList &args)
@@ -10,6 +10,13 @@
 #define KLEOPATRA_GNUPGSYSTEMCONFIGURATIONPAGE_H
 
 #include <KCModule>
+
+#include <utils/cryptoconfigcache.h>
+
+#include <memory>
+
+class QLabel;
+
 namespace Kleo
 {
 class CryptoConfigModule;
@@ -32,6 +39,11 @@ public:
     void defaults() override;
 
 private:
+    void createWidget();
+
+private:
+    std::unique_ptr<Kleo::CryptoConfigCache::Usage> mConfigUsage;
+    QLabel *mPlaceholder;
     Kleo::CryptoConfigModule *mWidget;
 };
 
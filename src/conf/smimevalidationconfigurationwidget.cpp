@@ -15,12 +15,15 @@
 
 #include "smimevalidationpreferences.h"
 
+#include <utils/cryptoconfigcache.h>
+
 #include <QGpgME/CryptoConfig>
-#include <QGpgME/Protocol>
 
 #include <KLocalizedString>
 #include "kleopatra_debug.h"
 
+#include <memory>
+
 #if HAVE_QDBUS
 # include <QDBusConnection>
 #endif
@@ -39,12 +42,16 @@ public:
           customHTTPProxyWritable(false),
           ui(q)
     {
+
 #if HAVE_QDBUS
         QDBusConnection::sessionBus().connect(QString(), QString(), QStringLiteral("org.kde.kleo.CryptoConfig"), QStringLiteral("changed"), q, SLOT(load()));
 #endif
     }
 
     bool customHTTPProxyWritable;
+    // keeps the gpgconf data alive while the widget works with it
+    std::unique_ptr<CryptoConfigCache::Usage> configUsage;
+    bool waitingForConfig = false;
 
 private:
     void enableDisableActions()
@@ -200,7 +207,22 @@ void SMimeValidationConfigurationWidget::load()
     d->ui.intervalRefreshCB->setChecked(refreshInterval > 0);
     d->ui.intervalRefreshSB->setValue(refreshInterval);
 
-    CryptoConfig *const config = QGpgME::cryptoConfig();
+    if (!CryptoConfigCache::instance()->isLoaded()) {
+        // the gpgconf data is (re)loaded in the background
+        setEnabled(false);
+        if (!d->waitingForConfig) {
+            d->waitingForConfig = true;
+            CryptoConfigCache::instance()->whenLoaded(this, [this]() {
+                d->waitingForConfig = false;
+                setEnabled(true);
+                load();
+            });
+        }
+        return;
+    }
+    // save() writes to the snapshot that was loaded here
+    d->configUsage.reset(new CryptoConfigCache::Usage);
+    CryptoConfig *const config = d->configUsage->config();
     if (!config) {
         setEnabled(false);
         return;
@@ -217,8 +239,6 @@ void SMimeValidationConfigurationWidget::load()
 #endif
 
     // Create config entries
-    // Don't keep them around, they'll get deleted by clear(), which could be
-    // done by the "configure backend" button even before we save().
     const SMIMECryptoConfigEntries e(config);
 
     // Initialize GUI items from the config entries
@@ -299,7 +319,7 @@ static void saveCheckBoxToKleoEntry(QCheckBox *cb, CryptoConfigEntry *entry)
 
 void SMimeValidationConfigurationWidget::save() const
 {
-    CryptoConfig *const config = QGpgME::cryptoConfig();
+    CryptoConfig *const config = d->configUsage ? d->configUsage->config() : nullptr;
     if (!config) {
         return;
     }
@@ -311,8 +331,6 @@ void SMimeValidationConfigurationWidget::save() const
     }
 
     // Create config entries
-    // Don't keep them around, they'll get deleted by clear(), which could be done by the
-    // "configure backend" button.
     const SMIMECryptoConfigEntries e(config);
 
     const bool b = d->ui.OCSPRB->isChecked();
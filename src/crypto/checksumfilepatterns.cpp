@@ -0,0 +1,52 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    crypto/checksumfilepatterns.cpp
+
+    This file is part of Kleopatra, the KDE keymanager
+    SPDX-FileCopyrightText: 2021 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <config-kleopatra.h>
+
+#include "checksumfilepatterns.h"
+
+#include <Libkleo/ChecksumDefinition>
+
+using namespace Kleo;
+using namespace Kleo::Crypto;
+
+#ifdef Q_OS_UNIX
+static const bool HAVE_UNIX = true;
+#else
+static const bool HAVE_UNIX = false;
+#endif
+
+static const Qt::CaseSensitivity fs_cs = HAVE_UNIX ? Qt::CaseSensitive : Qt::CaseInsensitive; // can we use QAbstractFileEngine::caseSensitive()?
+
+ChecksumFilePatterns::ChecksumFilePatterns(const std::vector< std::shared_ptr<ChecksumDefinition> > &checksumDefinitions)
+{
+    QStringList patterns;
+    for (const std::shared_ptr<ChecksumDefinition> &cd : checksumDefinitions) {
+        if (!cd) {
+            continue;
+        }
+        const QStringList cdPatterns = cd->patterns();
+        for (const QString &pattern : cdPatterns) {
+            patterns.push_back(pattern);
+            m_definitions.push_back(cd);
+        }
+    }
+    m_matcher = FileNameMatcher(patterns, fs_cs);
+}
+
+std::shared_ptr<ChecksumDefinition> ChecksumFilePatterns::definition(const QString &fileName) const
+{
+    const int idx = m_matcher.indexOf(fileName);
+    return idx < 0 ? std::shared_ptr<ChecksumDefinition>() : m_definitions[idx];
+}
+
+QString Kleo::Crypto::fileSystemKey(const QString &path)
+{
+    return HAVE_UNIX ? path : path.toCaseFolded();
+}
@@ -0,0 +1,57 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    crypto/checksumfilepatterns.h
+
+    This file is part of Kleopatra, the KDE keymanager
+    SPDX-FileCopyrightText: 2021 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef __KLEOPATRA_CRYPTO_CHECKSUMFILEPATTERNS_H__
+#define __KLEOPATRA_CRYPTO_CHECKSUMFILEPATTERNS_H__
+
+#include <utils/directoryscanner.h>
+
+#include <memory>
+#include <vector>
+
+namespace Kleo
+{
+class ChecksumDefinition;
+
+namespace Crypto
+{
+
+/*!
+ * The file patterns of all checksum definitions, compiled once and
+ * matched with the case sensitivity of the file system.
+ */
+class ChecksumFilePatterns
+{
+public:
+    explicit ChecksumFilePatterns(const std::vector< std::shared_ptr<ChecksumDefinition> > &checksumDefinitions);
+
+    /*! Returns whether \a fileName is the name of a checksum file. */
+    bool operator()(const QString &fileName) const
+    {
+        return m_matcher.matches(fileName);
+    }
+
+    /*! Returns the definition of the checksum file \a fileName, or null. */
+    std::shared_ptr<ChecksumDefinition> definition(const QString &fileName) const;
+
+private:
+    FileNameMatcher m_matcher;
+    std::vector< std::shared_ptr<ChecksumDefinition> > m_definitions; // one per pattern
+};
+
+/*!
+ * Returns \a path in a form that compares equal for all spellings of the
+ * same path, i.e. case folded on file systems that ignore the case.
+ */
+QString fileSystemKey(const QString &path);
+
+}
+}
+
+#endif // __KLEOPATRA_CRYPTO_CHECKSUMFILEPATTERNS_H__
@@ -10,7 +10,9 @@
 #include <config-kleopatra.h>
 
 #include "createchecksumscontroller.h"
+#include "checksumfilepatterns.h"
 
+#include <utils/directoryscanner.h>
 #include <utils/input.h>
 #include <utils/output.h>
 #include <utils/kleo_assert.h>
@@ -41,8 +43,8 @@
 
 #include <gpg-error.h>
 
-#include <deque>
-#include <map>
+#include <QHash>
+
 #include <limits>
 #include <functional>
 
@@ -163,31 +165,6 @@ static QStringList fs_intersect(QStringList l1, QStringList l2)
     return result;
 }
 
-static QList<QRegExp> get_patterns(const std::vector< std::shared_ptr<ChecksumDefinition> > &checksumDefinitions)
-{
-    QList<QRegExp> result;
-    for (const std::shared_ptr<ChecksumDefinition> &cd : checksumDefinitions)
-        if (cd)
-            Q_FOREACH (const QString &pattern, cd->patterns()) {
-                result.push_back(QRegExp(pattern, fs_cs));
-            }
-    return result;
-}
-
-namespace
-{
-
-struct matches_any : std::unary_function<QString, bool> {
-    const QList<QRegExp> m_regexps;
-    explicit matches_any(const QList<QRegExp> &regexps) : m_regexps(regexps) {}
-    bool operator()(const QString &s) const
-    {
-        return std::any_of(m_regexps.cbegin(), m_regexps.cend(),
-                           [s](const QRegExp &rx) { return rx.exactMatch(s); });
-    }
-};
-}
-
 class CreateChecksumsController::Private : public QThread
 {
     Q_OBJECT
@@ -360,16 +337,9 @@ struct Dir {
 
 }
 
-static QStringList remove_checksum_files(QStringList l, const QList<QRegExp> &rxs)
+static QStringList remove_checksum_files(QStringList l, const ChecksumFilePatterns &patterns)
 {
-    QStringList::iterator end = l.end();
-    for (const QRegExp &rx : rxs) {
-        end = std::remove_if(l.begin(), end,
-                             [rx](const QString &str) { 
-                                return rx.exactMatch(str);
-                             });
-    }
-    l.erase(end, l.end());
+    l.erase(std::remove_if(l.begin(), l.end(), std::cref(patterns)), l.end());
     return l;
 }
 
@@ -431,36 +401,12 @@ static std::vector<File> parse_sum_file(const QString &fileName)
     return files;
 }
 
-static quint64 aggregate_size(const QDir &dir, const QStringList &files)
-{
-    quint64 n = 0;
-    for (const QString &file : files) {
-        n += QFileInfo(dir.absoluteFilePath(file)).size();
-    }
-    return n;
-}
-
-static std::shared_ptr<ChecksumDefinition> filename2definition(const QString &fileName,
-        const std::vector< std::shared_ptr<ChecksumDefinition> > &checksumDefinitions)
-{
-    for (const std::shared_ptr<ChecksumDefinition> &cd : checksumDefinitions) {
-        if (cd) {
-            Q_FOREACH (const QString &pattern, cd->patterns()) {
-                if (QRegExp(pattern, fs_cs).exactMatch(fileName)) {
-                    return cd;
-                }
-            }
-        }
-    }
-    return std::shared_ptr<ChecksumDefinition>();
-}
-
 static std::vector<Dir> find_dirs_by_sum_files(const QStringList &files, bool allowAddition,
         const std::function<void(int)> &progress,
         const std::vector< std::shared_ptr<ChecksumDefinition> > &checksumDefinitions)
 {
 
-    const QList<QRegExp> patterns = get_patterns(checksumDefinitions);
+    const ChecksumFilePatterns patterns(checksumDefinitions);
 
     std::vector<Dir> dirs;
     dirs.reserve(files.size());
@@ -471,7 +417,15 @@ static std::vector<Dir> find_dirs_by_sum_files(const QStringList &files, bool al
 
         const QFileInfo fi(file);
         const QDir dir = fi.dir();
-        const QStringList entries = remove_checksum_files(dir.entryList(QDir::Files), patterns);
+        const DirectoryScanner::Directory scanned = DirectoryScanner::readDirectory(dir.absolutePath());
+        QStringList entries;
+        QHash<QString, quint64> sizes;
+        for (const DirectoryScanner::File &f : scanned.files) {
+            if (!patterns(f.name)) {
+                entries.push_back(f.name);
+                sizes.insert(f.name, f.size);
+            }
+        }
 
         QStringList inputFiles;
         if (allowAddition) {
@@ -485,12 +439,17 @@ static std::vector<Dir> find_dirs_by_sum_files(const QStringList &files, bool al
             inputFiles = fs_intersect(oldInputFiles, entries);
         }
 
+        quint64 totalSize = 0;
+        for (const QString &inputFile : qAsConst(inputFiles)) {
+            totalSize += sizes.value(inputFile);
+        }
+
         const Dir item = {
             dir,
             fi.fileName(),
             inputFiles,
-            aggregate_size(dir, inputFiles),
-            filename2definition(fi.fileName(), checksumDefinitions)
+            totalSize,
+            patterns.definition(fi.fileName())
         };
 
         dirs.push_back(item);
@@ -503,82 +462,95 @@ static std::vector<Dir> find_dirs_by_sum_files(const QStringList &files, bool al
     return dirs;
 }
 
-namespace
-{
-struct less_dir : std::binary_function<QDir, QDir, bool> {
-    bool operator()(const QDir &lhs, const QDir &rhs) const
-    {
-        return QString::compare(lhs.absolutePath(), rhs.absolutePath(), fs_cs) < 0;
-    }
-};
-}
-
+// Directories given in \a files are scanned with a DirectoryScanner, so
+// \a progress and \a canceled are also called from the scanner threads
+// (never concurrently). They must not touch GUI objects; emitting a signal
+// (which is queued to the receiver's thread) or reading a flag is fine.
 static std::vector<Dir> find_dirs_by_input_files(const QStringList &files, const std::shared_ptr<ChecksumDefinition> &checksumDefinition, bool allowAddition,
         const std::function<void(int)> &progress,
-        const std::vector< std::shared_ptr<ChecksumDefinition> > &checksumDefinitions)
+        const std::vector< std::shared_ptr<ChecksumDefinition> > &checksumDefinitions,
+        const std::function<bool()> &canceled)
 {
     Q_UNUSED(allowAddition);
     if (!checksumDefinition) {
         return std::vector<Dir>();
     }
 
-    const QList<QRegExp> patterns = get_patterns(checksumDefinitions);
+    const ChecksumFilePatterns patterns(checksumDefinitions);
 
-    std::map<QDir, QStringList, less_dir> dirs2files;
-
-    // Step 1: sort files by the dir they're contained in:
+    std::vector<Dir> dirs;
+    QHash<QString, size_t> dirIndexes; // fileSystemKey(absolute path) -> index into dirs
+    const auto dirFor = [&dirs, &dirIndexes, &checksumDefinition](const QString &path) -> Dir & {
+        const QString key = fileSystemKey(path);
+        const auto it = dirIndexes.constFind(key);
+        if (it != dirIndexes.cend()) {
+            return dirs[*it];
+        }
+        dirIndexes.insert(key, dirs.size());
+        dirs.push_back({QDir(path), checksumDefinition->outputFileName(), QStringList(), 0, checksumDefinition});
+        return dirs.back();
+    };
 
-    std::deque<QString> inputs(files.begin(), files.end());
+    // Step 1: sort files by the dir they're contained in. Directories are
+    // scanned in parallel and come with the sizes of their files:
 
+    QStringList roots;
     int i = 0;
-    while (!inputs.empty()) {
-        const QString file = inputs.front();
-        inputs.pop_front();
+    for (const QString &file : files) {
         const QFileInfo fi(file);
         if (fi.isDir()) {
-            QDir dir(file);
-            dirs2files[ dir ] = remove_checksum_files(dir.entryList(QDir::Files), patterns);
-            const auto entryList = dir.entryList(QDir::Dirs | QDir::NoDotAndDotDot);
-            std::transform(entryList.cbegin(), entryList.cend(),
-                           std::inserter(inputs, inputs.begin()),
-                           [&dir](const QString &entry) {
-                               return dir.absoluteFilePath(entry);
-                           });
-        } else {
-            dirs2files[fi.dir()].push_back(file);
-        }
-        if (progress) {
-            progress(++i);
+            roots.push_back(file);
+        } else if (!patterns(fi.fileName())) {
+            Dir &dir = dirFor(QDir::cleanPath(fi.absolutePath()));
+            dir.inputFiles.push_back(file);
+            dir.totalSize += fi.size();
+            if (progress) {
+                progress(++i);
+            }
         }
     }
 
-    // Step 2: convert into vector<Dir>:
-
-    std::vector<Dir> dirs;
-    dirs.reserve(dirs2files.size());
-
-    for (std::map<QDir, QStringList, less_dir>::const_iterator it = dirs2files.begin(), end = dirs2files.end(); it != end; ++it) {
-
-        const QStringList inputFiles = remove_checksum_files(it->second, patterns);
-        if (inputFiles.empty()) {
-            continue;
+    DirectoryScanner scanner;
+    scanner.scan(roots, [&](DirectoryScanner::Directory &&scanned) {
+        if (canceled && canceled()) {
+            scanner.cancel();
+            return;
+        }
+        Dir &dir = dirFor(scanned.path);
+        // a scanned directory includes all the files given explicitly
+        dir.inputFiles.clear();
+        dir.totalSize = 0;
+        for (const DirectoryScanner::File &f : scanned.files) {
+            if (!patterns(f.name)) {
+                dir.inputFiles.push_back(f.name);
+                dir.totalSize += f.size;
+            }
         }
-
-        const Dir dir = {
-            it->first,
-            checksumDefinition->outputFileName(),
-            inputFiles,
-            aggregate_size(it->first, inputFiles),
-            checksumDefinition
-        };
-        dirs.push_back(dir);
-
         if (progress) {
             progress(++i);
         }
+    });
 
+    // Step 2: drop directories without input files and sort the rest:
+
+    dirs.erase(std::remove_if(dirs.begin(), dirs.end(),
+                              [](const Dir &dir) { return dir.inputFiles.empty(); }),
+               dirs.end());
+    std::vector<std::pair<QString, size_t>> order;
+    order.reserve(dirs.size());
+    for (size_t idx = 0; idx < dirs.size(); ++idx) {
+        order.emplace_back(dirs[idx].dir.absolutePath(), idx);
     }
-    return dirs;
+    std::sort(order.begin(), order.end(),
+              [](const std::pair<QString, size_t> &lhs, const std::pair<QString, size_t> &rhs) {
+                  return QString::compare(lhs.first, rhs.first, fs_cs) < 0;
+              });
+    std::vector<Dir> result;
+    result.reserve(dirs.size());
+    for (const auto &entry : order) {
+        result.push_back(std::move(dirs[entry.second]));
+    }
+    return result;
 }
 
 static QString process(const Dir &dir, bool *fatal)
@@ -655,11 +627,14 @@ void CreateChecksumsController::Private::run()
     const QString scanning = i18n("Scanning directories...");
     Q_EMIT progress(0, 0, scanning);
 
-    const bool haveSumFiles = std::all_of(files.cbegin(), files.cend(), matches_any(get_patterns(checksumDefinitions)));
+    const ChecksumFilePatterns patterns(checksumDefinitions);
+    const bool haveSumFiles = std::all_of(files.cbegin(), files.cend(), std::cref(patterns));
+    // called from the scanner threads, too (see find_dirs_by_input_files())
     const auto progressCb = [this, &scanning](int c) { Q_EMIT progress(c, 0, scanning); };
+    const auto canceledCb = [this]() { return canceled; };
     const std::vector<Dir> dirs = haveSumFiles
                                   ? find_dirs_by_sum_files(files, allowAddition, progressCb, checksumDefinitions)
-                                  : find_dirs_by_input_files(files, checksumDefinition, allowAddition, progressCb, checksumDefinitions);
+                                  : find_dirs_by_input_files(files, checksumDefinition, allowAddition, progressCb, checksumDefinitions, canceledCb);
 
     for (const Dir &dir : dirs) {
         qCDebug(KLEOPATRA_LOG) << dir;
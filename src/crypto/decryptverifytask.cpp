@@ -1100,6 +1100,9 @@ void DecryptVerifyTask::doStart()
         }
         kleo_assert(job);
         d->registerJob(job);
+        // the plain text is about as large as the input
+        d->m_output->setExpectedSize(d->m_input->size());
+        d->m_output->setDurability(Output::configuredDurability());
         ensureIOOpen(d->m_input->ioDevice().get(), d->m_output->ioDevice().get());
         job->start(d->m_input->ioDevice(), d->m_output->ioDevice());
     } catch (const GpgME::Exception &e) {
@@ -1258,6 +1261,9 @@ void DecryptTask::doStart()
         QGpgME::DecryptJob *const job = d->m_backend->decryptJob();
         kleo_assert(job);
         d->registerJob(job);
+        // the plain text is about as large as the input
+        d->m_output->setExpectedSize(d->m_input->size());
+        d->m_output->setDurability(Output::configuredDurability());
         ensureIOOpen(d->m_input->ioDevice().get(), d->m_output->ioDevice().get());
         job->start(d->m_input->ioDevice(), d->m_output->ioDevice());
     } catch (const GpgME::Exception &e) {
@@ -1416,6 +1422,10 @@ void VerifyOpaqueTask::doStart()
         QGpgME::VerifyOpaqueJob *const job = d->m_backend->verifyOpaqueJob();
         kleo_assert(job);
         d->registerJob(job);
+        if (d->m_output) {
+            d->m_output->setExpectedSize(d->m_input->size());
+            d->m_output->setDurability(Output::configuredDurability());
+        }
         ensureIOOpen(d->m_input->ioDevice().get(), d->m_output ? d->m_output->ioDevice().get() : nullptr);
         job->start(d->m_input->ioDevice(), d->m_output ? d->m_output->ioDevice() : std::shared_ptr<QIODevice>());
     } catch (const GpgME::Exception &e) {
@@ -9,6 +9,7 @@
 
 #include "certificatelineedit.h"
 
+#include <QAbstractListModel>
 #include <QCompleter>
 #include <QPushButton>
 #include <QAction>
@@ -17,11 +18,11 @@
 #include "kleopatra_debug.h"
 
 #include "commands/detailscommand.h"
+#include "utils/keycompletionindex.h"
 
 #include <Libkleo/KeyCache>
 #include <Libkleo/KeyFilter>
 #include <Libkleo/KeyListModel>
-#include <Libkleo/KeyListSortFilterProxyModel>
 #include <Libkleo/Formatting>
 
 #include <KLocalizedString>
@@ -42,44 +43,60 @@ static QStringList s_lookedUpKeys;
 
 namespace
 {
-class ProxyModel : public KeyListSortFilterProxyModel
+// The best matches of the completion index for the current text. The
+// completer shows them as they are (unfiltered).
+class CompletionModel : public QAbstractListModel
 {
     Q_OBJECT
 
 public:
-    ProxyModel(QObject *parent = nullptr)
-        : KeyListSortFilterProxyModel(parent)
+    CompletionModel(QObject *parent = nullptr)
+        : QAbstractListModel(parent)
     {
     }
 
+    void setKeys(const std::vector<Key> &keys)
+    {
+        beginResetModel();
+        mKeys = keys;
+        endResetModel();
+    }
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override
+    {
+        return parent.isValid() ? 0 : mKeys.size();
+    }
+
     QVariant data(const QModelIndex &index, int role) const override
     {
-        if (!index.isValid()) {
+        if (!index.isValid() || index.row() >= int(mKeys.size())) {
             return QVariant();
         }
-
+        const Key &key = mKeys[index.row()];
         switch (role) {
-        case Qt::DecorationRole: {
-            const auto key = KeyListSortFilterProxyModel::data(index,
-                    Kleo::KeyListModelInterface::KeyRole).value<GpgME::Key>();
-            Q_ASSERT(!key.isNull());
-            if (key.isNull()) {
-                return QVariant();
-            }
-            return Kleo::Formatting::iconForUid(key.userID(0));
-        }
+        case Qt::DisplayRole:
+        case Qt::EditRole:
+            return Formatting::summaryLine(key);
+        case Qt::DecorationRole:
+            return Formatting::iconForUid(key.userID(0));
+        case KeyListModelInterface::KeyRole:
+            return QVariant::fromValue(key);
         default:
-            return KeyListSortFilterProxyModel::data(index, role);
+            return QVariant();
         }
     }
+
+private:
+    std::vector<Key> mKeys;
 };
 } // namespace
 
-CertificateLineEdit::CertificateLineEdit(AbstractKeyListModel *model,
-                                         QWidget *parent,
+// number of completions shown in the popup
+static const int maxCompletions = 50;
+
+CertificateLineEdit::CertificateLineEdit(QWidget *parent,
                                          KeyFilter *filter)
     : QLineEdit(parent),
-      mFilterModel(new KeyListSortFilterProxyModel(this)),
       mFilter(std::shared_ptr<KeyFilter>(filter)),
       mLineAction(new QAction(this))
 {
@@ -88,24 +105,19 @@ CertificateLineEdit::CertificateLineEdit(AbstractKeyListModel *model,
     addAction(mLineAction, QLineEdit::LeadingPosition);
 
     auto *completer = new QCompleter(this);
-    auto *completeFilterModel = new ProxyModel(completer);
-    completeFilterModel->setKeyFilter(mFilter);
-    completeFilterModel->setSourceModel(model);
-    completer->setModel(completeFilterModel);
-    completer->setCompletionColumn(KeyListModelInterface::Summary);
-    completer->setFilterMode(Qt::MatchContains);
+    mCompletionModel = new CompletionModel(completer);
+    completer->setModel(mCompletionModel);
+    completer->setCompletionMode(QCompleter::UnfilteredPopupCompletion);
     completer->setCaseSensitivity(Qt::CaseInsensitive);
     setCompleter(completer);
-    mFilterModel->setSourceModel(model);
-    mFilterModel->setFilterKeyColumn(KeyListModelInterface::Summary);
-    if (filter) {
-        mFilterModel->setKeyFilter(mFilter);
-    }
 
     connect(KeyCache::instance().get(), &Kleo::KeyCache::keyListingDone,
             this, &CertificateLineEdit::updateKey);
     connect(this, &QLineEdit::editingFinished,
             this, &CertificateLineEdit::updateKey);
+    // QLineEdit shows the completions after textEdited was emitted
+    connect(this, &QLineEdit::textEdited,
+            this, &CertificateLineEdit::updateCompletions);
     connect(this, &QLineEdit::textChanged,
             this, &CertificateLineEdit::editChanged);
     connect(mLineAction, &QAction::triggered,
@@ -113,10 +125,12 @@ CertificateLineEdit::CertificateLineEdit(AbstractKeyListModel *model,
     connect(this, &QLineEdit::editingFinished, this,
             &CertificateLineEdit::checkLocate);
     updateKey();
+}
 
-    /* Take ownership of the model to prevent double deletion when the
-     * filter models are deleted */
-    model->setParent(parent ? parent : this);
+void CertificateLineEdit::updateCompletions()
+{
+    static_cast<CompletionModel *>(mCompletionModel)->setKeys(
+        KeyCompletionIndex::instance()->find(text(), mFilter, maxCompletions));
 }
 
 void CertificateLineEdit::editChanged()
@@ -155,14 +169,15 @@ void CertificateLineEdit::updateKey()
         mLineAction->setIcon(QIcon::fromTheme(QStringLiteral("resource-group-new")));
         mLineAction->setToolTip(i18n("Open selection dialog."));
     } else {
-        mFilterModel->setFilterFixedString(mailText);
-        if (mFilterModel->rowCount() > 1) {
+        // two matches are enough to tell whether the text is ambiguous
+        const auto matches = KeyCompletionIndex::instance()->find(mailText, mFilter, 2);
+        if (matches.size() > 1) {
             if (mEditFinished) {
                 mLineAction->setIcon(QIcon::fromTheme(QStringLiteral("question")).pixmap(KIconLoader::SizeSmallMedium));
                 mLineAction->setToolTip(i18n("Multiple certificates"));
             }
-        } else if (mFilterModel->rowCount() == 1) {
-            newKey = mFilterModel->data(mFilterModel->index(0, 0), KeyListModelInterface::KeyRole).value<Key>();
+        } else if (matches.size() == 1) {
+            newKey = matches.front();
             mLineAction->setToolTip(Formatting::validity(newKey.userID(0)) +
                                     QStringLiteral("<br/>Click here for details."));
             /* FIXME: This needs to be solved by a multiple UID supporting model */
@@ -241,7 +256,7 @@ bool CertificateLineEdit::isEmpty() const
 void CertificateLineEdit::setKeyFilter(const std::shared_ptr<KeyFilter> &filter)
 {
     mFilter = filter;
-    mFilterModel->setKeyFilter(filter);
+    updateKey();
 }
 
 #include "certificatelineedit.moc"
@@ -17,14 +17,13 @@
 
 #include <memory>
 
+class QAbstractListModel;
 class QLabel;
 class QAction;
 
 namespace Kleo
 {
-class AbstractKeyListModel;
 class KeyFilter;
-class KeyListSortFilterProxyModel;
 
 /** Line edit and completion based Certificate Selection Widget.
  *
@@ -39,16 +38,13 @@ class CertificateLineEdit: public QLineEdit
 public:
     /** Create the certificate selection line.
      *
-     * If parent is not NULL the model is not taken
-     * over but the parent argument used as the parent of the model.
+     * The completions are looked up in the shared KeyCompletionIndex.
      *
-     * @param model: The keylistmodel to use.
      * @param parent: The usual widget parent.
      * @param filter: The filters to use. See certificateselectiondialog.
      */
-    CertificateLineEdit(AbstractKeyListModel *model,
-                        QWidget *parent = nullptr,
-                        KeyFilter *filter = nullptr);
+    explicit CertificateLineEdit(QWidget *parent = nullptr,
+                                 KeyFilter *filter = nullptr);
 
     /** Get the selected key */
     GpgME::Key key() const;
@@ -77,12 +73,13 @@ Q_SIGNALS:
 
 private Q_SLOTS:
     void updateKey();
+    void updateCompletions();
     void dialogRequested();
     void editChanged();
     void checkLocate();
 
 private:
-    KeyListSortFilterProxyModel *const mFilterModel;
+    QAbstractListModel *mCompletionModel = nullptr;
     QLabel *mStatusLabel,
            *mStatusIcon;
     GpgME::Key mKey;
@@ -23,7 +23,6 @@
 
 #include <Libkleo/DefaultKeyFilter>
 #include <Libkleo/KeyCache>
-#include <Libkleo/KeyListModel>
 #include <Libkleo/KeySelectionCombo>
 #include <Libkleo/KeyListSortFilterProxyModel>
 
@@ -87,15 +86,12 @@ public:
 
 SignEncryptWidget::SignEncryptWidget(QWidget *parent, bool sigEncExclusive)
     : QWidget(parent),
-      mModel(AbstractKeyListModel::createFlatKeyListModel(this)),
       mRecpRowCount(2),
       mIsExclusive(sigEncExclusive)
 {
     QVBoxLayout *lay = new QVBoxLayout(this);
     lay->setContentsMargins(0, 0, 0, 0);
 
-    mModel->useKeyCache(true, false);
-
     /* The signature selection */
     QHBoxLayout *sigLay = new QHBoxLayout;
     QGroupBox *sigGrp = new QGroupBox(i18n("Prove authenticity (sign)"));
@@ -221,7 +217,7 @@ void SignEncryptWidget::addRecipient()
 
 void SignEncryptWidget::addRecipient(const Key &key)
 {
-    CertificateLineEdit *certSel = new CertificateLineEdit(mModel, this,
+    CertificateLineEdit *certSel = new CertificateLineEdit(this,
                                                            new EncryptCertificateFilter(mCurrentProto));
     mRecpWidgets << certSel;
 
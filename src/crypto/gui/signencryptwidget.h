@@ -20,7 +20,6 @@ namespace Kleo
 {
 class CertificateLineEdit;
 class KeySelectionCombo;
-class AbstractKeyListModel;
 class UnknownRecipientWidget;
 
 class SignEncryptWidget: public QWidget
@@ -109,7 +108,6 @@ private:
     QVector<GpgME::Key> mAddedKeys;
     QGridLayout *mRecpLayout = nullptr;
     QString mOp;
-    AbstractKeyListModel *mModel = nullptr;
     QCheckBox *mSymmetric = nullptr;
     QCheckBox *mSigChk = nullptr;
     QCheckBox *mEncOtherChk = nullptr;
@@ -11,8 +11,6 @@
 
 #include "verifychecksumsdialog.h"
 
-#ifndef QT_NO_DIRMODEL
-
 #include <KLocalizedString>
 #include <KMessageBox>
 
@@ -22,14 +20,21 @@
 #include <QVBoxLayout>
 #include <QHash>
 #include <QTreeView>
-#include <QSortFilterProxyModel>
-#include <QDirModel>
+#include <QAbstractItemModel>
+#include <QDir>
+#include <QFileIconProvider>
+#include <QLocale>
 #include <QProgressBar>
 #include <QDialogButtonBox>
 #include <QPushButton>
 #include <QHeaderView>
 #include "kleopatra_debug.h"
 
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <vector>
+
 using namespace Kleo;
 using namespace Kleo::Crypto;
 using namespace Kleo::Crypto::Gui;
@@ -45,87 +50,323 @@ static Qt::GlobalColor statusColor[] = {
 };
 static_assert((sizeof(statusColor) / sizeof(*statusColor)) == VerifyChecksumsDialog::NumStatii, "");
 
-class ColorizedFileSystemModel : public QDirModel
+#ifdef Q_OS_UNIX
+static const Qt::CaseSensitivity fs_cs = Qt::CaseSensitive;
+#else
+static const Qt::CaseSensitivity fs_cs = Qt::CaseInsensitive;
+#endif
+
+static QString fs_key(const QString &s)
+{
+    return fs_cs == Qt::CaseSensitive ? s : s.toCaseFolded();
+}
+
+// The files found by the controller's directory scan, with the results of
+// the verification. Nothing is read from the file system: files that are
+// reported but were not scanned (e.g. because they are missing) are added
+// when their status arrives.
+class ChecksumStatusModel : public QAbstractItemModel
 {
     Q_OBJECT
 public:
-    explicit ColorizedFileSystemModel(QObject *parent = nullptr)
-        : QDirModel(parent),
-          statusMap()
+    enum Column {
+        NameColumn,
+        SizeColumn,
+        StatusColumn,
+        NumColumns
+    };
+
+    explicit ChecksumStatusModel(QObject *parent = nullptr)
+        : QAbstractItemModel(parent)
     {
+        std::fill(std::begin(m_counts), std::end(m_counts), 0);
+    }
 
+    void setBases(const QStringList &bases)
+    {
+        m_bases.clear();
+        for (const QString &base : bases) {
+            m_bases.push_back(QDir::cleanPath(base));
+        }
     }
 
-    QVariant data(const QModelIndex &mi, int role = Qt::DisplayRole) const override
+    QModelIndex indexForDirectory(const QString &path)
     {
-        if (mi.isValid() && role == Qt::BackgroundRole) {
-            const QHash<QString, VerifyChecksumsDialog::Status>::const_iterator
-            it = statusMap.find(filePath(mi));
-            if (it != statusMap.end())
-                if (const Qt::GlobalColor c = statusColor[*it]) {
-                    return QColor(c);
+        return nodeIndex(dirNode(QDir::cleanPath(path)));
+    }
+
+    void addEntries(const QString &path, const QStringList &files, const QVector<quint64> &sizes)
+    {
+        Node *const dir = dirNode(QDir::cleanPath(path));
+        std::vector<std::unique_ptr<Node>> added;
+        for (int i = 0; i < files.size(); ++i) {
+            const QString key = fs_key(files[i]);
+            if (dir->childByName.contains(key)) {
+                continue;
+            }
+            std::unique_ptr<Node> node(new Node);
+            node->name = files[i];
+            node->parent = dir;
+            node->size = i < sizes.size() ? sizes[i] : 0;
+            added.push_back(std::move(node));
+        }
+        if (added.empty()) {
+            return;
+        }
+        const int first = dir->children.size();
+        beginInsertRows(nodeIndex(dir), first, first + int(added.size()) - 1);
+        for (auto &node : added) {
+            node->row = dir->children.size();
+            dir->childByName.insert(fs_key(node->name), node.get());
+            dir->children.push_back(std::move(node));
+        }
+        endInsertRows();
+    }
+
+    void setStatuses(const QStringList &files, const QVector<VerifyChecksumsDialog::Status> &statuses)
+    {
+        // one dataChanged() per directory and batch
+        QHash<Node *, std::pair<int, int>> changed;
+        for (int i = 0, end = std::min(files.size(), statuses.size()); i < end; ++i) {
+            const VerifyChecksumsDialog::Status status = statuses[i];
+            if (status >= VerifyChecksumsDialog::NumStatii || files[i].isEmpty()) {
+                continue;
+            }
+            Node *const node = fileNode(QDir::cleanPath(files[i]));
+            if (node->hasStatus) {
+                if (node->status == status) {
+                    continue;
                 }
+                --m_counts[node->status];
+            }
+            node->status = status;
+            node->hasStatus = true;
+            ++m_counts[status];
+            auto it = changed.find(node->parent);
+            if (it == changed.end()) {
+                changed.insert(node->parent, std::make_pair(node->row, node->row));
+            } else {
+                it->first = std::min(it->first, node->row);
+                it->second = std::max(it->second, node->row);
+            }
+        }
+        for (auto it = changed.cbegin(), end = changed.cend(); it != end; ++it) {
+            const QModelIndex parent = nodeIndex(it.key());
+            Q_EMIT dataChanged(index(it->first, 0, parent), index(it->second, NumColumns - 1, parent));
         }
-        return QDirModel::data(mi, role);
     }
 
-public Q_SLOTS:
-    void setStatus(const QString &file, VerifyChecksumsDialog::Status status)
+    void clearStatusInformation()
     {
+        // no model reset, which would invalidate the root indexes of the views
+        clearStatus(&m_root);
+        std::fill(std::begin(m_counts), std::end(m_counts), 0);
+    }
 
-        if (status >= VerifyChecksumsDialog::NumStatii || file.isEmpty()) {
-            return;
+    int count(VerifyChecksumsDialog::Status status) const
+    {
+        return m_counts[status];
+    }
+
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const override
+    {
+        const Node *const p = node(parent);
+        if (row < 0 || column < 0 || column >= NumColumns || row >= int(p->children.size())) {
+            return QModelIndex();
         }
+        return createIndex(row, column, p->children[row].get());
+    }
 
-        // canonicalize filename:
-        const QModelIndex mi = index(file);
-        const QString canonical = filePath(mi);
-        if (canonical.isEmpty()) {
-            qCDebug(KLEOPATRA_LOG) << "can't locate file " << file;
-            return;
+    QModelIndex parent(const QModelIndex &child) const override
+    {
+        if (!child.isValid()) {
+            return QModelIndex();
+        }
+        return nodeIndex(node(child)->parent);
+    }
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override
+    {
+        if (parent.column() > 0) {
+            return 0;
         }
+        return node(parent)->children.size();
+    }
 
-        const QHash<QString, VerifyChecksumsDialog::Status>::iterator
-        it = statusMap.find(canonical);
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override
+    {
+        Q_UNUSED(parent)
+        return NumColumns;
+    }
 
-        if (it != statusMap.end())
-            if (*it == status) {
-                return;    // nothing to do
-            } else {
-                *it = status;
+    bool hasChildren(const QModelIndex &parent = QModelIndex()) const override
+    {
+        return parent.column() <= 0 && !node(parent)->children.empty();
+    }
+
+    QVariant data(const QModelIndex &mi, int role = Qt::DisplayRole) const override
+    {
+        if (!mi.isValid()) {
+            return QVariant();
+        }
+        const Node *const n = node(mi);
+        switch (role) {
+        case Qt::DisplayRole:
+            switch (mi.column()) {
+            case NameColumn:
+                return n->name;
+            case SizeColumn:
+                return n->isDir ? QString() : QLocale().formattedDataSize(qint64(n->size));
+            case StatusColumn:
+                return n->hasStatus ? statusText(n->status) : QString();
+            }
+            break;
+        case Qt::DecorationRole:
+            if (mi.column() == NameColumn) {
+                return m_iconProvider.icon(n->isDir ? QFileIconProvider::Folder : QFileIconProvider::File);
             }
-        else {
-            statusMap[canonical] = status;
+            break;
+        case Qt::TextAlignmentRole:
+            if (mi.column() == SizeColumn) {
+                return int(Qt::AlignRight | Qt::AlignVCenter);
+            }
+            break;
+        case Qt::BackgroundRole:
+            if (n->hasStatus)
+                if (const Qt::GlobalColor c = statusColor[n->status]) {
+                    return QColor(c);
+                }
+            break;
         }
+        return QVariant();
+    }
 
-        emitDataChangedFor(mi);
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override
+    {
+        if (orientation != Qt::Horizontal || role != Qt::DisplayRole) {
+            return QVariant();
+        }
+        switch (section) {
+        case NameColumn:   return i18nc("@title:column", "Name");
+        case SizeColumn:   return i18nc("@title:column", "Size");
+        case StatusColumn: return i18nc("@title:column", "Status");
+        }
+        return QVariant();
     }
 
-    void clearStatusInformation()
+    static QString statusText(VerifyChecksumsDialog::Status status)
+    {
+        switch (status) {
+        case VerifyChecksumsDialog::OK:     return i18nc("@info checksum status", "OK");
+        case VerifyChecksumsDialog::Failed: return i18nc("@info checksum status", "Failed");
+        default:                            return i18nc("@info checksum status", "Missing or unreadable");
+        }
+    }
+
+private:
+    struct Node {
+        QString name;
+        Node *parent = nullptr;
+        int row = 0;
+        bool isDir = false;
+        bool hasStatus = false;
+        VerifyChecksumsDialog::Status status = VerifyChecksumsDialog::Unknown;
+        quint64 size = 0;
+        std::vector<std::unique_ptr<Node>> children;
+        QHash<QString, Node *> childByName; // fs_key(name) -> child
+    };
+
+    Node *node(const QModelIndex &mi) const
     {
-        using std::swap;
+        return mi.isValid() ? static_cast<Node *>(mi.internalPointer()) : const_cast<Node *>(&m_root);
+    }
 
-        QHash<QString, VerifyChecksumsDialog::Status> oldStatusMap;
-        swap(statusMap, oldStatusMap);
+    QModelIndex nodeIndex(const Node *n) const
+    {
+        return !n || n == &m_root ? QModelIndex() : createIndex(n->row, 0, const_cast<Node *>(n));
+    }
 
-        for (QHash<QString, VerifyChecksumsDialog::Status>::const_iterator it = oldStatusMap.constBegin(), end = oldStatusMap.constEnd(); it != end; ++it) {
-            emitDataChangedFor(it.key());
+    Node *appendChild(Node *parent, const QString &name, bool isDir)
+    {
+        std::unique_ptr<Node> child(new Node);
+        child->name = name;
+        child->parent = parent;
+        child->isDir = isDir;
+        child->row = parent->children.size();
+        beginInsertRows(nodeIndex(parent), child->row, child->row);
+        Node *const result = child.get();
+        parent->childByName.insert(fs_key(name), result);
+        parent->children.push_back(std::move(child));
+        endInsertRows();
+        return result;
+    }
+
+    // returns the node of the directory \a path, creating it (and the
+    // directories between it and its base directory) if needed
+    Node *dirNode(const QString &path)
+    {
+        const QString key = fs_key(path);
+        if (Node *const n = m_dirs.value(key)) {
+            return n;
         }
+        const bool isBase = std::any_of(m_bases.cbegin(), m_bases.cend(), [&key](const QString &base) {
+            return fs_key(base) == key;
+        });
+        const bool belowBase = !isBase && std::any_of(m_bases.cbegin(), m_bases.cend(), [&path](const QString &base) {
+            return path.startsWith(base.endsWith(QLatin1Char('/')) ? base : base + QLatin1Char('/'), fs_cs);
+        });
+        const int slash = path.lastIndexOf(QLatin1Char('/'));
+        Node *n;
+        if (belowBase && slash > 0) {
+            n = appendChild(dirNode(path.left(slash)), path.mid(slash + 1), true);
+        } else {
+            // a top-level item, shown with its full path
+            n = appendChild(&m_root, QDir::toNativeSeparators(path), true);
+        }
+        m_dirs.insert(key, n);
+        return n;
     }
 
-private:
-    void emitDataChangedFor(const QString &file)
+    Node *fileNode(const QString &path)
     {
-        emitDataChangedFor(index(file));
+        const int slash = path.lastIndexOf(QLatin1Char('/'));
+        Node *const dir = dirNode(slash > 0 ? path.left(slash) : QStringLiteral("/"));
+        const QString name = path.mid(slash + 1);
+        if (Node *const n = dir->childByName.value(fs_key(name))) {
+            return n;
+        }
+        return appendChild(dir, name, false);
     }
-    void emitDataChangedFor(const QModelIndex &mi)
+
+    void clearStatus(Node *dir)
     {
-        const QModelIndex p = parent(mi);
-        Q_EMIT dataChanged(index(mi.row(), 0, p), index(mi.row(), columnCount(p) - 1, p));
+        int first = -1;
+        int last = -1;
+        for (const auto &child : dir->children) {
+            if (child->hasStatus) {
+                child->hasStatus = false;
+                child->status = VerifyChecksumsDialog::Unknown;
+                if (first < 0) {
+                    first = child->row;
+                }
+                last = child->row;
+            }
+            if (child->isDir) {
+                clearStatus(child.get());
+            }
+        }
+        if (first >= 0) {
+            const QModelIndex parent = nodeIndex(dir);
+            Q_EMIT dataChanged(index(first, 0, parent), index(last, NumColumns - 1, parent));
+        }
     }
 
 private:
-    QHash<QString, VerifyChecksumsDialog::Status> statusMap;
+    Node m_root;
+    QHash<QString, Node *> m_dirs; // fs_key(path) -> directory
+    QStringList m_bases;
+    int m_counts[VerifyChecksumsDialog::NumStatii];
+    QFileIconProvider m_iconProvider;
 };
 
 static int find_layout_item(const QBoxLayout &blay)
@@ -139,16 +380,15 @@ static int find_layout_item(const QBoxLayout &blay)
 }
 
 struct BaseWidget {
-    QSortFilterProxyModel proxy;
     QLabel label;
     QTreeView view;
+    ChecksumStatusModel *const model;
 
-    BaseWidget(QDirModel *model, QWidget *parent, QVBoxLayout *vlay)
-        : proxy(),
-          label(parent),
-          view(parent)
+    BaseWidget(ChecksumStatusModel *model_, QWidget *parent, QVBoxLayout *vlay)
+        : label(parent),
+          view(parent),
+          model(model_)
     {
-        KDAB_SET_OBJECT_NAME(proxy);
         KDAB_SET_OBJECT_NAME(label);
         KDAB_SET_OBJECT_NAME(view);
 
@@ -156,41 +396,22 @@ struct BaseWidget {
         vlay->insertWidget(row,   &label);
         vlay->insertWidget(row + 1, &view, 1);
 
-        proxy.setSourceModel(model);
-
-        view.setModel(&proxy);
-
-        QRect r;
-        for (int i = 0; i < proxy.columnCount(); ++i) {
-            view.resizeColumnToContents(i);
-        }
+        // all rows have one line of text; fixed column widths, because
+        // measuring the contents would format every row of the model
+        view.setUniformRowHeights(true);
+        view.setModel(model);
 
-        // define some minimum sizes
-        view.header()->resizeSection(0, qMax(view.header()->sectionSize(0), 220));
-        view.header()->resizeSection(1, qMax(view.header()->sectionSize(1), 75));
-        view.header()->resizeSection(2, qMax(view.header()->sectionSize(2), 75));
-        view.header()->resizeSection(3, qMax(view.header()->sectionSize(3), 140));
+        view.header()->resizeSection(ChecksumStatusModel::NameColumn, 300);
+        view.header()->resizeSection(ChecksumStatusModel::SizeColumn, 75);
+        view.header()->resizeSection(ChecksumStatusModel::StatusColumn, 140);
 
-        for (int i = 0; i < proxy.rowCount(); ++i) {
-            r = r.united(view.visualRect(proxy.index(proxy.columnCount() - 1, i)));
-        }
-        view.setMinimumSize(QSize(qBound(r.width() + 4 * view.frameWidth(), 220 + 75 + 75 + 140 + 4 * view.frameWidth(), 1024), // 100 is the default defaultSectionSize
-                                  qBound(r.height(), 220, 512)));
+        view.setMinimumSize(QSize(300 + 75 + 140 + 4 * view.frameWidth(), 220));
     }
 
     void setBase(const QString &base)
     {
         label.setText(base);
-        if (QDirModel *fsm = qobject_cast<QDirModel *>(proxy.sourceModel())) {
-            view.setRootIndex(proxy.mapFromSource(fsm->index(base)));
-        } else {
-            qCWarning(KLEOPATRA_LOG) << "expect a QDirModel-derived class as proxy.sourceModel(), got ";
-            if (!proxy.sourceModel()) {
-                qCWarning(KLEOPATRA_LOG) << "a null pointer";
-            } else {
-                qCWarning(KLEOPATRA_LOG) << proxy.sourceModel()->metaObject()->className();
-            }
-        }
+        view.setRootIndex(model->indexForDirectory(base));
     }
 };
 
@@ -222,6 +443,7 @@ private:
     void updateErrors()
     {
         const bool active = ui.isProgressBarActive();
+        updateSummary();
         ui.progressLabel.setVisible(active);
         ui.progressBar.  setVisible(active);
         ui.errorLabel.   setVisible(!active);
@@ -233,13 +455,21 @@ private:
         }
     }
 
+    void updateSummary()
+    {
+        ui.summaryLabel.setText(i18nc("@info", "OK: %1, failed: %2, missing or unreadable: %3",
+                                      model.count(OK), model.count(Failed),
+                                      model.count(Unknown) + model.count(Error)));
+    }
+
 private:
     QStringList bases;
     QStringList errors;
-    ColorizedFileSystemModel model;
+    ChecksumStatusModel model;
 
     struct UI {
         std::vector<BaseWidget *> baseWidgets;
+        QLabel summaryLabel;
         QLabel progressLabel;
         QProgressBar progressBar;
         QLabel errorLabel;
@@ -250,6 +480,7 @@ private:
 
         explicit UI(VerifyChecksumsDialog *q)
             : baseWidgets(),
+              summaryLabel(q),
               progressLabel(i18n("Progress:"), q),
               progressBar(q),
               errorLabel(i18n("No errors occurred"), q),
@@ -257,6 +488,7 @@ private:
               buttonBox(QDialogButtonBox::Close, Qt::Horizontal, q),
               vlay(q)
         {
+            KDAB_SET_OBJECT_NAME(summaryLabel);
             KDAB_SET_OBJECT_NAME(progressLabel);
             KDAB_SET_OBJECT_NAME(progressBar);
             KDAB_SET_OBJECT_NAME(errorLabel);
@@ -274,6 +506,7 @@ private:
             hlay[1].addWidget(&errorLabel, 1);
             hlay[1].addWidget(&errorButton);
 
+            vlay.addWidget(&summaryLabel);
             vlay.addLayout(&hlay[0]);
             vlay.addLayout(&hlay[1]);
             vlay.addWidget(&buttonBox);
@@ -299,8 +532,9 @@ private:
             return buttonBox.button(QDialogButtonBox::Close);
         }
 
-        void setBases(const QStringList &bases, QDirModel *model)
+        void setBases(const QStringList &bases, ChecksumStatusModel *model)
         {
+            model->setBases(bases);
 
             // create new BaseWidgets:
             for (unsigned int i = baseWidgets.size(), end = bases.size(); i < end; ++i) {
@@ -374,21 +608,32 @@ void VerifyChecksumsDialog::setProgress(int cur, int tot)
     d->updateErrors();
 }
 
+// slot
+void VerifyChecksumsDialog::addEntries(const QString &dir, const QStringList &files, const QVector<quint64> &sizes)
+{
+    d->model.addEntries(dir, files, sizes);
+}
+
 // slot
 void VerifyChecksumsDialog::setStatus(const QString &file, Status status)
 {
-    d->model.setStatus(file, status);
+    setStatuses(QStringList(file), QVector<Status>(1, status));
+}
+
+// slot
+void VerifyChecksumsDialog::setStatuses(const QStringList &files, const QVector<Status> &statuses)
+{
+    d->model.setStatuses(files, statuses);
+    d->updateSummary();
 }
 
 // slot
 void VerifyChecksumsDialog::clearStatusInformation()
 {
     d->errors.clear();
-    d->updateErrors();
     d->model.clearStatusInformation();
+    d->updateErrors();
 }
 
 #include "verifychecksumsdialog.moc"
 #include "moc_verifychecksumsdialog.cpp"
-
-#endif // QT_NO_DIRMODEL
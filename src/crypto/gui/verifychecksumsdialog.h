@@ -12,8 +12,7 @@
 
 #include <QDialog>
 #include <QMetaType>
-
-#ifndef QT_NO_DIRMODEL
+#include <QVector>
 
 #include <utils/pimpl_ptr.h>
 
@@ -43,7 +42,10 @@ public:
 public Q_SLOTS:
     void setBaseDirectories(const QStringList &bases);
     void setProgress(int current, int total);
+    /*! Adds the \a files (with their \a sizes) found in the directory \a dir. */
+    void addEntries(const QString &dir, const QStringList &files, const QVector<quint64> &sizes);
     void setStatus(const QString &file, Kleo::Crypto::Gui::VerifyChecksumsDialog::Status status);
+    void setStatuses(const QStringList &files, const QVector<Kleo::Crypto::Gui::VerifyChecksumsDialog::Status> &statuses);
     void setErrors(const QStringList &errors);
     void clearStatusInformation();
 
@@ -61,6 +63,4 @@ private:
 
 Q_DECLARE_METATYPE(Kleo::Crypto::Gui::VerifyChecksumsDialog::Status)
 
-#endif // QT_NO_DIRMODEL
-
 #endif // __KLEOPATRA_CRYPTO_GUI_RESULTITEMWIDGET_H__
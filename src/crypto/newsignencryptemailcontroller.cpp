@@ -26,6 +26,7 @@
 #include <Libkleo/GnuPG>
 #include "utils/kleo_assert.h"
 
+#include <Libkleo/KeyCache>
 #include <Libkleo/Stl_Util>
 #include <Libkleo/KleoException>
 
@@ -37,9 +38,16 @@
 
 #include <KMessageBox>
 
+#include <QCache>
+#include <QCoreApplication>
 #include <QPointer>
+#include <QStringList>
+#include <QThread>
 #include <QTimer>
 
+#include <algorithm>
+#include <map>
+
 using namespace Kleo;
 using namespace Kleo::Crypto;
 using namespace Kleo::Crypto::Gui;
@@ -197,6 +205,13 @@ static bool is_de_vs_compliant(bool sign, bool encrypt, const std::vector<Sender
     return true;
 }
 
+static bool are_de_vs_compliant(const std::vector<Key> &keys)
+{
+    return std::all_of(keys.cbegin(), keys.cend(), [](const Key &key) {
+        return IS_DE_VS(key) && keyValidity(key) >= GpgME::UserID::Validity::Full;
+    });
+}
+
 //
 // END Conflict Detection
 //
@@ -221,6 +236,74 @@ static std::vector<Recipient> mailbox2recipient(const std::vector<Mailbox> &mbs)
     return recipients;
 }
 
+namespace
+{
+
+// Remembers the accepted certificate resolutions, so that a mail client that
+// sends many messages from the same sender to the same recipients doesn't
+// pay for the lookups and the conflict dialog for each of them. Everything
+// is forgotten when the key cache changes. A cache hit skips the de-vs
+// compliance check, so in de-vs mode only compliant resolutions are kept.
+class ResolutionCache
+{
+public:
+    struct Resolution {
+        Protocol protocol;
+        std::vector<Key> signers;
+        std::vector<Key> recipients;
+    };
+
+    static ResolutionCache &instance()
+    {
+        static ResolutionCache self;
+        return self;
+    }
+
+    static QString cacheKey(Protocol presetProtocol, bool sign, bool encrypt, bool deVs,
+                            const std::vector<Mailbox> &senders, const std::vector<Mailbox> &recipients)
+    {
+        return QStringLiteral("%1:%2%3%4:%5:%6").arg(int(presetProtocol)).arg(int(sign)).arg(int(encrypt)).arg(int(deVs))
+               .arg(normalized(senders), normalized(recipients));
+    }
+
+    const Resolution *find(const QString &key) const
+    {
+        return mResolutions.object(key);
+    }
+
+    void insert(const QString &key, const Resolution &resolution)
+    {
+        mResolutions.insert(key, new Resolution(resolution));
+    }
+
+private:
+    ResolutionCache()
+        : mResolutions(64)
+    {
+        const auto cache = KeyCache::instance();
+        QObject *const context = QCoreApplication::instance();
+        QObject::connect(cache.get(), &KeyCache::keysMayHaveChanged, context, [this]() { mResolutions.clear(); });
+        QObject::connect(cache.get(), &KeyCache::added, context, [this]() { mResolutions.clear(); });
+        QObject::connect(cache.get(), &KeyCache::aboutToRemove, context, [this]() { mResolutions.clear(); });
+    }
+
+    static QString normalized(const std::vector<Mailbox> &mbs)
+    {
+        QStringList addresses;
+        addresses.reserve(mbs.size());
+        for (const Mailbox &mb : mbs) {
+            addresses.push_back(QString::fromUtf8(mb.address()).toLower());
+        }
+        addresses.sort();
+        addresses.removeDuplicates();
+        return addresses.join(QLatin1Char(','));
+    }
+
+    QCache<QString, Resolution> mResolutions;
+};
+
+}
+
 class NewSignEncryptEMailController::Private
 {
     friend class ::Kleo::Crypto::NewSignEncryptEMailController;
@@ -241,6 +324,8 @@ private:
     void startEncryption();
     void schedule();
     std::shared_ptr<Task> takeRunnable(GpgME::Protocol proto);
+    int numRunning(GpgME::Protocol proto) const;
+    void reportResults();
 
 private:
     bool sign : 1;
@@ -249,9 +334,17 @@ private:
     bool certificatesResolved : 1;
     bool detached : 1;
     Protocol presetProtocol;
+    Protocol resolvedProtocol;
+    QString resolutionCacheKey;
     std::vector<Key> signers, recipients;
-    std::vector< std::shared_ptr<Task> > runnable, completed;
-    std::shared_ptr<Task> cms, openpgp;
+    std::vector< std::shared_ptr<Task> > runnable, running, completed;
+    // all tasks in the order of their inputs; results are reported in this
+    // order, no matter in which order the tasks finish
+    std::vector< std::shared_ptr<Task> > ordered;
+    std::map<const Task *, std::shared_ptr<const Task::Result> > results;
+    size_t numReported;
+    bool reporting;
+    const int maxParallelTasks;
     QPointer<SignEncryptEMailConflictDialog> dialog;
 };
 
@@ -263,11 +356,16 @@ NewSignEncryptEMailController::Private::Private(NewSignEncryptEMailController *q
       certificatesResolved(false),
       detached(false),
       presetProtocol(UnknownProtocol),
+      resolvedProtocol(UnknownProtocol),
+      resolutionCacheKey(),
       signers(),
       recipients(),
       runnable(),
-      cms(),
-      openpgp(),
+      running(),
+      numReported(0),
+      reporting(false),
+      // the parts are independent; run a few of them per protocol at a time
+      maxParallelTasks(qBound(1, QThread::idealThreadCount(), 4)),
       dialog(new SignEncryptEMailConflictDialog)
 {
     connect(dialog, SIGNAL(accepted()), q, SLOT(slotDialogAccepted()));
@@ -309,7 +407,7 @@ void NewSignEncryptEMailController::setProtocol(Protocol proto)
 
 Protocol NewSignEncryptEMailController::protocol() const
 {
-    return d->dialog->selectedProtocol();
+    return d->resolvedProtocol != UnknownProtocol ? d->resolvedProtocol : d->dialog->selectedProtocol();
 }
 
 const char *NewSignEncryptEMailController::protocolAsString() const
@@ -380,10 +478,29 @@ void NewSignEncryptEMailController::startResolveCertificates(const std::vector<M
 {
     d->certificatesResolved = false;
     d->resolvingInProgress = true;
+    d->resolvedProtocol = UnknownProtocol;
+
+    const bool quickMode = is_dialog_quick_mode(d->sign, d->encrypt);
+
+    // Users who turned off the quick mode want to see the dialog every time.
+    d->resolutionCacheKey = quickMode
+                            ? ResolutionCache::cacheKey(d->presetProtocol, d->sign, d->encrypt, Kleo::gpgComplianceP("de-vs"), s, r)
+                            : QString();
+    if (!d->resolutionCacheKey.isEmpty()) {
+        if (const auto cached = ResolutionCache::instance().find(d->resolutionCacheKey)) {
+            qCDebug(KLEOPATRA_LOG) << "Using cached certificate resolution";
+            d->resolvingInProgress = false;
+            d->certificatesResolved = true;
+            d->resolvedProtocol = cached->protocol;
+            d->signers = cached->signers;
+            d->recipients = cached->recipients;
+            QMetaObject::invokeMethod(this, "certificatesResolved", Qt::QueuedConnection);
+            return;
+        }
+    }
 
     const std::vector<Sender> senders = mailbox2sender(s);
     const std::vector<Recipient> recipients = mailbox2recipient(r);
-    const bool quickMode = is_dialog_quick_mode(d->sign, d->encrypt);
 
     const bool conflict = quickMode && has_conflict(d->sign, d->encrypt, senders, recipients, d->presetProtocol);
 
@@ -415,6 +532,11 @@ void NewSignEncryptEMailController::Private::slotDialogAccepted()
     certificatesResolved = true;
     signers = dialog->resolvedSigningKeys();
     recipients = dialog->resolvedEncryptionKeys();
+    resolvedProtocol = dialog->selectedProtocol();
+    if (!resolutionCacheKey.isEmpty() && dialog->isQuickMode()
+        && (!Kleo::gpgComplianceP("de-vs") || (are_de_vs_compliant(signers) && are_de_vs_compliant(recipients)))) {
+        ResolutionCache::instance().insert(resolutionCacheKey, {resolvedProtocol, signers, recipients});
+    }
     QMetaObject::invokeMethod(q, "certificatesResolved", Qt::QueuedConnection);
 }
 
@@ -454,6 +576,7 @@ void NewSignEncryptEMailController::startEncryption(const std::vector< std::shar
 
     // append to runnable stack
     d->runnable.insert(d->runnable.end(), tasks.begin(), tasks.end());
+    d->ordered.insert(d->ordered.end(), tasks.begin(), tasks.end());
 
     d->startEncryption();
 }
@@ -505,6 +628,7 @@ void NewSignEncryptEMailController::startSigning(const std::vector< std::shared_
 
     // append to runnable stack
     d->runnable.insert(d->runnable.end(), tasks.begin(), tasks.end());
+    d->ordered.insert(d->ordered.end(), tasks.begin(), tasks.end());
 
     d->startSigning();
 }
@@ -530,25 +654,65 @@ void NewSignEncryptEMailController::Private::startSigning()
 void NewSignEncryptEMailController::Private::schedule()
 {
 
-    if (!cms)
-        if (const std::shared_ptr<Task> t = takeRunnable(CMS)) {
-            t->start();
-            cms = t;
-        }
-
-    if (!openpgp)
-        if (const std::shared_ptr<Task> t = takeRunnable(OpenPGP)) {
+    for (const Protocol proto : { CMS, OpenPGP }) {
+        while (numRunning(proto) < maxParallelTasks) {
+            const std::shared_ptr<Task> t = takeRunnable(proto);
+            if (!t) {
+                break;
+            }
+            running.push_back(t);
             t->start();
-            openpgp = t;
         }
+    }
 
-    if (cms || openpgp) {
+    // done() must not overtake the report of an earlier part
+    if (!running.empty() || reporting || numReported < ordered.size()) {
         return;
     }
     kleo_assert(runnable.empty());
     q->emitDoneOrError();
 }
 
+int NewSignEncryptEMailController::Private::numRunning(GpgME::Protocol proto) const
+{
+    return std::count_if(running.cbegin(), running.cend(),
+                         [proto](const std::shared_ptr<Task> &task) { return task->protocol() == proto; });
+}
+
+void NewSignEncryptEMailController::Private::reportResults()
+{
+    if (reporting) {
+        // a result came in while an error was shown; the outer call reports it
+        return;
+    }
+    reporting = true;
+    QPointer<NewSignEncryptEMailController> that = q;
+    while (numReported < ordered.size()) {
+        const auto it = results.find(ordered[numReported].get());
+        if (it == results.end()) {
+            break;
+        }
+        const std::shared_ptr<const Task::Result> result = it->second;
+        results.erase(it);
+        ++numReported;
+        if (result && result->hasError()) {
+            if (result->details().isEmpty())
+                KMessageBox::        sorry(nullptr,
+                                           result->overview(),
+                                           i18nc("@title:window", "Error"));
+            else
+                KMessageBox::detailedSorry(nullptr,
+                                           result->overview(),
+                                           result->details(),
+                                           i18nc("@title:window", "Error"));
+            if (!that) {
+                return;
+            }
+        }
+    }
+    reporting = false;
+}
+
 std::shared_ptr<Task> NewSignEncryptEMailController::Private::takeRunnable(GpgME::Protocol proto)
 {
     const auto it = std::find_if(runnable.begin(), runnable.end(),
@@ -566,33 +730,23 @@ void NewSignEncryptEMailController::doTaskDone(const Task *task, const std::shar
 {
     Q_ASSERT(task);
 
-    if (result && result->hasError()) {
-        QPointer<QObject> that = this;
-        if (result->details().isEmpty())
-            KMessageBox::        sorry(nullptr,
-                                       result->overview(),
-                                       i18nc("@title:window", "Error"));
-        else
-            KMessageBox::detailedSorry(nullptr,
-                                       result->overview(),
-                                       result->details(),
-                                       i18nc("@title:window", "Error"));
-        if (!that) {
-            return;
-        }
-    }
-
     // We could just delete the tasks here, but we can't use
     // Qt::QueuedConnection here (we need sender()) and other slots
     // might not yet have executed. Therefore, we push completed tasks
     // into a burial container
 
-    if (task == d->cms.get()) {
-        d->completed.push_back(d->cms);
-        d->cms.reset();
-    } else if (task == d->openpgp.get()) {
-        d->completed.push_back(d->openpgp);
-        d->openpgp.reset();
+    const auto it = std::find_if(d->running.begin(), d->running.end(),
+                                 [task](const std::shared_ptr<Task> &t) { return t.get() == task; });
+    if (it != d->running.end()) {
+        d->completed.push_back(*it);
+        d->running.erase(it);
+    }
+    d->results[task] = result;
+
+    QPointer<QObject> that = this;
+    d->reportResults();
+    if (!that) {
+        return;
     }
 
     QTimer::singleShot(0, this, SLOT(schedule()));
@@ -613,14 +767,16 @@ void NewSignEncryptEMailController::Private::cancelAllTasks()
 
     // we just kill all runnable tasks - this will not result in
     // signal emissions.
+    const auto notStarted = [this](const std::shared_ptr<Task> &task) {
+        return std::find(runnable.cbegin(), runnable.cend(), task) != runnable.cend();
+    };
+    ordered.erase(std::remove_if(ordered.begin() + numReported, ordered.end(), notStarted), ordered.end());
     runnable.clear();
 
     // a cancel() will result in a call to
-    if (cms) {
-        cms->cancel();
-    }
-    if (openpgp) {
-        openpgp->cancel();
+    const auto tasks = running;
+    for (const std::shared_ptr<Task> &task : tasks) {
+        task->cancel();
     }
 }
 
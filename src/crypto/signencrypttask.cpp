@@ -458,6 +458,11 @@ void SignEncryptTask::doStart()
     if (!d->output) {
         d->output = Output::createFromFile(d->outputFileName, d->m_overwritePolicy);
     }
+    d->output->setDurability(Output::configuredDurability());
+    if (!d->detached) {
+        // signed or encrypted data is at least about as large as the input
+        d->output->setExpectedSize(d->input->size());
+    }
 
     if (d->encrypt || d->symmetric) {
         Context::EncryptionFlags flags = Context::AlwaysTrust;
@@ -11,10 +11,10 @@
 
 #include "verifychecksumscontroller.h"
 
-#ifndef QT_NO_DIRMODEL
-
+#include <crypto/checksumfilepatterns.h>
 #include <crypto/gui/verifychecksumsdialog.h>
 
+#include <utils/directoryscanner.h>
 #include <utils/input.h>
 #include <utils/output.h>
 #include <utils/kleo_assert.h>
@@ -36,7 +36,10 @@
 
 #include <gpg-error.h>
 
-#include <deque>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QVector>
+
 #include <limits>
 #include <set>
 
@@ -81,39 +84,6 @@ static QStringList fs_intersect(QStringList l1, QStringList l2)
 }
 #endif
 
-static QList<QRegExp> get_patterns(const std::vector< std::shared_ptr<ChecksumDefinition> > &checksumDefinitions)
-{
-    QList<QRegExp> result;
-    for (const std::shared_ptr<ChecksumDefinition> &cd : checksumDefinitions)
-        if (cd)
-            Q_FOREACH (const QString &pattern, cd->patterns()) {
-                result.push_back(QRegExp(pattern, fs_cs));
-            }
-    return result;
-}
-
-namespace
-{
-struct matches_any : std::unary_function<QString, bool> {
-    const QList<QRegExp> m_regexps;
-    explicit matches_any(const QList<QRegExp> &regexps) : m_regexps(regexps) {}
-    bool operator()(const QString &s) const
-    {
-        return std::any_of(m_regexps.cbegin(), m_regexps.cend(),
-                           [&s](const QRegExp &rx) { return rx.exactMatch(s); });
-    }
-};
-struct matches_none_of : std::unary_function<QString, bool> {
-    const QList<QRegExp> m_regexps;
-    explicit matches_none_of(const QList<QRegExp> &regexps) : m_regexps(regexps) {}
-    bool operator()(const QString &s) const
-    {
-        return std::none_of(m_regexps.cbegin(), m_regexps.cend(),
-                            [&s](const QRegExp &rx) { return rx.exactMatch(s); });
-    }
-};
-}
-
 class VerifyChecksumsController::Private : public QThread
 {
     Q_OBJECT
@@ -126,7 +96,8 @@ public:
 Q_SIGNALS:
     void baseDirectories(const QStringList &);
     void progress(int, int, const QString &);
-    void status(const QString &file, Kleo::Crypto::Gui::VerifyChecksumsDialog::Status);
+    void entries(const QString &dir, const QStringList &files, const QVector<quint64> &sizes);
+    void statuses(const QStringList &files, const QVector<Kleo::Crypto::Gui::VerifyChecksumsDialog::Status> &statuses);
 
 private:
     void slotOperationFinished()
@@ -215,8 +186,10 @@ void VerifyChecksumsController::start()
                 d->dialog.data(), &VerifyChecksumsDialog::setBaseDirectories);
         connect(d.get(), &Private::progress,
                 d->dialog.data(), &VerifyChecksumsDialog::setProgress);
-        connect(d.get(), &Private::status,
-                d->dialog.data(), &VerifyChecksumsDialog::setStatus);
+        connect(d.get(), &Private::entries,
+                d->dialog.data(), &VerifyChecksumsDialog::addEntries);
+        connect(d.get(), &Private::statuses,
+                d->dialog.data(), &VerifyChecksumsDialog::setStatuses);
 
         d->canceled = false;
         d->errors.clear();
@@ -247,11 +220,14 @@ struct SumFile {
 
 }
 
-static QStringList filter_checksum_files(QStringList l, const QList<QRegExp> &rxs)
+static QStringList filter_checksum_files(const std::vector<DirectoryScanner::File> &files, const ChecksumFilePatterns &patterns)
 {
-    l.erase(std::remove_if(l.begin(), l.end(),
-                           matches_none_of(rxs)),
-            l.end());
+    QStringList l;
+    for (const DirectoryScanner::File &file : files) {
+        if (patterns(file.name)) {
+            l.push_back(file.name);
+        }
+    }
     return l;
 }
 
@@ -313,27 +289,18 @@ static std::vector<File> parse_sum_file(const QString &fileName)
     return files;
 }
 
-static quint64 aggregate_size(const QDir &dir, const QStringList &files)
+// sizes are taken from \a knownSizes (fileSystemKey(file name) -> size), if
+// the directory has been scanned; only other files are stat'ed
+static quint64 aggregate_size(const QDir &dir, const QStringList &files, const QHash<QString, quint64> &knownSizes)
 {
     quint64 n = 0;
     for (const QString &file : files) {
-        n += QFileInfo(dir.absoluteFilePath(file)).size();
+        const auto it = knownSizes.constFind(fileSystemKey(file));
+        n += it != knownSizes.cend() ? *it : QFileInfo(dir.absoluteFilePath(file)).size();
     }
     return n;
 }
 
-static std::shared_ptr<ChecksumDefinition> filename2definition(const QString &fileName,
-        const std::vector< std::shared_ptr<ChecksumDefinition> > &checksumDefinitions)
-{
-    for (const std::shared_ptr<ChecksumDefinition> &cd : checksumDefinitions)
-        if (cd)
-            Q_FOREACH (const QString &pattern, cd->patterns())
-                if (QRegExp(pattern, fs_cs).exactMatch(fileName)) {
-                    return cd;
-                }
-    return std::shared_ptr<ChecksumDefinition>();
-}
-
 namespace
 {
 struct less_dir : std::binary_function<QDir, QDir, bool> {
@@ -419,49 +386,60 @@ static QStringList find_base_directories(const QStringList &files)
     return rv;
 }
 
+namespace
+{
+struct SumDir {
+    QDir dir;
+    std::set<QString, less_file> sums;
+    QHash<QString, quint64> sizes; // of the files in dir, if it was scanned
+};
+}
+
+// Directories given in \a files are scanned with a DirectoryScanner, so
+// \a progress, \a canceled and \a scannedDirectory are also called from the
+// scanner threads (never concurrently). They must not touch GUI objects;
+// emitting a signal (which is queued to the receiver's thread) or reading
+// a flag is fine.
 static std::vector<SumFile> find_sums_by_input_files(const QStringList &files, QStringList &errors,
         const std::function<void(int)> &progress,
-        const std::vector< std::shared_ptr<ChecksumDefinition> > &checksumDefinitions)
+        const std::vector< std::shared_ptr<ChecksumDefinition> > &checksumDefinitions,
+        const std::function<bool()> &canceled,
+        const std::function<void(const DirectoryScanner::Directory &)> &scannedDirectory)
 {
-    const QList<QRegExp> patterns = get_patterns(checksumDefinitions);
-
-    const matches_any is_sum_file(patterns);
-
-    std::map<QDir, std::set<QString, less_file>, less_dir> dirs2sums;
-
-    // Step 1: find the sumfiles we need to check:
+    const ChecksumFilePatterns is_sum_file(checksumDefinitions);
+
+    std::vector<SumDir> dirs;
+    QHash<QString, size_t> dirIndexes; // fileSystemKey(absolute path) -> index into dirs
+    const auto dirFor = [&dirs, &dirIndexes](const QString &path) -> SumDir & {
+        const QString key = fileSystemKey(path);
+        const auto it = dirIndexes.constFind(key);
+        if (it != dirIndexes.cend()) {
+            return dirs[*it];
+        }
+        dirIndexes.insert(key, dirs.size());
+        dirs.push_back({QDir(path), {}, {}});
+        return dirs.back();
+    };
 
-    std::deque<QString> inputs(files.begin(), files.end());
+    // Step 1: find the sumfiles we need to check. Directories are scanned
+    // (recursively and in parallel) afterwards:
 
+    QStringList roots;
     int i = 0;
-    while (!inputs.empty()) {
-        const QString file = inputs.front();
+    for (const QString &file : files) {
         qCDebug(KLEOPATRA_LOG) << "find_sums_by_input_files: considering " << qPrintable(file);
-        inputs.pop_front();
         const QFileInfo fi(file);
         const QString fileName = fi.fileName();
         if (fi.isDir()) {
             qCDebug(KLEOPATRA_LOG) << "find_sums_by_input_files:   it's a directory";
-            QDir dir(file);
-            const QStringList sumfiles = filter_checksum_files(dir.entryList(QDir::Files), patterns);
-            qCDebug(KLEOPATRA_LOG) << "find_sums_by_input_files:   found " << sumfiles.size()
-                                   << " sum files: " << qPrintable(sumfiles.join(QLatin1String(", ")));
-            dirs2sums[ dir ].insert(sumfiles.begin(), sumfiles.end());
-            const QStringList dirs = dir.entryList(QDir::Dirs | QDir::NoDotAndDotDot);
-            qCDebug(KLEOPATRA_LOG) << "find_sums_by_input_files:   found " << dirs.size()
-                                   << " subdirs, prepending";
-            std::transform(dirs.cbegin(), dirs.cend(),
-                           std::inserter(inputs, inputs.begin()),
-                           [&dir](const QString &path) {
-                               return dir.absoluteFilePath(path);
-                           });
+            roots.push_back(file);
         } else if (is_sum_file(fileName)) {
             qCDebug(KLEOPATRA_LOG) << "find_sums_by_input_files:   it's a sum file";
-            dirs2sums[fi.dir()].insert(fileName);
+            dirFor(QDir::cleanPath(fi.absolutePath())).sums.insert(fileName);
         } else {
             qCDebug(KLEOPATRA_LOG) << "find_sums_by_input_files:   it's something else; checking whether we'll find a sumfile for it...";
             const QDir dir = fi.dir();
-            const QStringList sumfiles = filter_checksum_files(dir.entryList(QDir::Files), patterns);
+            const QStringList sumfiles = filter_checksum_files(DirectoryScanner::readDirectory(dir.absolutePath()).files, is_sum_file);
             qCDebug(KLEOPATRA_LOG) << "find_sums_by_input_files:   found " << sumfiles.size()
                                    << " potential sumfiles: " << qPrintable(sumfiles.join(QLatin1String(", ")));
             const auto it = std::find_if(sumfiles.cbegin(), sumfiles.cend(),
@@ -469,7 +447,7 @@ static std::vector<SumFile> find_sums_by_input_files(const QStringList &files, Q
             if (it == sumfiles.end()) {
                 errors.push_back(i18n("Cannot find checksums file for file %1", file));
             } else {
-                dirs2sums[dir].insert(*it);
+                dirFor(QDir::cleanPath(fi.absolutePath())).sums.insert(*it);
             }
         }
         if (progress) {
@@ -477,31 +455,65 @@ static std::vector<SumFile> find_sums_by_input_files(const QStringList &files, Q
         }
     }
 
-    // Step 2: convert into vector<SumFile>:
-
-    std::vector<SumFile> sumfiles;
-    sumfiles.reserve(dirs2sums.size());
+    DirectoryScanner scanner;
+    scanner.scan(roots, [&](DirectoryScanner::Directory &&scanned) {
+        if (canceled && canceled()) {
+            scanner.cancel();
+            return;
+        }
+        const QStringList sumfiles = filter_checksum_files(scanned.files, is_sum_file);
+        qCDebug(KLEOPATRA_LOG) << "find_sums_by_input_files:   found " << sumfiles.size()
+                               << " sum files in " << qPrintable(scanned.path) << ": " << qPrintable(sumfiles.join(QLatin1String(", ")));
+        if (scannedDirectory) {
+            scannedDirectory(scanned);
+        }
+        SumDir &dir = dirFor(scanned.path);
+        dir.sums.insert(sumfiles.begin(), sumfiles.end());
+        if (!sumfiles.empty()) {
+            // only needed for the sum files in this directory
+            dir.sizes.reserve(scanned.files.size());
+            for (const DirectoryScanner::File &f : scanned.files) {
+                dir.sizes.insert(fileSystemKey(f.name), f.size);
+            }
+        }
+        if (progress) {
+            progress(++i);
+        }
+    });
 
-    for (std::map<QDir, std::set<QString, less_file>, less_dir>::const_iterator it = dirs2sums.begin(), end = dirs2sums.end(); it != end; ++it) {
+    // Step 2: convert into vector<SumFile>, sorted by directory:
 
-        if (it->second.empty()) {
-            continue;
+    std::vector<std::pair<QString, size_t>> order;
+    order.reserve(dirs.size());
+    for (size_t idx = 0; idx < dirs.size(); ++idx) {
+        if (!dirs[idx].sums.empty()) {
+            order.emplace_back(dirs[idx].dir.absolutePath(), idx);
         }
+    }
+    std::sort(order.begin(), order.end(),
+              [](const std::pair<QString, size_t> &lhs, const std::pair<QString, size_t> &rhs) {
+                  return QString::compare(lhs.first, rhs.first, fs_cs) < 0;
+              });
+
+    std::vector<SumFile> sumfiles;
+    sumfiles.reserve(order.size());
 
-        const QDir &dir = it->first;
+    for (const auto &entry : order) {
 
-        Q_FOREACH (const QString &sumFileName, it->second) {
+        const SumDir &dir = dirs[entry.second];
 
-            const std::vector<File> summedfiles = parse_sum_file(dir.absoluteFilePath(sumFileName));
+        for (const QString &sumFileName : dir.sums) {
+
+            const std::vector<File> summedfiles = parse_sum_file(dir.dir.absoluteFilePath(sumFileName));
             QStringList files;
             files.reserve(summedfiles.size());
             std::transform(summedfiles.cbegin(), summedfiles.cend(),
                            std::back_inserter(files), std::mem_fn(&File::name));
             const SumFile sumFile = {
-                it->first,
+                dir.dir,
                 sumFileName,
-                aggregate_size(it->first, files),
-                filename2definition(sumFileName, checksumDefinitions),
+                aggregate_size(dir.dir, files, dir.sizes),
+                is_sum_file.definition(sumFileName),
             };
             sumfiles.push_back(sumFile);
 
@@ -545,6 +557,52 @@ static VerifyChecksumsDialog::Status string2status(const QByteArray &str)
     return VerifyChecksumsDialog::Unknown;
 }
 
+namespace
+{
+// Collects the results of the verification, so that the dialog receives
+// them in batches instead of with one queued signal per file.
+class StatusBatch
+{
+public:
+    typedef std::function<void(const QStringList &, const QVector<VerifyChecksumsDialog::Status> &)> Sink;
+
+    explicit StatusBatch(const Sink &sink)
+        : m_sink(sink)
+    {
+        m_timer.start();
+    }
+
+    void add(const QString &file, VerifyChecksumsDialog::Status status)
+    {
+        m_files.push_back(file);
+        m_statuses.push_back(status);
+        if (m_files.size() >= MaximumBatchSize || m_timer.hasExpired(MaximumDelay)) {
+            flush();
+        }
+    }
+
+    void flush()
+    {
+        if (!m_files.empty()) {
+            m_sink(m_files, m_statuses);
+            m_files.clear();
+            m_statuses.clear();
+        }
+        m_timer.restart();
+    }
+
+private:
+    enum {
+        MaximumBatchSize = 256,
+        MaximumDelay = 100 // ms
+    };
+    Sink m_sink;
+    QStringList m_files;
+    QVector<VerifyChecksumsDialog::Status> m_statuses;
+    QElapsedTimer m_timer;
+};
+}
+
 static QString process(const SumFile &sumFile, bool *fatal, const QStringList &env,
                        const std::function<void(const QString &, VerifyChecksumsDialog::Status)> &status)
 {
@@ -624,10 +682,30 @@ void VerifyChecksumsController::Private::run()
     const QString scanning = i18n("Scanning directories...");
     Q_EMIT progress(0, 0, scanning);
 
+    // these callbacks are called from the scanner threads, too (see
+    // find_sums_by_input_files()), so they only emit signals
     const auto progressCb = [this, scanning](int arg) { Q_EMIT progress(arg, 0, scanning); };
-    const auto statusCb = [this](const QString &str, VerifyChecksumsDialog::Status st) { Q_EMIT status(str, st); };
+    StatusBatch batch([this](const QStringList &files, const QVector<VerifyChecksumsDialog::Status> &st) {
+        Q_EMIT statuses(files, st);
+    });
+    const auto statusCb = [&batch](const QString &str, VerifyChecksumsDialog::Status st) { batch.add(str, st); };
+    // the dialog shows the files found while scanning, so it never has to
+    // look at the file system itself
+    const auto scannedCb = [this](const DirectoryScanner::Directory &dir) {
+        QStringList names;
+        QVector<quint64> sizes;
+        names.reserve(dir.files.size());
+        sizes.reserve(dir.files.size());
+        for (const DirectoryScanner::File &f : dir.files) {
+            names.push_back(f.name);
+            sizes.push_back(f.size);
+        }
+        Q_EMIT entries(dir.path, names, sizes);
+    };
 
-    const std::vector<SumFile> sumfiles = find_sums_by_input_files(files, errors, progressCb, checksumDefinitions);
+    const auto canceledCb = [this]() { return canceled; };
+
+    const std::vector<SumFile> sumfiles = find_sums_by_input_files(files, errors, progressCb, checksumDefinitions, canceledCb, scannedCb);
 
     for (const SumFile &sumfile : sumfiles) {
         qCDebug(KLEOPATRA_LOG) << sumfile;
@@ -658,6 +736,7 @@ void VerifyChecksumsController::Private::run()
                                 i18n("Verifying checksums (%2) in %1", sumFile.checksumDefinition->label(), sumFile.dir.path()));
                 bool fatal = false;
                 const QString error = process(sumFile, &fatal, env, statusCb);
+                batch.flush();
                 if (!error.isEmpty()) {
                     errors.push_back(error);
                 }
@@ -681,5 +760,3 @@ void VerifyChecksumsController::Private::run()
 
 #include "moc_verifychecksumscontroller.cpp"
 #include "verifychecksumscontroller.moc"
-
-#endif // QT_NO_DIRMODEL
@@ -12,8 +12,6 @@
 
 #include <crypto/controller.h>
 
-#ifndef QT_NO_DIRMODEL
-
 #include <utils/pimpl_ptr.h>
 
 #include <gpgme++/global.h>
@@ -51,7 +49,5 @@ private:
 }
 }
 
-#endif // QT_NO_DIRMODEL
-
 #endif /* __KLEOPATRA_UISERVER_VERIFYCHECKSUMSCONTROLLER_H__ */
 
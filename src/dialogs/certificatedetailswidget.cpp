@@ -20,6 +20,7 @@
 #include "commands/genrevokecommand.h"
 #include "commands/detailscommand.h"
 #include "commands/dumpcertificatecommand.h"
+#include "utils/issuerchains.h"
 #include "utils/remarks.h"
 
 #include <Libkleo/Formatting>
@@ -501,12 +502,12 @@ void CertificateDetailsWidget::Private::setupSMIMEProperties()
 void CertificateDetailsWidget::Private::smimeLinkActivated(const QString &link)
 {
     if (link == QLatin1String("#issuerDetails")) {
-        const auto parentKey = KeyCache::instance()->findIssuers(key, KeyCache::NoOption);
+        const auto parentKey = IssuerChains::issuer(key);
 
-        if (!parentKey.size()) {
+        if (parentKey.isNull()) {
             return;
         }
-        auto cmd = new Kleo::Commands::DetailsCommand(parentKey[0], nullptr);
+        auto cmd = new Kleo::Commands::DetailsCommand(parentKey, nullptr);
         cmd->setParentWidget(q);
         cmd->start();
         return;
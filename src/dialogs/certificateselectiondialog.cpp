@@ -11,6 +11,7 @@
 
 #include "certificateselectiondialog.h"
 
+#include <view/keylistmodelpool.h>
 #include <view/searchbar.h>
 #include <view/tabwidget.h>
 
@@ -43,6 +44,46 @@ using namespace Kleo::Dialogs;
 using namespace Kleo::Commands;
 using namespace GpgME;
 
+namespace
+{
+
+bool isAllowed(const Key &key, int options)
+{
+    switch (options & CertificateSelectionDialog::AnyFormat) {
+    case CertificateSelectionDialog::OpenPGPFormat:
+        if (key.protocol() != OpenPGP) {
+            return false;
+        }
+        break;
+    case CertificateSelectionDialog::CMSFormat:
+        if (key.protocol() != CMS) {
+            return false;
+        }
+        break;
+    default:
+        break;
+    }
+
+    switch (options & CertificateSelectionDialog::AnyCertificate) {
+    case CertificateSelectionDialog::SignOnly:
+        if (!key.canReallySign()) {
+            return false;
+        }
+        break;
+    case CertificateSelectionDialog::EncryptOnly:
+        if (!key.canEncrypt()) {
+            return false;
+        }
+        break;
+    default:
+        break;
+    }
+
+    return !(options & CertificateSelectionDialog::SecretKeys) || key.hasSecret();
+}
+
+}
+
 class CertificateSelectionDialog::Private
 {
     friend class ::Kleo::Dialogs::CertificateSelectionDialog;
@@ -73,6 +114,7 @@ private:
         cmd->start();
     }
     void slotKeysMayHaveChanged();
+    void updateModels();
     void slotCurrentViewChanged(QAbstractItemView *newView);
     void slotSelectionChanged();
     void slotDoubleClicked(const QModelIndex &idx);
@@ -94,6 +136,10 @@ private:
     QPointer<QAbstractItemView> lastView;
     QString customLabelText;
     Options options;
+    // shared with other dialogs; must outlive the views in ui
+    std::shared_ptr<AbstractKeyListModel> flatModel;
+    std::shared_ptr<AbstractKeyListModel> hierarchicalModel;
+    std::vector<Key> selectionBeforeReset;
 
     struct UI {
         QLabel label;
@@ -160,8 +206,7 @@ CertificateSelectionDialog::Private::Private(CertificateSelectionDialog *qq)
     : q(qq),
       ui(q)
 {
-    ui.tabWidget.setFlatModel(AbstractKeyListModel::createFlatKeyListModel(q));
-    ui.tabWidget.setHierarchicalModel(AbstractKeyListModel::createHierarchicalKeyListModel(q));
+    updateModels();
     ui.tabWidget.connectSearchBar(&ui.searchBar);
 
     connect(&ui.tabWidget, SIGNAL(currentViewChanged(QAbstractItemView*)),
@@ -178,7 +223,6 @@ CertificateSelectionDialog::CertificateSelectionDialog(QWidget *parent)
     d->ui.tabWidget.loadViews(config.data());
     const KConfigGroup geometry(config, "Geometry");
     resize(geometry.readEntry("size", size()));
-    d->slotKeysMayHaveChanged();
 }
 
 CertificateSelectionDialog::~CertificateSelectionDialog() {}
@@ -206,7 +250,7 @@ void CertificateSelectionDialog::setOptions(Options options)
 
     d->ui.tabWidget.setMultiSelection(options & MultiSelection);
 
-    d->slotKeysMayHaveChanged();
+    d->updateModels();
 }
 
 CertificateSelectionDialog::Options CertificateSelectionDialog::options() const
@@ -276,52 +320,48 @@ void CertificateSelectionDialog::hideEvent(QHideEvent *e)
 
 void CertificateSelectionDialog::Private::slotKeysMayHaveChanged()
 {
+    // the shared models follow the key cache themselves
     q->setEnabled(true);
-    std::vector<Key> keys = (options & SecretKeys) ? KeyCache::instance()->secretKeys() : KeyCache::instance()->keys();
-    q->filterAllowedKeys(keys, options);
-    const std::vector<Key> selected = q->selectedCertificates();
-    if (AbstractKeyListModel *const model = ui.tabWidget.flatModel()) {
-        model->setKeys(keys);
-    }
-    if (AbstractKeyListModel *const model = ui.tabWidget.hierarchicalModel()) {
-        model->setKeys(keys);
-    }
-    q->selectCertificates(selected);
 }
 
-void CertificateSelectionDialog::filterAllowedKeys(std::vector<Key> &keys, int options)
+void CertificateSelectionDialog::Private::updateModels()
 {
-    std::vector<Key>::iterator end = keys.end();
-
-    switch (options & AnyFormat) {
-    case OpenPGPFormat:
-        end = std::remove_if(keys.begin(), end, [](const Key &key) { return key.protocol() != OpenPGP; });
-        break;
-    case CMSFormat:
-        end = std::remove_if(keys.begin(), end, [](const Key &key) { return key.protocol() != CMS; });
-        break;
-    default:
-    case AnyFormat:
-        ;
+    const int filterOptions = options & (AnyFormat | AnyCertificate | SecretKeys);
+    const QString id = QStringLiteral("CertificateSelectionDialog-%1").arg(filterOptions);
+    const auto filter = [filterOptions](const Key &key) { return isAllowed(key, filterOptions); };
+    auto newFlatModel = KeyListModelPool::model(KeyListModelPool::Flat, id, filter);
+    auto newHierarchicalModel = KeyListModelPool::model(KeyListModelPool::Hierarchical, id, filter);
+    if (newFlatModel == flatModel && newHierarchicalModel == hierarchicalModel) {
+        return;
     }
 
-    switch (options & AnyCertificate) {
-    case SignOnly:
-        end = std::remove_if(keys.begin(), end, [](const Key &key) { return !key.canReallySign(); });
-        break;
-    case EncryptOnly:
-        end = std::remove_if(keys.begin(), end, [](const Key &key) { return !key.canEncrypt(); });
-        break;
-    default:
-    case AnyCertificate:
-        ;
+    const std::vector<Key> selected = q->selectedCertificates();
+    for (const auto &model : { flatModel, hierarchicalModel }) {
+        if (model) {
+            QObject::disconnect(model.get(), nullptr, q, nullptr);
+        }
     }
-
-    if (options & SecretKeys) {
-        end = std::remove_if(keys.begin(), end, [](const Key &key) { return !key.hasSecret(); });
+    ui.tabWidget.setFlatModel(newFlatModel.get());
+    ui.tabWidget.setHierarchicalModel(newHierarchicalModel.get());
+    flatModel = std::move(newFlatModel);
+    hierarchicalModel = std::move(newHierarchicalModel);
+
+    // keep the selection when the key cache is reloaded
+    for (const auto &model : { flatModel, hierarchicalModel }) {
+        connect(model.get(), &QAbstractItemModel::modelAboutToBeReset, q, [this]() {
+            selectionBeforeReset = q->selectedCertificates();
+        });
+        connect(model.get(), &QAbstractItemModel::modelReset, q, [this]() {
+            q->selectCertificates(selectionBeforeReset);
+        });
     }
+    q->selectCertificates(selected);
+}
 
-    keys.erase(end, keys.end());
+void CertificateSelectionDialog::filterAllowedKeys(std::vector<Key> &keys, int options)
+{
+    keys.erase(std::remove_if(keys.begin(), keys.end(), [options](const Key &key) { return !isAllowed(key, options); }),
+               keys.end());
 }
 
 void CertificateSelectionDialog::Private::slotCurrentViewChanged(QAbstractItemView *newView)
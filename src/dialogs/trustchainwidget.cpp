@@ -7,6 +7,7 @@
 #include "ui_trustchainwidget.h"
 
 #include "kleopatra_debug.h"
+#include "utils/issuerchains.h"
 
 #include <QTreeWidgetItem>
 #include <QTreeWidget>
@@ -16,7 +17,6 @@
 #include <gpgme++/key.h>
 
 #include <Libkleo/Dn>
-#include <Libkleo/KeyCache>
 
 class TrustChainWidget::Private
 {
@@ -52,8 +52,7 @@ void TrustChainWidget::setKey(const GpgME::Key &key)
 
     d->key = key;
     d->ui.treeWidget->clear();
-    const auto chain = Kleo::KeyCache::instance()->findIssuers(key,
-                            Kleo::KeyCache::RecursiveSearch | Kleo::KeyCache::IncludeSubject);
+    const auto chain = Kleo::IssuerChains::chain(key);
     if (chain.empty()) {
         return;
     }
@@ -10,6 +10,8 @@
 
 #include <Libkleo/GnuPG>
 
+#include "utils/cryptoconfigcache.h"
+
 #include "kleopatra_debug.h"
 
 #include <QIcon>
@@ -43,7 +45,10 @@ namespace
 {
 static void gpgconf_set_update_check(bool value)
 {
-    auto conf = QGpgME::cryptoConfig();
+    auto conf = CryptoConfigCache::instance()->config();
+    if (!conf) {
+        return;
+    }
     auto entry = conf->entry(QStringLiteral("dirmngr"),
                              QStringLiteral("Enforcement"),
                              QStringLiteral("allow-version-check"));
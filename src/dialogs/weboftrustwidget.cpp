@@ -12,6 +12,8 @@
 #include "commands/certifycertificatecommand.h"
 #include "commands/revokecertificationcommand.h"
 
+#include <QCoreApplication>
+#include <QHash>
 #include <QHeaderView>
 #include <QVBoxLayout>
 #include <QTreeView>
@@ -34,8 +36,67 @@
 
 #include <QMenu>
 
+#include <algorithm>
+
 using namespace Kleo;
 
+namespace
+{
+
+// Keys with signatures listed during this session, so that reopening the
+// certifications of a heavily certified key doesn't run gpg again. The cache
+// is cleared whenever the key cache reports changes of the keyring.
+class SignatureCache
+{
+public:
+    static SignatureCache &instance()
+    {
+        static SignatureCache self;
+        return self;
+    }
+
+    // The listed key is only valid for the key object it was listed for.
+    // The key cache replaces the key objects of all keys it refreshes,
+    // while the last update time gpgme reports is often 0.
+    GpgME::Key find(const GpgME::Key &key) const
+    {
+        const auto it = mKeys.constFind(QByteArray(key.primaryFingerprint()));
+        if (it == mKeys.cend()) {
+            return GpgME::Key();
+        }
+        if (key.impl() != it->source.impl() && key.impl() != it->listed.impl()) {
+            return GpgME::Key();
+        }
+        return it->listed;
+    }
+
+    void insert(const GpgME::Key &source, const GpgME::Key &listed)
+    {
+        mKeys.insert(QByteArray(listed.primaryFingerprint()), {source, listed});
+    }
+
+    void remove(const GpgME::Key &key)
+    {
+        mKeys.remove(QByteArray(key.primaryFingerprint()));
+    }
+
+private:
+    SignatureCache()
+    {
+        QObject::connect(KeyCache::instance().get(), &KeyCache::keysMayHaveChanged,
+                         QCoreApplication::instance(), [this]() { mKeys.clear(); });
+    }
+
+    struct Entry {
+        // holding the source key makes sure its object is not reused
+        GpgME::Key source;
+        GpgME::Key listed;
+    };
+    QHash<QByteArray, Entry> mKeys;
+};
+
+}
+
 class WebOfTrustWidget::Private
 {
     friend class ::Kleo::WebOfTrustWidget;
@@ -46,6 +107,8 @@ private:
     UserIDListModel certificationsModel;
     QGpgME::KeyListJob *keyListJob = nullptr;
     QTreeView *certificationsTV = nullptr;
+    // the certification keys of the listed signatures by key ID
+    QHash<QByteArray, GpgME::Key> signers;
 
 public:
     Private(WebOfTrustWidget *qq)
@@ -57,6 +120,7 @@ public:
         certificationsTV->setModel(&certificationsModel);
         certificationsTV->setAllColumnsShowFocus(true);
         certificationsTV->setSelectionMode(QAbstractItemView::ExtendedSelection);
+        certificationsTV->setUniformRowHeights(true);
 
         auto vLay = new QVBoxLayout(q);
         vLay->setContentsMargins(0, 0, 0, 0);
@@ -105,7 +169,7 @@ public:
                     q, [this]() {
                 certificationsTV->setEnabled(true);
                 // Trigger an update when done
-                q->setKey(key);
+                reload();
             });
             cmd->start();
         });
@@ -120,7 +184,7 @@ public:
                         q, [this]() {
                     certificationsTV->setEnabled(true);
                     // Trigger an update when done
-                    q->setKey(key);
+                    reload();
                 });
                 cmd->start();
             });
@@ -147,11 +211,11 @@ public:
                         q, [this]() {
                     certificationsTV->setEnabled(true);
                     // Trigger an update when done
-                    q->setKey(key);
+                    reload();
                 });
                 cmd->start();
             });
-            const auto certificationKey = KeyCache::instance()->findByKeyIDOrFingerprint(signature.signerKeyID());
+            const auto certificationKey = signers.value(QByteArray(signature.signerKeyID()));
             const bool isSelfSignature = qstrcmp(signature.parent().parent().keyID(), signature.signerKeyID()) == 0;
             action->setEnabled(!isSelfSignature && certificationKey.hasSecret() && !signature.isRevokation() && !signature.isExpired() && !signature.isInvalid());
             if (isSelfSignature) {
@@ -192,6 +256,63 @@ public:
         menu->popup(certificationsTV->viewport()->mapToGlobal(p));
     }
 
+    void reload()
+    {
+        SignatureCache::instance().remove(key);
+        q->setKey(key);
+    }
+
+    void cancelSignatureListing()
+    {
+        if (!keyListJob) {
+            return;
+        }
+        disconnect(keyListJob, nullptr, q, nullptr);
+        keyListJob->slotCancel();
+        keyListJob = nullptr;
+    }
+
+    void showKey(const GpgME::Key &k)
+    {
+        key = k;
+        certificationsModel.setKey(key);
+        certificationsTV->expandAll();
+        certificationsTV->header()->resizeSections(QHeaderView::ResizeToContents);
+    }
+
+    // Resolves the certification keys of all signatures with a single
+    // lookup in the key cache instead of one lookup per signature.
+    void resolveSigners()
+    {
+        signers.clear();
+        std::vector<std::string> keyIDs;
+        for (const auto &userID : key.userIDs()) {
+            for (const auto &signature : userID.signatures()) {
+                if (signature.signerKeyID()) {
+                    keyIDs.push_back(signature.signerKeyID());
+                }
+            }
+        }
+        std::sort(keyIDs.begin(), keyIDs.end());
+        keyIDs.erase(std::unique(keyIDs.begin(), keyIDs.end()), keyIDs.end());
+        for (const auto &signer : KeyCache::instance()->findByKeyIDOrFingerprint(keyIDs)) {
+            signers.insert(QByteArray(signer.keyID()), signer);
+            signers.insert(QByteArray(signer.primaryFingerprint()), signer);
+        }
+        // certifications made with a subkey name the subkey; they belong to
+        // its primary key
+        keyIDs.erase(std::remove_if(keyIDs.begin(), keyIDs.end(),
+                                    [this](const std::string &keyID) {
+                                        return signers.contains(QByteArray(keyID.c_str()));
+                                    }),
+                     keyIDs.end());
+        if (!keyIDs.empty()) {
+            for (const auto &subkey : KeyCache::instance()->findSubkeysByKeyID(keyIDs)) {
+                signers.insert(QByteArray(subkey.keyID()), subkey.parent());
+            }
+        }
+    }
+
     void startSignatureListing()
     {
         if (keyListJob) {
@@ -240,27 +361,43 @@ void WebOfTrustWidget::setKey(const GpgME::Key &key)
         return;
     }
 
-    d->key = key;
-    d->certificationsModel.setKey(key);
-    d->certificationsTV->expandAll();
-    d->certificationsTV->header()->resizeSections(QHeaderView::ResizeToContents);
+    if (qstrcmp(key.primaryFingerprint(), d->key.primaryFingerprint()) != 0) {
+        d->cancelSignatureListing();
+    }
+
+    const GpgME::Key cached = SignatureCache::instance().find(key);
+    if (!cached.isNull()) {
+        d->cancelSignatureListing();
+        d->showKey(cached);
+        d->resolveSigners();
+        return;
+    }
+
+    // show the user IDs right away; the certifications are filled in as soon
+    // as the listing delivers the key
+    d->showKey(key);
     d->startSignatureListing();
 }
 
 WebOfTrustWidget::~WebOfTrustWidget()
 {
+    d->cancelSignatureListing();
 }
 
 void WebOfTrustWidget::signatureListingNextKey(const GpgME::Key &key)
 {
+    // the key the listing was started for
+    const GpgME::Key source = d->key;
     GpgME::Key merged = key;
-    merged.mergeWith(d->key);
-    setKey(merged);
+    merged.mergeWith(source);
+    d->showKey(merged);
+    d->resolveSigners();
+    SignatureCache::instance().insert(source, merged);
 }
 
 void WebOfTrustWidget::signatureListingDone(const GpgME::KeyListResult &result)
 {
-    if (result.error()) {
+    if (result.error() && !result.error().isCanceled()) {
         KMessageBox::information(this, xi18nc("@info",
                                            "<para>An error occurred while loading the certifications: "
                                            "<message>%1</message></para>",
@@ -67,6 +67,10 @@ static void kleopatra_options(QCommandLineParser *parser)
                                         " by fingerprint"))
             << QCommandLineOption(QStringList() << QStringLiteral("gen-key"),
                                   i18n("Create a new key pair or certificate signing request"))
+            << QCommandLineOption(QStringLiteral("gen-keys-from"),
+                                  i18n("Create the key pairs and certificate signing requests listed in a CSV or JSON file."
+                                       " The results are written to the folder given as argument, or next to the list"),
+                                  QStringLiteral("file"))
             << QCommandLineOption(QStringLiteral("parent-windowid"),
                                   i18n("Parent Window Id for dialogs"),
                                   QStringLiteral("windowId"))
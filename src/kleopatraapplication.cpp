@@ -23,6 +23,7 @@
 #include <Libkleo/GnuPG>
 #include <utils/kdpipeiodevice.h>
 #include <utils/log.h>
+#include <utils/cryptoconfigcache.h>
 
 #include <gpgme++/key.h>
 
@@ -41,6 +42,7 @@
 #include "commands/checksumverifyfilescommand.h"
 #include "commands/detailscommand.h"
 #include "commands/newcertificatecommand.h"
+#include "commands/batchkeygenerationcommand.h"
 
 #include "dialogs/updatenotification.h"
 
@@ -191,6 +193,7 @@ void KleopatraApplication::init()
     add_resources();
     d->setupKeyCache();
     d->setupLogging();
+    CryptoConfigCache::instance()->prefetchWhenIdle();
 #ifndef QT_NO_SYSTEMTRAYICON
     d->sysTray->show();
 #endif
@@ -338,6 +341,18 @@ QString KleopatraApplication::newInstance(const QCommandLineParser &parser,
         return QString();
     }
 
+    // Check for --gen-keys-from command
+    if (parser.isSet(QStringLiteral("gen-keys-from"))) {
+        auto cmd = new BatchKeyGenerationCommand;
+        cmd->setParentWId(parentId);
+        cmd->setInputFileName(cwd.absoluteFilePath(parser.value(QStringLiteral("gen-keys-from"))));
+        if (!files.empty()) {
+            cmd->setOutputDirectory(files.front());
+        }
+        cmd->start();
+        return QString();
+    }
+
     // Check for --config command
     if (parser.isSet(QStringLiteral("config"))) {
         openConfigDialogWithForeignParent(parentId);
@@ -522,6 +537,8 @@ void KleopatraApplication::openConfigDialogWithForeignParent(WId parentWId)
         d->configureDialog = new ConfigureDialog;
         d->configureDialog->setAttribute(Qt::WA_DeleteOnClose);
         d->connectConfigureDialog();
+        // the pages load the gpgconf data themselves, in the background
+        connect(d->configureDialog, SIGNAL(configCommitted()), CryptoConfigCache::instance(), SLOT(invalidate()));
     }
 
     // This is similar to what the commands do.
@@ -118,8 +118,8 @@ KWatchGnuPGConfig::KWatchGnuPGConfig(QWidget *parent)
 
     ++row;
     mLoglenSB = new KPluralHandlingSpinBox(group);
-    mLoglenSB->setRange(0, 1000000);
-    mLoglenSB->setSingleStep(100);
+    mLoglenSB->setRange(0, 100000000);
+    mLoglenSB->setSingleStep(10000);
     mLoglenSB->setSuffix(ki18ncp("history size spinbox suffix", " line", " lines"));
     mLoglenSB->setSpecialValueText(i18n("unlimited"));
     label = new QLabel(i18n("&History size:"), group);
@@ -132,9 +132,22 @@ KWatchGnuPGConfig::KWatchGnuPGConfig(QWidget *parent)
     connect(mLoglenSB, static_cast<void (KPluralHandlingSpinBox::*)(int)>(&KPluralHandlingSpinBox::valueChanged), this, &KWatchGnuPGConfig::slotChanged);
     connect(button, &QPushButton::clicked, this, &KWatchGnuPGConfig::slotSetHistorySizeUnlimited);
 
+    ++row;
+    mStoreSizeSB = new KPluralHandlingSpinBox(group);
+    mStoreSizeSB->setRange(4, 4096);
+    mStoreSizeSB->setSingleStep(16);
+    mStoreSizeSB->setSuffix(ki18ncp("log buffer size spinbox suffix", " MiB", " MiB"));
+    mStoreSizeSB->setToolTip(i18n("The amount of log text that is kept. Changes take effect after a restart."));
+    label = new QLabel(i18n("Log &buffer size:"), group);
+    label->setBuddy(mStoreSizeSB);
+    glay->addWidget(label, row, 0);
+    glay->addWidget(mStoreSizeSB, row, 1);
+
+    connect(mStoreSizeSB, static_cast<void (KPluralHandlingSpinBox::*)(int)>(&KPluralHandlingSpinBox::valueChanged), this, &KWatchGnuPGConfig::slotChanged);
+
     ++row;
     mWordWrapCB = new QCheckBox(i18n("Enable &word wrapping"), group);
-    mWordWrapCB->hide(); // QTextEdit doesn't support word wrapping in LogText mode
+    mWordWrapCB->hide(); // the log view shows one line per row
     glay->addWidget(mWordWrapCB, row, 0, 1, 3);
 
     connect(mWordWrapCB, &QCheckBox::clicked, this, &KWatchGnuPGConfig::slotChanged);
@@ -160,6 +173,7 @@ void KWatchGnuPGConfig::loadConfig()
 
     const KConfigGroup logWindow(KSharedConfig::openConfig(), "LogWindow");
     mLoglenSB->setValue(logWindow.readEntry("MaxLogLen", 10000));
+    mStoreSizeSB->setValue(logWindow.readEntry("LogStoreSize", 64));
     mWordWrapCB->setChecked(logWindow.readEntry("WordWrap", false));
 
     mButtonBox->button(QDialogButtonBox::Ok)->setEnabled(false);
@@ -174,6 +188,7 @@ void KWatchGnuPGConfig::saveConfig()
 
     KConfigGroup logWindow(KSharedConfig::openConfig(), "LogWindow");
     logWindow.writeEntry("MaxLogLen", mLoglenSB->value());
+    logWindow.writeEntry("LogStoreSize", mStoreSizeSB->value());
     logWindow.writeEntry("WordWrap", mWordWrapCB->isChecked());
 
     KSharedConfig::openConfig()->sync();
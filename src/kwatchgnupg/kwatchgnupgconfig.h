@@ -44,6 +44,7 @@ private:
     Kleo::FileNameRequester *mSocketED;
     QComboBox *mLogLevelCB;
     KPluralHandlingSpinBox *mLoglenSB;
+    KPluralHandlingSpinBox *mStoreSizeSB;
     QCheckBox *mWordWrapCB;
     QDialogButtonBox *mButtonBox;
 };
@@ -13,11 +13,21 @@
 #include "kwatchgnupgconfig.h"
 #include "kwatchgnupg.h"
 #include "tray.h"
+#include "logmodel.h"
+
+#include "utils/cryptoconfigcache.h"
 
-#include <QGpgME/Protocol>
 #include <QGpgME/CryptoConfig>
 
-#include <QTextEdit>
+#include <QComboBox>
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QLabel>
+#include <QLineEdit>
+#include <QScrollBar>
+#include <QTableView>
+#include <QTimer>
+#include <QVBoxLayout>
 
 #include <KMessageBox>
 #include <KLocalizedString>
@@ -33,7 +43,6 @@
 #include <KConfigGroup>
 
 #include <QEventLoop>
-#include <QTextStream>
 #include <QDateTime>
 #include <QFileDialog>
 #include <KSharedConfig>
@@ -44,10 +53,68 @@ KWatchGnuPGMainWindow::KWatchGnuPGMainWindow(QWidget *parent)
     createActions();
     createGUI();
 
-    mCentralWidget = new QTextEdit(this);
-    mCentralWidget->setReadOnly(true);
-
-    setCentralWidget(mCentralWidget);
+    const KConfigGroup logWindow(KSharedConfig::openConfig(), "LogWindow");
+    const qint64 storeSize = logWindow.readEntry("LogStoreSize", 64);
+    mLogModel = new LogModel(storeSize * 1024 * 1024, this);
+    mFilterModel = new LogFilterModel(this);
+    mFilterModel->setSourceModel(mLogModel);
+
+    auto central = new QWidget(this);
+    auto vlay = new QVBoxLayout(central);
+    vlay->setContentsMargins(0, 0, 0, 0);
+
+    auto hlay = new QHBoxLayout;
+    mFilterED = new QLineEdit(central);
+    mFilterED->setClearButtonEnabled(true);
+    mFilterED->setPlaceholderText(i18n("Filter new lines (press Enter to find the next match)"));
+    hlay->addWidget(mFilterED, 1);
+    auto label = new QLabel(i18n("&Component:"), central);
+    mComponentCB = new QComboBox(central);
+    mComponentCB->addItem(i18n("All"));
+    mComponentCB->setSizeAdjustPolicy(QComboBox::AdjustToContents);
+    label->setBuddy(mComponentCB);
+    hlay->addWidget(label);
+    hlay->addWidget(mComponentCB);
+    label = new QLabel(i18n("&Level:"), central);
+    mLevelCB = new QComboBox(central);
+    for (int level = LogStore::Debug; level < LogStore::NumLevels; ++level) {
+        mLevelCB->addItem(LogModel::levelName(static_cast<LogStore::Level>(level)));
+    }
+    label->setBuddy(mLevelCB);
+    hlay->addWidget(label);
+    hlay->addWidget(mLevelCB);
+    vlay->addLayout(hlay);
+
+    mLogView = new QTableView(central);
+    mLogView->setModel(mFilterModel);
+    mLogView->setWordWrap(false);
+    mLogView->setShowGrid(false);
+    mLogView->setSelectionBehavior(QAbstractItemView::SelectRows);
+    mLogView->setHorizontalScrollMode(QAbstractItemView::ScrollPerPixel);
+    mLogView->verticalHeader()->hide();
+    // all rows have the same height, so the view never has to measure them
+    mLogView->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    mLogView->verticalHeader()->setDefaultSectionSize(mLogView->fontMetrics().height() + 4);
+    mLogView->horizontalHeader()->setStretchLastSection(true);
+    const int digitWidth = mLogView->fontMetrics().horizontalAdvance(QLatin1Char('0'));
+    mLogView->setColumnWidth(LogModel::Time, 16 * digitWidth);
+    mLogView->setColumnWidth(LogModel::Client, 6 * digitWidth);
+    mLogView->setColumnWidth(LogModel::Component, 14 * digitWidth);
+    mLogView->setColumnWidth(LogModel::Pid, 9 * digitWidth);
+    mLogView->setColumnWidth(LogModel::Level, 10 * digitWidth);
+    vlay->addWidget(mLogView, 1);
+
+    setCentralWidget(central);
+
+    mFilterTimer = new QTimer(this);
+    mFilterTimer->setSingleShot(true);
+    mFilterTimer->setInterval(250);
+    connect(mFilterTimer, &QTimer::timeout, this, &KWatchGnuPGMainWindow::slotApplyFilter);
+    connect(mFilterED, &QLineEdit::textChanged, mFilterTimer, qOverload<>(&QTimer::start));
+    connect(mFilterED, &QLineEdit::returnPressed, this, &KWatchGnuPGMainWindow::slotFindNext);
+    connect(mComponentCB, qOverload<int>(&QComboBox::currentIndexChanged), this, &KWatchGnuPGMainWindow::slotApplyFilter);
+    connect(mLevelCB, qOverload<int>(&QComboBox::currentIndexChanged), this, &KWatchGnuPGMainWindow::slotApplyFilter);
+    connect(mLogModel, &LogModel::componentsChanged, this, &KWatchGnuPGMainWindow::slotUpdateComponents);
 
     mWatcher = new KProcess;
     connect(mWatcher, SIGNAL(finished(int,QProcess::ExitStatus)),
@@ -73,8 +140,65 @@ KWatchGnuPGMainWindow::~KWatchGnuPGMainWindow()
 
 void KWatchGnuPGMainWindow::slotClear()
 {
-    mCentralWidget->clear();
-    mCentralWidget->append(i18n("[%1] Log cleared", QDateTime::currentDateTime().toString(Qt::ISODate)));
+    mLogModel->clear();
+    appendMessage(i18n("[%1] Log cleared", QDateTime::currentDateTime().toString(Qt::ISODate)));
+}
+
+bool KWatchGnuPGMainWindow::isScrolledToBottom() const
+{
+    const QScrollBar *const sb = mLogView->verticalScrollBar();
+    return sb->value() == sb->maximum();
+}
+
+void KWatchGnuPGMainWindow::appendMessage(const QString &message)
+{
+    const bool follow = isScrolledToBottom();
+    mLogModel->appendLine(message);
+    if (follow) {
+        mLogView->scrollToBottom();
+    }
+}
+
+void KWatchGnuPGMainWindow::slotUpdateComponents()
+{
+    const QStringList &components = mLogModel->store().components();
+    // the combo box holds "All" followed by the components in order of appearance
+    for (int i = mComponentCB->count() - 1; i < components.size(); ++i) {
+        mComponentCB->addItem(components[i].isEmpty() ? i18n("(none)") : components[i], components[i]);
+    }
+}
+
+void KWatchGnuPGMainWindow::slotApplyFilter()
+{
+    mFilterTimer->stop();
+    mFilterModel->setComponent(mComponentCB->currentIndex() > 0 ? mComponentCB->currentData().toString() : QString());
+    mFilterModel->setMinimumLevel(static_cast<LogStore::Level>(mLevelCB->currentIndex()));
+    mFilterModel->setText(mFilterED->text());
+}
+
+void KWatchGnuPGMainWindow::slotFindNext()
+{
+    if (mFilterTimer->isActive()) {
+        slotApplyFilter();
+    }
+    const QString text = mFilterED->text();
+    const int rows = mFilterModel->rowCount();
+    if (text.isEmpty() || rows == 0) {
+        return;
+    }
+    // the lines shown before the filter was changed need not match, so
+    // search the shown lines for the next one that does
+    const QModelIndex current = mLogView->currentIndex();
+    const int start = current.isValid() ? current.row() + 1 : 0;
+    for (int i = 0; i < rows; ++i) {
+        const QModelIndex index = mFilterModel->index((start + i) % rows, LogModel::Message);
+        if (mFilterModel->matchesText(mFilterModel->mapToSource(index).row(), text)) {
+            mLogView->setCurrentIndex(index);
+            mLogView->scrollTo(index);
+            return;
+        }
+    }
+    QApplication::beep();
 }
 
 void KWatchGnuPGMainWindow::createActions()
@@ -112,8 +236,7 @@ void KWatchGnuPGMainWindow::startWatcher()
         while (mWatcher->state() == QProcess::Running) {
             qApp->processEvents(QEventLoop::ExcludeUserInputEvents);
         }
-        mCentralWidget->append(i18n("[%1] Log stopped", QDateTime::currentDateTime().toString(Qt::ISODate)));
-        mCentralWidget->ensureCursorVisible();
+        appendMessage(i18n("[%1] Log stopped", QDateTime::currentDateTime().toString(Qt::ISODate)));
     }
     mWatcher->clearProgram();
 
@@ -130,8 +253,7 @@ void KWatchGnuPGMainWindow::startWatcher()
     if (!ok) {
         KMessageBox::sorry(this, i18n("The watchgnupg logging process could not be started.\nPlease install watchgnupg somewhere in your $PATH.\nThis log window is unable to display any useful information."));
     } else {
-        mCentralWidget->append(i18n("[%1] Log started", QDateTime::currentDateTime().toString(Qt::ISODate)));
-        mCentralWidget->ensureCursorVisible();
+        appendMessage(i18n("[%1] Log started", QDateTime::currentDateTime().toString(Qt::ISODate)));
     }
     connect(mWatcher, SIGNAL(finished(int,QProcess::ExitStatus)),
             this, SLOT(slotWatcherExited(int,QProcess::ExitStatus)));
@@ -139,9 +261,18 @@ void KWatchGnuPGMainWindow::startWatcher()
 
 void KWatchGnuPGMainWindow::setGnuPGConfig()
 {
+    Kleo::CryptoConfigCache *const cache = Kleo::CryptoConfigCache::instance();
+    if (!cache->isLoaded()) {
+        // the gpgconf data is loaded in the background
+        cache->whenLoaded(this, [this]() {
+            setGnuPGConfig();
+        });
+        return;
+    }
+
     QStringList logclients;
     // Get config object
-    QGpgME::CryptoConfig *cconfig = QGpgME::cryptoConfig();
+    QGpgME::CryptoConfig *cconfig = cache->config();
     if (!cconfig) {
         return;
     }
@@ -166,6 +297,7 @@ void KWatchGnuPGMainWindow::setGnuPGConfig()
         }
     }
     cconfig->sync(true);
+    cache->invalidate();
     if (logclients.isEmpty()) {
         KMessageBox::sorry(nullptr, i18n("There are no components available that support logging."));
     }
@@ -174,8 +306,7 @@ void KWatchGnuPGMainWindow::setGnuPGConfig()
 void KWatchGnuPGMainWindow::slotWatcherExited(int, QProcess::ExitStatus)
 {
     if (KMessageBox::questionYesNo(this, i18n("The watchgnupg logging process died.\nDo you want to try to restart it?"), QString(), KGuiItem(i18n("Try Restart")), KGuiItem(i18n("Do Not Try"))) == KMessageBox::Yes) {
-        mCentralWidget->append(i18n("====== Restarting logging process ====="));
-        mCentralWidget->ensureCursorVisible();
+        appendMessage(i18n("====== Restarting logging process ====="));
         startWatcher();
     } else {
         KMessageBox::sorry(this, i18n("The watchgnupg logging process is not running.\nThis log window is unable to display any useful information."));
@@ -187,21 +318,31 @@ void KWatchGnuPGMainWindow::slotReadStdout()
     if (!mWatcher) {
         return;
     }
+    // collect everything that is available and hand it to the model in one
+    // batch, so that the views are only updated once per read
+    QVector<QByteArray> lines;
     while (mWatcher->canReadLine()) {
-        QString str = QString::fromUtf8(mWatcher->readLine());
-        if (str.endsWith(QLatin1Char('\n'))) {
-            str.chop(1);
+        QByteArray line = mWatcher->readLine();
+        if (line.endsWith('\n')) {
+            line.chop(1);
         }
-        if (str.endsWith(QLatin1Char('\r'))) {
-            str.chop(1);
-        }
-        mCentralWidget->append(str);
-        mCentralWidget->ensureCursorVisible();
-        if (!isVisible()) {
-            // Change tray icon to show something happened
-            // PENDING(steffen)
-            mSysTray->setAttention(true);
+        if (line.endsWith('\r')) {
+            line.chop(1);
         }
+        lines.push_back(line);
+    }
+    if (lines.isEmpty()) {
+        return;
+    }
+    const bool follow = isScrolledToBottom();
+    mLogModel->appendLines(lines);
+    if (follow) {
+        mLogView->scrollToBottom();
+    }
+    if (!isVisible()) {
+        // Change tray icon to show something happened
+        // PENDING(steffen)
+        mSysTray->setAttention(true);
     }
 }
 
@@ -219,7 +360,11 @@ void KWatchGnuPGMainWindow::slotSaveAs()
     }
     QFile file(filename);
     if (file.open(QIODevice::WriteOnly)) {
-        QTextStream(&file) << mCentralWidget->document()->toRawText();
+        const LogStore &store = mLogModel->store();
+        for (int row = 0, end = store.count(); row < end; ++row) {
+            file.write(store.rawLine(row));
+            file.write("\n", 1);
+        }
     } else
         KMessageBox::information(this, i18n("Could not save file %1: %2",
                                             filename, file.errorString()));
@@ -249,7 +394,7 @@ void KWatchGnuPGMainWindow::slotReadConfig()
 {
     const KConfigGroup config(KSharedConfig::openConfig(), "LogWindow");
     const int maxLogLen = config.readEntry("MaxLogLen", 10000);
-    mCentralWidget->document()->setMaximumBlockCount(maxLogLen < 1 ? -1 : maxLogLen);
+    mLogModel->setMaximumLineCount(maxLogLen < 1 ? 0 : maxLogLen);
     setGnuPGConfig();
     startWatcher();
 }
@@ -16,7 +16,12 @@
 class KWatchGnuPGTray;
 class KWatchGnuPGConfig;
 class KProcess;
-class QTextEdit;
+class LogModel;
+class LogFilterModel;
+class QComboBox;
+class QLineEdit;
+class QTableView;
+class QTimer;
 
 class KWatchGnuPGMainWindow : public KXmlGuiWindow
 {
@@ -37,6 +42,9 @@ private Q_SLOTS:
     void slotConfigureToolbars();
     void configureShortcuts();
     void slotReadConfig();
+    void slotUpdateComponents();
+    void slotApplyFilter();
+    void slotFindNext();
 
 public Q_SLOTS:
     /* reimp */ void show();
@@ -48,10 +56,18 @@ private:
     void createActions();
     void startWatcher();
     void setGnuPGConfig();
+    void appendMessage(const QString &message);
+    bool isScrolledToBottom() const;
 
     KProcess *mWatcher;
 
-    QTextEdit *mCentralWidget;
+    LogModel *mLogModel;
+    LogFilterModel *mFilterModel;
+    QTableView *mLogView;
+    QLineEdit *mFilterED;
+    QComboBox *mComponentCB;
+    QComboBox *mLevelCB;
+    QTimer *mFilterTimer;
     KWatchGnuPGTray *mSysTray;
     KWatchGnuPGConfig *mConfig;
 };
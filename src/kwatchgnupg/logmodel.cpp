@@ -0,0 +1,231 @@
+/*
+    logmodel.cpp
+
+    This file is part of Kleopatra, the KDE keymanager
+    SPDX-FileCopyrightText: 2021 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <config-kleopatra.h>
+
+#include "logmodel.h"
+
+#include <KLocalizedString>
+
+#include <QBrush>
+#include <QDateTime>
+#include <QPalette>
+
+LogModel::LogModel(qint64 storeCapacity, QObject *parent)
+    : QAbstractTableModel(parent), mStore(storeCapacity)
+{
+}
+
+LogModel::~LogModel() {}
+
+void LogModel::setMaximumLineCount(int count)
+{
+    mStore.setMaximumLineCount(count);
+    dropFront(mStore.linesToDrop(0, 0));
+}
+
+void LogModel::appendLines(const QVector<QByteArray> &lines)
+{
+    const int first = mStore.firstLineToKeep(lines);
+    const int appended = lines.size() - first;
+    if (appended <= 0) {
+        return;
+    }
+    qint64 bytes = 0;
+    for (int i = first; i < lines.size(); ++i) {
+        bytes += mStore.storedLength(lines[i]);
+    }
+    // make room first, so that the rows are removed while the store still
+    // holds them
+    dropFront(mStore.linesToDrop(appended, bytes));
+
+    const int row = mStore.count();
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    beginInsertRows(QModelIndex(), row, row + appended - 1);
+    for (int i = first; i < lines.size(); ++i) {
+        const int dropped = mStore.append(lines[i], now);
+        Q_ASSERT(dropped == 0);
+        Q_UNUSED(dropped)
+    }
+    endInsertRows();
+
+    if (mStore.components().size() != mComponentCount) {
+        mComponentCount = mStore.components().size();
+        Q_EMIT componentsChanged();
+    }
+}
+
+void LogModel::appendLine(const QString &line)
+{
+    appendLines(QVector<QByteArray>() << line.toUtf8());
+}
+
+void LogModel::dropFront(int count)
+{
+    if (count <= 0) {
+        return;
+    }
+    beginRemoveRows(QModelIndex(), 0, count - 1);
+    mStore.dropFront(count);
+    endRemoveRows();
+}
+
+void LogModel::clear()
+{
+    beginResetModel();
+    mStore.clear();
+    endResetModel();
+}
+
+// static
+QString LogModel::levelName(LogStore::Level level)
+{
+    switch (level) {
+    case LogStore::Debug:
+        return i18nc("log level", "Debug");
+    case LogStore::Info:
+        return i18nc("log level", "Info");
+    case LogStore::Warning:
+        return i18nc("log level", "Warning");
+    case LogStore::Error:
+        return i18nc("log level", "Error");
+    case LogStore::NumLevels:
+        break;
+    }
+    return QString();
+}
+
+int LogModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : mStore.count();
+}
+
+int LogModel::columnCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : NumColumns;
+}
+
+QVariant LogModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= mStore.count()) {
+        return QVariant();
+    }
+    const int row = index.row();
+    if (role == Qt::DisplayRole) {
+        switch (index.column()) {
+        case Time:
+            return QDateTime::fromMSecsSinceEpoch(mStore.timestamp(row)).toString(QStringLiteral("hh:mm:ss.zzz"));
+        case Client:
+            return mStore.client(row) >= 0 ? QVariant(mStore.client(row)) : QVariant();
+        case Component:
+            return mStore.component(row);
+        case Pid:
+            return mStore.pid(row) >= 0 ? QVariant(mStore.pid(row)) : QVariant();
+        case Level:
+            return levelName(mStore.level(row));
+        case Message:
+            return mStore.message(row);
+        }
+    } else if (role == Qt::ToolTipRole) {
+        return mStore.line(row);
+    } else if (role == Qt::ForegroundRole) {
+        switch (mStore.level(row)) {
+        case LogStore::Debug:
+            return QBrush(QPalette().color(QPalette::Disabled, QPalette::Text));
+        case LogStore::Warning:
+            return QBrush(Qt::darkYellow);
+        case LogStore::Error:
+            return QBrush(Qt::red);
+        default:
+            break;
+        }
+    }
+    return QVariant();
+}
+
+QVariant LogModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole) {
+        return QVariant();
+    }
+    switch (section) {
+    case Time:
+        return i18n("Time");
+    case Client:
+        return i18n("Client");
+    case Component:
+        return i18n("Component");
+    case Pid:
+        return i18n("PID");
+    case Level:
+        return i18n("Level");
+    case Message:
+        return i18n("Message");
+    }
+    return QVariant();
+}
+
+LogFilterModel::LogFilterModel(QObject *parent)
+    : QSortFilterProxyModel(parent)
+{
+}
+
+void LogFilterModel::setSourceModel(QAbstractItemModel *model)
+{
+    mLogModel = qobject_cast<LogModel *>(model);
+    QSortFilterProxyModel::setSourceModel(model);
+}
+
+void LogFilterModel::setComponent(const QString &component)
+{
+    if (mComponent == component) {
+        return;
+    }
+    mComponent = component;
+    invalidateFilter();
+}
+
+void LogFilterModel::setMinimumLevel(LogStore::Level level)
+{
+    if (mMinimumLevel == level) {
+        return;
+    }
+    mMinimumLevel = level;
+    invalidateFilter();
+}
+
+void LogFilterModel::setText(const QString &text)
+{
+    if (mText == text) {
+        return;
+    }
+    mText = text;
+    invalidateFilter();
+}
+
+bool LogFilterModel::matchesText(int sourceRow, const QString &text) const
+{
+    return text.isEmpty() || mLogModel->store().line(sourceRow).contains(text, Qt::CaseInsensitive);
+}
+
+bool LogFilterModel::filterAcceptsRow(int sourceRow, const QModelIndex &sourceParent) const
+{
+    Q_UNUSED(sourceParent)
+    if (!mLogModel) {
+        return true;
+    }
+    const LogStore &store = mLogModel->store();
+    if (store.level(sourceRow) < mMinimumLevel) {
+        return false;
+    }
+    if (!mComponent.isEmpty() && store.component(sourceRow) != mComponent) {
+        return false;
+    }
+    return matchesText(sourceRow, mText);
+}
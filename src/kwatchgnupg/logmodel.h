@@ -0,0 +1,96 @@
+/*
+    logmodel.h
+
+    This file is part of Kleopatra, the KDE keymanager
+    SPDX-FileCopyrightText: 2021 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef KWATCHGNUPG_LOGMODEL_H
+#define KWATCHGNUPG_LOGMODEL_H
+
+#include "logstore.h"
+
+#include <QAbstractTableModel>
+#include <QSortFilterProxyModel>
+#include <QVector>
+
+class LogModel : public QAbstractTableModel
+{
+    Q_OBJECT
+public:
+    enum Column {
+        Time,
+        Client,
+        Component,
+        Pid,
+        Level,
+        Message,
+
+        NumColumns
+    };
+
+    explicit LogModel(qint64 storeCapacity, QObject *parent = nullptr);
+    ~LogModel() override;
+
+    const LogStore &store() const
+    {
+        return mStore;
+    }
+
+    void setMaximumLineCount(int count);
+
+    void appendLines(const QVector<QByteArray> &lines);
+    void appendLine(const QString &line);
+    void clear();
+
+    static QString levelName(LogStore::Level level);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+Q_SIGNALS:
+    void componentsChanged();
+
+private:
+    void dropFront(int count);
+
+private:
+    LogStore mStore;
+    int mComponentCount = 0;
+};
+
+/*!
+ * Filters a LogModel by component, minimum level and message text.
+ *
+ * Appended lines are filtered as they arrive; changing a criterion filters
+ * all lines again.
+ */
+class LogFilterModel : public QSortFilterProxyModel
+{
+    Q_OBJECT
+public:
+    explicit LogFilterModel(QObject *parent = nullptr);
+
+    void setSourceModel(QAbstractItemModel *model) override;
+
+    void setComponent(const QString &component);
+    void setMinimumLevel(LogStore::Level level);
+    void setText(const QString &text);
+
+    bool matchesText(int sourceRow, const QString &text) const;
+
+protected:
+    bool filterAcceptsRow(int sourceRow, const QModelIndex &sourceParent) const override;
+
+private:
+    const LogModel *mLogModel = nullptr;
+    QString mComponent;
+    LogStore::Level mMinimumLevel = LogStore::Debug;
+    QString mText;
+};
+
+#endif /* KWATCHGNUPG_LOGMODEL_H */
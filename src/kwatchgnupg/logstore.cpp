@@ -0,0 +1,333 @@
+/*
+    logstore.cpp
+
+    This file is part of Kleopatra, the KDE keymanager
+    SPDX-FileCopyrightText: 2021 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <config-kleopatra.h>
+
+#include "logstore.h"
+
+#include "kwatchgnupg_debug.h"
+
+#include <QDir>
+#include <QTemporaryFile>
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+
+bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+bool isComponentChar(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || isDigit(c)
+           || c == '-' || c == '_' || c == '.';
+}
+
+bool startsWith(const char *data, int length, const char *prefix)
+{
+    const int prefixLength = std::strlen(prefix);
+    return length >= prefixLength && std::memcmp(data, prefix, prefixLength) == 0;
+}
+
+// matches "YYYY-MM-DD HH:MM:SS"
+bool isTimestamp(const char *data, int length)
+{
+    static const char pattern[] = "dddd-dd-dd dd:dd:dd";
+    const int patternLength = sizeof pattern - 1;
+    if (length < patternLength) {
+        return false;
+    }
+    for (int i = 0; i < patternLength; ++i) {
+        if (pattern[i] == 'd' ? !isDigit(data[i]) : data[i] != pattern[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int parseNumber(const char *data, int length, int *pos)
+{
+    int result = 0;
+    while (*pos < length && isDigit(data[*pos])) {
+        result = result * 10 + (data[*pos] - '0');
+        ++*pos;
+    }
+    return result;
+}
+
+void skipSpaces(const char *data, int length, int *pos)
+{
+    while (*pos < length && data[*pos] == ' ') {
+        ++*pos;
+    }
+}
+
+}
+
+// static
+LogStore::ParsedLine LogStore::parseLine(const char *data, int length)
+{
+    // watchgnupg prefixes every line with the number of the client
+    // connection, e.g. "  3 - gpg-agent[1234]: DBG: chan_6 -> OK"
+    ParsedLine result;
+    int pos = 0;
+    skipSpaces(data, length, &pos);
+    if (pos < length && isDigit(data[pos])) {
+        int p = pos;
+        const int client = parseNumber(data, length, &p);
+        if (startsWith(data + p, length - p, " - ")) {
+            result.client = client;
+            pos = p + 3;
+        }
+    }
+
+    // optional timestamp if the component logs with time
+    if (isTimestamp(data + pos, length - pos)) {
+        pos += 19;
+        skipSpaces(data, length, &pos);
+    }
+
+    // "component[pid]" followed by ':' or ' '
+    int p = pos;
+    while (p < length && isComponentChar(data[p])) {
+        ++p;
+    }
+    if (p > pos && p < length && data[p] == '[') {
+        int q = p + 1;
+        const int pid = parseNumber(data, length, &q);
+        if (q < length && data[q] == ']') {
+            result.componentBegin = pos;
+            result.componentLength = p - pos;
+            result.pid = pid;
+            pos = q + 1;
+            if (pos < length && data[pos] == ':') {
+                ++pos;
+            }
+            skipSpaces(data, length, &pos);
+        }
+    }
+    result.messageBegin = pos;
+
+    const char *msg = data + pos;
+    const int msgLength = length - pos;
+    if (startsWith(msg, msgLength, "DBG:")) {
+        result.level = Debug;
+    } else if (startsWith(msg, msgLength, "Fatal:") || startsWith(msg, msgLength, "Ohhhh jeeee:")) {
+        result.level = Error;
+    } else if (startsWith(msg, msgLength, "Warning:") || startsWith(msg, msgLength, "WARNING:")) {
+        result.level = Warning;
+    }
+    // log_error() does not add a prefix, so its lines cannot be told apart
+    // from those of log_info() and are shown as Info
+    return result;
+}
+
+LogStore::LogStore(qint64 capacity)
+    : mCapacity(std::max<qint64>(capacity, 4096))
+{
+    mFile.reset(new QTemporaryFile(QDir::tempPath() + QLatin1String("/kwatchgnupg-XXXXXX.log")));
+    if (mFile->open() && mFile->resize(mCapacity)) {
+        mData = mFile->map(0, mCapacity);
+    }
+    if (!mData) {
+        qCDebug(KWATCHGNUPG_LOG) << "Failed to map log store into memory:" << mFile->errorString()
+                                 << "- keeping the log in memory";
+        mFile.reset();
+        mHeapBuffer.resize(mCapacity);
+        mData = reinterpret_cast<uchar *>(mHeapBuffer.data());
+    }
+}
+
+LogStore::~LogStore()
+{
+    if (mFile) {
+        mFile->unmap(mData);
+    }
+}
+
+void LogStore::setMaximumLineCount(int count)
+{
+    mMaxLines = std::max(count, 0);
+}
+
+quint32 LogStore::storedLength(const QByteArray &line) const
+{
+    // the offset of the message must fit into the record
+    return std::min<qint64>(line.size(), std::min<qint64>(mCapacity, 0xFFFF));
+}
+
+int LogStore::firstLineToKeep(const QVector<QByteArray> &lines) const
+{
+    qint64 bytes = 0;
+    int first = lines.size();
+    while (first > 0 && (mMaxLines <= 0 || lines.size() - first < mMaxLines)) {
+        bytes += storedLength(lines[first - 1]);
+        if (bytes > mCapacity) {
+            break;
+        }
+        --first;
+    }
+    return first;
+}
+
+int LogStore::linesToDrop(int lines, qint64 bytes) const
+{
+    const int count = this->count();
+    int result = 0;
+    if (mMaxLines > 0 && count + lines > mMaxLines) {
+        result = count + lines - mMaxLines + mMaxLines / TrimChunkDivisor;
+    }
+    const qint64 used = count ? static_cast<qint64>(mHead - mRecords.front().offset) : 0;
+    if (used + bytes > mCapacity) {
+        const qint64 needed = used + bytes - mCapacity + mCapacity / TrimChunkDivisor;
+        qint64 freed = 0;
+        int n = 0;
+        while (n < count && freed < needed) {
+            freed += mRecords[n].length;
+            ++n;
+        }
+        result = std::max(result, n);
+    }
+    return std::min(result, count);
+}
+
+void LogStore::dropFront(int count)
+{
+    count = std::min(count, this->count());
+    if (count > 0) {
+        mRecords.erase(mRecords.begin(), mRecords.begin() + count);
+    }
+}
+
+int LogStore::append(const QByteArray &line, qint64 timestamp)
+{
+    const quint32 length = storedLength(line);
+    const ParsedLine parsed = parseLine(line.constData(), length);
+
+    Record r;
+    r.offset = mHead;
+    r.timestamp = timestamp;
+    r.length = length;
+    r.pid = parsed.pid;
+    r.client = parsed.client;
+    r.component = componentIndexFor(line.constData() + parsed.componentBegin, parsed.componentLength);
+    r.messageBegin = parsed.messageBegin;
+    r.level = parsed.level;
+
+    const quint64 pos = mHead % mCapacity;
+    const quint64 first = std::min<quint64>(length, mCapacity - pos);
+    std::memcpy(mData + pos, line.constData(), first);
+    if (first < length) {
+        std::memcpy(mData, line.constData() + first, length - first);
+    }
+    mHead += length;
+
+    // the ring holds the bytes [mHead - mCapacity, mHead); drop lines
+    // that have (partially) been overwritten
+    int dropped = 0;
+    while (!mRecords.empty() && mRecords.front().offset + mCapacity < mHead) {
+        mRecords.pop_front();
+        ++dropped;
+    }
+    mRecords.push_back(r);
+    if (mMaxLines > 0 && count() > mMaxLines) {
+        dropped += count() - mMaxLines;
+        dropFront(count() - mMaxLines);
+    }
+    return dropped;
+}
+
+void LogStore::clear()
+{
+    mRecords.clear();
+    mHead = 0;
+}
+
+int LogStore::componentIndexFor(const char *data, int length)
+{
+    const QByteArray name = QByteArray::fromRawData(data, length);
+    const auto it = mComponentIndex.constFind(name);
+    if (it != mComponentIndex.constEnd()) {
+        return it.value();
+    }
+    const int index = mComponents.size();
+    if (index >= UnknownComponent) {
+        return UnknownComponent;
+    }
+    mComponents.push_back(QString::fromUtf8(data, length));
+    mComponentIndex.insert(QByteArray(data, length), index);
+    return index;
+}
+
+void LogStore::read(quint64 offset, char *dest, quint32 length) const
+{
+    const quint64 pos = offset % mCapacity;
+    const quint64 first = std::min<quint64>(length, mCapacity - pos);
+    std::memcpy(dest, mData + pos, first);
+    if (first < length) {
+        std::memcpy(dest + first, mData, length - first);
+    }
+}
+
+QByteArray LogStore::rawLine(int row) const
+{
+    const Record &r = record(row);
+    QByteArray result(r.length, Qt::Uninitialized);
+    read(r.offset, result.data(), r.length);
+    return result;
+}
+
+QString LogStore::line(int row) const
+{
+    return QString::fromUtf8(rawLine(row));
+}
+
+QString LogStore::message(int row) const
+{
+    const Record &r = record(row);
+    const quint32 length = r.length - r.messageBegin;
+    QByteArray result(length, Qt::Uninitialized);
+    read(r.offset + r.messageBegin, result.data(), length);
+    return QString::fromUtf8(result);
+}
+
+qint64 LogStore::timestamp(int row) const
+{
+    return record(row).timestamp;
+}
+
+int LogStore::client(int row) const
+{
+    return record(row).client;
+}
+
+int LogStore::pid(int row) const
+{
+    return record(row).pid;
+}
+
+LogStore::Level LogStore::level(int row) const
+{
+    return static_cast<Level>(record(row).level);
+}
+
+int LogStore::componentIndex(int row) const
+{
+    return record(row).component;
+}
+
+QString LogStore::component(int row) const
+{
+    const int index = record(row).component;
+    return index == UnknownComponent ? QString() : mComponents[index];
+}
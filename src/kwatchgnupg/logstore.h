@@ -0,0 +1,170 @@
+/*
+    logstore.h
+
+    This file is part of Kleopatra, the KDE keymanager
+    SPDX-FileCopyrightText: 2021 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef KWATCHGNUPG_LOGSTORE_H
+#define KWATCHGNUPG_LOGSTORE_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include <deque>
+#include <memory>
+
+class QTemporaryFile;
+
+/*!
+ * A bounded store for the lines written by watchgnupg.
+ *
+ * The text of the lines lives in a byte ring that is backed by a memory
+ * mapped temporary file (or, if mapping is not possible, by a heap buffer
+ * of the same size). Only a small fixed-size record with the parsed
+ * columns is kept per line, so that millions of lines can be kept without
+ * holding them as QStrings.
+ *
+ * When the ring is full, or when the configured maximum number of lines is
+ * reached, the oldest lines have to be dropped. Users of the store ask
+ * linesToDrop() how many, and call dropFront() before appending, so that a
+ * model can announce the removal before the data changes. To keep views
+ * from remapping all rows for every appended line, linesToDrop() frees a
+ * chunk of TrimChunkDivisor-th of the limit at once.
+ */
+class LogStore
+{
+public:
+    enum Level {
+        Debug,
+        Info,
+        Warning,
+        Error,
+
+        NumLevels
+    };
+
+    struct ParsedLine {
+        int client = -1;
+        int pid = -1;
+        int level = Info;
+        // component and message are slices of the parsed line
+        int componentBegin = 0;
+        int componentLength = 0;
+        int messageBegin = 0;
+    };
+
+    static ParsedLine parseLine(const char *data, int length);
+
+    static const qint64 DefaultCapacity = 64 * 1024 * 1024;
+    static const int TrimChunkDivisor = 16;
+
+    explicit LogStore(qint64 capacity = DefaultCapacity);
+    ~LogStore();
+
+    /*! The maximum number of lines to keep; 0 means "as many as fit". */
+    void setMaximumLineCount(int count);
+    int maximumLineCount() const
+    {
+        return mMaxLines;
+    }
+
+    qint64 capacity() const
+    {
+        return mCapacity;
+    }
+    bool isMemoryMapped() const
+    {
+        return mFile != nullptr;
+    }
+
+    /*!
+     * Returns the index of the first of \a lines that has to be kept if all
+     * of them are appended: a batch that exceeds the limits by itself loses
+     * its oldest lines.
+     */
+    int firstLineToKeep(const QVector<QByteArray> &lines) const;
+    /*!
+     * Returns the number of lines to drop from the front before \a lines
+     * more lines with \a bytes bytes of text can be appended. This is 0 or
+     * a whole chunk of lines.
+     */
+    int linesToDrop(int lines, qint64 bytes) const;
+    void dropFront(int count);
+
+    /*!
+     * Appends \a line (without line terminator). Returns the number of
+     * lines that had to be dropped from the front to make room, which is 0
+     * if room was made with linesToDrop() and dropFront() before.
+     */
+    int append(const QByteArray &line, qint64 timestamp);
+    void clear();
+
+    /*! The number of bytes append() stores for \a line. */
+    quint32 storedLength(const QByteArray &line) const;
+
+    int count() const
+    {
+        return static_cast<int>(mRecords.size());
+    }
+
+    QByteArray rawLine(int row) const;
+    QString line(int row) const;
+    QString message(int row) const;
+    qint64 timestamp(int row) const;
+    int client(int row) const;
+    int pid(int row) const;
+    Level level(int row) const;
+    /*!
+     * The index of the component of \a row in components(), or
+     * UnknownComponent if there were too many different ones to keep.
+     */
+    int componentIndex(int row) const;
+    /*! The name of the component of \a row; empty if it is unknown. */
+    QString component(int row) const;
+
+    /*! All component names seen so far, indexed by componentIndex(). */
+    const QStringList &components() const
+    {
+        return mComponents;
+    }
+
+    static const int UnknownComponent = 0xFFFF;
+
+private:
+    struct Record {
+        quint64 offset; // absolute offset into the ring
+        qint64 timestamp;
+        quint32 length;
+        qint32 pid;
+        qint16 client;
+        quint16 component;
+        quint16 messageBegin;
+        quint8 level;
+    };
+
+    const Record &record(int row) const
+    {
+        return mRecords[row];
+    }
+    void read(quint64 offset, char *dest, quint32 length) const;
+    int componentIndexFor(const char *data, int length);
+
+private:
+    const qint64 mCapacity;
+    int mMaxLines = 0;
+    std::unique_ptr<QTemporaryFile> mFile;
+    QByteArray mHeapBuffer;
+    uchar *mData = nullptr;
+    quint64 mHead = 0;
+    std::deque<Record> mRecords;
+    QStringList mComponents;
+    QHash<QByteArray, int> mComponentIndex;
+};
+
+#endif /* KWATCHGNUPG_LOGSTORE_H */
@@ -24,6 +24,7 @@
 #endif
 
 #include <QMutexLocker>
+#include <QElapsedTimer>
 #include <QFile>
 #include "libkleopatraclientcore_debug.h"
 #include <QDir>
@@ -416,6 +417,29 @@ my_assuan_transact(const AssuanClientContext &ctx,
     return assuan_transact(ctx.get(), command, data_cb, data_cb_arg, inquire_cb, inquire_cb_arg, status_cb, status_cb_arg);
 }
 
+namespace
+{
+// Records the duration of one Assuan transaction in Outputs::transactionTimes.
+class TransactionTimer
+{
+public:
+    TransactionTimer(QVector<QPair<QByteArray, qint64> > &times, const QByteArray &command)
+        : m_times(times), m_name(command.left(command.indexOf(' ')))
+    {
+        m_timer.start();
+    }
+    ~TransactionTimer()
+    {
+        m_times.push_back(qMakePair(m_name, m_timer.nsecsElapsed()));
+    }
+
+private:
+    QVector<QPair<QByteArray, qint64> > &m_times;
+    const QByteArray m_name;
+    QElapsedTimer m_timer;
+};
+}
+
 static QString to_error_string(int err)
 {
     char buffer[1024];
@@ -549,6 +573,8 @@ void Command::Private::run()
     {
         const QMutexLocker locker(&mutex);
         in = inputs;
+        // the server location is set by the user of Command, too
+        out.serverLocation = outputs.serverLocation;
         outputs = out;
     }
 
@@ -617,7 +643,10 @@ void Command::Private::run()
 #endif
 
     out.serverPid = -1;
-    err = my_assuan_transact(ctx, "GETINFO pid", &getinfo_pid_cb, &out.serverPid);
+    {
+        const TransactionTimer timer(out.transactionTimes, "GETINFO");
+        err = my_assuan_transact(ctx, "GETINFO pid", &getinfo_pid_cb, &out.serverPid);
+    }
     if (err || out.serverPid <= 0) {
         out.errorString = i18n("Could not get the process-id of the Kleopatra UI server at %1: %2", socketName, to_error_string(err));
         goto leave;
@@ -646,8 +675,12 @@ void Command::Private::run()
         }
     }
 
-    for (std::map<std::string, Option>::const_iterator it = in.options.begin(), end = in.options.end(); it != end; ++it)
-        if ((err = send_option(ctx, it->first.c_str(), it->second.hasValue ? it->second.value.toString() : QVariant()))) {
+    for (std::map<std::string, Option>::const_iterator it = in.options.begin(), end = in.options.end(); it != end; ++it) {
+        {
+            const TransactionTimer timer(out.transactionTimes, "OPTION");
+            err = send_option(ctx, it->first.c_str(), it->second.hasValue ? it->second.value.toString() : QVariant());
+        }
+        if (err) {
             if (it->second.isCritical) {
                 out.errorString = i18n("Failed to send critical option %1: %2", QString::fromLatin1(it->first.c_str()), to_error_string(err));
                 goto leave;
@@ -655,30 +688,56 @@ void Command::Private::run()
                 qCDebug(LIBKLEOPATRACLIENTCORE_LOG) << "Failed to send non-critical option" << it->first.c_str() << ":" << to_error_string(err);
             }
         }
+    }
 
-    Q_FOREACH (const QString &filePath, in.filePaths)
-        if ((err = send_file(ctx, filePath))) {
+    Q_FOREACH (const QString &filePath, in.filePaths) {
+        {
+            const TransactionTimer timer(out.transactionTimes, "FILE");
+            err = send_file(ctx, filePath);
+        }
+        if (err) {
             out.errorString = i18n("Failed to send file path %1: %2", filePath, to_error_string(err));
             goto leave;
         }
+    }
 
-    Q_FOREACH (const QString &sender, in.senders)
-        if ((err = send_sender(ctx, sender, in.areSendersInformative))) {
+    Q_FOREACH (const QString &sender, in.senders) {
+        {
+            const TransactionTimer timer(out.transactionTimes, "SENDER");
+            err = send_sender(ctx, sender, in.areSendersInformative);
+        }
+        if (err) {
             out.errorString = i18n("Failed to send sender %1: %2", sender, to_error_string(err));
             goto leave;
         }
+    }
 
-    Q_FOREACH (const QString &recipient, in.recipients)
-        if ((err = send_recipient(ctx, recipient, in.areRecipientsInformative))) {
+    Q_FOREACH (const QString &recipient, in.recipients) {
+        {
+            const TransactionTimer timer(out.transactionTimes, "RECIPIENT");
+            err = send_recipient(ctx, recipient, in.areRecipientsInformative);
+        }
+        if (err) {
             out.errorString = i18n("Failed to send recipient %1: %2", recipient, to_error_string(err));
             goto leave;
         }
+    }
 
-#if 0
-    setup I / O;
-#endif
+    Q_FOREACH (const QByteArray &command, in.setupCommands) {
+        {
+            const TransactionTimer timer(out.transactionTimes, command);
+            err = my_assuan_transact(ctx, command.constData());
+        }
+        if (err) {
+            out.errorString = i18n("Command (%1) failed: %2", QString::fromLatin1(command), to_error_string(err));
+            goto leave;
+        }
+    }
 
-    err = my_assuan_transact(ctx, in.command.constData(), &command_data_cb, &out.data, &command_inquire_cb, &id);
+    {
+        const TransactionTimer timer(out.transactionTimes, in.command);
+        err = my_assuan_transact(ctx, in.command.constData(), &command_data_cb, &out.data, &command_inquire_cb, &id);
+    }
     if (err) {
         if (gpg_err_code(err) == GPG_ERR_CANCELED) {
             out.canceled = true;
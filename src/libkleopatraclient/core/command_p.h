@@ -13,11 +13,14 @@
 
 #include <QThread>
 #include <QMutex>
+#include <QMutexLocker>
 
 #include <QString>
 #include <QStringList>
 #include <QByteArray>
+#include <QPair>
 #include <QVariant>
+#include <QVector>
 
 #include <map>
 #include <string>
@@ -40,6 +43,27 @@ public:
     }
     ~Private() override {}
 
+    // Used by the uiserver_replay test tool only; not part of the
+    // library's interface, since this header is not installed.
+
+    /* Raw Assuan commands (e.g. INPUT or MESSAGE) that are sent verbatim
+       after the options, files, senders and recipients and before the
+       command itself. */
+    void setSetupCommands(const QList<QByteArray> &commands)
+    {
+        const QMutexLocker locker(&mutex);
+        inputs.setupCommands = commands;
+    }
+
+    /* Returns the duration in nanoseconds of each Assuan transaction of the
+       last run, in the order they were made, together with the name of the
+       Assuan command. */
+    QVector<QPair<QByteArray, qint64> > transactionTimes()
+    {
+        const QMutexLocker locker(&mutex);
+        return outputs.transactionTimes;
+    }
+
 private:
     void init();
 
@@ -59,6 +83,7 @@ private:
         QStringList filePaths;
         QStringList recipients, senders;
         std::map<std::string, QByteArray> inquireData;
+        QList<QByteArray> setupCommands;
         WId parentWId;
         QByteArray command;
         bool areRecipientsInformative : 1;
@@ -71,6 +96,7 @@ private:
         QByteArray data;
         qint64 serverPid;
         QString serverLocation;
+        QVector<QPair<QByteArray, qint64> > transactionTimes;
     } outputs;
 };
 
@@ -0,0 +1,436 @@
+/*
+    uiserver_replay.cpp
+
+    This file is part of KleopatraClient, the Kleopatra interface library
+    SPDX-FileCopyrightText: 2021 g10 Code GmbH
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+//
+// Records UI server sessions from an Assuan log (see UiServer::setLogStream())
+// into a trace file and replays traces against a running UI server.
+//
+// Usage: uiserver_replay record [--io-size <bytes>] <assuan log> <trace>
+//        uiserver_replay replay [--socket <path>] [--concurrency <n>] [--repeat <n>] <trace>
+//
+// Trace format (one entry per line):
+//   S                       start of a session
+//   C <assuan command>      command sent verbatim (OPTION, FILE, SENDER, ...)
+//   I INPUT|MESSAGE <size>  input with <size> bytes of generated data
+//   F INPUT|MESSAGE <path>  input read from an existing file
+//   O OUTPUT [<options>]    output written to a temporary file
+//   Q <keyword> <size>      inquiry answered with <size> bytes
+//   X <assuan command>      the command that ends the session
+//
+
+#include <libkleopatraclient/core/command.h>
+// for access to the setup commands and transaction times
+#include "../core/command_p.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QMap>
+#include <QRandomGenerator>
+#include <QRegularExpression>
+#include <QTemporaryDir>
+#include <QTextStream>
+
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <vector>
+
+using namespace KleopatraClientCopy;
+
+namespace
+{
+
+struct Step {
+    char type;
+    QByteArray line;
+};
+
+struct Session {
+    std::vector<Step> steps;
+    QByteArray command;
+};
+
+QTextStream &err()
+{
+    static QTextStream stream(stderr);
+    return stream;
+}
+
+// Encodes a file name like the UI server expects option values.
+QByteArray hexencode(const QByteArray &in)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    QByteArray result;
+    for (const char c : in) {
+        const uchar ch = c;
+        if ((ch >= '0' && ch <= '9') || (ch >= 'A' && ch <= 'Z') || (ch >= 'a' && ch <= 'z') || ch == '/' || ch == '.' || ch == '-' || ch == '_') {
+            result += c;
+        } else {
+            result += '%';
+            result += hex[ch >> 4];
+            result += hex[ch & 0x0F];
+        }
+    }
+    return result;
+}
+
+// Returns the value of FILE=... in the arguments of an INPUT, OUTPUT or MESSAGE command.
+QString fileArgument(const QByteArray &args)
+{
+    const QList<QByteArray> words = args.split(' ');
+    for (const QByteArray &word : words) {
+        if (word.toUpper().startsWith("FILE=")) {
+            return QFile::decodeName(QByteArray::fromPercentEncoding(word.mid(5).replace('+', ' ')));
+        }
+    }
+    return QString();
+}
+
+// Returns the number of bytes in a data line as logged by libassuan. Data is
+// logged either percent-escaped or as hex dump, possibly shortened.
+qint64 dataLineSize(const QByteArray &line)
+{
+    if (line.startsWith("D ")) {
+        return line.size() - 2 - 2 * line.count('%');
+    }
+    if (line.startsWith('[')) {
+        static const QRegularExpression skipped(QStringLiteral("\\((\\d+) byte\\(s\\) skipped\\)"));
+        const auto match = skipped.match(QString::fromLatin1(line));
+        const QByteArray dump = match.hasMatch() ? line.left(match.capturedStart()) : line;
+        qint64 size = dump.mid(1).simplified().replace(']', "").split(' ').size() - 2; // "D "
+        if (match.hasMatch()) {
+            size += match.captured(1).toLongLong();
+        }
+        return std::max<qint64>(size, 0);
+    }
+    return 0;
+}
+
+bool isDataLine(const QByteArray &line)
+{
+    return line.startsWith("D ") || line.startsWith("[ 44 20");
+}
+
+int record(const QString &logFileName, const QString &traceFileName, qint64 ioSize)
+{
+    QFile log(logFileName);
+    if (!log.open(QIODevice::ReadOnly)) {
+        err() << "Failed to open " << logFileName << ": " << log.errorString() << endl;
+        return 1;
+    }
+    QFile trace(traceFileName);
+    if (!trace.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        err() << "Failed to open " << traceFileName << ": " << trace.errorString() << endl;
+        return 1;
+    }
+    trace.write("# kleopatra uiserver trace 1\n");
+
+    struct Channel {
+        Session session;
+        QByteArray inquiry;
+        qint64 inquirySize = 0;
+    };
+    QHash<QByteArray, Channel> channels;
+    static const QRegularExpression lineRE(QStringLiteral("chan_(\\S+) (<-|->) (.*)$"));
+    int numSessions = 0;
+
+    while (!log.atEnd()) {
+        const QString logLine = QString::fromUtf8(log.readLine()).trimmed();
+        const auto match = lineRE.match(logLine);
+        if (!match.hasMatch()) {
+            continue;
+        }
+        Channel &channel = channels[match.captured(1).toLatin1()];
+        const bool fromClient = match.captured(2) == QLatin1String("<-");
+        const QByteArray line = match.captured(3).toUtf8();
+        const QByteArray verb = line.left(line.indexOf(' ')).toUpper();
+        const QByteArray args = line.mid(verb.size() + 1);
+
+        if (!fromClient) {
+            if (line.startsWith("OK Pleased to meet you")) {
+                // a new connection
+                channel = Channel();
+            } else if (verb == "INQUIRE") {
+                channel.inquiry = args.left(args.indexOf(' '));
+                channel.inquirySize = 0;
+            }
+            continue;
+        }
+
+        if (!channel.inquiry.isEmpty()) {
+            if (isDataLine(line)) {
+                channel.inquirySize += dataLineSize(line);
+            } else if (verb == "END") {
+                channel.session.steps.push_back({ 'Q', channel.inquiry + ' ' + QByteArray::number(channel.inquirySize) });
+                channel.inquiry.clear();
+            } else if (verb == "CAN") {
+                channel.inquiry.clear();
+            }
+            continue;
+        }
+
+        if (verb == "GETINFO" || verb == "BYE" || verb == "NOP" || verb == "RESET" || verb.isEmpty()) {
+            // Command sends GETINFO pid itself
+        } else if (verb == "INPUT" || verb == "MESSAGE") {
+            const QString file = fileArgument(args);
+            if (!file.isEmpty() && QFileInfo(file).isFile()) {
+                channel.session.steps.push_back({ 'F', verb + ' ' + QFile::encodeName(file) });
+            } else {
+                // data passed via file descriptors isn't logged; use the configured size
+                const qint64 size = file.isEmpty() ? ioSize : QFileInfo(file).size();
+                channel.session.steps.push_back({ 'I', verb + ' ' + QByteArray::number(size > 0 ? size : ioSize) });
+            }
+        } else if (verb == "OUTPUT") {
+            const QByteArray options = args.contains("--binary") ? QByteArray(" --binary") : QByteArray();
+            channel.session.steps.push_back({ 'O', verb + options });
+        } else if (verb == "OPTION" || verb == "FILE" || verb == "SENDER" || verb == "RECIPIENT" || verb == "SESSION") {
+            channel.session.steps.push_back({ 'C', line });
+        } else {
+            trace.write("S\n");
+            for (const Step &step : channel.session.steps) {
+                trace.write(QByteArray(1, step.type) + ' ' + step.line + '\n');
+            }
+            trace.write("X " + line + '\n');
+            ++numSessions;
+            channel.session = Session();
+        }
+    }
+
+    err() << "Recorded " << numSessions << " sessions." << endl;
+    return 0;
+}
+
+bool loadTrace(const QString &fileName, std::vector<Session> &sessions)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        err() << "Failed to open " << fileName << ": " << file.errorString() << endl;
+        return false;
+    }
+    Session session;
+    int lineNumber = 0;
+    while (!file.atEnd()) {
+        ++lineNumber;
+        QByteArray line = file.readLine();
+        line.chop(line.endsWith('\n') ? 1 : 0);
+        if (line.isEmpty() || line.startsWith('#')) {
+            continue;
+        }
+        const char type = line[0];
+        const QByteArray rest = line.mid(2);
+        if (type == 'S') {
+            session = Session();
+        } else if (type == 'X') {
+            session.command = rest;
+            sessions.push_back(session);
+        } else if (type == 'C' || type == 'I' || type == 'F' || type == 'O' || type == 'Q') {
+            session.steps.push_back({ type, rest });
+        } else {
+            err() << fileName << ':' << lineNumber << ": invalid line" << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+class ReplayCommand : public Command
+{
+public:
+    ReplayCommand(const Session &session, QTemporaryDir &payloadDir, int number, QObject *parent = nullptr)
+        : Command(parent)
+    {
+        QList<QByteArray> setupCommands;
+        for (const Step &step : session.steps) {
+            const QByteArray verb = step.line.left(step.line.indexOf(' '));
+            const QByteArray args = step.line.mid(verb.size() + 1);
+            switch (step.type) {
+            case 'C':
+                setupCommands.push_back(step.line);
+                break;
+            case 'F':
+                setupCommands.push_back(verb + " FILE=" + hexencode(args));
+                break;
+            case 'I':
+                setupCommands.push_back(verb + " FILE=" + hexencode(QFile::encodeName(inputFile(payloadDir, args.toLongLong()))));
+                break;
+            case 'O': {
+                // the UI server only writes to existing files
+                const QString fileName = payloadDir.filePath(QStringLiteral("output-%1-%2").arg(number).arg(setupCommands.size()));
+                QFile(fileName).open(QIODevice::WriteOnly);
+                m_outputFiles.push_back(fileName);
+                setupCommands.push_back(verb + ' ' + args + " FILE=" + hexencode(QFile::encodeName(fileName)));
+                break;
+            }
+            case 'Q':
+                setInquireData(verb.constData(), QByteArray(args.toInt(), 'x'));
+                break;
+            }
+        }
+        d->setSetupCommands(setupCommands);
+        setCommand(session.command.constData());
+    }
+
+    ~ReplayCommand() override
+    {
+        for (const QString &fileName : qAsConst(m_outputFiles)) {
+            QFile::remove(fileName);
+        }
+    }
+
+    QVector<QPair<QByteArray, qint64> > transactionTimes() const
+    {
+        return d->transactionTimes();
+    }
+
+private:
+    static QString inputFile(QTemporaryDir &payloadDir, qint64 size)
+    {
+        // inputs of the same size share one file
+        const QString fileName = payloadDir.filePath(QStringLiteral("input-%1").arg(size));
+        QFile file(fileName);
+        if (!file.exists() && file.open(QIODevice::WriteOnly)) {
+            QRandomGenerator generator(size);
+            QByteArray chunk(64 * 1024, Qt::Uninitialized);
+            for (qint64 written = 0; written < size; written += chunk.size()) {
+                generator.fillRange(reinterpret_cast<quint32 *>(chunk.data()), chunk.size() / sizeof(quint32));
+                file.write(chunk.constData(), std::min<qint64>(chunk.size(), size - written));
+            }
+        }
+        return fileName;
+    }
+
+private:
+    QStringList m_outputFiles;
+};
+
+double percentile(const std::vector<qint64> &sorted, double p)
+{
+    if (sorted.empty()) {
+        return 0;
+    }
+    const size_t index = std::min(sorted.size() - 1, size_t(p * (sorted.size() - 1) + 0.5));
+    return sorted[index] / 1e6;
+}
+
+int replay(const std::vector<Session> &sessions, const QString &socket, int concurrency, int repeat)
+{
+    QTemporaryDir payloadDir;
+    if (!payloadDir.isValid()) {
+        err() << "Failed to create a temporary directory" << endl;
+        return 1;
+    }
+
+    QMap<QByteArray, std::vector<qint64> > latencies;
+    const int total = int(sessions.size()) * repeat;
+    int started = 0;
+    int finished = 0;
+    int errors = 0;
+    QElapsedTimer wallTime;
+
+    std::function<void()> startNext = [&]() {
+        if (started == total) {
+            return;
+        }
+        const int number = started++;
+        auto cmd = new ReplayCommand(sessions[number % sessions.size()], payloadDir, number);
+        if (!socket.isEmpty()) {
+            cmd->setServerLocation(socket);
+        }
+        auto sessionTimer = std::make_shared<QElapsedTimer>();
+        QObject::connect(cmd, &Command::finished, cmd, [&, cmd, sessionTimer, number]() {
+            latencies["(session)"].push_back(sessionTimer->nsecsElapsed());
+            if (cmd->error()) {
+                ++errors;
+                err() << "Session " << number << " failed: " << cmd->errorString() << endl;
+            }
+            const auto times = cmd->transactionTimes();
+            for (const auto &time : times) {
+                latencies[time.first].push_back(time.second);
+            }
+            cmd->deleteLater();
+            if (++finished == total) {
+                QCoreApplication::quit();
+            } else {
+                startNext();
+            }
+        });
+        sessionTimer->start();
+        cmd->start();
+    };
+
+    wallTime.start();
+    for (int i = 0; i < concurrency; ++i) {
+        startNext();
+    }
+    if (total > 0) {
+        QCoreApplication::exec();
+    }
+
+    QTextStream out(stdout);
+    out << total << " sessions (" << errors << " failed) with concurrency " << concurrency
+        << " in " << wallTime.elapsed() << " ms" << endl;
+    out << qSetFieldWidth(24) << left << "command" << qSetFieldWidth(10) << right
+        << "count" << "p50 ms" << "p90 ms" << "p99 ms" << "max ms" << qSetFieldWidth(0) << endl;
+    out.setRealNumberNotation(QTextStream::FixedNotation);
+    out.setRealNumberPrecision(2);
+    for (auto it = latencies.begin(); it != latencies.end(); ++it) {
+        std::vector<qint64> &values = it.value();
+        std::sort(values.begin(), values.end());
+        out << qSetFieldWidth(24) << left << it.key() << qSetFieldWidth(10) << right
+            << int(values.size()) << percentile(values, 0.5) << percentile(values, 0.9)
+            << percentile(values, 0.99) << values.back() / 1e6 << qSetFieldWidth(0) << endl;
+    }
+    return errors ? 1 : 0;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Records and replays Kleopatra UI server sessions."));
+    parser.addHelpOption();
+    parser.addPositionalArgument(QStringLiteral("mode"), QStringLiteral("record or replay"));
+    const QCommandLineOption ioSizeOption(QStringLiteral("io-size"),
+                                          QStringLiteral("Size of inputs passed as file descriptor (record)."),
+                                          QStringLiteral("bytes"), QStringLiteral("65536"));
+    const QCommandLineOption socketOption(QStringLiteral("socket"),
+                                          QStringLiteral("Socket of the UI server (replay)."),
+                                          QStringLiteral("path"));
+    const QCommandLineOption concurrencyOption(QStringLiteral("concurrency"),
+                                               QStringLiteral("Number of concurrent sessions (replay)."),
+                                               QStringLiteral("n"), QStringLiteral("1"));
+    const QCommandLineOption repeatOption(QStringLiteral("repeat"),
+                                          QStringLiteral("Number of times the trace is replayed (replay)."),
+                                          QStringLiteral("n"), QStringLiteral("1"));
+    parser.addOptions({ ioSizeOption, socketOption, concurrencyOption, repeatOption });
+    parser.process(app);
+
+    const QStringList args = parser.positionalArguments();
+    if (args.size() == 3 && args[0] == QLatin1String("record")) {
+        return record(args[1], args[2], parser.value(ioSizeOption).toLongLong());
+    }
+    if (args.size() == 2 && args[0] == QLatin1String("replay")) {
+        std::vector<Session> sessions;
+        if (!loadTrace(args[1], sessions)) {
+            return 1;
+        }
+        return replay(sessions, parser.value(socketOption),
+                      std::max(1, parser.value(concurrencyOption).toInt()),
+                      std::max(1, parser.value(repeatOption).toInt()));
+    }
+    parser.showHelp(1);
+}
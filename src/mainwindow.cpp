@@ -31,6 +31,7 @@
 #include "utils/action_data.h"
 #include "utils/filedialog.h"
 #include "utils/clipboardmenu.h"
+#include "utils/cryptoconfigcache.h"
 
 #include "dialogs/updatenotification.h"
 
@@ -481,19 +482,29 @@ void MainWindow::Private::setupActions()
 
 void MainWindow::Private::configureBackend()
 {
-    QGpgME::CryptoConfig *const config = QGpgME::cryptoConfig();
-    if (!config) {
-        KMessageBox::error(q, i18n("Could not configure the cryptography backend (gpgconf tool not found)"), i18n("Configuration Error"));
+    CryptoConfigCache *const cache = CryptoConfigCache::instance();
+    if (!cache->isLoaded()) {
+        QApplication::setOverrideCursor(Qt::WaitCursor);
+        cache->whenLoaded(q, [this]() {
+            QApplication::restoreOverrideCursor();
+            configureBackend();
+        });
         return;
     }
 
-    Kleo::CryptoConfigDialog dlg(config);
+    // keeps the snapshot alive while the dialog works with it
+    const CryptoConfigCache::Usage usage;
+    if (!usage.config()) {
+        KMessageBox::error(q, i18n("Could not configure the cryptography backend (gpgconf tool not found)"), i18n("Configuration Error"));
+        return;
+    }
 
+    Kleo::CryptoConfigDialog dlg(usage.config());
     const int result = dlg.exec();
 
-    // Forget all data parsed from gpgconf, so that we show updated information
-    // when reopening the configuration dialog.
-    config->clear();
+    // Reload the data parsed from gpgconf in the background, so that we show
+    // updated information when reopening the configuration dialog.
+    cache->invalidate();
 
     if (result == QDialog::Accepted) {
 #if 0
@@ -29,6 +29,7 @@
 #include "utils/validation.h"
 #include "utils/filedialog.h"
 #include "utils/keyparameters.h"
+#include "utils/cryptoconfigcache.h"
 
 #include <Libkleo/GnuPG>
 #include <Libkleo/Stl_Util>
@@ -1811,7 +1812,7 @@ void AdvancedSettingsDialog::fillKeySizeComboBoxen()
 // Try to load the default key type from GnuPG
 void AdvancedSettingsDialog::loadDefaultGnuPGKeyType()
 {
-    const auto conf = QGpgME::cryptoConfig();
+    const auto conf = CryptoConfigCache::instance()->config();
     if (!conf) {
         qCWarning(KLEOPATRA_LOG) << "Failed to obtain cryptoConfig.";
         return;
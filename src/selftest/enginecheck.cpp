@@ -14,6 +14,8 @@
 
 #include "implementation_p.h"
 
+#include <utils/cryptoconfigcache.h>
+
 #include <gpgme++/global.h>
 #include <gpgme++/engineinfo.h>
 #include <gpgme++/error.h>
@@ -69,7 +71,7 @@ public:
         // First use the crypto config which is much faster because it is only
         // created once and then kept in memory. Only if the crypoconfig is
         // bad we check into the engine info.
-        const auto conf = QGpgME::cryptoConfig();
+        const auto conf = CryptoConfigCache::instance()->config();
         if (conf && eng == GpgME::GpgEngine) {
             m_passed = true;
             return;
@@ -15,6 +15,7 @@
 
 #include <Libkleo/GnuPG>
 #include <utils/hex.h>
+#include <utils/cryptoconfigcache.h>
 
 #include "kleopatra_debug.h"
 #include <KLocalizedString>
@@ -43,7 +44,7 @@ public:
 
     void runTest()
     {
-        const auto conf = QGpgME::cryptoConfig();
+        const auto conf = CryptoConfigCache::instance()->config();
         QString message;
         m_passed = true;
 
@@ -701,6 +701,27 @@ struct Transaction {
 
 static const Transaction updateTransaction = { { "__all__", "__all__" }, "__update__", nullptr, nullptr, nullptr };
 static const Transaction quitTransaction   = { { "__all__", "__all__" }, "__quit__",   nullptr, nullptr, nullptr };
+static const QByteArray updateCardCommand = "__update_card__";
+
+static bool isUpdateTransaction(const Transaction &t)
+{
+    return !t.slot && (t.command == updateTransaction.command || t.command == updateCardCommand);
+}
+
+// Returns true if the queued update transaction \a queued makes the update
+// transaction \a t redundant.
+static bool coversUpdate(const Transaction &queued, const Transaction &t)
+{
+    if (!isUpdateTransaction(queued)) {
+        return false;
+    }
+    if (queued.command == updateTransaction.command) {
+        return true;
+    }
+    return t.command == updateCardCommand
+        && queued.cardApp.serialNumber == t.cardApp.serialNumber
+        && queued.cardApp.appName == t.cardApp.appName;
+}
 
 namespace
 {
@@ -736,7 +757,27 @@ public:
     void addTransaction(const Transaction &t)
     {
         const QMutexLocker locker(&m_mutex);
-        m_transactions.push_back(t);
+        if (isUpdateTransaction(t)) {
+            // An update that hasn't started yet will see all changes that
+            // happened until now, so there is no need to queue another one.
+            if (std::any_of(m_transactions.cbegin(), m_transactions.cend(),
+                            [&t](const Transaction &queued) { return coversUpdate(queued, t); })) {
+                qCDebug(KLEOPATRA_LOG) << "ReaderStatusThread: merged" << t.command << "with queued update";
+                return;
+            }
+            if (t.command == updateTransaction.command) {
+                m_transactions.remove_if([](const Transaction &queued) {
+                    return isUpdateTransaction(queued) && queued.command == updateCardCommand;
+                });
+            }
+            m_transactions.push_back(t);
+        } else {
+            // Card commands are usually started by the user who waits for the
+            // result; run them before the pending (background) updates, but
+            // keep their relative order.
+            const auto firstUpdate = std::find_if(m_transactions.begin(), m_transactions.end(), &isUpdateTransaction);
+            m_transactions.insert(firstUpdate, t);
+        }
         m_waitForTransactions.wakeOne();
     }
 
@@ -761,6 +802,13 @@ public Q_SLOTS:
         addTransaction(updateTransaction);
     }
 
+    void pingCard(const std::string &serialNumber, const std::string &appName)
+    {
+        qCDebug(KLEOPATRA_LOG) << "ReaderStatusThread[GUI]::pingCard(" << serialNumber << ',' << appName << ')';
+        const Transaction t = { { serialNumber, appName }, updateCardCommand, nullptr, nullptr, nullptr };
+        addTransaction(t);
+    }
+
     void stop()
     {
         const QMutexLocker locker(&m_mutex);
@@ -830,9 +878,18 @@ private:
                 return;    // quit
             }
 
-            if ((nullSlot && command == updateTransaction.command)) {
+            if (nullSlot && (command == updateTransaction.command || command == updateCardCommand)) {
 
-                std::vector<std::shared_ptr<Card> > newCards = update_cardinfo(gpgAgent);
+                std::vector<std::shared_ptr<Card> > newCards;
+                if (command == updateCardCommand) {
+                    if (!updateSingleCard(cardApp, gpgAgent, oldCards, newCards)) {
+                        // the card (or app) is gone or cannot be read; fall back to a full update
+                        ping();
+                        continue;
+                    }
+                } else {
+                    newCards = update_cardinfo(gpgAgent);
+                }
 
                 KDAB_SYNCHRONIZED(m_mutex)
                 m_cardInfos = newCards;
@@ -903,6 +960,28 @@ private:
         }
     }
 
+    // Reads the status of the card application \a cardApp and stores the
+    // list of known cards with the card replaced by the new status in
+    // \a newCards. Returns false if the card isn't known or couldn't be read.
+    static bool updateSingleCard(const CardApp &cardApp, std::shared_ptr<Context> &gpgAgent,
+                                 const std::vector<std::shared_ptr<Card> > &oldCards,
+                                 std::vector<std::shared_ptr<Card> > &newCards)
+    {
+        const auto matchesCardApp = [&cardApp](const std::shared_ptr<Card> &card) {
+            return card->serialNumber() == cardApp.serialNumber && card->appName() == cardApp.appName;
+        };
+        if (std::none_of(oldCards.cbegin(), oldCards.cend(), matchesCardApp)) {
+            return false;
+        }
+        const auto card = get_card_status(cardApp.serialNumber, cardApp.appName, gpgAgent);
+        if (card->status() != Card::CardPresent || !matchesCardApp(card)) {
+            return false;
+        }
+        newCards = oldCards;
+        std::replace_if(newCards.begin(), newCards.end(), matchesCardApp, card);
+        return true;
+    }
+
 private:
     mutable QMutex m_mutex;
     QWaitCondition m_waitForTransactions;
@@ -1059,6 +1138,11 @@ void ReaderStatus::updateStatus()
     d->ping();
 }
 
+void ReaderStatus::updateCard(const std::string &serialNumber, const std::string &appName)
+{
+    d->pingCard(serialNumber, appName);
+}
+
 std::vector <std::shared_ptr<Card> > ReaderStatus::getCards() const
 {
     return d->cardInfos();
@@ -52,6 +52,14 @@ public:
 
     std::shared_ptr<Card> getCard(const std::string &serialNumber, const std::string &appName) const;
 
+    /*!
+     * Re-reads the status of the card application \a appName of the card with
+     * the serial number \a serialNumber only. Use this instead of updateStatus()
+     * after a command that modified a single card. Falls back to a full update
+     * if the card is no longer available.
+     */
+    void updateCard(const std::string &serialNumber, const std::string &appName);
+
     template <typename T>
     std::shared_ptr<T> getCard(const std::string &serialNumber) const
     {
@@ -11,8 +11,6 @@
 
 #include "verifychecksumscommand.h"
 
-#ifndef QT_NO_DIRMODEL
-
 #include <crypto/verifychecksumscontroller.h>
 
 #include <Libkleo/KleoException>
@@ -84,5 +82,3 @@ void VerifyChecksumsCommand::doCanceled()
         d->controller->cancel();
     }
 }
-
-#endif // QT_NO_DIRMODEL
@@ -12,8 +12,6 @@
 
 #include "assuancommand.h"
 
-#ifndef QT_NO_DIRMODEL
-
 #include <QObject>
 
 namespace Kleo
@@ -50,6 +48,4 @@ private:
 
 }
 
-#endif // QT_NO_DIRMODEL
-
 #endif /* __KLEOPATRA_UISERVER_VERIFYCHECKSUMSCOMMAND_H__ */
@@ -0,0 +1,395 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    utils/certificatebundle.cpp
+
+    This file is part of Kleopatra, the KDE keymanager
+    SPDX-FileCopyrightText: 2021 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <config-kleopatra.h>
+
+#include "certificatebundle.h"
+
+#include <QCryptographicHash>
+#include <QList>
+
+using namespace Kleo;
+using namespace Kleo::CertificateBundle;
+
+namespace
+{
+
+enum PacketTag {
+    SignaturePacket = 2,
+    SecretKeyPacket = 5,
+    PublicKeyPacket = 6,
+    SecretSubkeyPacket = 7,
+    MarkerPacket = 10,
+    TrustPacket = 12,
+    UserIDPacket = 13,
+    PublicSubkeyPacket = 14,
+    UserAttributePacket = 17
+};
+
+struct Packet {
+    int tag = 0;
+    int headerLength = 0;
+    qint64 bodyLength = 0;
+};
+
+// Parses the header of the OpenPGP packet at data[pos]. Indeterminate and
+// partial body lengths are not used in transferable public keys and are
+// rejected.
+bool readPacketHeader(const QByteArray &data, qint64 pos, Packet *packet)
+{
+    const auto p = reinterpret_cast<const uchar *>(data.constData()) + pos;
+    const qint64 available = data.size() - pos;
+    if (available < 2 || !(p[0] & 0x80)) {
+        return false;
+    }
+    if (p[0] & 0x40) {
+        // new format
+        packet->tag = p[0] & 0x3f;
+        const uchar o1 = p[1];
+        if (o1 < 192) {
+            packet->headerLength = 2;
+            packet->bodyLength = o1;
+        } else if (o1 < 224) {
+            if (available < 3) {
+                return false;
+            }
+            packet->headerLength = 3;
+            packet->bodyLength = ((o1 - 192) << 8) + p[2] + 192;
+        } else if (o1 == 255) {
+            if (available < 6) {
+                return false;
+            }
+            packet->headerLength = 6;
+            packet->bodyLength = (qint64(p[2]) << 24) | (p[3] << 16) | (p[4] << 8) | p[5];
+        } else {
+            return false;
+        }
+    } else {
+        // old format
+        packet->tag = (p[0] >> 2) & 0x0f;
+        switch (p[0] & 0x03) {
+        case 0:
+            packet->headerLength = 2;
+            packet->bodyLength = p[1];
+            break;
+        case 1:
+            if (available < 3) {
+                return false;
+            }
+            packet->headerLength = 3;
+            packet->bodyLength = (p[1] << 8) | p[2];
+            break;
+        case 2:
+            if (available < 5) {
+                return false;
+            }
+            packet->headerLength = 5;
+            packet->bodyLength = (qint64(p[1]) << 24) | (p[2] << 16) | (p[3] << 8) | p[4];
+            break;
+        default:
+            return false;
+        }
+    }
+    return packet->headerLength + packet->bodyLength <= available;
+}
+
+QByteArray openpgpFingerprint(const QByteArray &body)
+{
+    // only v4 keys are supported; other versions are always imported
+    if (body.isEmpty() || body[0] != 4 || body.size() > 0xffff) {
+        return QByteArray();
+    }
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    const char header[] = { char(0x99), char(body.size() >> 8), char(body.size() & 0xff) };
+    hash.addData(header, sizeof header);
+    hash.addData(body);
+    return hash.result().toHex().toUpper();
+}
+
+Certificate makeCertificate(const QByteArray &data, const QByteArray &fingerprint)
+{
+    Certificate result;
+    result.fingerprint = fingerprint;
+    result.digest = QCryptographicHash::hash(data, QCryptographicHash::Sha256);
+    result.data = data;
+    return result;
+}
+
+class LineReader
+{
+public:
+    explicit LineReader(const QByteArray &data) : m_data(data) {}
+
+    bool atEnd() const
+    {
+        return m_pos >= m_data.size();
+    }
+
+    QByteArray next()
+    {
+        int end = m_data.indexOf('\n', m_pos);
+        if (end < 0) {
+            end = m_data.size();
+        }
+        QByteArray line = m_data.mid(m_pos, end - m_pos);
+        m_pos = end + 1;
+        if (line.endsWith('\r')) {
+            line.chop(1);
+        }
+        return line;
+    }
+
+private:
+    const QByteArray &m_data;
+    int m_pos = 0;
+};
+
+// Decodes all armored blocks in data. Returns false if a block of another
+// type than one of the given types is found or if no block was found.
+bool dearmor(const QByteArray &data, const QList<QByteArray> &types, bool skipHeaders, std::vector<QByteArray> *blocks)
+{
+    LineReader reader(data);
+    while (!reader.atEnd()) {
+        const QByteArray line = reader.next().trimmed();
+        if (!line.startsWith("-----BEGIN ") || !line.endsWith("-----")) {
+            continue;
+        }
+        const QByteArray type = line.mid(11, line.size() - 16);
+        if (!types.contains(type)) {
+            return false;
+        }
+        if (skipHeaders) {
+            // skip the armor headers up to the empty line
+            while (!reader.atEnd() && !reader.next().trimmed().isEmpty()) {
+            }
+        }
+        QByteArray base64;
+        bool complete = false;
+        while (!reader.atEnd()) {
+            const QByteArray l = reader.next().trimmed();
+            if (l.startsWith("-----END ")) {
+                complete = true;
+                break;
+            }
+            if (l.startsWith('=')) {
+                // the CRC24 of OpenPGP armor; gpg checks it on import
+                continue;
+            }
+            base64 += l;
+        }
+        if (!complete) {
+            return false;
+        }
+        blocks->push_back(QByteArray::fromBase64(base64));
+    }
+    return !blocks->empty();
+}
+
+bool splitOpenPGPBinary(const QByteArray &data, std::vector<Certificate> *result)
+{
+    qint64 pos = 0;
+    qint64 certStart = -1;
+    Certificate current;
+    const auto finishCertificate = [&]() {
+        result->push_back(makeCertificate(data.mid(certStart, pos - certStart), current.fingerprint));
+    };
+    while (pos < data.size()) {
+        Packet packet;
+        if (!readPacketHeader(data, pos, &packet)) {
+            return false;
+        }
+        if (packet.tag != PublicKeyPacket && packet.tag != MarkerPacket && certStart < 0) {
+            return false;
+        }
+        switch (packet.tag) {
+        case PublicKeyPacket:
+            if (certStart >= 0) {
+                finishCertificate();
+            }
+            certStart = pos;
+            current = Certificate();
+            current.fingerprint = openpgpFingerprint(data.mid(pos + packet.headerLength, packet.bodyLength));
+            break;
+        case SignaturePacket:
+        case UserIDPacket:
+        case PublicSubkeyPacket:
+        case TrustPacket:
+        case UserAttributePacket:
+            break;
+        case MarkerPacket:
+            break;
+        default:
+            // secret keys and anything else are left to gpg
+            return false;
+        }
+        pos += packet.headerLength + packet.bodyLength;
+    }
+    if (certStart >= 0) {
+        finishCertificate();
+    }
+    return true;
+}
+
+enum {
+    DerBitString = 0x03,
+    DerSequence = 0x30
+};
+
+// Returns the total length of the DER encoded element with the given tag
+// at data[pos] or -1. Sets contentStart to the offset of its contents.
+qint64 derElementLength(const QByteArray &data, qint64 pos, uchar tag, qint64 *contentStart = nullptr)
+{
+    const auto p = reinterpret_cast<const uchar *>(data.constData()) + pos;
+    const qint64 available = data.size() - pos;
+    if (available < 2 || p[0] != tag) {
+        return -1;
+    }
+    qint64 length;
+    int headerLength;
+    if (p[1] < 0x80) {
+        length = p[1];
+        headerLength = 2;
+    } else {
+        const int n = p[1] & 0x7f;
+        if (n < 1 || n > 4 || available < 2 + n) {
+            return -1;
+        }
+        length = 0;
+        for (int i = 0; i < n; ++i) {
+            length = (length << 8) | p[2 + i];
+        }
+        headerLength = 2 + n;
+    }
+    if (contentStart) {
+        *contentStart = pos + headerLength;
+    }
+    return headerLength + length <= available ? headerLength + length : -1;
+}
+
+// Returns the length of the X.509 certificate at data[pos] or -1. Only the
+// outer structure is checked:
+//   Certificate ::= SEQUENCE { tbsCertificate SEQUENCE,
+//                              signatureAlgorithm SEQUENCE,
+//                              signatureValue BIT STRING }
+qint64 x509CertificateLength(const QByteArray &data, qint64 pos)
+{
+    qint64 p;
+    const qint64 length = derElementLength(data, pos, DerSequence, &p);
+    if (length < 0) {
+        return -1;
+    }
+    const qint64 end = pos + length;
+    // the elements must not extend beyond the certificate
+    const QByteArray content = QByteArray::fromRawData(data.constData(), end);
+    for (const uchar tag : {uchar(DerSequence), uchar(DerSequence), uchar(DerBitString)}) {
+        const qint64 elementLength = derElementLength(content, p, tag);
+        if (elementLength < 0) {
+            return -1;
+        }
+        p += elementLength;
+    }
+    return p == end ? length : -1;
+}
+
+bool splitX509Binary(const QByteArray &data, std::vector<Certificate> *result)
+{
+    qint64 pos = 0;
+    while (pos < data.size()) {
+        const qint64 length = x509CertificateLength(data, pos);
+        if (length < 0) {
+            return false;
+        }
+        const QByteArray der = data.mid(pos, length);
+        result->push_back(makeCertificate(der, QCryptographicHash::hash(der, QCryptographicHash::Sha1).toHex().toUpper()));
+        pos += length;
+    }
+    return true;
+}
+
+}
+
+std::vector<Certificate> CertificateBundle::splitOpenPGP(const QByteArray &data, bool *ok)
+{
+    std::vector<Certificate> result;
+    bool success = false;
+    if (!data.isEmpty() && (data[0] & 0x80)) {
+        success = splitOpenPGPBinary(data, &result);
+    } else {
+        std::vector<QByteArray> blocks;
+        if (dearmor(data, QList<QByteArray>() << QByteArray("PGP PUBLIC KEY BLOCK"), true, &blocks)) {
+            success = true;
+            for (const QByteArray &block : blocks) {
+                if (!splitOpenPGPBinary(block, &result)) {
+                    success = false;
+                    break;
+                }
+            }
+        }
+    }
+    if (!success) {
+        result.clear();
+    }
+    if (ok) {
+        *ok = success;
+    }
+    return result;
+}
+
+std::vector<Certificate> CertificateBundle::splitX509(const QByteArray &data, bool *ok)
+{
+    std::vector<Certificate> result;
+    bool success = false;
+    if (!data.isEmpty() && data[0] == 0x30) {
+        success = splitX509Binary(data, &result);
+    } else {
+        std::vector<QByteArray> blocks;
+        if (dearmor(data, QList<QByteArray>() << QByteArray("CERTIFICATE") << QByteArray("X509 CERTIFICATE"), false, &blocks)) {
+            success = true;
+            for (const QByteArray &block : blocks) {
+                // one certificate per PEM block
+                if (x509CertificateLength(block, 0) != block.size()) {
+                    success = false;
+                    break;
+                }
+                result.push_back(makeCertificate(block, QCryptographicHash::hash(block, QCryptographicHash::Sha1).toHex().toUpper()));
+            }
+        }
+    }
+    if (!success) {
+        result.clear();
+    }
+    if (ok) {
+        *ok = success;
+    }
+    return result;
+}
+
+QByteArray CertificateBundle::joinOpenPGP(const std::vector<Certificate> &certificates)
+{
+    QByteArray result;
+    for (const Certificate &cert : certificates) {
+        result += cert.data;
+    }
+    return result;
+}
+
+QByteArray CertificateBundle::joinX509(const std::vector<Certificate> &certificates)
+{
+    QByteArray result;
+    for (const Certificate &cert : certificates) {
+        result += "-----BEGIN CERTIFICATE-----\n";
+        const QByteArray base64 = cert.data.toBase64();
+        for (int i = 0; i < base64.size(); i += 64) {
+            result += base64.mid(i, 64);
+            result += '\n';
+        }
+        result += "-----END CERTIFICATE-----\n";
+    }
+    return result;
+}
@@ -0,0 +1,56 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    utils/certificatebundle.h
+
+    This file is part of Kleopatra, the KDE keymanager
+    SPDX-FileCopyrightText: 2021 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef __KLEOPATRA_UTILS_CERTIFICATEBUNDLE_H__
+#define __KLEOPATRA_UTILS_CERTIFICATEBUNDLE_H__
+
+#include <QByteArray>
+
+#include <vector>
+
+namespace Kleo
+{
+namespace CertificateBundle
+{
+
+struct Certificate {
+    /*! The fingerprint as upper-case hex string; empty if it could not be computed. */
+    QByteArray fingerprint;
+    /*! A SHA-256 digest of data. */
+    QByteArray digest;
+    /*! The binary packets (OpenPGP) or the DER encoding (X.509) of the certificate. */
+    QByteArray data;
+};
+
+/*!
+ * Splits \a data, which may be binary or ASCII armored, into the individual
+ * OpenPGP certificates. Sets \a ok to false if \a data isn't a plain
+ * sequence of public keys (e.g. because it contains secret keys or uses
+ * packet features the splitter doesn't understand).
+ */
+std::vector<Certificate> splitOpenPGP(const QByteArray &data, bool *ok);
+
+/*!
+ * Splits \a data, which may be a sequence of PEM or DER encoded X.509
+ * certificates, into the individual certificates. Sets \a ok to false for
+ * anything else (e.g. PKCS#7 or PKCS#12 files, which are DER encoded
+ * sequences, too, but do not have the structure of a certificate).
+ */
+std::vector<Certificate> splitX509(const QByteArray &data, bool *ok);
+
+/*! Concatenates the binary packets of \a certificates. */
+QByteArray joinOpenPGP(const std::vector<Certificate> &certificates);
+
+/*! Returns \a certificates as sequence of PEM blocks. */
+QByteArray joinX509(const std::vector<Certificate> &certificates);
+
+}
+}
+
+#endif // __KLEOPATRA_UTILS_CERTIFICATEBUNDLE_H__
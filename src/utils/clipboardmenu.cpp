@@ -21,11 +21,18 @@
 #include <QApplication>
 #include <QClipboard>
 #include <QSignalBlocker>
+#include <QTimer>
 
 using namespace Kleo;
 
 using namespace Kleo::Commands;
 
+namespace
+{
+// QClipboard::changed is emitted more than once for a single copy
+const int ClipboardChangeDelay = 100; // ms
+}
+
 ClipboardMenu::ClipboardMenu(QObject *parent)
     : QObject(parent),
       mWindow(nullptr)
@@ -54,7 +61,16 @@ ClipboardMenu::ClipboardMenu(QObject *parent)
     mClipboardMenu->addAction(mSmimeSignClipboardAction);
     mClipboardMenu->addAction(mOpenPGPSignClipboardAction);
     mClipboardMenu->addAction(mDecryptVerifyClipboardAction);
-    connect(QApplication::clipboard(), &QClipboard::changed, this, &ClipboardMenu::slotEnableDisableActions);
+    mClipboardChangeTimer = new QTimer(this);
+    mClipboardChangeTimer->setSingleShot(true);
+    mClipboardChangeTimer->setInterval(ClipboardChangeDelay);
+    connect(mClipboardChangeTimer, &QTimer::timeout, this, &ClipboardMenu::slotEnableDisableActions);
+    connect(QApplication::clipboard(), &QClipboard::changed, this, [this](QClipboard::Mode mode) {
+        // the actions work only on the clipboard, not on the selection
+        if (mode == QClipboard::Clipboard) {
+            mClipboardChangeTimer->start();
+        }
+    });
     slotEnableDisableActions();
 }
 
@@ -10,6 +10,7 @@
 #include <QObject>
 class KActionMenu;
 class QAction;
+class QTimer;
 class MainWindow;
 namespace Kleo
 {
@@ -43,6 +44,7 @@ private:
     QAction *mSmimeSignClipboardAction;
     QAction *mOpenPGPSignClipboardAction;
     QAction *mDecryptVerifyClipboardAction;
+    QTimer *mClipboardChangeTimer;
     MainWindow *mWindow;
 };
 
@@ -0,0 +1,29 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    utils/clipboardprobe.cpp
+
+    This file is part of Kleopatra, the KDE keymanager
+    SPDX-FileCopyrightText: 2021 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <config-kleopatra.h>
+
+#include "clipboardprobe.h"
+
+#include <Libkleo/Classify>
+
+#include <QString>
+
+using namespace Kleo;
+
+namespace
+{
+// enough for the armor headers and some text in front of them
+const int SniffLength = 64 * 1024;
+}
+
+unsigned int Kleo::classifyClipboardText(const QString &text)
+{
+    return classifyContent(text.midRef(0, SniffLength).toUtf8());
+}
@@ -0,0 +1,27 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    utils/clipboardprobe.h
+
+    This file is part of Kleopatra, the KDE keymanager
+    SPDX-FileCopyrightText: 2021 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef __KLEOPATRA_UTILS_CLIPBOARDPROBE_H__
+#define __KLEOPATRA_UTILS_CLIPBOARDPROBE_H__
+
+class QString;
+
+namespace Kleo
+{
+
+/*!
+ * Classifies clipboard \a text like Kleo::classifyContent(), but looks only
+ * at its beginning. Armored data is recognized by its header, so there is
+ * no need to convert and scan all of a large clipboard.
+ */
+unsigned int classifyClipboardText(const QString &text);
+
+}
+
+#endif // __KLEOPATRA_UTILS_CLIPBOARDPROBE_H__
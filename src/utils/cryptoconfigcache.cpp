@@ -0,0 +1,272 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    utils/cryptoconfigcache.cpp
+
+    This file is part of Kleopatra, the KDE keymanager
+    SPDX-FileCopyrightText: 2021 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <config-kleopatra.h>
+
+#include "cryptoconfigcache.h"
+
+#include <Libkleo/FileSystemWatcher>
+#include <Libkleo/GnuPG>
+
+#include <QGpgME/Protocol>
+#include <QGpgME/CryptoConfig>
+#if HAVE_QGPGME_NEWCRYPTOCONFIG
+# include <qgpgme/qgpgmenewcryptoconfig.h>
+#endif
+
+#include <gpgme++/global.h>
+
+#include "kleopatra_debug.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QPointer>
+#include <QThread>
+#include <QTimer>
+
+#include <memory>
+
+using namespace Kleo;
+
+namespace
+{
+
+// Parsing the gpgconf output happens lazily in QGpgME; touching all
+// components and groups forces everything to be parsed at once.
+void loadConfiguration(QGpgME::CryptoConfig *config)
+{
+    QElapsedTimer timer;
+    timer.start();
+    const QStringList components = config->componentList();
+    for (const QString &name : components) {
+        if (QGpgME::CryptoConfigComponent *const component = config->component(name)) {
+            const QStringList groups = component->groupList();
+            for (const QString &group : groups) {
+                (void)component->group(group);
+            }
+        }
+    }
+    qCDebug(KLEOPATRA_LOG) << "CryptoConfigCache: loaded" << components.size() << "components in" << timer.elapsed() << "ms";
+}
+
+#if HAVE_QGPGME_NEWCRYPTOCONFIG
+std::shared_ptr<QGpgME::CryptoConfig> createConfiguration()
+{
+    // a new instance runs gpgconf itself; it shares nothing with the
+    // instance of QGpgME::cryptoConfig() or with other snapshots
+    auto config = std::make_shared<QGpgME::QGpgMENewCryptoConfig>();
+    loadConfiguration(config.get());
+    return config;
+}
+#else
+std::shared_ptr<QGpgME::CryptoConfig> createConfiguration()
+{
+    // Without an instance of our own we have to reload the shared one on
+    // the GUI thread. It is not ours to delete.
+    QGpgME::CryptoConfig *const config = QGpgME::cryptoConfig();
+    config->clear();
+    loadConfiguration(config);
+    return std::shared_ptr<QGpgME::CryptoConfig>(config, [](QGpgME::CryptoConfig *) {});
+}
+#endif
+
+class LoaderThread : public QThread
+{
+public:
+    using QThread::QThread;
+
+    // only valid after the thread has finished
+    std::shared_ptr<QGpgME::CryptoConfig> takeResult()
+    {
+        return std::move(m_result);
+    }
+
+private:
+    void run() override
+    {
+        m_result = createConfiguration();
+    }
+
+private:
+    std::shared_ptr<QGpgME::CryptoConfig> m_result;
+};
+
+}
+
+class CryptoConfigCache::Private
+{
+public:
+    explicit Private(CryptoConfigCache *qq);
+
+    void startLoading();
+    void publish(std::shared_ptr<QGpgME::CryptoConfig> config);
+    void waitForLoading();
+
+    bool haveSnapshot = false;
+    std::shared_ptr<QGpgME::CryptoConfig> snapshot;
+    QPointer<LoaderThread> thread;
+    int generation = 0;
+    bool reloadPending = false;
+    FileSystemWatcher watcher;
+
+private:
+    CryptoConfigCache *const q;
+};
+
+CryptoConfigCache::Private::Private(CryptoConfigCache *qq)
+    : q(qq)
+{
+    watcher.whitelistFiles(QStringList(QStringLiteral("*.conf")));
+    watcher.addPath(gnupgHomeDirectory());
+    watcher.setDelay(1000);
+    QObject::connect(&watcher, &FileSystemWatcher::triggered, q, [this]() {
+        qCDebug(KLEOPATRA_LOG) << "CryptoConfigCache: configuration files changed";
+        q->invalidate();
+    });
+}
+
+void CryptoConfigCache::Private::startLoading()
+{
+    if (thread) {
+        return;
+    }
+    if (!GpgME::hasFeature(GpgME::GpgConfEngineFeature, 0)) {
+        qCWarning(KLEOPATRA_LOG) << "CryptoConfigCache: gpgconf is not available";
+        publish(nullptr);
+        return;
+    }
+#if HAVE_QGPGME_NEWCRYPTOCONFIG
+    thread = new LoaderThread(q);
+    const int gen = ++generation;
+    QObject::connect(thread.data(), &QThread::finished, q, [this, gen]() {
+        // config() may have taken the result already
+        if (gen == generation && thread) {
+            waitForLoading();
+        }
+    });
+    thread->start(QThread::LowPriority);
+#else
+    publish(createConfiguration());
+#endif
+}
+
+void CryptoConfigCache::Private::waitForLoading()
+{
+    thread->wait();
+    std::shared_ptr<QGpgME::CryptoConfig> config = thread->takeResult();
+    thread->deleteLater();
+    thread = nullptr;
+    publish(std::move(config));
+}
+
+void CryptoConfigCache::Private::publish(std::shared_ptr<QGpgME::CryptoConfig> config)
+{
+    // the previous snapshot lives on as long as somebody holds a Usage of it
+    snapshot = std::move(config);
+    haveSnapshot = true;
+    if (reloadPending) {
+        // the configuration changed while it was being loaded
+        reloadPending = false;
+        startLoading();
+        return;
+    }
+    Q_EMIT q->loaded();
+}
+
+// static
+CryptoConfigCache *CryptoConfigCache::instance()
+{
+    static QPointer<CryptoConfigCache> self;
+    if (!self) {
+        self = new CryptoConfigCache(QCoreApplication::instance());
+    }
+    return self;
+}
+
+CryptoConfigCache::CryptoConfigCache(QObject *parent)
+    : QObject(parent), d(new Private(this))
+{
+}
+
+CryptoConfigCache::~CryptoConfigCache()
+{
+    if (d->thread) {
+        d->thread->wait();
+    }
+}
+
+bool CryptoConfigCache::isLoaded() const
+{
+    return d->haveSnapshot && !d->thread;
+}
+
+void CryptoConfigCache::prefetch()
+{
+    if (!d->haveSnapshot) {
+        d->startLoading();
+    }
+}
+
+void CryptoConfigCache::prefetchWhenIdle()
+{
+    QTimer::singleShot(2000, this, &CryptoConfigCache::prefetch);
+}
+
+QGpgME::CryptoConfig *CryptoConfigCache::config()
+{
+    if (!d->haveSnapshot) {
+        if (d->thread) {
+            qCDebug(KLEOPATRA_LOG) << "CryptoConfigCache: waiting for the background loading";
+            d->waitForLoading();
+        } else if (GpgME::hasFeature(GpgME::GpgConfEngineFeature, 0)) {
+            d->publish(createConfiguration());
+        } else {
+            d->publish(nullptr);
+        }
+    }
+    return d->snapshot.get();
+}
+
+void CryptoConfigCache::whenLoaded(QObject *receiver, const std::function<void()> &func)
+{
+    if (isLoaded()) {
+        func();
+        return;
+    }
+    auto connection = std::make_shared<QMetaObject::Connection>();
+    *connection = connect(this, &CryptoConfigCache::loaded, receiver, [connection, func]() {
+        QObject::disconnect(*connection);
+        func();
+    });
+    prefetch();
+}
+
+void CryptoConfigCache::invalidate()
+{
+    // code that still uses QGpgME::cryptoConfig() must not see stale data either
+    if (QGpgME::CryptoConfig *const config = QGpgME::cryptoConfig()) {
+        config->clear();
+    }
+    if (d->thread) {
+        d->reloadPending = true;
+    } else if (d->haveSnapshot) {
+        d->startLoading();
+    }
+}
+
+CryptoConfigCache::Usage::Usage()
+{
+    CryptoConfigCache *const cache = CryptoConfigCache::instance();
+    cache->config();
+    m_config = cache->d->snapshot;
+}
+
+CryptoConfigCache::Usage::~Usage() {}
+
+#include "moc_cryptoconfigcache.cpp"
@@ -0,0 +1,123 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    utils/cryptoconfigcache.h
+
+    This file is part of Kleopatra, the KDE keymanager
+    SPDX-FileCopyrightText: 2021 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef __KLEOPATRA_UTILS_CRYPTOCONFIGCACHE_H__
+#define __KLEOPATRA_UTILS_CRYPTOCONFIGCACHE_H__
+
+#include <QObject>
+
+#include <utils/pimpl_ptr.h>
+
+#include <functional>
+#include <memory>
+
+namespace QGpgME
+{
+class CryptoConfig;
+}
+
+namespace Kleo
+{
+
+/*!
+ * Loads the gpgconf data in a background thread and shares it.
+ *
+ * Parsing the output of gpgconf --list-components and --list-options for
+ * all components takes seconds on some systems. This class does it off the
+ * GUI thread, with a CryptoConfig instance of its own (the instance returned
+ * by QGpgME::cryptoConfig() must not be touched from other threads), and
+ * publishes the parsed configuration to the GUI thread when it is complete.
+ *
+ * The data is reloaded in the background when a configuration file in the
+ * GnuPG home directory changes or when invalidate() is called. Until the
+ * reload is complete, the previous snapshot stays available; a snapshot is
+ * never cleared while it is in use.
+ *
+ * If QGpgME does not install QGpgMENewCryptoConfig, then the instance of
+ * QGpgME::cryptoConfig() is reloaded on the GUI thread instead, and the
+ * guarantees above do not hold.
+ *
+ * Must only be used from the GUI thread.
+ */
+class CryptoConfigCache : public QObject
+{
+    Q_OBJECT
+public:
+    static CryptoConfigCache *instance();
+    ~CryptoConfigCache() override;
+
+    /*! Returns true if the configuration is loaded and no reload is pending. */
+    bool isLoaded() const;
+
+    /*! Starts loading the configuration in the background, unless already done. */
+    void prefetch();
+    /*! Calls prefetch() after the application had some time to settle. */
+    void prefetchWhenIdle();
+
+    /*!
+     * Returns the current configuration snapshot, or nullptr if gpgconf is
+     * not available. If nothing has been loaded yet, then this waits for
+     * (or performs) the loading. Prefer whenLoaded() in code that can wait
+     * for the result.
+     *
+     * The snapshot may be replaced by a reloaded one whenever control
+     * returns to the event loop. Code that keeps the configuration (or
+     * entries of it) for longer must hold a Usage.
+     */
+    QGpgME::CryptoConfig *config();
+
+    /*!
+     * Calls \a func as soon as the configuration is loaded, i.e. immediately
+     * if it is already loaded. \a func is not called if \a receiver is
+     * destroyed before.
+     */
+    void whenLoaded(QObject *receiver, const std::function<void()> &func);
+
+    /*!
+     * Keeps the snapshot returned by config() alive, even if it is replaced
+     * by a reloaded snapshot in the meantime.
+     */
+    class Usage
+    {
+    public:
+        Usage();
+        ~Usage();
+
+        QGpgME::CryptoConfig *config() const
+        {
+            return m_config.get();
+        }
+
+    private:
+        Q_DISABLE_COPY(Usage)
+        std::shared_ptr<QGpgME::CryptoConfig> m_config;
+    };
+
+public Q_SLOTS:
+    /*!
+     * Reloads the configuration in the background. The current snapshot
+     * stays available until the reloaded one replaces it. The instance of
+     * QGpgME::cryptoConfig() is cleared right away.
+     */
+    void invalidate();
+
+Q_SIGNALS:
+    /*! Emitted when an up-to-date snapshot has been published. */
+    void loaded();
+
+private:
+    explicit CryptoConfigCache(QObject *parent = nullptr);
+
+    class Private;
+    kdtools::pimpl_ptr<Private> d;
+};
+
+}
+
+#endif // __KLEOPATRA_UTILS_CRYPTOCONFIGCACHE_H__
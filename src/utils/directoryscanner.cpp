@@ -0,0 +1,365 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    utils/directoryscanner.cpp
+
+    This file is part of Kleopatra, the KDE keymanager
+    SPDX-FileCopyrightText: 2021 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <config-kleopatra.h>
+
+#include "directoryscanner.h"
+
+#include "kleopatra_debug.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QSet>
+#include <QThread>
+#include <QWaitCondition>
+
+#ifdef Q_OS_UNIX
+# include <dirent.h>
+# include <errno.h>
+# include <fcntl.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#else
+# include <QDirIterator>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+
+using namespace Kleo;
+
+//
+// FileNameMatcher
+//
+
+static bool is_simple_pattern(const QString &pattern)
+{
+    return !pattern.isEmpty()
+           && std::all_of(pattern.cbegin(), pattern.cend(), [](QChar ch) {
+                  return (ch.unicode() < 128 && ch.isLetterOrNumber())
+                         || ch == QLatin1Char('-') || ch == QLatin1Char('_') || ch == QLatin1Char('.');
+              });
+}
+
+// '.' matches any character, like in the regular expression
+static bool matches_simple_pattern(const QString &pattern, const QString &s, Qt::CaseSensitivity cs)
+{
+    if (pattern.size() != s.size()) {
+        return false;
+    }
+    for (int i = 0, end = pattern.size(); i < end; ++i) {
+        const QChar p = pattern[i];
+        if (p == QLatin1Char('.')) {
+            continue;
+        }
+        const QChar c = s[i];
+        if (p != c && (cs == Qt::CaseSensitive || p.toCaseFolded() != c.toCaseFolded())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+FileNameMatcher::FileNameMatcher(const QStringList &patterns, Qt::CaseSensitivity cs)
+    : m_cs(cs)
+{
+    m_patterns.reserve(patterns.size());
+    for (const QString &pattern : patterns) {
+        Pattern p;
+        if (is_simple_pattern(pattern)) {
+            p.simple = pattern;
+        } else {
+            QRegularExpression::PatternOptions options = QRegularExpression::DontCaptureOption;
+            if (cs == Qt::CaseInsensitive) {
+                options |= QRegularExpression::CaseInsensitiveOption;
+            }
+            p.rx = QRegularExpression(QRegularExpression::anchoredPattern(pattern), options);
+            if (!p.rx.isValid()) {
+                qCWarning(KLEOPATRA_LOG) << "Invalid file name pattern" << pattern << ":" << p.rx.errorString();
+                continue;
+            }
+            p.rx.optimize();
+        }
+        m_patterns.push_back(p);
+    }
+}
+
+int FileNameMatcher::indexOf(const QString &fileName) const
+{
+    for (unsigned int i = 0, end = m_patterns.size(); i < end; ++i) {
+        const Pattern &p = m_patterns[i];
+        if (p.simple.isEmpty()
+            ? p.rx.match(fileName).hasMatch()
+            : matches_simple_pattern(p.simple, fileName, m_cs)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+//
+// DirectoryScanner
+//
+
+namespace
+{
+
+// returns the order of QDir's default sorting (QDir::Name | QDir::IgnoreCase)
+bool less_file_name(const DirectoryScanner::File &lhs, const DirectoryScanner::File &rhs)
+{
+    const int ci = QString::compare(lhs.name, rhs.name, Qt::CaseInsensitive);
+    return ci < 0 || (ci == 0 && lhs.name < rhs.name);
+}
+
+// Reads the directory \a path into \a dir. \a firstVisit is called with an
+// identifier of the directory before its entries are read; if it returns
+// false (the directory was reached before through a symbolic link), the
+// directory is skipped.
+bool read_directory(const QString &path, DirectoryScanner::Directory &dir, QStringList *subdirectories,
+                    const std::function<bool(const QString &)> &firstVisit)
+{
+    dir.path = QDir::cleanPath(QFileInfo(path).absoluteFilePath());
+    dir.files.clear();
+    const QString prefix = dir.path.endsWith(QLatin1Char('/')) ? dir.path : dir.path + QLatin1Char('/');
+
+#ifdef Q_OS_UNIX
+    int fd;
+    do {
+        fd = ::open(QFile::encodeName(dir.path).constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    } while (fd < 0 && errno == EINTR);
+    if (fd < 0) {
+        qCDebug(KLEOPATRA_LOG) << "Failed to open directory" << dir.path << ":" << strerror(errno);
+        return false;
+    }
+    if (firstVisit) {
+        struct stat st;
+        if (::fstat(fd, &st) == 0
+            && !firstVisit(QString::number(quint64(st.st_dev)) + QLatin1Char(':') + QString::number(quint64(st.st_ino)))) {
+            ::close(fd);
+            return false;
+        }
+    }
+    // readdir() fetches the entries in large batches with getdents(); the
+    // entries are then stat'ed relative to the directory, which saves the
+    // kernel from resolving the full path of every file again
+    DIR *const dirp = ::fdopendir(fd);
+    if (!dirp) {
+        ::close(fd);
+        return false;
+    }
+    while (const struct dirent *const entry = ::readdir(dirp)) {
+        const char *const name = entry->d_name;
+        if (name[0] == '.') {
+            // ".", ".." and hidden entries
+            continue;
+        }
+        bool isDir = false;
+        bool isFile = false;
+        struct stat st;
+        bool haveStat = false;
+#ifdef _DIRENT_HAVE_D_TYPE
+        if (entry->d_type == DT_DIR) {
+            isDir = true;
+        } else if (entry->d_type != DT_REG && entry->d_type != DT_LNK && entry->d_type != DT_UNKNOWN) {
+            continue;
+        }
+#endif
+        if (!isDir) {
+            // follows symbolic links, like QFileInfo
+            if (::fstatat(fd, name, &st, 0) != 0) {
+                continue;
+            }
+            haveStat = true;
+            isDir = S_ISDIR(st.st_mode);
+            isFile = S_ISREG(st.st_mode);
+        }
+        if (isDir) {
+            if (subdirectories) {
+                subdirectories->push_back(prefix + QFile::decodeName(name));
+            }
+        } else if (isFile && haveStat) {
+            dir.files.push_back({QFile::decodeName(name), quint64(st.st_size)});
+        }
+    }
+    ::closedir(dirp);
+#else
+    if (firstVisit && !firstVisit(QFileInfo(dir.path).canonicalFilePath())) {
+        return false;
+    }
+    // on Windows, the file information comes with the directory listing
+    QDirIterator it(dir.path, QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot);
+    while (it.hasNext()) {
+        it.next();
+        const QFileInfo fi = it.fileInfo();
+        if (fi.isDir()) {
+            if (subdirectories) {
+                subdirectories->push_back(prefix + fi.fileName());
+            }
+        } else {
+            dir.files.push_back({fi.fileName(), quint64(fi.size())});
+        }
+    }
+#endif
+    std::sort(dir.files.begin(), dir.files.end(), less_file_name);
+    return true;
+}
+
+}
+
+class DirectoryScanner::Private
+{
+    friend class ::Kleo::DirectoryScanner;
+public:
+    void work();
+
+private:
+    int maximumThreadCount = qBound(1, QThread::idealThreadCount(), 8);
+    bool recursive = true;
+
+    std::function<void(Directory &&)> consumer;
+    std::atomic<bool> canceled{false};
+
+    QMutex mutex; // protects the following
+    QWaitCondition pendingChanged;
+    QStringList pending;
+    QSet<QString> visited;
+    int busy = 0;
+
+    QMutex consumerMutex;
+};
+
+void DirectoryScanner::Private::work()
+{
+    const auto firstVisit = [this](const QString &id) {
+        const QMutexLocker locker(&mutex);
+        if (visited.contains(id)) {
+            return false;
+        }
+        visited.insert(id);
+        return true;
+    };
+
+    QMutexLocker locker(&mutex);
+    Q_FOREVER {
+        while (pending.empty() && busy > 0 && !canceled) {
+            pendingChanged.wait(&mutex);
+        }
+        if (pending.empty() || canceled) {
+            // nothing left to do, and nobody who could find more work
+            pendingChanged.wakeAll();
+            return;
+        }
+        // depth first, which keeps the list of pending directories short
+        const QString path = pending.takeLast();
+        ++busy;
+        locker.unlock();
+
+        QStringList subdirectories;
+        Directory dir;
+        const bool ok = read_directory(path, dir, recursive ? &subdirectories : nullptr, firstVisit);
+
+        locker.relock();
+        // subdirectories are queued in reverse, so that they are taken in order
+        std::copy(subdirectories.crbegin(), subdirectories.crend(), std::back_inserter(pending));
+        if (!subdirectories.empty()) {
+            pendingChanged.wakeAll();
+        }
+        locker.unlock();
+
+        if (ok && !canceled) {
+            const QMutexLocker consumerLocker(&consumerMutex);
+            consumer(std::move(dir));
+        }
+
+        locker.relock();
+        if (--busy == 0 && pending.empty()) {
+            pendingChanged.wakeAll();
+        }
+    }
+}
+
+DirectoryScanner::DirectoryScanner()
+    : d(new Private)
+{
+}
+
+DirectoryScanner::~DirectoryScanner() {}
+
+void DirectoryScanner::setMaximumThreadCount(int count)
+{
+    d->maximumThreadCount = std::max(count, 1);
+}
+
+int DirectoryScanner::maximumThreadCount() const
+{
+    return d->maximumThreadCount;
+}
+
+void DirectoryScanner::setRecursive(bool recursive)
+{
+    d->recursive = recursive;
+}
+
+bool DirectoryScanner::isRecursive() const
+{
+    return d->recursive;
+}
+
+void DirectoryScanner::cancel()
+{
+    d->canceled = true;
+    const QMutexLocker locker(&d->mutex);
+    d->pendingChanged.wakeAll();
+}
+
+bool DirectoryScanner::isCanceled() const
+{
+    return d->canceled;
+}
+
+void DirectoryScanner::scan(const QStringList &roots, const std::function<void(Directory &&)> &consumer)
+{
+    if (roots.empty() || !consumer) {
+        return;
+    }
+
+    d->consumer = consumer;
+    d->pending.clear();
+    std::copy(roots.crbegin(), roots.crend(), std::back_inserter(d->pending));
+    d->visited.clear();
+    d->busy = 0;
+
+    // the calling thread works, too
+    const int threadCount = d->recursive ? d->maximumThreadCount : std::min(d->maximumThreadCount, roots.size());
+    std::vector<std::unique_ptr<QThread>> threads;
+    threads.reserve(threadCount - 1);
+    for (int i = 1; i < threadCount; ++i) {
+        threads.emplace_back(QThread::create([this]() { d->work(); }));
+        threads.back()->start();
+    }
+    d->work();
+    for (const auto &thread : threads) {
+        thread->wait();
+    }
+
+    d->consumer = nullptr;
+    d->visited.clear();
+}
+
+// static
+DirectoryScanner::Directory DirectoryScanner::readDirectory(const QString &path, QStringList *subdirectories)
+{
+    Directory dir;
+    read_directory(path, dir, subdirectories, nullptr);
+    return dir;
+}
@@ -0,0 +1,123 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    utils/directoryscanner.h
+
+    This file is part of Kleopatra, the KDE keymanager
+    SPDX-FileCopyrightText: 2021 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef __KLEOPATRA_UTILS_DIRECTORYSCANNER_H__
+#define __KLEOPATRA_UTILS_DIRECTORYSCANNER_H__
+
+#include <utils/pimpl_ptr.h>
+
+#include <QRegularExpression>
+#include <QString>
+#include <QStringList>
+
+#include <functional>
+#include <vector>
+
+namespace Kleo
+{
+
+/*!
+ * Matches file names against a fixed set of patterns (e.g. the file
+ * patterns of the checksum definitions), compiling them only once.
+ *
+ * The patterns are anchored regular expressions, like with
+ * QRegExp::exactMatch(). Patterns that consist only of letters, digits,
+ * '-', '_' and '.' (i.e. names like "sha256sum.txt") are matched without
+ * the regular expression engine.
+ */
+class FileNameMatcher
+{
+public:
+    FileNameMatcher() = default;
+    FileNameMatcher(const QStringList &patterns, Qt::CaseSensitivity cs);
+
+    /*! Returns the index of the first pattern matching \a fileName, or -1. */
+    int indexOf(const QString &fileName) const;
+    bool matches(const QString &fileName) const
+    {
+        return indexOf(fileName) >= 0;
+    }
+
+    bool isEmpty() const
+    {
+        return m_patterns.empty();
+    }
+
+private:
+    struct Pattern {
+        QString simple;
+        QRegularExpression rx;
+    };
+    std::vector<Pattern> m_patterns;
+    Qt::CaseSensitivity m_cs = Qt::CaseSensitive;
+};
+
+/*!
+ * Walks directory trees with several threads and hands every directory
+ * to a consumer as soon as it has been read.
+ *
+ * A directory is read with a single pass over its entries; the sizes of
+ * the files are collected on the way, so consumers do not have to stat
+ * the files again. Like QDir::entryList() with its default filters,
+ * hidden entries and entries that are neither files nor directories
+ * (e.g. sockets or broken links) are skipped. Symbolic links are
+ * followed, but every directory is visited at most once.
+ */
+class DirectoryScanner
+{
+public:
+    struct File {
+        QString name;
+        quint64 size;
+    };
+
+    struct Directory {
+        QString path;               // absolute, cleaned
+        std::vector<File> files;    // sorted like QDir::entryList()
+    };
+
+    DirectoryScanner();
+    ~DirectoryScanner();
+
+    /*! Defaults to min(QThread::idealThreadCount(), 8). */
+    void setMaximumThreadCount(int count);
+    int maximumThreadCount() const;
+
+    /*! Whether subdirectories are scanned, too. The default is true. */
+    void setRecursive(bool recursive);
+    bool isRecursive() const;
+
+    /*!
+     * Scans the directories \a roots and blocks until all directories have
+     * been passed to \a consumer (or until cancel() was called).
+     *
+     * The consumer is called from the scanning threads, but never from
+     * two threads at the same time. The order in which directories are
+     * reported is unspecified.
+     */
+    void scan(const QStringList &roots, const std::function<void(Directory &&)> &consumer);
+
+    /*! Stops a running scan(). Can be called from any thread, including the consumer. */
+    void cancel();
+    bool isCanceled() const;
+
+    /*!
+     * Reads the single directory \a path. If \a subdirectories is given,
+     * the absolute paths of its subdirectories are appended to it.
+     */
+    static Directory readDirectory(const QString &path, QStringList *subdirectories = nullptr);
+
+private:
+    class Private;
+    kdtools::pimpl_ptr<Private> d;
+};
+
+}
+
+#endif // __KLEOPATRA_UTILS_DIRECTORYSCANNER_H__
@@ -0,0 +1,334 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    utils/dumpfile.cpp
+
+    This file is part of Kleopatra, the KDE keymanager
+    SPDX-FileCopyrightText: 2021 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <config-kleopatra.h>
+
+#include "dumpfile.h"
+
+#include "kleopatra_debug.h"
+
+#include <QDir>
+#include <QHash>
+#include <QTemporaryFile>
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+using namespace Kleo;
+
+namespace
+{
+
+bool isHexDigit(char c)
+{
+    return (c >= '0' && c <= '9') || (c >= 'A' && c <= 'F') || (c >= 'a' && c <= 'f');
+}
+
+char toUpper(char c)
+{
+    return (c >= 'a' && c <= 'z') ? c - 'a' + 'A' : c;
+}
+
+// dirmngr lists the entries of a CRL as "  <hex serial>:\t reasons( ... ) <date>"
+QByteArray entrySerialNumber(const char *data, int length)
+{
+    if (length < 4 || data[0] != ' ' || data[1] != ' ') {
+        return QByteArray();
+    }
+    int pos = 2;
+    while (pos < length && isHexDigit(data[pos])) {
+        ++pos;
+    }
+    if (pos == 2 || pos == length || data[pos] != ':') {
+        return QByteArray();
+    }
+    if (!QByteArray::fromRawData(data + pos, length - pos).contains("reasons")) {
+        return QByteArray();
+    }
+    QByteArray serial(data + 2, pos - 2);
+    std::transform(serial.begin(), serial.end(), serial.begin(), toUpper);
+    return serial;
+}
+
+bool isIssuerLine(const char *data, int length)
+{
+    int pos = 0;
+    while (pos < length && (data[pos] == ' ' || data[pos] == '\t')) {
+        ++pos;
+    }
+    static const char issuer[] = "Issuer:";
+    const int issuerLength = sizeof issuer - 1;
+    return length - pos >= issuerLength && std::memcmp(data + pos, issuer, issuerLength) == 0;
+}
+
+// needle must be lower case
+bool containsCaseInsensitive(const char *data, int length, const QByteArray &needle)
+{
+    const int n = needle.size();
+    if (n == 0) {
+        return true;
+    }
+    const char first = needle[0];
+    const char firstUpper = toUpper(first);
+    for (int i = 0; i + n <= length; ++i) {
+        if ((data[i] == first || data[i] == firstUpper) && qstrnicmp(data + i, needle.constData(), n) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}
+
+DumpFile::DumpFile()
+    : mFile(new QTemporaryFile(QDir::tempPath() + QLatin1String("/kleopatra-dump-XXXXXX")))
+{
+    if (!mFile->open()) {
+        qCDebug(KLEOPATRA_LOG) << "Failed to create temporary file for dump:" << mFile->errorString()
+                               << "- keeping the dump in memory";
+        mFile.reset();
+    }
+    mLineStarts.push_back(0);
+}
+
+DumpFile::~DumpFile()
+{
+    clear();
+}
+
+bool DumpFile::isMemoryMapped() const
+{
+    return mMappedChunks > 0;
+}
+
+void DumpFile::clear()
+{
+    if (mFile) {
+        for (int i = 0; i < mMappedChunks; ++i) {
+            mFile->unmap(mChunks[i]);
+        }
+        mFile->resize(0);
+    }
+    mMappedChunks = 0;
+    mChunks.clear();
+    mHeapChunks.clear();
+    mSize = 0;
+    mLineStarts.assign(1, 0);
+    mMaxLineLength = 0;
+    mEntryRuns.clear();
+    mIssuerLines.clear();
+    mSerials.clear();
+    mSortedSerials = 0;
+}
+
+void DumpFile::addChunk()
+{
+    const qint64 offset = static_cast<qint64>(mChunks.size()) * ChunkSize;
+    // mapped chunks must come first, so stop mapping after the first failure
+    if (mFile && mMappedChunks == static_cast<int>(mChunks.size())) {
+        uchar *chunk = nullptr;
+        if (mFile->resize(offset + ChunkSize)) {
+            chunk = mFile->map(offset, ChunkSize);
+        }
+        if (chunk) {
+            mChunks.push_back(chunk);
+            ++mMappedChunks;
+            return;
+        }
+        qCDebug(KLEOPATRA_LOG) << "Failed to map dump into memory:" << mFile->errorString()
+                               << "- keeping the rest of the dump in memory";
+    }
+    mHeapChunks.push_back(QByteArray(ChunkSize, Qt::Uninitialized));
+    mChunks.push_back(reinterpret_cast<uchar *>(mHeapChunks.back().data()));
+}
+
+void DumpFile::write(const char *data, qint64 length)
+{
+    while (length > 0) {
+        if (mSize == static_cast<qint64>(mChunks.size()) * ChunkSize) {
+            addChunk();
+        }
+        const qint64 pos = mSize % ChunkSize;
+        const qint64 n = std::min(length, ChunkSize - pos);
+        std::memcpy(mChunks[mSize / ChunkSize] + pos, data, n);
+        data += n;
+        length -= n;
+        mSize += n;
+    }
+}
+
+void DumpFile::read(qint64 offset, char *dest, qint64 length) const
+{
+    while (length > 0) {
+        const qint64 pos = offset % ChunkSize;
+        const qint64 n = std::min(length, ChunkSize - pos);
+        std::memcpy(dest, mChunks[offset / ChunkSize] + pos, n);
+        dest += n;
+        offset += n;
+        length -= n;
+    }
+}
+
+void DumpFile::append(const char *data, qint64 length)
+{
+    const qint64 start = mSize;
+    write(data, length);
+    const char *p = data;
+    const char *const end = data + length;
+    while (const char *nl = static_cast<const char *>(std::memchr(p, '\n', end - p))) {
+        mLineStarts.push_back(start + (nl - data) + 1);
+        lineCompleted();
+        p = nl + 1;
+    }
+}
+
+void DumpFile::finish()
+{
+    if (mSize > mLineStarts.back()) {
+        append("\n", 1);
+    }
+}
+
+const char *DumpFile::lineData(int line, QByteArray *buffer, int *length) const
+{
+    const qint64 start = mLineStarts[line];
+    qint64 end = mLineStarts[line + 1];
+    char last;
+    while (end > start && (read(end - 1, &last, 1), last == '\n' || last == '\r')) {
+        --end;
+    }
+    *length = static_cast<int>(end - start);
+    if (start / ChunkSize == (end - 1) / ChunkSize || end == start) {
+        return reinterpret_cast<const char *>(mChunks.empty() ? nullptr : mChunks[start / ChunkSize] + start % ChunkSize);
+    }
+    // the line crosses a chunk boundary
+    buffer->resize(*length);
+    read(start, buffer->data(), *length);
+    return buffer->constData();
+}
+
+QByteArray DumpFile::line(int line) const
+{
+    if (line < 0 || line >= lineCount()) {
+        return QByteArray();
+    }
+    QByteArray buffer;
+    int length;
+    const char *data = lineData(line, &buffer, &length);
+    return data == buffer.constData() ? buffer : QByteArray(data, length);
+}
+
+void DumpFile::lineCompleted()
+{
+    const int index = lineCount() - 1;
+    QByteArray buffer;
+    int length;
+    const char *data = lineData(index, &buffer, &length);
+    mMaxLineLength = std::max(mMaxLineLength, length);
+
+    const QByteArray serial = entrySerialNumber(data, length);
+    if (!serial.isEmpty()) {
+        if (!mEntryRuns.empty() && mEntryRuns.back().firstLine + mEntryRuns.back().count == index) {
+            ++mEntryRuns.back().count;
+        } else {
+            mEntryRuns.push_back({index, 1});
+        }
+        mSerials.emplace_back(qHash(serial), index);
+    } else if (isIssuerLine(data, length)) {
+        mIssuerLines.push_back(index);
+    }
+}
+
+int DumpFile::entryRunOf(int line) const
+{
+    const auto it = std::upper_bound(mEntryRuns.cbegin(), mEntryRuns.cend(), line,
+                                     [](int l, const EntryRun &run) {
+                                         return l < run.firstLine;
+                                     });
+    if (it == mEntryRuns.cbegin()) {
+        return -1;
+    }
+    const auto run = std::prev(it);
+    return line < run->firstLine + run->count ? static_cast<int>(run - mEntryRuns.cbegin()) : -1;
+}
+
+int DumpFile::findSerialNumber(const QByteArray &serial) const
+{
+    QByteArray normalized;
+    for (const char c : serial) {
+        if (isHexDigit(c)) {
+            normalized += toUpper(c);
+        } else if (c != ':' && c != ' ') {
+            return -1;
+        }
+    }
+    if (normalized.isEmpty()) {
+        return -1;
+    }
+
+    // the serial numbers arrive in no particular order; sort the ones that
+    // were added since the last search and merge them into the sorted part
+    if (mSortedSerials < mSerials.size()) {
+        std::sort(mSerials.begin() + mSortedSerials, mSerials.end());
+        std::inplace_merge(mSerials.begin(), mSerials.begin() + mSortedSerials, mSerials.end());
+        mSortedSerials = mSerials.size();
+    }
+
+    const uint hash = qHash(normalized);
+    auto it = std::lower_bound(mSerials.cbegin(), mSerials.cend(), std::make_pair(hash, -1));
+    for (; it != mSerials.cend() && it->first == hash; ++it) {
+        QByteArray buffer;
+        int length;
+        const char *data = lineData(it->second, &buffer, &length);
+        if (entrySerialNumber(data, length) == normalized) {
+            return it->second;
+        }
+    }
+    return -1;
+}
+
+int DumpFile::findIssuer(const QByteArray &text, int from) const
+{
+    if (mIssuerLines.empty()) {
+        return -1;
+    }
+    const QByteArray needle = text.toLower();
+    const auto start = std::upper_bound(mIssuerLines.cbegin(), mIssuerLines.cend(), from) - mIssuerLines.cbegin();
+    const int count = static_cast<int>(mIssuerLines.size());
+    for (int i = 0; i < count; ++i) {
+        const int line = mIssuerLines[(start + i) % count];
+        QByteArray buffer;
+        int length;
+        const char *data = lineData(line, &buffer, &length);
+        if (containsCaseInsensitive(data, length, needle)) {
+            return line;
+        }
+    }
+    return -1;
+}
+
+int DumpFile::find(const QByteArray &text, int from) const
+{
+    const int count = lineCount();
+    if (count == 0) {
+        return -1;
+    }
+    const QByteArray needle = text.toLower();
+    QByteArray buffer;
+    for (int i = 1; i <= count; ++i) {
+        const int line = ((from + i) % count + count) % count;
+        int length;
+        const char *data = lineData(line, &buffer, &length);
+        if (containsCaseInsensitive(data, length, needle)) {
+            return line;
+        }
+    }
+    return -1;
+}
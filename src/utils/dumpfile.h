@@ -0,0 +1,134 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    utils/dumpfile.h
+
+    This file is part of Kleopatra, the KDE keymanager
+    SPDX-FileCopyrightText: 2021 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef __KLEOPATRA_UTILS_DUMPFILE_H__
+#define __KLEOPATRA_UTILS_DUMPFILE_H__
+
+#include <QByteArray>
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+class QTemporaryFile;
+
+namespace Kleo
+{
+
+/*!
+ * Stores the output of gpgsm --dump-cert and gpgsm --call-dirmngr listcrls
+ * while it is being read.
+ *
+ * The output is appended to a temporary file that is memory mapped in chunks
+ * of ChunkSize bytes (chunks that cannot be mapped are kept on the heap), so
+ * that a dump of a CRL cache with hundreds of thousands of entries does not
+ * have to be held in memory. Only the offsets of the lines are kept.
+ *
+ * Complete lines are parsed as they arrive:
+ * - consecutive CRL entries ("  <serial number>:\t reasons( ... )") are
+ *   recorded as entry runs that a view can collapse,
+ * - the serial numbers of all CRL entries are indexed,
+ * - the "Issuer:" lines of the CRL headers are recorded.
+ */
+class DumpFile
+{
+public:
+    static const qint64 ChunkSize = 4 * 1024 * 1024;
+
+    struct EntryRun {
+        int firstLine;
+        int count;
+    };
+
+    DumpFile();
+    ~DumpFile();
+
+    void clear();
+
+    /*! Appends \a data; lines are parsed as soon as they are complete. */
+    void append(const char *data, qint64 length);
+    void append(const QByteArray &data)
+    {
+        append(data.constData(), data.size());
+    }
+    /*! Completes a trailing line without line terminator. */
+    void finish();
+
+    qint64 size() const
+    {
+        return mSize;
+    }
+    int lineCount() const
+    {
+        return static_cast<int>(mLineStarts.size()) - 1;
+    }
+    /*! Returns the line (without line terminator) with the index \a line. */
+    QByteArray line(int line) const;
+    int maximumLineLength() const
+    {
+        return mMaxLineLength;
+    }
+
+    const std::vector<EntryRun> &entryRuns() const
+    {
+        return mEntryRuns;
+    }
+    /*! Returns the index of the entry run containing \a line or -1. */
+    int entryRunOf(int line) const;
+
+    const std::vector<int> &issuerLines() const
+    {
+        return mIssuerLines;
+    }
+
+    /*!
+     * Returns the line of the CRL entry for the serial number \a serial or
+     * -1. The serial number is compared in hex; colons and spaces are
+     * ignored.
+     */
+    int findSerialNumber(const QByteArray &serial) const;
+    /*!
+     * Returns the first "Issuer:" line after \a from containing \a text
+     * (case-insensitively) or -1. The search wraps around.
+     */
+    int findIssuer(const QByteArray &text, int from) const;
+    /*!
+     * Returns the first line after \a from containing \a text
+     * (case-insensitively) or -1. The search wraps around.
+     */
+    int find(const QByteArray &text, int from) const;
+
+    bool isMemoryMapped() const;
+
+private:
+    void write(const char *data, qint64 length);
+    void read(qint64 offset, char *dest, qint64 length) const;
+    const char *lineData(int line, QByteArray *buffer, int *length) const;
+    void addChunk();
+    void lineCompleted();
+
+private:
+    std::unique_ptr<QTemporaryFile> mFile;
+    std::vector<uchar *> mChunks;
+    std::vector<QByteArray> mHeapChunks;
+    int mMappedChunks = 0;
+    qint64 mSize = 0;
+    // the start offsets of all complete lines and of the pending line
+    std::vector<qint64> mLineStarts;
+    int mMaxLineLength = 0;
+    std::vector<EntryRun> mEntryRuns;
+    std::vector<int> mIssuerLines;
+    // (hash of the serial number, line); sorted up to mSortedSerials
+    mutable std::vector<std::pair<uint, int> > mSerials;
+    mutable size_t mSortedSerials = 0;
+};
+
+}
+
+#endif // __KLEOPATRA_UTILS_DUMPFILE_H__
@@ -14,10 +14,12 @@
 
 #include "detail_p.h"
 #include "kdpipeiodevice.h"
+#include "unbufferedfiledevice.h"
 #include "windowsprocessdevice.h"
 #include "log.h"
 #include "kleo_assert.h"
 #include "cached.h"
+#include "clipboardprobe.h"
 
 #include <Libkleo/KleoException>
 #include <Libkleo/Classify>
@@ -35,6 +37,9 @@
 #include <QFileInfo>
 #include <QProcess>
 
+#include <algorithm>
+#include <cstring>
+
 #include <errno.h>
 
 using namespace Kleo;
@@ -116,15 +121,55 @@ public:
     unsigned int classification() const override;
     unsigned long long size() const override
     {
-        return QFileInfo(m_fileName).size();
+        return m_size;
     }
 
+private:
+    void open(const std::shared_ptr<QFile> &file);
+
 private:
     std::shared_ptr<QIODevice> m_io;
     QString m_fileName;
+    unsigned long long m_size = 0;
+    mutable cached<unsigned int> m_classification;
 };
 
 #ifndef QT_NO_CLIPBOARD
+// Provides a string as UTF-8. The string is converted chunk by chunk while
+// it is read, so that there is no complete UTF-8 copy of a large clipboard.
+class Utf8StringDevice : public QIODevice
+{
+public:
+    explicit Utf8StringDevice(const QString &text);
+
+    bool isSequential() const override
+    {
+        return false;
+    }
+    qint64 size() const override
+    {
+        return m_size;
+    }
+    bool seek(qint64 pos) override;
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override;
+    qint64 writeData(const char *, qint64) override
+    {
+        return -1;
+    }
+
+private:
+    void convertNextChunk();
+
+private:
+    const QString m_text;
+    const qint64 m_size;
+    int m_textPos = 0;      // first character not yet converted
+    QByteArray m_chunk;     // converted, but not yet read completely
+    int m_chunkPos = 0;
+};
+
 class ClipboardInput : public Input
 {
 public:
@@ -134,12 +179,12 @@ public:
     QString label() const override;
     std::shared_ptr<QIODevice> ioDevice() const override
     {
-        return m_buffer;
+        return m_device;
     }
     unsigned int classification() const override;
     unsigned long long size() const override
     {
-        return m_buffer ? m_buffer->buffer().size() : 0;
+        return m_device ? m_device->size() : 0;
     }
     QString errorString() const override
     {
@@ -148,7 +193,9 @@ public:
 
 private:
     const QClipboard::Mode m_mode;
-    std::shared_ptr<QBuffer> m_buffer;
+    const QString m_text;
+    std::shared_ptr<Utf8StringDevice> m_device;
+    mutable cached<unsigned int> m_classification;
 };
 #endif // QT_NO_CLIPBOARD
 
@@ -242,14 +289,7 @@ FileInput::FileInput(const QString &fileName)
     : InputImplBase(),
       m_io(), m_fileName(fileName)
 {
-    std::shared_ptr<QFile> file(new QFile(fileName));
-
-    errno = 0;
-    if (!file->open(QIODevice::ReadOnly))
-        throw Exception(errno ? gpg_error_from_errno(errno) : gpg_error(GPG_ERR_EIO),
-                        i18n("Could not open file \"%1\" for reading", fileName));
-    m_io = Log::instance()->createIOLogger(file, QStringLiteral("file-in"), Log::Read);
-
+    open(std::shared_ptr<QFile>(new QFile(fileName)));
 }
 
 FileInput::FileInput(const std::shared_ptr<QFile> &file)
@@ -257,19 +297,30 @@ FileInput::FileInput(const std::shared_ptr<QFile> &file)
       m_io(), m_fileName(file->fileName())
 {
     kleo_assert(file);
-    errno = 0;
     if (file->isOpen() && !file->isReadable())
         throw Exception(gpg_error(GPG_ERR_INV_ARG),
                         i18n("File \"%1\" is already open, but not for reading", file->fileName()));
-    if (!file->isOpen() && !file->open(QIODevice::ReadOnly))
+    open(file);
+}
+
+void FileInput::open(const std::shared_ptr<QFile> &file)
+{
+    // gpgme reads straight from the file instead of through QFile's buffer
+    std::shared_ptr<UnbufferedFileDevice> device(new UnbufferedFileDevice(file));
+    errno = 0;
+    if (!device->open(QIODevice::ReadOnly))
         throw Exception(errno ? gpg_error_from_errno(errno) : gpg_error(GPG_ERR_EIO),
                         i18n("Could not open file \"%1\" for reading", m_fileName));
-    m_io = Log::instance()->createIOLogger(file, QStringLiteral("file-in"), Log::Read);
+    m_size = device->size();
+    m_io = Log::instance()->createIOLogger(device, QStringLiteral("file-in"), Log::Read);
 }
 
 unsigned int FileInput::classification() const
 {
-    return classify(m_fileName);
+    if (m_classification.dirty()) {
+        m_classification = classify(m_fileName);
+    }
+    return m_classification;
 }
 
 std::shared_ptr<Input> Input::createFromProcessStdOut(const QString &command)
@@ -403,23 +454,105 @@ std::shared_ptr<Input> Input::createFromClipboard()
     return std::shared_ptr<Input>(new ClipboardInput(QClipboard::Clipboard));
 }
 
-static QByteArray dataFromClipboard(QClipboard::Mode mode)
+static QString textFromClipboard(QClipboard::Mode mode)
 {
     Q_UNUSED(mode);
     if (QClipboard *const cb = QApplication::clipboard()) {
-        return cb->text().toUtf8();
+        return cb->text();
     } else {
-        return QByteArray();
+        return QString();
     }
 }
 
+namespace
+{
+const int ChunkLength = 64 * 1024; // characters
+
+// the length of text.toUtf8()
+qint64 utf8_size(const QString &text)
+{
+    qint64 size = 0;
+    for (int i = 0, end = text.size(); i < end; ++i) {
+        const ushort ch = text.at(i).unicode();
+        if (ch < 0x80) {
+            size += 1;
+        } else if (ch < 0x800) {
+            size += 2;
+        } else if (QChar::isHighSurrogate(ch) && i + 1 < end && QChar::isLowSurrogate(text.at(i + 1).unicode())) {
+            size += 4;
+            ++i;
+        } else if (QChar::isSurrogate(ch)) {
+            size += 1; // unpaired surrogates are replaced by '?'
+        } else {
+            size += 3;
+        }
+    }
+    return size;
+}
+}
+
+Utf8StringDevice::Utf8StringDevice(const QString &text)
+    : QIODevice(),
+      m_text(text),
+      m_size(utf8_size(text))
+{
+}
+
+void Utf8StringDevice::convertNextChunk()
+{
+    int end = std::min(m_textPos + ChunkLength, m_text.size());
+    if (end < m_text.size() && m_text.at(end - 1).isHighSurrogate()) {
+        --end; // keep surrogate pairs together
+    }
+    m_chunk = m_text.midRef(m_textPos, end - m_textPos).toUtf8();
+    m_chunkPos = 0;
+    m_textPos = end;
+}
+
+qint64 Utf8StringDevice::readData(char *data, qint64 maxSize)
+{
+    qint64 done = 0;
+    while (done < maxSize) {
+        if (m_chunkPos == m_chunk.size()) {
+            if (m_textPos == m_text.size()) {
+                break;
+            }
+            convertNextChunk();
+        }
+        const int n = std::min<qint64>(maxSize - done, m_chunk.size() - m_chunkPos);
+        memcpy(data + done, m_chunk.constData() + m_chunkPos, n);
+        m_chunkPos += n;
+        done += n;
+    }
+    return done;
+}
+
+bool Utf8StringDevice::seek(qint64 pos)
+{
+    if (pos < 0 || pos > m_size) {
+        return false;
+    }
+    if (pos != this->pos()) {
+        // gpgme only rewinds, so there is no need to be clever
+        m_textPos = 0;
+        m_chunk.clear();
+        m_chunkPos = 0;
+        for (qint64 skipped = 0; skipped < pos;) {
+            convertNextChunk();
+            m_chunkPos = std::min<qint64>(pos - skipped, m_chunk.size());
+            skipped += m_chunkPos;
+        }
+    }
+    return QIODevice::seek(pos);
+}
+
 ClipboardInput::ClipboardInput(QClipboard::Mode mode)
     : Input(),
       m_mode(mode),
-      m_buffer(new QBuffer)
+      m_text(textFromClipboard(mode)),
+      m_device(new Utf8StringDevice(m_text))
 {
-    m_buffer->setData(dataFromClipboard(mode));
-    if (!m_buffer->open(QIODevice::ReadOnly))
+    if (!m_device->open(QIODevice::ReadOnly | QIODevice::Unbuffered))
         throw Exception(gpg_error(GPG_ERR_EIO),
                         i18n("Could not open clipboard for reading"));
 }
@@ -444,7 +577,10 @@ QString ClipboardInput::label() const
 
 unsigned int ClipboardInput::classification() const
 {
-    return classifyContent(m_buffer->data());
+    if (m_classification.dirty()) {
+        m_classification = classifyClipboardText(m_text);
+    }
+    return m_classification;
 }
 #endif // QT_NO_CLIPBOARD
 
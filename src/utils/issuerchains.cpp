@@ -0,0 +1,144 @@
+/*  utils/issuerchains.cpp
+
+    This file is part of Kleopatra, the KDE keymanager
+    SPDX-FileCopyrightText: 2021 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "issuerchains.h"
+
+#include <Libkleo/KeyCache>
+
+#include <QCoreApplication>
+#include <QHash>
+#include <QSet>
+
+#include <algorithm>
+
+using namespace Kleo;
+
+namespace
+{
+
+// gpgsm does not accept chains longer than this either
+static const int MaxChainLength = 20;
+
+class ChainCache
+{
+public:
+    static ChainCache &instance()
+    {
+        static ChainCache self;
+        return self;
+    }
+
+    std::vector<GpgME::Key> chain(const GpgME::Key &key)
+    {
+        QSet<QByteArray> path;
+        bool truncated = false;
+        return chain(key, path, &truncated);
+    }
+
+    void clear()
+    {
+        mChains.clear();
+    }
+
+private:
+    // path holds the fingerprints of the certificates below key in the
+    // current walk. A chain is only cached if no part of the walk was cut
+    // off by a cycle or by MaxChainLength, since it would depend on where
+    // the walk started otherwise.
+    std::vector<GpgME::Key> chain(const GpgME::Key &key, QSet<QByteArray> &path, bool *truncated)
+    {
+        const QByteArray fpr(key.primaryFingerprint());
+        const auto it = mChains.constFind(fpr);
+        if (it != mChains.cend()) {
+            return *it;
+        }
+
+        std::vector<GpgME::Key> result(1, key);
+        bool cutOff = false;
+        if (!key.isRoot() && path.size() + 1 >= MaxChainLength) {
+            cutOff = true;
+        } else if (!key.isRoot()) {
+            path.insert(fpr);
+            // With several certificates of the issuer (e.g. a renewed CA
+            // certificate), the chain leading to a valid root wins; ties
+            // are broken by the fingerprint, so that the choice does not
+            // depend on the order of the key cache.
+            std::vector<GpgME::Key> best;
+            int bestRank = -1;
+            const char *bestFpr = nullptr;
+            for (const GpgME::Key &issuer : KeyCache::instance()->findIssuers(key, KeyCache::NoOption)) {
+                if (qstrcmp(issuer.primaryFingerprint(), key.primaryFingerprint()) == 0) {
+                    continue;
+                }
+                if (path.contains(QByteArray(issuer.primaryFingerprint()))) {
+                    // a cycle; the issuer is already below us
+                    cutOff = true;
+                    continue;
+                }
+                // the chain of the issuer is shared by all of its certificates
+                auto candidate = chain(issuer, path, &cutOff);
+                const int rank = chainRank(candidate);
+                if (rank > bestRank || (rank == bestRank && qstrcmp(issuer.primaryFingerprint(), bestFpr) < 0)) {
+                    best = std::move(candidate);
+                    bestRank = rank;
+                    bestFpr = best.front().primaryFingerprint();
+                }
+            }
+            result.insert(result.end(), best.begin(), best.end());
+            path.remove(fpr);
+        }
+        if (cutOff) {
+            *truncated = true;
+        } else {
+            mChains.insert(fpr, result);
+        }
+        return result;
+    }
+
+    // 2: ends at a root and all certificates are valid, 1: ends at a root,
+    // 0: incomplete
+    static int chainRank(const std::vector<GpgME::Key> &chain)
+    {
+        if (chain.empty() || !chain.back().isRoot()) {
+            return 0;
+        }
+        const bool valid = std::none_of(chain.cbegin(), chain.cend(), [](const GpgME::Key &key) {
+            return key.isRevoked() || key.isExpired() || key.isInvalid() || key.isDisabled();
+        });
+        return valid ? 2 : 1;
+    }
+
+    ChainCache()
+    {
+        QObject::connect(KeyCache::instance().get(), &KeyCache::keysMayHaveChanged,
+                         QCoreApplication::instance(), [this]() { clear(); });
+    }
+
+    QHash<QByteArray, std::vector<GpgME::Key>> mChains;
+};
+
+}
+
+std::vector<GpgME::Key> IssuerChains::chain(const GpgME::Key &key)
+{
+    if (key.isNull() || key.protocol() != GpgME::CMS) {
+        return std::vector<GpgME::Key>();
+    }
+    return ChainCache::instance().chain(key);
+}
+
+GpgME::Key IssuerChains::issuer(const GpgME::Key &key)
+{
+    const auto keys = chain(key);
+    return keys.size() > 1 ? keys[1] : GpgME::Key();
+}
+
+void IssuerChains::clear()
+{
+    ChainCache::instance().clear();
+}
@@ -0,0 +1,39 @@
+/*  utils/issuerchains.h
+
+    This file is part of Kleopatra, the KDE keymanager
+    SPDX-FileCopyrightText: 2021 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef __KLEOPATRA_UTILS_ISSUERCHAINS_H__
+#define __KLEOPATRA_UTILS_ISSUERCHAINS_H__
+
+#include <gpgme++/key.h>
+
+#include <vector>
+
+namespace Kleo
+{
+namespace IssuerChains
+{
+/* Returns the chain of X.509 certificates from key up to the root (or up
+ * to the last certificate whose issuer is not available). The first element
+ * is key itself. If there are several certificates of an issuer, the one
+ * leading to a valid root is preferred. A chain ends before a certificate
+ * that is already part of it (a cycle of cross-certified CAs) and has at
+ * most 20 certificates. Chains are computed once and shared between all
+ * certificates issued by the same CA until the key cache changes. */
+std::vector<GpgME::Key> chain(const GpgME::Key &key);
+
+/* Returns the issuer of key or a null key if the issuer is not available
+ * or if key is a root certificate. */
+GpgME::Key issuer(const GpgME::Key &key);
+
+/* Forgets all computed chains. This happens automatically when the key
+ * cache reports changes. */
+void clear();
+}
+}
+
+#endif // __KLEOPATRA_UTILS_ISSUERCHAINS_H__
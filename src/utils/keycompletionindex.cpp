@@ -0,0 +1,275 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    utils/keycompletionindex.cpp
+
+    This file is part of Kleopatra, the KDE keymanager
+    SPDX-FileCopyrightText: 2021 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <config-kleopatra.h>
+
+#include "keycompletionindex.h"
+
+#include "substringindex.h"
+
+#include <Libkleo/Formatting>
+#include <Libkleo/KeyCache>
+#include <Libkleo/KeyFilter>
+
+#include <gpgme++/key.h>
+
+#include <QCoreApplication>
+#include <QHash>
+#include <QSet>
+#include <QStringList>
+#include <QTimer>
+
+#include <algorithm>
+#include <tuple>
+
+using namespace Kleo;
+using namespace GpgME;
+
+namespace
+{
+
+// number of keys compared with the index per event loop iteration
+const int SyncChunkSize = 500;
+
+struct Entry {
+    Key key;
+    QString text;
+    QStringList emails;
+    int validity = 0;
+    int id = 0;
+    unsigned int generation = 0;
+};
+
+}
+
+class KeyCompletionIndex::Private
+{
+public:
+    void upsert(const Key &key);
+    void remove(const Key &key);
+    void addToIndex(Entry &entry, const QByteArray &fpr);
+    void removeFromIndex(const Entry &entry);
+    void startSync();
+    void syncNextChunk();
+    void finishSync();
+
+    SubstringIndex index;
+    QMultiHash<QString, int> idsByEmail;
+    QHash<QByteArray, Entry> entries;
+    QHash<int, QByteArray> fingerprintById;
+    int nextId = 0;
+
+    // keys of the cache not yet compared with the index
+    std::vector<Key> syncKeys;
+    size_t syncPos = 0;
+    bool syncScheduled = false;
+    unsigned int generation = 0;
+    QSet<QByteArray> removedWhileSyncing;
+};
+
+static QStringList emailAddresses(const Key &key)
+{
+    QStringList emails;
+    for (const UserID &uid : key.userIDs()) {
+        const QString email = QString::fromUtf8(uid.email()).toCaseFolded();
+        if (!email.isEmpty()) {
+            emails.push_back(email.startsWith(QLatin1Char('<')) && email.endsWith(QLatin1Char('>'))
+                             ? email.mid(1, email.size() - 2) : email);
+        }
+    }
+    return emails;
+}
+
+void KeyCompletionIndex::Private::addToIndex(Entry &entry, const QByteArray &fpr)
+{
+    entry.id = ++nextId;
+    index.insert(entry.id, entry.text);
+    for (const QString &email : qAsConst(entry.emails)) {
+        idsByEmail.insert(email, entry.id);
+    }
+    fingerprintById.insert(entry.id, fpr);
+}
+
+void KeyCompletionIndex::Private::removeFromIndex(const Entry &entry)
+{
+    index.remove(entry.id);
+    for (const QString &email : entry.emails) {
+        idsByEmail.remove(email, entry.id);
+    }
+    fingerprintById.remove(entry.id);
+}
+
+void KeyCompletionIndex::Private::upsert(const Key &key)
+{
+    if (key.isNull() || !key.primaryFingerprint()) {
+        return;
+    }
+    const QByteArray fpr(key.primaryFingerprint());
+    removedWhileSyncing.remove(fpr);
+    Entry &entry = entries[fpr];
+    entry.generation = generation;
+    if (!entry.key.isNull() && entry.key.impl() == key.impl()) {
+        return;
+    }
+
+    entry.key = key;
+    entry.validity = key.userID(0).validity();
+    // only what the completer shows is searched
+    const QString text = Formatting::summaryLine(key);
+    const QStringList emails = emailAddresses(key);
+    if (entry.id && entry.text == text && entry.emails == emails) {
+        // the indexed texts are unchanged
+        return;
+    }
+    if (entry.id) {
+        removeFromIndex(entry);
+    }
+    entry.text = text;
+    entry.emails = emails;
+    addToIndex(entry, fpr);
+}
+
+void KeyCompletionIndex::Private::remove(const Key &key)
+{
+    if (!key.primaryFingerprint()) {
+        return;
+    }
+    const QByteArray fpr(key.primaryFingerprint());
+    const auto it = entries.find(fpr);
+    if (it == entries.end()) {
+        return;
+    }
+    removeFromIndex(*it);
+    entries.erase(it);
+    if (syncScheduled) {
+        // the key may still be in the snapshot being synced
+        removedWhileSyncing.insert(fpr);
+    }
+}
+
+void KeyCompletionIndex::Private::startSync()
+{
+    // comparing all keys at once would block the GUI with large keyrings
+    syncKeys = KeyCache::instance()->keys();
+    syncPos = 0;
+    ++generation;
+    removedWhileSyncing.clear();
+    if (!syncScheduled) {
+        syncScheduled = true;
+        QTimer::singleShot(0, QCoreApplication::instance(), [this]() { syncNextChunk(); });
+    }
+}
+
+void KeyCompletionIndex::Private::syncNextChunk()
+{
+    if (!syncScheduled) {
+        return;
+    }
+    const size_t end = std::min(syncKeys.size(), syncPos + SyncChunkSize);
+    for (; syncPos < end; ++syncPos) {
+        const Key &key = syncKeys[syncPos];
+        if (key.primaryFingerprint() && !removedWhileSyncing.contains(QByteArray(key.primaryFingerprint()))) {
+            upsert(key);
+        }
+    }
+    if (syncPos < syncKeys.size()) {
+        QTimer::singleShot(0, QCoreApplication::instance(), [this]() { syncNextChunk(); });
+    } else {
+        finishSync();
+    }
+}
+
+void KeyCompletionIndex::Private::finishSync()
+{
+    // keys that were neither in the cache nor added since are gone
+    for (auto it = entries.begin(); it != entries.end();) {
+        if (it->generation != generation) {
+            removeFromIndex(*it);
+            it = entries.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    syncKeys.clear();
+    syncPos = 0;
+    syncScheduled = false;
+    removedWhileSyncing.clear();
+}
+
+// static
+KeyCompletionIndex *KeyCompletionIndex::instance()
+{
+    static KeyCompletionIndex self;
+    return &self;
+}
+
+KeyCompletionIndex::KeyCompletionIndex()
+    : d(new Private)
+{
+    const auto cache = KeyCache::instance();
+    QObject *const context = QCoreApplication::instance();
+    QObject::connect(cache.get(), &KeyCache::added, context, [this](const Key &key) {
+        d->upsert(key);
+    });
+    QObject::connect(cache.get(), &KeyCache::aboutToRemove, context, [this](const Key &key) {
+        d->remove(key);
+    });
+    QObject::connect(cache.get(), &KeyCache::keysMayHaveChanged, context, [this]() {
+        d->startSync();
+    });
+    if (cache->initialized()) {
+        // the first query needs the index
+        for (const Key &key : cache->keys()) {
+            d->upsert(key);
+        }
+    }
+}
+
+KeyCompletionIndex::~KeyCompletionIndex() {}
+
+std::vector<Key> KeyCompletionIndex::find(const QString &text, const std::shared_ptr<KeyFilter> &filter, int maxResults) const
+{
+    const QString query = text.trimmed();
+    if (query.isEmpty() || maxResults <= 0) {
+        return std::vector<Key>();
+    }
+    const QString email = query.toCaseFolded();
+
+    // (rank, -validity, id)
+    std::vector<std::tuple<int, int, int>> matches;
+    const auto addMatch = [&](int id, int rank) {
+        const auto entry = d->entries.constFind(d->fingerprintById.value(id));
+        if (entry == d->entries.cend()) {
+            return;
+        }
+        if (filter && !filter->matches(entry->key, KeyFilter::Filtering)) {
+            return;
+        }
+        matches.emplace_back(rank, -entry->validity, id);
+    };
+    // an address of any user ID matches exactly, even if it is not shown
+    const QList<int> emailIds = d->idsByEmail.values(email);
+    for (const int id : emailIds) {
+        addMatch(id, 0);
+    }
+    for (const SubstringIndex::Match &match : d->index.find(query)) {
+        if (!emailIds.contains(match.id)) {
+            addMatch(match.id, match.wordStart ? 1 : 2);
+        }
+    }
+
+    const auto end = matches.size() > size_t(maxResults) ? matches.begin() + maxResults : matches.end();
+    std::partial_sort(matches.begin(), end, matches.end());
+    std::vector<Key> result;
+    result.reserve(end - matches.begin());
+    for (auto it = matches.begin(); it != end; ++it) {
+        result.push_back(d->entries.value(d->fingerprintById.value(std::get<2>(*it))).key);
+    }
+    return result;
+}
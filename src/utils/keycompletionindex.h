@@ -0,0 +1,69 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    utils/keycompletionindex.h
+
+    This file is part of Kleopatra, the KDE keymanager
+    SPDX-FileCopyrightText: 2021 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef __KLEOPATRA_UTILS_KEYCOMPLETIONINDEX_H__
+#define __KLEOPATRA_UTILS_KEYCOMPLETIONINDEX_H__
+
+#include <utils/pimpl_ptr.h>
+
+#include <QString>
+
+#include <memory>
+#include <vector>
+
+namespace GpgME
+{
+class Key;
+}
+
+namespace Kleo
+{
+
+class KeyFilter;
+
+/*!
+ * Search index over the summary lines and e-mail addresses of all keys in
+ * the key cache, shared by all certificate line edits.
+ *
+ * The summary lines of the keys are kept in a SubstringIndex, so that a
+ * query does not scan all keys. The index follows the key cache. After a
+ * reload, the keys are compared with the index in small chunks from the
+ * event loop, and only keys whose texts changed are re-indexed.
+ */
+class KeyCompletionIndex
+{
+public:
+    static KeyCompletionIndex *instance();
+    ~KeyCompletionIndex();
+
+    /*!
+     * Returns up to \a maxResults keys matching \a text and accepted by
+     * \a filter (if any). Keys whose e-mail address equals \a text come
+     * first, followed by keys where \a text starts a word, followed by other
+     * substring matches. Within each group keys with higher validity come
+     * first.
+     *
+     * \a text matches a substring of the summary line, as shown by the
+     * completer, or the e-mail address of any user ID. Texts of fewer than
+     * three characters only match the start of a word.
+     */
+    std::vector<GpgME::Key> find(const QString &text,
+                                 const std::shared_ptr<KeyFilter> &filter = std::shared_ptr<KeyFilter>(),
+                                 int maxResults = 50) const;
+
+private:
+    KeyCompletionIndex();
+
+    class Private;
+    kdtools::pimpl_ptr<Private> d;
+};
+
+}
+
+#endif // __KLEOPATRA_UTILS_KEYCOMPLETIONINDEX_H__
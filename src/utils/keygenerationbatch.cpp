@@ -0,0 +1,352 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    utils/keygenerationbatch.cpp
+
+    This file is part of Kleopatra, the KDE keymanager
+    SPDX-FileCopyrightText: 2021 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <config-kleopatra.h>
+
+#include "keygenerationbatch.h"
+
+#include <KLocalizedString>
+
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRegularExpression>
+#include <QStringList>
+
+#include <gpgme++/key.h>
+
+using namespace Kleo;
+using namespace GpgME;
+
+namespace
+{
+
+const unsigned int DefaultRSAKeyLength = 3072;
+
+bool is_ecc_curve(const QString &algorithm)
+{
+    static const QStringList curves = {
+        QStringLiteral("nistp256"), QStringLiteral("nistp384"), QStringLiteral("nistp521"),
+        QStringLiteral("brainpoolP256r1"), QStringLiteral("brainpoolP384r1"), QStringLiteral("brainpoolP512r1"),
+        QStringLiteral("secp256k1"),
+    };
+    return curves.contains(algorithm, Qt::CaseInsensitive);
+}
+
+QString canonical_curve_name(const QString &algorithm)
+{
+    // gpg expects "brainpoolP256r1" etc. with a capital P
+    QString curve = algorithm.toLower();
+    if (curve.startsWith(QLatin1String("brainpoolp"))) {
+        curve[9] = QLatin1Char('P');
+    }
+    return curve;
+}
+
+bool parse_bool(const QString &s, bool *ok)
+{
+    const QString v = s.trimmed().toLower();
+    *ok = true;
+    if (v == QLatin1String("yes") || v == QLatin1String("true") || v == QLatin1String("1")) {
+        return true;
+    }
+    if (v == QLatin1String("no") || v == QLatin1String("false") || v == QLatin1String("0")) {
+        return false;
+    }
+    *ok = false;
+    return false;
+}
+
+// Fills \a request from the field named \a key; returns an error message
+// if the value is invalid
+QString set_field(KeyGenerationRequest &request, const QString &key, const QString &value)
+{
+    const QString field = key.trimmed().toLower();
+    const QString v = value.trimmed();
+    if (field == QLatin1String("protocol")) {
+        const QString p = v.toLower();
+        if (p.isEmpty() || p == QLatin1String("openpgp") || p == QLatin1String("pgp")) {
+            request.protocol = KeyParameters::OpenPGP;
+        } else if (p == QLatin1String("cms") || p == QLatin1String("smime") || p == QLatin1String("x509")) {
+            request.protocol = KeyParameters::CMS;
+        } else {
+            return i18n("Unknown protocol \"%1\"", v);
+        }
+    } else if (field == QLatin1String("name")) {
+        request.name = v;
+    } else if (field == QLatin1String("email")) {
+        request.email = v;
+    } else if (field == QLatin1String("dn")) {
+        request.dn = v;
+    } else if (field == QLatin1String("algorithm")) {
+        request.algorithm = v;
+    } else if (field == QLatin1String("length")) {
+        if (!v.isEmpty()) {
+            bool ok;
+            request.length = v.toUInt(&ok);
+            if (!ok) {
+                return i18n("Invalid key length \"%1\"", v);
+            }
+        }
+    } else if (field == QLatin1String("expires")) {
+        if (!v.isEmpty()) {
+            request.expirationDate = QDate::fromString(v, Qt::ISODate);
+            if (!request.expirationDate.isValid()) {
+                return i18n("Invalid expiration date \"%1\"", v);
+            }
+        }
+    } else if (field == QLatin1String("protect")) {
+        if (!v.isEmpty()) {
+            bool ok;
+            request.protect = parse_bool(v, &ok);
+            if (!ok) {
+                return i18n("Invalid value \"%1\" for \"protect\"", v);
+            }
+        }
+    } else if (field == QLatin1String("file")) {
+        request.fileName = v;
+    }
+    return QString();
+}
+
+QString check_request(const KeyGenerationRequest &request)
+{
+    QString errorMessage;
+    request.keyParameters(&errorMessage);
+    return errorMessage;
+}
+
+QStringList split_csv_line(const QString &line, QChar separator)
+{
+    QStringList fields;
+    QString field;
+    bool quoted = false;
+    for (int i = 0, end = line.size(); i < end; ++i) {
+        const QChar ch = line[i];
+        if (quoted) {
+            if (ch == QLatin1Char('"')) {
+                if (i + 1 < end && line[i + 1] == QLatin1Char('"')) {
+                    field += ch;
+                    ++i;
+                } else {
+                    quoted = false;
+                }
+            } else {
+                field += ch;
+            }
+        } else if (ch == QLatin1Char('"')) {
+            quoted = true;
+        } else if (ch == separator) {
+            fields.push_back(field);
+            field.clear();
+        } else {
+            field += ch;
+        }
+    }
+    fields.push_back(field);
+    return fields;
+}
+
+}
+
+QString KeyGenerationRequest::keyParameters(QString *errorMessage) const
+{
+    const auto fail = [errorMessage](const QString &message) {
+        if (errorMessage) {
+            *errorMessage = message;
+        }
+        return QString();
+    };
+
+    KeyParameters parameters(protocol);
+
+    const QString algo = algorithm.trimmed().toLower();
+    if (algo.isEmpty() || algo.startsWith(QLatin1String("rsa"))) {
+        unsigned int bits = length;
+        if (algo.size() > 3) {
+            bool ok;
+            bits = algo.mid(3).toUInt(&ok);
+            if (!ok) {
+                return fail(i18n("Unknown algorithm \"%1\"", algorithm));
+            }
+        }
+        if (!bits) {
+            bits = DefaultRSAKeyLength;
+        }
+        parameters.setKeyType(Subkey::AlgoRSA);
+        parameters.setKeyLength(bits);
+        if (protocol == KeyParameters::OpenPGP) {
+            parameters.setKeyUsages({QStringLiteral("sign")});
+            parameters.setSubkeyType(Subkey::AlgoRSA);
+            parameters.setSubkeyLength(bits);
+            parameters.setSubkeyUsages({QStringLiteral("encrypt")});
+        } else {
+            parameters.setKeyUsages({QStringLiteral("sign"), QStringLiteral("encrypt")});
+        }
+    } else if (protocol == KeyParameters::CMS) {
+        return fail(i18n("Only RSA is supported for S/MIME certificates"));
+    } else if (algo == QLatin1String("ed25519") || algo == QLatin1String("curve25519")) {
+        parameters.setKeyType(Subkey::AlgoEDDSA);
+        parameters.setKeyCurve(QStringLiteral("ed25519"));
+        parameters.setKeyUsages({QStringLiteral("sign")});
+        parameters.setSubkeyType(Subkey::AlgoECDH);
+        parameters.setSubkeyCurve(QStringLiteral("cv25519"));
+        parameters.setSubkeyUsages({QStringLiteral("encrypt")});
+    } else if (is_ecc_curve(algo)) {
+        const QString curve = canonical_curve_name(algo);
+        parameters.setKeyType(Subkey::AlgoECDSA);
+        parameters.setKeyCurve(curve);
+        parameters.setKeyUsages({QStringLiteral("sign")});
+        parameters.setSubkeyType(Subkey::AlgoECDH);
+        parameters.setSubkeyCurve(curve);
+        parameters.setSubkeyUsages({QStringLiteral("encrypt")});
+    } else {
+        return fail(i18n("Unknown algorithm \"%1\"", algorithm));
+    }
+
+    if (protocol == KeyParameters::OpenPGP) {
+        if (name.isEmpty() && email.isEmpty()) {
+            return fail(i18n("A name or an email address is required"));
+        }
+        if (!name.isEmpty()) {
+            parameters.setName(name);
+        }
+        if (!email.isEmpty()) {
+            parameters.setEmail(email);
+        }
+        if (expirationDate.isValid()) {
+            parameters.setExpirationDate(expirationDate);
+        }
+        parameters.setPassphraseProtected(protect);
+    } else {
+        if (dn.isEmpty()) {
+            return fail(i18n("A DN is required for certificate signing requests"));
+        }
+        parameters.setDN(dn);
+        if (!email.isEmpty()) {
+            parameters.setEmail(email);
+        }
+    }
+
+    return parameters.toString();
+}
+
+QString KeyGenerationRequest::outputBaseName() const
+{
+    QString base = fileName;
+    if (base.isEmpty()) {
+        base = !email.isEmpty() ? email : !name.isEmpty() ? name : dn;
+    }
+    static const QRegularExpression unsafe(QStringLiteral("[^A-Za-z0-9._@+-]+"));
+    base.replace(unsafe, QStringLiteral("_"));
+    if (base.startsWith(QLatin1Char('.'))) {
+        base.prepend(QLatin1Char('_'));
+    }
+    return base;
+}
+
+std::vector<KeyGenerationRequest> Kleo::parseKeyGenerationRequestsCsv(const QByteArray &data, QString *errorMessage)
+{
+    std::vector<KeyGenerationRequest> requests;
+    const QStringList lines = QString::fromUtf8(data).split(QRegularExpression(QStringLiteral("\r?\n")));
+
+    QStringList columns;
+    QChar separator = QLatin1Char(',');
+    for (int i = 0, end = lines.size(); i < end; ++i) {
+        const QString &line = lines[i];
+        if (line.trimmed().isEmpty() || line.trimmed().startsWith(QLatin1Char('#'))) {
+            continue;
+        }
+        if (columns.empty()) {
+            if (!line.contains(QLatin1Char(',')) && line.contains(QLatin1Char(';'))) {
+                separator = QLatin1Char(';');
+            }
+            columns = split_csv_line(line, separator);
+            continue;
+        }
+        const QStringList fields = split_csv_line(line, separator);
+        KeyGenerationRequest request;
+        QString error;
+        for (int c = 0; c < fields.size() && c < columns.size() && error.isEmpty(); ++c) {
+            error = set_field(request, columns[c], fields[c]);
+        }
+        if (error.isEmpty()) {
+            error = check_request(request);
+        }
+        if (!error.isEmpty()) {
+            if (errorMessage) {
+                *errorMessage = i18n("Line %1: %2", i + 1, error);
+            }
+            return {};
+        }
+        requests.push_back(request);
+    }
+    return requests;
+}
+
+std::vector<KeyGenerationRequest> Kleo::parseKeyGenerationRequestsJson(const QByteArray &data, QString *errorMessage)
+{
+    const auto fail = [errorMessage](const QString &message) {
+        if (errorMessage) {
+            *errorMessage = message;
+        }
+        return std::vector<KeyGenerationRequest>();
+    };
+
+    QJsonParseError parseError;
+    const QJsonDocument doc = QJsonDocument::fromJson(data, &parseError);
+    if (doc.isNull()) {
+        return fail(parseError.errorString());
+    }
+    const QJsonArray array = doc.isArray() ? doc.array() : doc.object().value(QLatin1String("keys")).toArray();
+
+    std::vector<KeyGenerationRequest> requests;
+    requests.reserve(array.size());
+    for (int i = 0, end = array.size(); i < end; ++i) {
+        if (!array[i].isObject()) {
+            return fail(i18n("Entry %1: not an object", i + 1));
+        }
+        const QJsonObject obj = array[i].toObject();
+        KeyGenerationRequest request;
+        QString error;
+        for (auto it = obj.constBegin(); it != obj.constEnd() && error.isEmpty(); ++it) {
+            const QJsonValue value = it.value();
+            const QString s = value.isDouble() ? QString::number(value.toInt())
+                            : value.isBool() ? QString::number(value.toBool())
+                            : value.toString();
+            error = set_field(request, it.key(), s);
+        }
+        if (error.isEmpty()) {
+            error = check_request(request);
+        }
+        if (!error.isEmpty()) {
+            return fail(i18n("Entry %1: %2", i + 1, error));
+        }
+        requests.push_back(request);
+    }
+    return requests;
+}
+
+std::vector<KeyGenerationRequest> Kleo::readKeyGenerationRequests(const QString &fileName, QString *errorMessage)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        if (errorMessage) {
+            *errorMessage = i18n("Could not read file %1: %2", fileName, file.errorString());
+        }
+        return {};
+    }
+    const QByteArray data = file.readAll();
+    if (QFileInfo(fileName).suffix().compare(QLatin1String("json"), Qt::CaseInsensitive) == 0) {
+        return parseKeyGenerationRequestsJson(data, errorMessage);
+    }
+    return parseKeyGenerationRequestsCsv(data, errorMessage);
+}
@@ -0,0 +1,74 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    utils/keygenerationbatch.h
+
+    This file is part of Kleopatra, the KDE keymanager
+    SPDX-FileCopyrightText: 2021 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef __KLEOPATRA_UTILS_KEYGENERATIONBATCH_H__
+#define __KLEOPATRA_UTILS_KEYGENERATIONBATCH_H__
+
+#include <utils/keyparameters.h>
+
+#include <QByteArray>
+#include <QDate>
+#include <QString>
+
+#include <vector>
+
+namespace Kleo
+{
+
+/*!
+ * One key pair (OpenPGP) or certificate signing request (S/MIME) of a
+ * batch that is created without user interaction.
+ */
+struct KeyGenerationRequest {
+    KeyParameters::Protocol protocol = KeyParameters::OpenPGP;
+    QString name;
+    QString email;
+    QString dn;
+    /*!
+     * "rsa", "rsa<bits>", "ed25519" or the name of an ECC curve (e.g.
+     * "nistp256" or "brainpoolP256r1"). Empty means RSA.
+     */
+    QString algorithm;
+    unsigned int length = 0;
+    QDate expirationDate;
+    bool protect = true;
+    /*! The base name of the output files; derived from the identity if empty. */
+    QString fileName;
+
+    /*!
+     * Returns the parameters for the key generation job, or an empty
+     * string (and the reason in \a errorMessage) if the request is invalid.
+     */
+    QString keyParameters(QString *errorMessage = nullptr) const;
+
+    /*! Returns fileName, or a file system safe name made from the identity. */
+    QString outputBaseName() const;
+};
+
+/*!
+ * Reads a list of key generation requests.
+ *
+ * In CSV files, the first line names the columns: "protocol" ("openpgp"
+ * or "cms"), "name", "email", "dn", "algorithm", "length", "expires"
+ * (an ISO date), "protect" ("yes" or "no") and "file". Unknown columns are
+ * ignored, as are empty lines and lines starting with '#'. Fields are
+ * separated by ',' or ';' and can be quoted with '"'.
+ *
+ * JSON files contain an array of objects with the same keys, or an object
+ * with this array as its "keys" member.
+ *
+ * On errors, an empty list is returned and \a errorMessage is set.
+ */
+std::vector<KeyGenerationRequest> readKeyGenerationRequests(const QString &fileName, QString *errorMessage);
+std::vector<KeyGenerationRequest> parseKeyGenerationRequestsCsv(const QByteArray &data, QString *errorMessage);
+std::vector<KeyGenerationRequest> parseKeyGenerationRequestsJson(const QByteArray &data, QString *errorMessage);
+
+}
+
+#endif // __KLEOPATRA_UTILS_KEYGENERATIONBATCH_H__
@@ -45,6 +45,7 @@ class KeyParameters::Private
     KeyParameters *const q;
 
     Protocol protocol;
+    bool passphraseProtected = true;
     QString keyType;
     QMap<QString, QStringList> parameters;
 
@@ -125,6 +126,11 @@ void KeyParameters::setExpirationDate(const QDate &date)
     d->setValue(QStringLiteral("Expire-Date"), date.toString(Qt::ISODate));
 }
 
+void KeyParameters::setPassphraseProtected(bool isProtected)
+{
+    d->passphraseProtected = isProtected;
+}
+
 void KeyParameters::setName(const QString &name)
 {
     d->setValue(QStringLiteral("Name-Real"), name);
@@ -164,8 +170,12 @@ QString KeyParameters::toString() const
     keyParameters.push_back(QLatin1String("<GnupgKeyParms format=\"internal\">"));
 
     if (d->protocol == OpenPGP) {
-        // for backward compatibility with GnuPG 2.0 and earlier
-        keyParameters.push_back(QStringLiteral("%ask-passphrase"));
+        if (d->passphraseProtected) {
+            // for backward compatibility with GnuPG 2.0 and earlier
+            keyParameters.push_back(QStringLiteral("%ask-passphrase"));
+        } else {
+            keyParameters.push_back(QStringLiteral("%no-protection"));
+        }
     }
 
     // add Key-Type as first parameter
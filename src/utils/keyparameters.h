@@ -46,6 +46,12 @@ public:
 
     void setExpirationDate(const QDate &date);
 
+    /*!
+     * Whether the OpenPGP key is protected by a passphrase that gpg asks
+     * for. The default is true; false creates the key without protection.
+     */
+    void setPassphraseProtected(bool isProtected);
+
     void setName(const QString &name);
     void setDN(const QString &dn);
     void setEmail(const QString &email);
@@ -16,6 +16,9 @@
 #include "kdpipeiodevice.h"
 #include "log.h"
 #include "cached.h"
+#include "outputfile.h"
+
+#include "fileoperationspreferences.h"
 
 #include <Libkleo/KleoException>
 
@@ -33,12 +36,15 @@
 #include <QWidget>
 #include <QDir>
 #include <QProcess>
+#include <QTextCodec>
 #include <QTimer>
 
 #ifdef Q_OS_WIN
 # include <windows.h>
 #endif
 
+#include <memory>
+
 #include <errno.h>
 
 using namespace Kleo;
@@ -79,20 +85,20 @@ QWidget *OverwritePolicy::parentWidget() const
 namespace
 {
 
-class TemporaryFile : public QTemporaryFile
+class TemporaryFile : public OutputFile
 {
 public:
-    explicit TemporaryFile() : QTemporaryFile() {}
-    explicit TemporaryFile(const QString &templateName) : QTemporaryFile(templateName) {}
-    explicit TemporaryFile(QObject *parent) : QTemporaryFile(parent) {}
-    explicit TemporaryFile(const QString &templateName, QObject *parent) : QTemporaryFile(templateName, parent) {}
+    explicit TemporaryFile() : OutputFile() {}
+    explicit TemporaryFile(const QString &templateName) : OutputFile(templateName) {}
+    explicit TemporaryFile(QObject *parent) : OutputFile(parent) {}
+    explicit TemporaryFile(const QString &templateName, QObject *parent) : OutputFile(templateName, parent) {}
 
     void close() override {
         if (isOpen())
         {
             m_oldFileName = fileName();
         }
-        QTemporaryFile::close();
+        OutputFile::close();
     }
 
     bool openNonInheritable()
@@ -395,17 +401,68 @@ public:
         m_attachedInput = std::weak_ptr<OutputInput>(input);
     }
 
+    void setDurability(Durability durability) override
+    {
+        m_durability = durability;
+    }
+
+    void setExpectedSize(unsigned long long size) override
+    {
+        if (m_tmpFile && size > 0) {
+            m_tmpFile->preallocate(size);
+        }
+    }
+
 private:
     bool obtainOverwritePermission();
+    void renamed();
 
 private:
     const QString m_fileName;
     std::shared_ptr< TemporaryFile > m_tmpFile;
     const std::shared_ptr<OverwritePolicy> m_policy;
     std::weak_ptr<OutputInput> m_attachedInput;
+    Durability m_durability;
 };
 
 #ifndef QT_NO_CLIPBOARD
+// Collects UTF-8 data as a string. The data is converted as it is written,
+// so that there is no complete UTF-8 copy of a large result.
+class Utf8StringWriter : public QIODevice
+{
+public:
+    Utf8StringWriter()
+        : QIODevice(),
+          m_decoder(QTextCodec::codecForMib(106 /* UTF-8 */)->makeDecoder())
+    {
+    }
+
+    bool isSequential() const override
+    {
+        return true;
+    }
+    const QString &text() const
+    {
+        return m_text;
+    }
+
+protected:
+    qint64 readData(char *, qint64) override
+    {
+        return -1;
+    }
+    qint64 writeData(const char *data, qint64 size) override
+    {
+        // the decoder keeps incomplete sequences for the next call
+        m_text += m_decoder->toUnicode(data, size);
+        return size;
+    }
+
+private:
+    const std::unique_ptr<QTextDecoder> m_decoder;
+    QString m_text;
+};
+
 class ClipboardOutput : public OutputImplBase
 {
 public:
@@ -414,7 +471,7 @@ public:
     QString label() const override;
     std::shared_ptr<QIODevice> ioDevice() const override
     {
-        return m_buffer;
+        return m_writer;
     }
     void doFinalize() override;
     void doCancel() override {}
@@ -426,7 +483,7 @@ private:
     }
 private:
     const QClipboard::Mode m_mode;
-    std::shared_ptr<QBuffer> m_buffer;
+    std::shared_ptr<Utf8StringWriter> m_writer;
 };
 #endif // QT_NO_CLIPBOARD
 
@@ -508,11 +565,25 @@ std::shared_ptr<Output> Output::createFromFile(const QString &fileName, const st
     return fo;
 }
 
+// static
+Output::Durability Output::configuredDurability()
+{
+    switch (FileOperationsPreferences().outputDurability()) {
+    case FileOperationsPreferences::EnumOutputDurability::SyncFile:
+        return Output::SyncFile;
+    case FileOperationsPreferences::EnumOutputDurability::SyncFileAndFolder:
+        return Output::SyncFileAndDirectory;
+    default:
+        return Output::NoSync;
+    }
+}
+
 FileOutput::FileOutput(const QString &fileName, const std::shared_ptr<OverwritePolicy> &policy)
     : OutputImplBase(),
       m_fileName(fileName),
       m_tmpFile(new TemporaryFile(fileName)),
-      m_policy(policy)
+      m_policy(policy),
+      m_durability(NoSync)
 {
     Q_ASSERT(m_policy);
     errno = 0;
@@ -555,7 +626,15 @@ void FileOutput::doFinalize()
     kleo_assert(m_tmpFile);
 
     if (m_tmpFile->isOpen()) {
-        m_tmpFile->close();
+        // without a sync, a crash after the rename can leave an empty file
+        // behind instead of the old one
+        if (m_durability != NoSync && !m_tmpFile->sync(m_durability == SyncFile))
+            throw Exception(errno ? gpg_error_from_errno(errno) : gpg_error(GPG_ERR_EIO),
+                            i18n("Could not write file \"%1\" to disk.", m_fileName));
+        // the last part of the output may still be in the write buffer
+        if (!m_tmpFile->finish())
+            throw Exception(errno ? gpg_error_from_errno(errno) : gpg_error(GPG_ERR_EIO),
+                            i18n("Could not write file \"%1\": %2", m_fileName, m_tmpFile->errorString()));
     }
 
     const QString tmpFileName = remover.file = m_tmpFile->oldFileName();
@@ -569,10 +648,7 @@ void FileOutput::doFinalize()
 
     if (QFile::rename(tmpFileName, m_fileName)) {
         qCDebug(KLEOPATRA_LOG) << this << "succeeded";
-
-        if (!m_attachedInput.expired()) {
-            m_attachedInput.lock()->outputFinalized();
-        }
+        renamed();
         return;
     }
 
@@ -592,10 +668,7 @@ void FileOutput::doFinalize()
 
     if (QFile::rename(tmpFileName, m_fileName)) {
         qCDebug(KLEOPATRA_LOG) << this << "succeeded";
-
-        if (!m_attachedInput.expired()) {
-            m_attachedInput.lock()->outputFinalized();
-        }
+        renamed();
         return;
     }
 
@@ -606,6 +679,17 @@ void FileOutput::doFinalize()
                          tmpFileName, m_fileName));
 }
 
+void FileOutput::renamed()
+{
+    if (m_durability == SyncFileAndDirectory) {
+        // the rename is only durable once the directory entry is
+        OutputFile::syncDirectory(QFileInfo(m_fileName).absolutePath());
+    }
+    if (!m_attachedInput.expired()) {
+        m_attachedInput.lock()->outputFinalized();
+    }
+}
+
 std::shared_ptr<Output> Output::createFromProcessStdIn(const QString &command)
 {
     return std::shared_ptr<Output>(new ProcessStdInOutput(command, QStringList(), QDir::current()));
@@ -676,10 +760,10 @@ std::shared_ptr<Output> Output::createFromClipboard()
 ClipboardOutput::ClipboardOutput(QClipboard::Mode mode)
     : OutputImplBase(),
       m_mode(mode),
-      m_buffer(new QBuffer)
+      m_writer(new Utf8StringWriter)
 {
     errno = 0;
-    if (!m_buffer->open(QIODevice::WriteOnly))
+    if (!m_writer->open(QIODevice::WriteOnly | QIODevice::Unbuffered))
         throw Exception(errno ? gpg_error_from_errno(errno) : gpg_error(GPG_ERR_EIO),
                         i18n("Could not write to clipboard"));
 }
@@ -699,11 +783,11 @@ QString ClipboardOutput::label() const
 
 void ClipboardOutput::doFinalize()
 {
-    if (m_buffer->isOpen()) {
-        m_buffer->close();
+    if (m_writer->isOpen()) {
+        m_writer->close();
     }
     if (QClipboard *const cb = QApplication::clipboard()) {
-        cb->setText(QString::fromUtf8(m_buffer->data()));
+        cb->setText(m_writer->text());
     } else
         throw Exception(gpg_error(GPG_ERR_EIO),
                         i18n("Could not find clipboard"));
@@ -50,6 +50,13 @@ private:
 class Output
 {
 public:
+    /** How thoroughly the output is written to the disk when it is finalized. */
+    enum Durability {
+        NoSync,                 ///< leave it to the operating system
+        SyncFile,               ///< sync the data of the file before it gets its final name
+        SyncFileAndDirectory    ///< additionally sync the directory after the rename
+    };
+
     virtual ~Output();
 
     virtual void setLabel(const QString &label) = 0;
@@ -63,6 +70,13 @@ public:
     virtual void setBinaryOpt(bool value) = 0;
     /** Whether or not the output failed. */
     virtual bool failed() const { return false; }
+    /** Only used by file outputs, which do not sync by default. */
+    virtual void setDurability(Durability) {}
+    /** A hint for the size of the output, e.g. for preallocating disk space. */
+    virtual void setExpectedSize(unsigned long long) {}
+
+    /** The durability set in the file operations preferences. */
+    static Durability configuredDurability();
 
     static std::shared_ptr<Output> createFromFile(const QString &fileName, const std::shared_ptr<OverwritePolicy> &);
     static std::shared_ptr<Output> createFromFile(const QString &fileName, bool forceOverwrite);
@@ -0,0 +1,219 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    utils/outputfile.cpp
+
+    This file is part of Kleopatra, the KDE keymanager
+    SPDX-FileCopyrightText: 2021 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <config-kleopatra.h>
+
+#include "outputfile.h"
+
+#include "kleopatra_debug.h"
+
+#include <QFile>
+
+#include <algorithm>
+#include <cstring>
+
+#include <errno.h>
+
+#ifdef Q_OS_WIN
+# include <windows.h>
+# include <io.h>
+#else
+# include <fcntl.h>
+# include <unistd.h>
+#endif
+
+using namespace Kleo;
+
+OutputFile::OutputFile(QObject *parent)
+    : QTemporaryFile(parent)
+{
+}
+
+OutputFile::OutputFile(const QString &templateName, QObject *parent)
+    : QTemporaryFile(templateName, parent)
+{
+}
+
+OutputFile::~OutputFile()
+{
+    // QTemporaryFile's destructor would not call our close()
+    close();
+}
+
+void OutputFile::setWriteBufferSize(qint64 size)
+{
+    flushWriteBuffer();
+    m_writeBufferSize = std::max<qint64>(size, 0);
+    m_writeBuffer = QByteArray();
+}
+
+qint64 OutputFile::writeBufferSize() const
+{
+    return m_writeBufferSize;
+}
+
+bool OutputFile::preallocate(qint64 size)
+{
+    if (!isOpen() || size <= 0) {
+        return false;
+    }
+#ifdef Q_OS_LINUX
+    // keep the size, so that nothing has to be cut off if less is written
+    int ret;
+    do {
+        ret = ::fallocate(handle(), FALLOC_FL_KEEP_SIZE, 0, size);
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0) {
+        qCDebug(KLEOPATRA_LOG) << "Failed to preallocate" << size << "bytes for" << fileName() << ":" << strerror(errno);
+        return false;
+    }
+    m_preallocated = std::max(m_preallocated, size);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void OutputFile::releasePreallocation()
+{
+#ifdef Q_OS_LINUX
+    if (m_preallocated > 0) {
+        const qint64 end = QTemporaryFile::size();
+        if (m_preallocated > end) {
+            // the space reserved beyond the end of the file stays allocated
+            // until it is punched out
+            ::fallocate(handle(), FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, end, m_preallocated - end);
+        }
+        m_preallocated = 0;
+    }
+#endif
+}
+
+bool OutputFile::flushWriteBuffer()
+{
+    const char *data = m_writeBuffer.constData();
+    qint64 remaining = m_writeBuffer.size();
+    while (remaining > 0) {
+        const qint64 written = QTemporaryFile::writeData(data, remaining);
+        if (written <= 0) {
+            // keep only what is left for another attempt
+            m_writeBuffer.remove(0, data - m_writeBuffer.constData());
+            return false;
+        }
+        data += written;
+        remaining -= written;
+    }
+    // keeps the capacity reserved in writeData()
+    m_writeBuffer.resize(0);
+    return true;
+}
+
+qint64 OutputFile::writeData(const char *data, qint64 len)
+{
+    if (m_writeBufferSize <= 0) {
+        return QTemporaryFile::writeData(data, len);
+    }
+    if (m_writeBuffer.size() + len > m_writeBufferSize) {
+        if (!flushWriteBuffer()) {
+            return -1;
+        }
+        if (len >= m_writeBufferSize) {
+            return QTemporaryFile::writeData(data, len);
+        }
+    }
+    if (m_writeBuffer.capacity() < m_writeBufferSize) {
+        m_writeBuffer.reserve(m_writeBufferSize);
+    }
+    m_writeBuffer.append(data, len);
+    return len;
+}
+
+bool OutputFile::seek(qint64 pos)
+{
+    return flushWriteBuffer() && QTemporaryFile::seek(pos);
+}
+
+qint64 OutputFile::size() const
+{
+    // writes only happen at the current position, so the buffered data
+    // ends there
+    const qint64 fileSize = QTemporaryFile::size();
+    return m_writeBuffer.isEmpty() ? fileSize : std::max(fileSize, pos());
+}
+
+bool OutputFile::finish()
+{
+    const bool written = !isOpen() || flushWriteBuffer();
+    // calls the close() of subclasses, too
+    close();
+    // QFileDevice::close() keeps the error of a failed flush or close
+    return written && error() == QFileDevice::NoError;
+}
+
+void OutputFile::close()
+{
+    if (isOpen()) {
+        if (!flushWriteBuffer()) {
+            qCWarning(KLEOPATRA_LOG) << "Failed to write" << fileName() << ":" << errorString();
+        }
+        QTemporaryFile::flush();
+        releasePreallocation();
+    }
+    QTemporaryFile::close();
+}
+
+bool OutputFile::sync(bool dataOnly)
+{
+    if (!isOpen() || !flushWriteBuffer() || !QTemporaryFile::flush()) {
+        return false;
+    }
+#ifdef Q_OS_WIN
+    Q_UNUSED(dataOnly)
+    return FlushFileBuffers(reinterpret_cast<HANDLE>(_get_osfhandle(handle())));
+#else
+    int ret;
+    do {
+#ifdef Q_OS_LINUX
+        ret = dataOnly ? ::fdatasync(handle()) : ::fsync(handle());
+#else
+        Q_UNUSED(dataOnly)
+        ret = ::fsync(handle());
+#endif
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0) {
+        qCWarning(KLEOPATRA_LOG) << "Failed to sync" << fileName() << ":" << strerror(errno);
+    }
+    return ret == 0;
+#endif
+}
+
+// static
+bool OutputFile::syncDirectory(const QString &path)
+{
+#ifdef Q_OS_WIN
+    // directory entries cannot be synced explicitly on Windows
+    Q_UNUSED(path)
+    return true;
+#else
+    const int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        qCWarning(KLEOPATRA_LOG) << "Failed to open" << path << "for syncing:" << strerror(errno);
+        return false;
+    }
+    int ret;
+    do {
+        ret = ::fsync(fd);
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0) {
+        qCWarning(KLEOPATRA_LOG) << "Failed to sync" << path << ":" << strerror(errno);
+    }
+    ::close(fd);
+    return ret == 0;
+#endif
+}
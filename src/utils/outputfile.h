@@ -0,0 +1,93 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    utils/outputfile.h
+
+    This file is part of Kleopatra, the KDE keymanager
+    SPDX-FileCopyrightText: 2021 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef __KLEOPATRA_UTILS_OUTPUTFILE_H__
+#define __KLEOPATRA_UTILS_OUTPUTFILE_H__
+
+#include <QByteArray>
+#include <QTemporaryFile>
+
+namespace Kleo
+{
+
+/*!
+ * A temporary file for output that is later renamed to its final name.
+ *
+ * Writes are collected in a large write buffer (DefaultWriteBufferSize
+ * unless changed), so that the file system sees few large writes instead
+ * of many small ones. The buffer is written when it is full, on seek()
+ * and close(), and by flushWriteBuffer(); note that QFile::flush() is not
+ * virtual and does not write it. Use finish() instead of close() to learn
+ * whether the buffered data could be written.
+ *
+ * If the expected size of the output is known, preallocate() reserves the
+ * disk space up front to avoid fragmentation. Space that is not used is
+ * released again on close().
+ *
+ * sync() writes the contents of the file to the disk; syncDirectory()
+ * does the same for the entry of the file after it has been renamed.
+ */
+class OutputFile : public QTemporaryFile
+{
+    Q_OBJECT
+public:
+    static const qint64 DefaultWriteBufferSize = 1024 * 1024;
+
+    explicit OutputFile(QObject *parent = nullptr);
+    explicit OutputFile(const QString &templateName, QObject *parent = nullptr);
+    ~OutputFile() override;
+
+    /*! Sets the size of the write buffer; 0 disables it. */
+    void setWriteBufferSize(qint64 size);
+    qint64 writeBufferSize() const;
+
+    /*!
+     * Reserves \a size bytes of disk space for the file without changing
+     * its size. Returns false if this is not supported by the platform or
+     * the file system.
+     */
+    bool preallocate(qint64 size);
+
+    bool flushWriteBuffer();
+
+    /*!
+     * Writes the contents of the file (and, unless \a dataOnly is set, its
+     * metadata) to the disk and returns whether this succeeded.
+     */
+    bool sync(bool dataOnly = true);
+
+    /*! Writes the entries of the directory \a path to the disk. */
+    static bool syncDirectory(const QString &path);
+
+    /*!
+     * Closes the file like close(), but returns false if the buffered data
+     * could not be written or the file could not be closed. errorString()
+     * tells why.
+     */
+    bool finish();
+
+    void close() override;
+    bool seek(qint64 pos) override;
+    qint64 size() const override;
+
+protected:
+    qint64 writeData(const char *data, qint64 len) override;
+
+private:
+    void releasePreallocation();
+
+private:
+    QByteArray m_writeBuffer;
+    qint64 m_writeBufferSize = DefaultWriteBufferSize;
+    qint64 m_preallocated = 0;
+};
+
+}
+
+#endif // __KLEOPATRA_UTILS_OUTPUTFILE_H__
@@ -0,0 +1,142 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    utils/substringindex.cpp
+
+    This file is part of Kleopatra, the KDE keymanager
+    SPDX-FileCopyrightText: 2021 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <config-kleopatra.h>
+
+#include "substringindex.h"
+
+#include <QSet>
+
+#include <algorithm>
+
+using namespace Kleo;
+
+namespace
+{
+
+// stale postings are only dropped when there are this many at least
+const int MinimumStaleForCompaction = 1000;
+
+// the length of the terms indexed at every position
+const int TermLength = 3;
+
+// A term packs up to three UTF-16 code units and their number, so that
+// "a" and "a\0" do not collide.
+quint64 term(const QChar *p, int length)
+{
+    quint64 result = quint64(length) << 48;
+    for (int i = 0; i < length; ++i) {
+        result |= quint64(p[i].unicode()) << (16 * (2 - i));
+    }
+    return result;
+}
+
+bool isWordStart(const QString &text, int pos)
+{
+    return pos == 0 || !text[pos - 1].isLetterOrNumber();
+}
+
+}
+
+void SubstringIndex::insert(int id, const QString &text)
+{
+    Q_ASSERT(!m_texts.contains(id));
+    const QString folded = text.toCaseFolded();
+    m_texts.insert(id, folded);
+    addTerms(id, folded);
+}
+
+void SubstringIndex::addTerms(int id, const QString &text)
+{
+    QSet<quint64> terms;
+    for (int i = 0; i < text.size(); ++i) {
+        if (i + TermLength <= text.size()) {
+            terms.insert(term(text.constData() + i, TermLength));
+        }
+        if (isWordStart(text, i)) {
+            for (int length = 1; length < TermLength && i + length <= text.size(); ++length) {
+                terms.insert(term(text.constData() + i, length));
+            }
+        }
+    }
+    for (const quint64 t : qAsConst(terms)) {
+        m_postings[t].push_back(id);
+    }
+}
+
+void SubstringIndex::remove(int id)
+{
+    if (m_texts.remove(id)) {
+        ++m_stale;
+    }
+    if (m_stale >= MinimumStaleForCompaction && m_stale > m_texts.size()) {
+        compact();
+    }
+}
+
+void SubstringIndex::clear()
+{
+    m_texts.clear();
+    m_postings.clear();
+    m_stale = 0;
+}
+
+void SubstringIndex::compact()
+{
+    m_postings.clear();
+    m_stale = 0;
+    for (auto it = m_texts.cbegin(); it != m_texts.cend(); ++it) {
+        addTerms(it.key(), it.value());
+    }
+}
+
+std::vector<SubstringIndex::Match> SubstringIndex::find(const QString &query) const
+{
+    std::vector<Match> result;
+    const QString folded = query.toCaseFolded();
+    if (folded.isEmpty()) {
+        return result;
+    }
+
+    // the candidates are the texts with the rarest term of the query; a
+    // short query is a term by itself, which is only indexed at word starts
+    const std::vector<int> *candidates = nullptr;
+    const bool shortQuery = folded.size() < TermLength;
+    const int length = std::min(folded.size(), TermLength);
+    for (int i = 0; i + length <= folded.size(); ++i) {
+        const auto it = m_postings.constFind(term(folded.constData() + i, length));
+        if (it == m_postings.cend()) {
+            return result;
+        }
+        if (!candidates || it->size() < candidates->size()) {
+            candidates = &*it;
+        }
+    }
+
+    for (const int id : *candidates) {
+        const auto text = m_texts.constFind(id);
+        if (text == m_texts.cend()) {
+            // removed
+            continue;
+        }
+        int pos = text->indexOf(folded);
+        if (pos < 0) {
+            continue;
+        }
+        bool wordStart = false;
+        for (; pos >= 0 && !wordStart; pos = text->indexOf(folded, pos + 1)) {
+            wordStart = isWordStart(*text, pos);
+        }
+        if (shortQuery && !wordStart) {
+            continue;
+        }
+        result.push_back({id, wordStart});
+    }
+    return result;
+}
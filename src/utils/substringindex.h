@@ -0,0 +1,71 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    utils/substringindex.h
+
+    This file is part of Kleopatra, the KDE keymanager
+    SPDX-FileCopyrightText: 2021 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef __KLEOPATRA_UTILS_SUBSTRINGINDEX_H__
+#define __KLEOPATRA_UTILS_SUBSTRINGINDEX_H__
+
+#include <QHash>
+#include <QString>
+
+#include <vector>
+
+namespace Kleo
+{
+
+/*!
+ * Finds the texts containing a query as a case-insensitive substring
+ * without scanning all texts.
+ *
+ * The texts are indexed by all their substrings of three characters and by
+ * the first one and two characters of each word. A query only looks at the
+ * texts containing its rarest term and verifies those. Therefore queries
+ * of fewer than three characters only match at the start of a word.
+ *
+ * Removed texts leave stale entries in the index, which are dropped when
+ * they make up most of it. Therefore ids must not be reused.
+ */
+class SubstringIndex
+{
+public:
+    struct Match {
+        int id;
+        //! whether the query starts a word of the text
+        bool wordStart;
+    };
+
+    /*! Indexes \a text under the new \a id. */
+    void insert(int id, const QString &text);
+    void remove(int id);
+    void clear();
+
+    int size() const
+    {
+        return m_texts.size();
+    }
+
+    /*!
+     * Returns the ids of all texts containing \a query, in no particular
+     * order. A query shorter than three characters only matches texts
+     * with a word starting with it. An empty query matches nothing.
+     */
+    std::vector<Match> find(const QString &query) const;
+
+private:
+    void addTerms(int id, const QString &text);
+    void compact();
+
+private:
+    QHash<int, QString> m_texts;
+    QHash<quint64, std::vector<int>> m_postings;
+    int m_stale = 0;
+};
+
+}
+
+#endif // __KLEOPATRA_UTILS_SUBSTRINGINDEX_H__
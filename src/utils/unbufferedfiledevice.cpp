@@ -0,0 +1,127 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    utils/unbufferedfiledevice.cpp
+
+    This file is part of Kleopatra, the KDE keymanager
+    SPDX-FileCopyrightText: 2021 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <config-kleopatra.h>
+
+#include "unbufferedfiledevice.h"
+
+#include <QFile>
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef Q_OS_UNIX
+#include <errno.h>
+#include <unistd.h>
+#endif
+
+using namespace Kleo;
+
+UnbufferedFileDevice::UnbufferedFileDevice(const std::shared_ptr<QFile> &file, QObject *parent)
+    : QIODevice(parent),
+      m_file(file)
+{
+}
+
+UnbufferedFileDevice::~UnbufferedFileDevice()
+{
+    close();
+}
+
+QString UnbufferedFileDevice::fileName() const
+{
+    return m_file->fileName();
+}
+
+bool UnbufferedFileDevice::open(OpenMode mode)
+{
+    if ((mode & ReadWrite) != ReadOnly) {
+        setErrorString(QStringLiteral("UnbufferedFileDevice can only be opened for reading"));
+        return false;
+    }
+    if (m_file->isOpen() && !m_file->isReadable()) {
+        setErrorString(m_file->errorString());
+        return false;
+    }
+    m_openedFile = !m_file->isOpen();
+    if (m_openedFile && !m_file->open(ReadOnly | Unbuffered)) {
+        setErrorString(m_file->errorString());
+        m_openedFile = false;
+        return false;
+    }
+
+    // files like those in /proc report a size of 0, but are not empty
+    m_sequential = m_file->isSequential() || m_file->size() == 0;
+    m_start = m_sequential ? 0 : m_file->pos();
+    return QIODevice::open(mode | Unbuffered);
+}
+
+void UnbufferedFileDevice::close()
+{
+    if (!isOpen()) {
+        return;
+    }
+    const qint64 end = m_start + pos();
+    QIODevice::close();
+    if (m_openedFile) {
+        m_file->close();
+        m_openedFile = false;
+    } else if (!m_sequential) {
+        // the reads did not move the file
+        m_file->seek(end);
+    }
+    m_sequential = false;
+    m_start = 0;
+}
+
+bool UnbufferedFileDevice::isSequential() const
+{
+    return m_sequential || m_file->isSequential();
+}
+
+qint64 UnbufferedFileDevice::size() const
+{
+    if (!isOpen()) {
+        return m_file->size();
+    }
+    return m_sequential ? 0 : std::max<qint64>(m_file->size() - m_start, 0);
+}
+
+qint64 UnbufferedFileDevice::readData(char *data, qint64 maxSize)
+{
+    if (isSequential()) {
+        return m_file->read(data, maxSize);
+    }
+    const qint64 offset = m_start + pos();
+#ifdef Q_OS_UNIX
+    const int fd = m_file->handle();
+    if (fd >= 0) {
+        ssize_t n;
+        do {
+            n = ::pread(fd, data, maxSize, offset);
+        } while (n < 0 && errno == EINTR);
+        if (n < 0) {
+            setErrorString(QString::fromLocal8Bit(std::strerror(errno)));
+        }
+        return n;
+    }
+#endif
+    if (m_file->pos() != offset && !m_file->seek(offset)) {
+        setErrorString(m_file->errorString());
+        return -1;
+    }
+    return m_file->read(data, maxSize);
+}
+
+qint64 UnbufferedFileDevice::writeData(const char *data, qint64 maxSize)
+{
+    Q_UNUSED(data)
+    Q_UNUSED(maxSize)
+    return -1;
+}
@@ -0,0 +1,70 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    utils/unbufferedfiledevice.h
+
+    This file is part of Kleopatra, the KDE keymanager
+    SPDX-FileCopyrightText: 2021 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef __KLEOPATRA_UTILS_UNBUFFEREDFILEDEVICE_H__
+#define __KLEOPATRA_UTILS_UNBUFFEREDFILEDEVICE_H__
+
+#include <QIODevice>
+
+#include <memory>
+
+class QFile;
+
+namespace Kleo
+{
+
+/*!
+ * A read-only device for a file that reads straight into the caller's
+ * buffer instead of going through QFile's read buffer.
+ *
+ * Regular files are read with positional reads (pread()) starting at the
+ * position the file had when the device was opened. Nothing is cached:
+ * data that is appended to the file while it is read is read, too, and a
+ * file that is truncated simply ends early. Sequential files (e.g. FIFOs)
+ * and files that report a size of 0 (e.g. those in /proc) are read through
+ * the QFile.
+ *
+ * The file is not mapped into memory on purpose: the input files belong
+ * to the user, and accessing a mapping of a file that was truncated by
+ * someone else crashes the process with SIGBUS.
+ *
+ * If the file is already open when the device is opened, it is left open
+ * on close() and positioned after the data that was read; otherwise the
+ * device opens it unbuffered and closes it again.
+ */
+class UnbufferedFileDevice : public QIODevice
+{
+    Q_OBJECT
+public:
+    explicit UnbufferedFileDevice(const std::shared_ptr<QFile> &file, QObject *parent = nullptr);
+    ~UnbufferedFileDevice() override;
+
+    /*! Opens the file (unless it is already open); \a mode must be ReadOnly. */
+    bool open(OpenMode mode) override;
+    void close() override;
+
+    bool isSequential() const override;
+    qint64 size() const override;
+
+    QString fileName() const;
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override;
+    qint64 writeData(const char *data, qint64 maxSize) override;
+
+private:
+    const std::shared_ptr<QFile> m_file;
+    qint64 m_start = 0;
+    bool m_sequential = false;
+    bool m_openedFile = false;
+};
+
+}
+
+#endif // __KLEOPATRA_UTILS_UNBUFFEREDFILEDEVICE_H__
@@ -0,0 +1,447 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    view/dumpview.cpp
+
+    This file is part of Kleopatra, the KDE keymanager
+    SPDX-FileCopyrightText: 2021 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <config-kleopatra.h>
+
+#include "dumpview.h"
+
+#include <utils/dumpfile.h>
+
+#include <Libkleo/GnuPG>
+
+#include <KLocalizedString>
+
+#include <QAbstractListModel>
+#include <QApplication>
+#include <QClipboard>
+#include <QFontDatabase>
+#include <QKeyEvent>
+#include <QTimer>
+
+#include <algorithm>
+#include <vector>
+
+using namespace Kleo;
+
+namespace
+{
+
+QString expandTabs(const QString &text)
+{
+    static const int tabWidth = 8;
+    if (!text.contains(QLatin1Char('\t'))) {
+        return text;
+    }
+    QString result;
+    result.reserve(text.size() + tabWidth);
+    for (const QChar c : text) {
+        if (c == QLatin1Char('\t')) {
+            result.append(QString(tabWidth - result.size() % tabWidth, QLatin1Char(' ')));
+        } else {
+            result.append(c);
+        }
+    }
+    return result;
+}
+
+/*
+ * Presents the lines of a DumpFile. A collapsed entry run is shown as a
+ * single summary row, so the rows do not map 1:1 to the lines.
+ *
+ * Appended data only changes the end of the file, so existing rows never
+ * move; new rows are published in batches.
+ */
+class DumpModel : public QAbstractListModel
+{
+    Q_OBJECT
+public:
+    explicit DumpModel(QObject *parent = nullptr)
+        : QAbstractListModel(parent)
+    {
+        mFlushTimer.setSingleShot(true);
+        mFlushTimer.setInterval(100);
+        connect(&mFlushTimer, &QTimer::timeout, this, &DumpModel::flush);
+    }
+
+    const DumpFile &file() const
+    {
+        return mFile;
+    }
+
+    void clear()
+    {
+        beginResetModel();
+        mFlushTimer.stop();
+        mFile.clear();
+        mExpanded.clear();
+        mRunRows.clear();
+        mRowCount = 0;
+        mMaxLineLength = 0;
+        endResetModel();
+    }
+
+    void append(const QByteArray &data)
+    {
+        mFile.append(data);
+        if (!mFlushTimer.isActive()) {
+            // show the first screen right away
+            mFlushTimer.start(mRowCount == 0 ? 0 : mFlushTimer.interval());
+        }
+    }
+
+    void finish()
+    {
+        mFile.finish();
+        flush();
+    }
+
+    void setItemSize(int charWidth, int height)
+    {
+        mCharWidth = charWidth;
+        mItemHeight = height;
+    }
+
+    void setExpanded(bool expanded)
+    {
+        beginResetModel();
+        mExpandAll = expanded;
+        mExpanded.assign(mFile.entryRuns().size(), expanded);
+        updateRows();
+        endResetModel();
+    }
+
+    bool isExpanded() const
+    {
+        return mExpandAll;
+    }
+
+    // expands or collapses the entry run shown in row
+    void toggleRun(int row)
+    {
+        // the row counts must match the file
+        flush();
+        int run;
+        rowToLine(row, &run);
+        if (run < 0) {
+            return;
+        }
+        const int first = mRunRows[run];
+        const int count = mFile.entryRuns()[run].count;
+        if (count > 1) {
+            if (mExpanded[run]) {
+                beginRemoveRows(QModelIndex(), first + 1, first + count - 1);
+            } else {
+                beginInsertRows(QModelIndex(), first + 1, first + count - 1);
+            }
+        }
+        mExpanded[run] = !mExpanded[run];
+        updateRows();
+        if (count > 1) {
+            if (mExpanded[run]) {
+                endInsertRows();
+            } else {
+                endRemoveRows();
+            }
+        }
+        Q_EMIT dataChanged(index(first), index(first));
+    }
+
+    // returns the line shown in row or -1 for the summary row of the entry
+    // run returned in run
+    int rowToLine(int row, int *run = nullptr) const
+    {
+        if (run) {
+            *run = -1;
+        }
+        const auto it = std::upper_bound(mRunRows.cbegin(), mRunRows.cend(), row);
+        if (it == mRunRows.cbegin()) {
+            return row;
+        }
+        const int r = static_cast<int>(it - mRunRows.cbegin()) - 1;
+        const DumpFile::EntryRun &entryRun = mFile.entryRuns()[r];
+        const int visible = mExpanded[r] ? entryRun.count : 1;
+        const int offset = row - mRunRows[r];
+        if (offset >= visible) {
+            return entryRun.firstLine + entryRun.count + offset - visible;
+        }
+        if (mExpanded[r]) {
+            return entryRun.firstLine + offset;
+        }
+        if (run) {
+            *run = r;
+        }
+        return -1;
+    }
+
+    // returns the row showing line; collapsed entry runs are expanded
+    int lineToRow(int line)
+    {
+        flush();
+        const int run = mFile.entryRunOf(line);
+        if (run >= 0 && !mExpanded[run]) {
+            toggleRun(mRunRows[run]);
+        }
+        const auto &runs = mFile.entryRuns();
+        const auto it = std::upper_bound(runs.cbegin(), runs.cend(), line,
+                                         [](int l, const DumpFile::EntryRun &r) {
+                                             return l < r.firstLine;
+                                         });
+        if (it == runs.cbegin()) {
+            return line;
+        }
+        const int r = static_cast<int>(it - runs.cbegin()) - 1;
+        const int visible = mExpanded[r] ? runs[r].count : 1;
+        const int offset = line - runs[r].firstLine;
+        return mRunRows[r] + (offset < visible ? offset : visible + offset - runs[r].count);
+    }
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override
+    {
+        return parent.isValid() ? 0 : mRowCount;
+    }
+
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override
+    {
+        if (!index.isValid() || index.row() >= mRowCount) {
+            return QVariant();
+        }
+        switch (role) {
+        case Qt::DisplayRole: {
+            int run;
+            const int line = rowToLine(index.row(), &run);
+            if (line >= 0) {
+                return expandTabs(stringFromGpgOutput(mFile.line(line)));
+            }
+            return expandTabs(QLatin1Char(' ') + i18nc("Count of revocations in a CRL", "Entries:")
+                              + QStringLiteral("\t\t%1").arg(mFile.entryRuns()[run].count));
+        }
+        case Qt::ToolTipRole: {
+            int run;
+            if (rowToLine(index.row(), &run) < 0) {
+                return i18nc("@info:tooltip", "Double-click to show the entries of this CRL.");
+            }
+            return QVariant();
+        }
+        case Qt::SizeHintRole:
+            // all rows have the same size; leave room for expanded tabs
+            return QSize((mMaxLineLength + 16) * mCharWidth, mItemHeight);
+        }
+        return QVariant();
+    }
+
+Q_SIGNALS:
+    void maximumLineLengthChanged();
+
+private:
+    void flush()
+    {
+        mFlushTimer.stop();
+        const int oldCount = mRowCount;
+        const int lastRun = static_cast<int>(mExpanded.size()) - 1;
+        mExpanded.resize(mFile.entryRuns().size(), mExpandAll);
+        const int newCount = countRows();
+        if (newCount > oldCount) {
+            beginInsertRows(QModelIndex(), oldCount, newCount - 1);
+            updateRows();
+            endInsertRows();
+        } else {
+            updateRows();
+        }
+        // the entry count of the last collapsed run may have grown
+        if (lastRun >= 0 && !mExpanded[lastRun]) {
+            const QModelIndex summary = index(mRunRows[lastRun]);
+            Q_EMIT dataChanged(summary, summary);
+        }
+        if (mFile.maximumLineLength() > mMaxLineLength) {
+            mMaxLineLength = mFile.maximumLineLength();
+            Q_EMIT maximumLineLengthChanged();
+        }
+    }
+
+    int countRows() const
+    {
+        int count = mFile.lineCount();
+        const auto &runs = mFile.entryRuns();
+        for (size_t i = 0; i < runs.size(); ++i) {
+            if (!mExpanded[i]) {
+                count -= runs[i].count - 1;
+            }
+        }
+        return count;
+    }
+
+    void updateRows()
+    {
+        const auto &runs = mFile.entryRuns();
+        mRunRows.resize(runs.size());
+        int hidden = 0;
+        for (size_t i = 0; i < runs.size(); ++i) {
+            mRunRows[i] = runs[i].firstLine - hidden;
+            if (!mExpanded[i]) {
+                hidden += runs[i].count - 1;
+            }
+        }
+        mRowCount = countRows();
+    }
+
+private:
+    DumpFile mFile;
+    QTimer mFlushTimer;
+    bool mExpandAll = false;
+    // per entry run
+    std::vector<bool> mExpanded;
+    std::vector<int> mRunRows;
+    int mRowCount = 0;
+    int mMaxLineLength = 0;
+    int mCharWidth = 8;
+    int mItemHeight = 16;
+};
+
+}
+
+class DumpView::Private
+{
+    friend class ::Kleo::DumpView;
+    DumpView *const q;
+public:
+    explicit Private(DumpView *qq)
+        : q(qq),
+          model(new DumpModel(qq))
+    {
+    }
+
+private:
+    void updateItemSize()
+    {
+        const QFontMetrics fm(q->font());
+        model->setItemSize(fm.horizontalAdvance(QLatin1Char('M')), fm.lineSpacing());
+    }
+
+    void copySelection() const
+    {
+        QModelIndexList indexes = q->selectionModel()->selectedIndexes();
+        std::sort(indexes.begin(), indexes.end());
+        QStringList lines;
+        lines.reserve(indexes.size());
+        for (const QModelIndex &index : qAsConst(indexes)) {
+            lines.push_back(index.data().toString());
+        }
+        if (!lines.isEmpty()) {
+            QApplication::clipboard()->setText(lines.join(QLatin1Char('\n')));
+        }
+    }
+
+private:
+    DumpModel *const model;
+};
+
+DumpView::DumpView(QWidget *parent)
+    : QListView(parent),
+      d(new Private(this))
+{
+    setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    setUniformItemSizes(true);
+    setWordWrap(false);
+    setTextElideMode(Qt::ElideNone);
+    setSelectionMode(ExtendedSelection);
+    setEditTriggers(NoEditTriggers);
+    setModel(d->model);
+    d->updateItemSize();
+
+    connect(d->model, &DumpModel::maximumLineLengthChanged, this, [this]() {
+        // the cached uniform item size is only updated on relayout
+        scheduleDelayedItemsLayout();
+    });
+    connect(this, &QAbstractItemView::doubleClicked, this, [this](const QModelIndex &index) {
+        d->model->toggleRun(index.row());
+    });
+}
+
+DumpView::~DumpView() {}
+
+void DumpView::clear()
+{
+    d->model->clear();
+}
+
+void DumpView::append(const QByteArray &data)
+{
+    d->model->append(data);
+}
+
+void DumpView::finish()
+{
+    d->model->finish();
+}
+
+int DumpView::lineCount() const
+{
+    return d->model->file().lineCount();
+}
+
+void DumpView::setEntriesExpanded(bool expanded)
+{
+    d->model->setExpanded(expanded);
+}
+
+bool DumpView::entriesExpanded() const
+{
+    return d->model->isExpanded();
+}
+
+bool DumpView::find(const QString &text)
+{
+    const QByteArray needle = text.trimmed().toUtf8();
+    if (needle.isEmpty()) {
+        return false;
+    }
+    const DumpFile &file = d->model->file();
+
+    int from = -1;
+    if (currentIndex().isValid()) {
+        int run;
+        from = d->model->rowToLine(currentIndex().row(), &run);
+        if (from < 0) {
+            from = file.entryRuns()[run].firstLine;
+        }
+    }
+
+    int line = file.findSerialNumber(needle);
+    if (line < 0 || line == from) {
+        line = file.findIssuer(needle, from);
+    }
+    if (line < 0) {
+        line = file.find(needle, from);
+    }
+    if (line < 0) {
+        return false;
+    }
+
+    const QModelIndex index = d->model->index(d->model->lineToRow(line));
+    setCurrentIndex(index);
+    scrollTo(index, PositionAtCenter);
+    return true;
+}
+
+void DumpView::keyPressEvent(QKeyEvent *event)
+{
+    if (event == QKeySequence::Copy) {
+        d->copySelection();
+        event->accept();
+        return;
+    }
+    if ((event->key() == Qt::Key_Return || event->key() == Qt::Key_Enter) && currentIndex().isValid()) {
+        d->model->toggleRun(currentIndex().row());
+        event->accept();
+        return;
+    }
+    QListView::keyPressEvent(event);
+}
+
+#include "dumpview.moc"
@@ -0,0 +1,64 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    view/dumpview.h
+
+    This file is part of Kleopatra, the KDE keymanager
+    SPDX-FileCopyrightText: 2021 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef __KLEOPATRA_VIEW_DUMPVIEW_H__
+#define __KLEOPATRA_VIEW_DUMPVIEW_H__
+
+#include <QListView>
+
+#include <utils/pimpl_ptr.h>
+
+namespace Kleo
+{
+
+/*!
+ * Shows the output of gpgsm --dump-cert or gpgsm --call-dirmngr listcrls
+ * while it is being read.
+ *
+ * The output is kept in a DumpFile; the view only renders the visible lines.
+ * The entries of each CRL are collapsed into a single line showing their
+ * number unless entriesExpanded() is set; double-clicking this line shows
+ * the entries of this CRL.
+ */
+class DumpView : public QListView
+{
+    Q_OBJECT
+public:
+    explicit DumpView(QWidget *parent = nullptr);
+    ~DumpView() override;
+
+    void clear();
+    void append(const QByteArray &data);
+    /*! Call after the last data has been appended. */
+    void finish();
+
+    int lineCount() const;
+
+    void setEntriesExpanded(bool expanded);
+    bool entriesExpanded() const;
+
+public Q_SLOTS:
+    /*!
+     * Selects the next line matching \a text, which is looked up as serial
+     * number of a CRL entry, in the issuers of the CRLs and finally in all
+     * lines. Returns false if nothing was found.
+     */
+    bool find(const QString &text);
+
+protected:
+    void keyPressEvent(QKeyEvent *event) override;
+
+private:
+    class Private;
+    kdtools::pimpl_ptr<Private> d;
+};
+
+}
+
+#endif // __KLEOPATRA_VIEW_DUMPVIEW_H__
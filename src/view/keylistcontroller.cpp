@@ -11,6 +11,7 @@
 
 #include "keylistcontroller.h"
 #include "tabwidget.h"
+#include "selectioncounters.h"
 
 #include <smartcard/readerstatus.h>
 
@@ -62,6 +63,7 @@
 #include <QAction>
 
 #include <algorithm>
+#include <map>
 
 using namespace Kleo;
 using namespace Kleo::Commands;
@@ -96,6 +98,11 @@ public:
     {
         view->disconnect(q);
         view->selectionModel()->disconnect(q);
+        const auto it = selectionCounters.find(view->selectionModel());
+        if (it != selectionCounters.end()) {
+            delete it->second;
+            selectionCounters.erase(it);
+        }
         views.erase(std::remove(views.begin(), views.end(), view), views.end());
     }
 
@@ -135,7 +142,7 @@ private:
     int toolTipOptions() const;
 
 private:
-    static Command::Restrictions calculateRestrictionsMask(const QItemSelectionModel *sm);
+    Command::Restrictions calculateRestrictionsMask(const QItemSelectionModel *sm) const;
 
 private:
     struct action_item {
@@ -150,6 +157,7 @@ private:
     QPointer<TabWidget> tabWidget;
     QPointer<QAbstractItemView> currentView;
     QPointer<AbstractKeyListModel> flatModel, hierarchicalModel;
+    std::map<const QItemSelectionModel *, QPointer<SelectionCounters>> selectionCounters;
 };
 
 KeyListController::Private::Private(KeyListController *qq)
@@ -520,8 +528,9 @@ void KeyListController::createActions(KActionCollection *coll)
     //---
     registerActionForCommand<DumpCertificateCommand>(coll->action(QStringLiteral("certificates_dump_certificate")));
 
-    registerActionForCommand<RefreshX509CertsCommand>(coll->action(QStringLiteral("tools_refresh_x509_certificates")));
-    registerActionForCommand<RefreshOpenPGPCertsCommand>(coll->action(QStringLiteral("tools_refresh_openpgp_certificates")));
+    // the refresh actions in the Tools menu always refresh all certificates
+    registerActionForGlobalCommand<RefreshX509CertsCommand>(coll->action(QStringLiteral("tools_refresh_x509_certificates")));
+    registerActionForGlobalCommand<RefreshOpenPGPCertsCommand>(coll->action(QStringLiteral("tools_refresh_openpgp_certificates")));
     //---
     registerActionForCommand<ImportCrlCommand>(coll->action(QStringLiteral("crl_import_crl")));
     //---
@@ -575,6 +584,12 @@ void KeyListController::cancelCommands()
 
 void KeyListController::Private::connectView(QAbstractItemView *view)
 {
+    // the counters must see selection changes before slotSelectionChanged()
+    QItemSelectionModel *const sm = view->selectionModel();
+    if (!selectionCounters[sm]) {
+        selectionCounters[sm] = new SelectionCounters(sm);
+        connect(sm, &QObject::destroyed, q, [this, sm]() { selectionCounters.erase(sm); });
+    }
 
     connect(view, SIGNAL(destroyed(QObject*)),
             q, SLOT(slotDestroyed(QObject*)));
@@ -671,81 +686,22 @@ void KeyListController::enableDisableActions(const QItemSelectionModel *sm) cons
         }
 }
 
-static bool all_secret_are_not_owner_trust_ultimate(const std::vector<Key> &keys)
-{
-    for (const Key &key : keys)
-        if (key.hasSecret() && key.ownerTrust() == Key::Ultimate) {
-            return false;
-        }
-    return true;
-}
-
-Command::Restrictions find_root_restrictions(const std::vector<Key> &keys)
-{
-    bool trusted = false, untrusted = false;
-    for (const Key &key : keys)
-        if (key.isRoot())
-            if (key.userID(0).validity() == UserID::Ultimate) {
-                trusted = true;
-            } else {
-                untrusted = true;
-            }
-        else {
-            return Command::NoRestriction;
-        }
-    if (trusted)
-        if (untrusted) {
-            return Command::NoRestriction;
-        } else {
-            return Command::MustBeTrustedRoot;
-        }
-    else if (untrusted) {
-        return Command::MustBeUntrustedRoot;
-    } else {
-        return Command::NoRestriction;
-    }
-}
-
-Command::Restrictions KeyListController::Private::calculateRestrictionsMask(const QItemSelectionModel *sm)
+Command::Restrictions KeyListController::Private::calculateRestrictionsMask(const QItemSelectionModel *sm) const
 {
     if (!sm) {
         return Command::NoRestriction;
     }
 
-    const KeyListModelInterface *const m = dynamic_cast<const KeyListModelInterface *>(sm->model());
-    if (!m) {
+    const auto it = selectionCounters.find(sm);
+    if (it == selectionCounters.end() || !it->second) {
         return Command::NoRestriction;
     }
 
-    const std::vector<Key> keys = m->keys(sm->selectedRows());
-    if (keys.empty()) {
-        return Command::NoRestriction;
+    Command::Restrictions result = it->second->restrictions();
+    if (result == Command::NoRestriction) {
+        return result;
     }
 
-    Command::Restrictions result = Command::NeedSelection;
-
-    if (keys.size() == 1) {
-        result |= Command::OnlyOneKey;
-    }
-
-    if (std::all_of(keys.cbegin(), keys.cend(), std::mem_fn(&Key::hasSecret))) {
-        result |= Command::NeedSecretKey;
-    } else if (!std::any_of(keys.cbegin(), keys.cend(), std::mem_fn(&Key::hasSecret))) {
-        result |= Command::MustNotBeSecretKey;
-    }
-
-    if (std::all_of(keys.cbegin(), keys.cend(), [](const Key &key) { return key.protocol() == OpenPGP; })) {
-        result |= Command::MustBeOpenPGP;
-    } else if (std::all_of(keys.cbegin(), keys.cend(), [](const Key &key) { return key.protocol() == CMS; })) {
-        result |= Command::MustBeCMS;
-    }
-
-    if (all_secret_are_not_owner_trust_ultimate(keys)) {
-        result |= Command::MayOnlyBeSecretKeyIfOwnerTrustIsNotYetUltimate;
-    }
-
-    result |= find_root_restrictions(keys);
-
     if (const ReaderStatus *rs = ReaderStatus::instance()) {
         if (!rs->firstCardWithNullPin().empty()) {
             result |= Command::AnyCardHasNullPin;
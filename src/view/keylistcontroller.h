@@ -63,6 +63,16 @@ public:
         this->registerAction(action, T_Command::restrictions(), &KeyListController::template create<T_Command>);
     }
 
+    /*!
+     * Like registerActionForCommand(), but the command is created without
+     * a view, i.e. it does not act on the current selection.
+     */
+    template <typename T_Command>
+    void registerActionForGlobalCommand(QAction *action)
+    {
+        this->registerAction(action, T_Command::restrictions(), &KeyListController::template createGlobal<T_Command>);
+    }
+
     void enableDisableActions(const QItemSelectionModel *sm) const;
 
     bool hasRunningCommands() const;
@@ -77,6 +87,12 @@ private:
         return new T_Command(v, c);
     }
 
+    template <typename T_Command>
+    static Command *createGlobal(QAbstractItemView *, KeyListController *c)
+    {
+        return new T_Command(c);
+    }
+
 public Q_SLOTS:
     void addView(QAbstractItemView *view);
     void removeView(QAbstractItemView *view);
@@ -0,0 +1,164 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    view/keylistmodelpool.cpp
+
+    This file is part of Kleopatra, the KDE keymanager
+    SPDX-FileCopyrightText: 2021 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <config-kleopatra.h>
+
+#include "keylistmodelpool.h"
+
+#include <Libkleo/KeyCache>
+#include <Libkleo/KeyListModel>
+
+#include <gpgme++/key.h>
+
+#include "kleopatra_debug.h"
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QHash>
+#include <QPointer>
+#include <QTimer>
+
+#include <algorithm>
+#include <vector>
+
+using namespace Kleo;
+using namespace GpgME;
+
+namespace
+{
+
+// unused models are released after this time
+static const qint64 keepAliveMSecs = 5 * 60 * 1000;
+
+struct Entry {
+    std::shared_ptr<AbstractKeyListModel> model;
+    qint64 lastAcquired;
+};
+
+class Pool
+{
+public:
+    static Pool &instance()
+    {
+        static Pool self;
+        return self;
+    }
+
+    std::shared_ptr<AbstractKeyListModel> model(KeyListModelPool::Kind kind, const QString &id, const KeyListModelPool::Filter &filter)
+    {
+        const QString key = QString::number(kind) + QLatin1Char('/') + id;
+        auto it = mEntries.find(key);
+        if (it == mEntries.end()) {
+            it = mEntries.insert(key, Entry{createModel(kind, filter), 0});
+            expiryTimer()->start();
+        }
+        it->lastAcquired = QDateTime::currentMSecsSinceEpoch();
+        return it->model;
+    }
+
+private:
+    Pool() = default;
+
+    // The pool itself outlives the application object, so the timer is
+    // owned by the application and serves as context of the connections.
+    QTimer *expiryTimer()
+    {
+        if (!mExpiryTimer) {
+            mExpiryTimer = new QTimer(QCoreApplication::instance());
+            mExpiryTimer->setInterval(60 * 1000);
+            QObject::connect(mExpiryTimer.data(), &QTimer::timeout, mExpiryTimer.data(), [this]() { expire(); });
+            QObject::connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, mExpiryTimer.data(), [this]() {
+                mExpiryTimer->stop();
+                mEntries.clear();
+            });
+        }
+        return mExpiryTimer;
+    }
+
+    static std::vector<Key> filteredKeys(const KeyListModelPool::Filter &filter)
+    {
+        std::vector<Key> keys = KeyCache::instance()->keys();
+        if (filter) {
+            keys.erase(std::remove_if(keys.begin(), keys.end(),
+                                      [&filter](const Key &key) { return !filter(key); }),
+                       keys.end());
+        }
+        return keys;
+    }
+
+    static std::shared_ptr<AbstractKeyListModel> createModel(KeyListModelPool::Kind kind, const KeyListModelPool::Filter &filter)
+    {
+        AbstractKeyListModel *const model = kind == KeyListModelPool::Hierarchical
+                                            ? AbstractKeyListModel::createHierarchicalKeyListModel()
+                                            : AbstractKeyListModel::createFlatKeyListModel();
+        // the keys in the model by fingerprint
+        const auto contents = std::make_shared<QHash<QByteArray, Key>>();
+        const auto cache = KeyCache::instance();
+        // the key cache also emits added() for keys that were updated
+        QObject::connect(cache.get(), &KeyCache::added, model, [model, filter, contents](const Key &key) {
+            const QByteArray fpr = key.primaryFingerprint();
+            if (!filter || filter(key)) {
+                contents->insert(fpr, key);
+                model->addKey(key);
+            } else if (contents->contains(fpr)) {
+                model->removeKey(contents->take(fpr));
+            }
+        });
+        QObject::connect(cache.get(), &KeyCache::aboutToRemove, model, [model, contents](const Key &key) {
+            if (contents->remove(key.primaryFingerprint())) {
+                model->removeKey(key);
+            }
+        });
+        // a reload of the key cache re-adds the keys it still has, but does
+        // not tell about the ones that are gone
+        QObject::connect(cache.get(), &KeyCache::keysMayHaveChanged, model, [model, contents]() {
+            const auto cache = KeyCache::instance();
+            for (auto it = contents->begin(); it != contents->end();) {
+                if (cache->findByFingerprint(it.key().constData()).isNull()) {
+                    model->removeKey(it.value());
+                    it = contents->erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        });
+        const std::vector<Key> keys = filteredKeys(filter);
+        for (const Key &key : keys) {
+            contents->insert(key.primaryFingerprint(), key);
+        }
+        model->setKeys(keys);
+        return std::shared_ptr<AbstractKeyListModel>(model, [](AbstractKeyListModel *m) { m->deleteLater(); });
+    }
+
+    void expire()
+    {
+        const qint64 now = QDateTime::currentMSecsSinceEpoch();
+        for (auto it = mEntries.begin(); it != mEntries.end();) {
+            if (it->model.use_count() == 1 && now - it->lastAcquired > keepAliveMSecs) {
+                qCDebug(KLEOPATRA_LOG) << "KeyListModelPool: releasing" << it.key();
+                it = mEntries.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        if (mEntries.isEmpty()) {
+            expiryTimer()->stop();
+        }
+    }
+
+    QHash<QString, Entry> mEntries;
+    QPointer<QTimer> mExpiryTimer;
+};
+
+}
+
+std::shared_ptr<AbstractKeyListModel> KeyListModelPool::model(Kind kind, const QString &id, const Filter &filter)
+{
+    return Pool::instance().model(kind, id, filter);
+}
@@ -0,0 +1,59 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    view/keylistmodelpool.h
+
+    This file is part of Kleopatra, the KDE keymanager
+    SPDX-FileCopyrightText: 2021 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef __KLEOPATRA_VIEW_KEYLISTMODELPOOL_H__
+#define __KLEOPATRA_VIEW_KEYLISTMODELPOOL_H__
+
+#include <QString>
+
+#include <functional>
+#include <memory>
+
+namespace GpgME
+{
+class Key;
+}
+
+namespace Kleo
+{
+
+class AbstractKeyListModel;
+
+/*!
+ * Application-wide pool of key list models that follow the key cache.
+ *
+ * Building a model (and in particular the hierarchy) for tens of thousands
+ * of keys is expensive, so dialogs share the models of this pool instead of
+ * filling their own copies. The models are kept up to date incrementally
+ * when the key cache adds or removes keys. A model is released some time
+ * after the last user dropped its reference, so that a dialog that is
+ * opened repeatedly finds it ready.
+ */
+namespace KeyListModelPool
+{
+
+enum Kind {
+    Flat,
+    Hierarchical
+};
+
+using Filter = std::function<bool(const GpgME::Key &)>;
+
+/*!
+ * Returns the shared model of the given \a kind that contains the keys of
+ * the key cache accepted by \a filter (all keys if \a filter is empty).
+ * Models are identified by \a id; all callers passing the same \a id must
+ * pass equivalent filters.
+ */
+std::shared_ptr<AbstractKeyListModel> model(Kind kind, const QString &id, const Filter &filter = Filter());
+
+}
+}
+
+#endif // __KLEOPATRA_VIEW_KEYLISTMODELPOOL_H__
@@ -37,6 +37,10 @@
 #include <QAction>
 #include <QEvent>
 #include <QContextMenuEvent>
+#include <QHash>
+#include <QScrollBar>
+
+#include <algorithm>
 
 #include <KSharedConfig>
 #include <KLocalizedString>
@@ -48,6 +52,17 @@
 
 #define REMARK_COLUMN 13
 
+// with at least this many keys in the key cache, views switch to the
+// large-keyring mode (see KeyTreeView::setLargeKeyringMode())
+static const size_t LargeKeyringThreshold = 5000;
+// number of rows used to estimate the column widths in large-keyring mode
+static const int ColumnWidthSampleSize = 200;
+// number of rows formatted per step when preformatting off-screen rows
+static const int PreformatChunkSize = 50;
+// maximum number of keys whose formatted columns are cached; scrolling
+// through a huge keyring must not keep the texts of all keys around
+static const int MaxCachedKeys = 2000;
+
 using namespace Kleo;
 using namespace GpgME;
 
@@ -124,6 +139,96 @@ private:
     QList<QAction *> mColumnActions;
 };
 
+// Caches the formatted display strings of the columns that are expensive to
+// format (validity, dates, technical details) per key. An entry is dropped
+// when the model reports a change of its key with dataChanged(), and the
+// whole cache on a model reset or when it grows beyond MaxCachedKeys.
+class CachingRearrangeColumnsProxyModel : public KeyRearrangeColumnsProxyModel
+{
+public:
+    explicit CachingRearrangeColumnsProxyModel(QObject *parent = nullptr)
+        : KeyRearrangeColumnsProxyModel(parent)
+    {
+        connect(this, &QAbstractItemModel::dataChanged, this, [this](const QModelIndex &topLeft, const QModelIndex &bottomRight) {
+            if (mCache.empty()) {
+                return;
+            }
+            for (int row = topLeft.row(); row <= bottomRight.row(); ++row) {
+                const Key key = this->key(index(row, 0, topLeft.parent()));
+                if (!key.isNull()) {
+                    mCache.remove(QByteArray::fromRawData(key.primaryFingerprint(), qstrlen(key.primaryFingerprint())));
+                }
+            }
+        });
+        connect(this, &QAbstractItemModel::modelReset, this, [this]() { mCache.clear(); });
+    }
+
+    void setCachingEnabled(bool enabled)
+    {
+        mCachingEnabled = enabled;
+        if (!enabled) {
+            mCache.clear();
+        }
+    }
+
+    bool isCachingEnabled() const
+    {
+        return mCachingEnabled;
+    }
+
+    QVariant data(const QModelIndex &index, int role) const override
+    {
+        if (!mCachingEnabled || role != Qt::DisplayRole || !index.isValid()) {
+            return KeyRearrangeColumnsProxyModel::data(index, role);
+        }
+        const int column = cachedColumn(sourceColumnForProxyColumn(index.column()));
+        if (column < 0) {
+            return KeyRearrangeColumnsProxyModel::data(index, role);
+        }
+        const Key key = this->key(index);
+        if (key.isNull() || !key.primaryFingerprint()) {
+            return KeyRearrangeColumnsProxyModel::data(index, role);
+        }
+        const QByteArray fpr = QByteArray::fromRawData(key.primaryFingerprint(), qstrlen(key.primaryFingerprint()));
+        auto it = mCache.find(fpr);
+        if (it == mCache.end()) {
+            if (mCache.size() >= MaxCachedKeys) {
+                // the rows on screen are formatted again with their next paint
+                mCache.clear();
+            }
+            it = mCache.insert(QByteArray(fpr.constData(), fpr.size()), Entry());
+        }
+        Entry &entry = *it;
+        if (!(entry.valid & (1u << column))) {
+            entry.texts[column] = KeyRearrangeColumnsProxyModel::data(index, role).toString();
+            entry.valid |= 1u << column;
+        }
+        return entry.texts[column];
+    }
+
+private:
+    static int cachedColumn(int sourceColumn)
+    {
+        switch (sourceColumn) {
+        case KeyListModelInterface::Validity:         return 0;
+        case KeyListModelInterface::ValidFrom:        return 1;
+        case KeyListModelInterface::ValidUntil:       return 2;
+        case KeyListModelInterface::TechnicalDetails: return 3;
+        case KeyListModelInterface::OwnerTrust:       return 4;
+        case KeyListModelInterface::LastUpdate:       return 5;
+        default:                                      return -1;
+        }
+    }
+
+    struct Entry {
+        QString texts[6];
+        unsigned int valid = 0;
+    };
+
+    bool mCachingEnabled = false;
+    mutable QHash<QByteArray, Entry> mCache;
+};
+
 } // anon namespace
 
 KeyTreeView::KeyTreeView(QWidget *parent)
@@ -135,7 +240,11 @@ KeyTreeView::KeyTreeView(QWidget *parent)
       m_hierarchicalModel(nullptr),
       m_stringFilter(),
       m_keyFilter(),
-      m_isHierarchical(true)
+      m_isHierarchical(true),
+      m_onceResized(false),
+      m_largeKeyringMode(false),
+      m_suspended(false),
+      m_detached(false)
 {
     init();
 }
@@ -150,9 +259,14 @@ KeyTreeView::KeyTreeView(const KeyTreeView &other)
       m_stringFilter(other.m_stringFilter),
       m_keyFilter(other.m_keyFilter),
       m_group(other.m_group),
-      m_isHierarchical(other.m_isHierarchical)
+      m_isHierarchical(other.m_isHierarchical),
+      m_onceResized(false),
+      m_largeKeyringMode(false),
+      m_suspended(false),
+      m_detached(false)
 {
     init();
+    setLargeKeyringMode(other.m_largeKeyringMode);
     setColumnSizes(other.columnSizes());
     setSortColumn(other.sortColumn(), other.sortOrder());
 }
@@ -170,7 +284,10 @@ KeyTreeView::KeyTreeView(const QString &text, const std::shared_ptr<KeyFilter> &
       m_keyFilter(kf),
       m_group(group),
       m_isHierarchical(true),
-      m_onceResized(false)
+      m_onceResized(false),
+      m_largeKeyringMode(false),
+      m_suspended(false),
+      m_detached(false)
 {
     init();
 }
@@ -271,7 +388,7 @@ void KeyTreeView::init()
     m_proxy->setKeyFilter(m_keyFilter);
     m_proxy->setSortCaseSensitivity(Qt::CaseInsensitive);
 
-    KeyRearrangeColumnsProxyModel *rearangingModel = new KeyRearrangeColumnsProxyModel(this);
+    KeyRearrangeColumnsProxyModel *rearangingModel = new CachingRearrangeColumnsProxyModel(this);
     rearangingModel->setSourceModel(m_proxy);
     rearangingModel->setSourceColumns(QVector<int>() << KeyListModelInterface::PrettyName
                                                      << KeyListModelInterface::PrettyEMail
@@ -319,23 +436,118 @@ void KeyTreeView::init()
         m_group.writeEntry("Expanded", m_expandedKeys);
     });
 
+    m_preformatTimer = new QTimer(this);
+    m_preformatTimer->setSingleShot(true);
+    m_preformatTimer->setInterval(0);
+    connect(m_preformatTimer, &QTimer::timeout, this, &KeyTreeView::preformatNextChunk);
+    connect(m_view->verticalScrollBar(), &QScrollBar::valueChanged, this, &KeyTreeView::schedulePreformatting);
+    connect(rearangingModel, &QAbstractItemModel::layoutChanged, this, &KeyTreeView::schedulePreformatting);
+    connect(rearangingModel, &QAbstractItemModel::modelReset, this, &KeyTreeView::schedulePreformatting);
+
     connect(KeyCache::instance().get(), &KeyCache::keysMayHaveChanged, this, [this] () {
         /* We use a single shot timer here to ensure that the keysMayHaveChanged
          * handlers are all handled before we restore the expand state so that
          * the model is already populated. */
         QTimer::singleShot(0, [this] () {
-            restoreExpandState();
+            if (!m_largeKeyringMode && KeyCache::instance()->keys().size() >= LargeKeyringThreshold) {
+                setLargeKeyringMode(true);
+            }
+            if (!m_detached) {
+                // a detached view would forget the expanded keys it cannot find
+                restoreExpandState();
+            }
             setupRemarkKeys();
-            if (!m_onceResized) {
+            // a detached view has no rows to measure; it is resized when attached
+            if (!m_onceResized && !m_detached) {
                 m_onceResized = true;
                 resizeColumns();
             }
         });
     });
+    if (KeyCache::instance()->initialized() && KeyCache::instance()->keys().size() >= LargeKeyringThreshold) {
+        setLargeKeyringMode(true);
+    }
     resizeColumns();
     restoreLayout();
 }
 
+void KeyTreeView::setLargeKeyringMode(bool on)
+{
+    if (on == m_largeKeyringMode) {
+        return;
+    }
+    m_largeKeyringMode = on;
+    // all keys are displayed with a single line, so the height of one row is
+    // good for all, and the view doesn't have to measure every row
+    m_view->setUniformRowHeights(on);
+    static_cast<CachingRearrangeColumnsProxyModel *>(m_view->model())->setCachingEnabled(on);
+    if (on) {
+        schedulePreformatting();
+    } else {
+        m_preformatTimer->stop();
+        m_preformatRows.clear();
+    }
+}
+
+bool KeyTreeView::isLargeKeyringMode() const
+{
+    return m_largeKeyringMode;
+}
+
+void KeyTreeView::schedulePreformatting()
+{
+    if (!m_largeKeyringMode) {
+        return;
+    }
+    // the rows on screen are formatted by painting them; prepare the rows of
+    // one page above and below, so that scrolling finds them formatted
+    m_preformatRows.clear();
+    const QModelIndex top = m_view->indexAt(QPoint(0, 0));
+    if (!top.isValid()) {
+        return;
+    }
+    const int pageRows = std::max(1, m_view->viewport()->height() / std::max(1, m_view->visualRect(top).height()));
+
+    // skip the rows on screen
+    QModelIndex idx = top;
+    for (int i = 0; i < pageRows && idx.isValid(); ++i) {
+        idx = m_view->indexBelow(idx);
+    }
+    for (int i = 0; i < pageRows && idx.isValid(); ++i) {
+        m_preformatRows.push_back(idx);
+        idx = m_view->indexBelow(idx);
+    }
+    idx = m_view->indexAbove(top);
+    for (int i = 0; i < pageRows && idx.isValid(); ++i) {
+        m_preformatRows.push_back(idx);
+        idx = m_view->indexAbove(idx);
+    }
+    // formatted back to front
+    std::reverse(m_preformatRows.begin(), m_preformatRows.end());
+    m_preformatTimer->start();
+}
+
+void KeyTreeView::preformatNextChunk()
+{
+    const QAbstractItemModel *const model = m_view->model();
+    const int columns = model->columnCount();
+    for (int i = 0; i < PreformatChunkSize && !m_preformatRows.empty(); ++i) {
+        const QPersistentModelIndex idx = m_preformatRows.back();
+        m_preformatRows.pop_back();
+        if (!idx.isValid()) {
+            continue;
+        }
+        for (int column = 0; column < columns; ++column) {
+            if (!m_view->isColumnHidden(column)) {
+                model->data(idx.sibling(idx.row(), column), Qt::DisplayRole);
+            }
+        }
+    }
+    if (!m_preformatRows.empty()) {
+        m_preformatTimer->start();
+    }
+}
+
 void KeyTreeView::restoreExpandState()
 {
     if (!KeyCache::instance()->initialized()) {
@@ -477,6 +689,13 @@ void KeyTreeView::setFlatModel(AbstractKeyListModel *model)
         return;
     }
     m_flatModel = model;
+    if (m_suspended) {
+        watchSuspendedModel();
+    }
+    if (m_detached) {
+        // attached with the new model when resumed
+        return;
+    }
     if (!m_isHierarchical)
         // TODO: this fails when called after setHierarchicalView( false )...
     {
@@ -490,6 +709,13 @@ void KeyTreeView::setHierarchicalModel(AbstractKeyListModel *model)
         return;
     }
     m_hierarchicalModel = model;
+    if (m_suspended) {
+        watchSuspendedModel();
+    }
+    if (m_detached) {
+        // attached with the new model when resumed
+        return;
+    }
     if (m_isHierarchical) {
         find_last_proxy(m_proxy)->setSourceModel(model);
         m_view->expandAll();
@@ -554,6 +780,9 @@ void KeyTreeView::setHierarchicalView(bool on)
         qCWarning(KLEOPATRA_LOG) << "flat view requested, but no flat model set";
         return;
     }
+    if (m_detached) {
+        attach();
+    }
     const std::vector<Key> selectedKeys = m_proxy->keys(m_view->selectionModel()->selectedRows());
     const Key currentKey = m_proxy->key(m_view->currentIndex());
 
@@ -570,9 +799,106 @@ void KeyTreeView::setHierarchicalView(bool on)
             m_view->scrollTo(currentIndex);
         }
     }
+    if (m_suspended) {
+        watchSuspendedModel();
+    }
     Q_EMIT hierarchicalChanged(on);
 }
 
+void KeyTreeView::setSuspended(bool suspended)
+{
+    if (suspended == m_suspended) {
+        return;
+    }
+    m_suspended = suspended;
+    if (suspended) {
+        watchSuspendedModel();
+    } else {
+        for (const QMetaObject::Connection &connection : m_suspendConnections) {
+            disconnect(connection);
+        }
+        m_suspendConnections.clear();
+        if (m_detached) {
+            attach();
+        }
+    }
+}
+
+bool KeyTreeView::isSuspended() const
+{
+    return m_suspended;
+}
+
+void KeyTreeView::watchSuspendedModel()
+{
+    for (const QMetaObject::Connection &connection : m_suspendConnections) {
+        disconnect(connection);
+    }
+    m_suspendConnections.clear();
+    const QAbstractItemModel *const source = model();
+    if (!source || m_detached) {
+        return;
+    }
+    // Detaching resets the proxies, which is only worth it once the keys
+    // actually change. The proxies handle the first change themselves,
+    // because they are connected to the model before us.
+    const auto detachOnChange = [this]() { detach(); };
+    m_suspendConnections = {
+        connect(source, &QAbstractItemModel::rowsInserted, this, detachOnChange),
+        connect(source, &QAbstractItemModel::rowsRemoved, this, detachOnChange),
+        connect(source, &QAbstractItemModel::dataChanged, this, detachOnChange),
+        connect(source, &QAbstractItemModel::layoutChanged, this, detachOnChange),
+        connect(source, &QAbstractItemModel::modelReset, this, detachOnChange),
+    };
+}
+
+void KeyTreeView::detach()
+{
+    if (m_detached) {
+        return;
+    }
+    for (const QMetaObject::Connection &connection : m_suspendConnections) {
+        disconnect(connection);
+    }
+    m_suspendConnections.clear();
+
+    m_detachedSelection = m_proxy->keys(m_view->selectionModel()->selectedRows());
+    m_detachedCurrent = m_proxy->key(m_view->currentIndex());
+    m_detached = true;
+    find_last_proxy(m_proxy)->setSourceModel(nullptr);
+}
+
+void KeyTreeView::attach()
+{
+    if (!m_detached) {
+        return;
+    }
+    m_detached = false;
+    // a single pass of filtering and sorting over the current keys
+    find_last_proxy(m_proxy)->setSourceModel(model());
+    if (m_isHierarchical) {
+        m_view->expandAll();
+    }
+    restoreExpandState();
+    if (!m_onceResized) {
+        m_onceResized = true;
+        resizeColumns();
+    }
+    selectKeys(m_detachedSelection);
+    if (!m_detachedCurrent.isNull()) {
+        const QModelIndex currentIndex = m_proxy->index(m_detachedCurrent);
+        if (currentIndex.isValid()) {
+            m_view->selectionModel()->setCurrentIndex(currentIndex, QItemSelectionModel::NoUpdate);
+            m_view->scrollTo(currentIndex);
+        }
+    }
+    m_detachedSelection.clear();
+    m_detachedCurrent = Key();
+    if (m_suspended) {
+        watchSuspendedModel();
+    }
+}
+
 void KeyTreeView::setKeys(const std::vector<Key> &keys)
 {
     std::vector<Key> sorted = keys;
@@ -691,7 +1017,26 @@ void KeyTreeView::resizeColumns()
     m_view->setColumnWidth(KeyListModelInterface::PrettyName, 260);
     m_view->setColumnWidth(KeyListModelInterface::PrettyEMail, 260);
 
-    for (int i = 2; i < m_view->model()->columnCount(); ++i) {
-        m_view->resizeColumnToContents(i);
+    if (!m_largeKeyringMode) {
+        for (int i = 2; i < m_view->model()->columnCount(); ++i) {
+            m_view->resizeColumnToContents(i);
+        }
+        return;
+    }
+
+    // resizeColumnToContents() formats and measures every row; estimate the
+    // widths from rows spread evenly over the list instead
+    const QAbstractItemModel *const model = m_view->model();
+    const int rows = model->rowCount();
+    const int step = std::max(1, rows / ColumnWidthSampleSize);
+    for (int i = 2; i < model->columnCount(); ++i) {
+        if (m_view->isColumnHidden(i)) {
+            continue;
+        }
+        int width = m_view->header()->sectionSizeHint(i);
+        for (int row = 0; row < rows; row += step) {
+            width = std::max(width, m_view->sizeHintForIndex(model->index(row, i)).width());
+        }
+        m_view->setColumnWidth(i, width);
     }
 }
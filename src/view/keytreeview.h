@@ -12,6 +12,7 @@
 
 #include <QWidget>
 
+#include <QPersistentModelIndex>
 #include <QString>
 #include <QStringList>
 
@@ -22,6 +23,7 @@
 
 #include <KConfigGroup>
 
+class QTimer;
 class QTreeView;
 
 namespace Kleo
@@ -111,6 +113,27 @@ public:
     bool connectSearchBar(const QObject *bar);
     void resizeColumns();
 
+    /*!
+     * In large-keyring mode, all rows have the same height, column widths
+     * are estimated from a sample of the rows, the formatted texts of the
+     * expensive columns are cached per key, and the rows around the visible
+     * ones are formatted in the background. The mode is switched on
+     * automatically if the key cache holds many keys.
+     */
+    void setLargeKeyringMode(bool on);
+    bool isLargeKeyringMode() const;
+
+    /*!
+     * A suspended view (e.g. on a hidden tab) stops following changes of
+     * its model: on the first change, its proxy models are detached from
+     * the key list model, so that further changes are not filtered and
+     * sorted for it. When the view is resumed, the proxies are attached
+     * again and catch up with a single pass; selection and current key
+     * are restored.
+     */
+    void setSuspended(bool suspended);
+    bool isSuspended() const;
+
 public Q_SLOTS:
     virtual void setStringFilter(const QString &text);
     virtual void setKeyFilter(const std::shared_ptr<Kleo::KeyFilter> &filter);
@@ -131,6 +154,11 @@ private:
     void saveLayout();
     void restoreLayout();
     void setupRemarkKeys();
+    void schedulePreformatting();
+    void preformatNextChunk();
+    void watchSuspendedModel();
+    void detach();
+    void attach();
 
 private:
     std::vector<GpgME::Key> m_keys;
@@ -150,8 +178,18 @@ private:
 
     KConfigGroup m_group;
 
+    QTimer *m_preformatTimer = nullptr;
+    std::vector<QPersistentModelIndex> m_preformatRows;
+
+    std::vector<QMetaObject::Connection> m_suspendConnections;
+    std::vector<GpgME::Key> m_detachedSelection;
+    GpgME::Key m_detachedCurrent;
+
     bool m_isHierarchical : 1;
     bool m_onceResized : 1;
+    bool m_largeKeyringMode : 1;
+    bool m_suspended : 1;
+    bool m_detached : 1;
 };
 
 }
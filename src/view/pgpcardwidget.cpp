@@ -353,7 +353,7 @@ void PGPCardWidget::genKeyDone(const GpgME::Error &err, const std::string &backu
     KMessageBox::information(this, i18nc("@info",
                              "Successfully generated a new key for this card."),
                              i18nc("@title", "Success"));
-    ReaderStatus::mutableInstance()->updateStatus();
+    ReaderStatus::mutableInstance()->updateCard(mRealSerial, OpenPGPCard::AppName);
 }
 
 void PGPCardWidget::genkeyRequested()
@@ -450,7 +450,7 @@ void PGPCardWidget::changeNameResult(const GpgME::Error &err)
         KMessageBox::information(this, i18nc("@info",
                     "Name successfully changed."),
                 i18nc("@title", "Success"));
-        ReaderStatus::mutableInstance()->updateStatus();
+        ReaderStatus::mutableInstance()->updateCard(mRealSerial, OpenPGPCard::AppName);
     }
 }
 
@@ -497,7 +497,7 @@ void PGPCardWidget::changeUrlResult(const GpgME::Error &err)
         KMessageBox::information(this, i18nc("@info",
                     "URL successfully changed."),
                 i18nc("@title", "Success"));
-        ReaderStatus::mutableInstance()->updateStatus();
+        ReaderStatus::mutableInstance()->updateCard(mRealSerial, OpenPGPCard::AppName);
     }
 }
 
@@ -0,0 +1,163 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    view/selectioncounters.cpp
+
+    This file is part of Kleopatra, the KDE keymanager
+    SPDX-FileCopyrightText: 2021 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <config-kleopatra.h>
+
+#include "selectioncounters.h"
+
+#include <Libkleo/KeyListModelInterface>
+
+#include <gpgme++/key.h>
+
+#include <QAbstractItemModel>
+#include <QItemSelectionModel>
+
+using namespace Kleo;
+using namespace GpgME;
+
+SelectionCounters::SelectionCounters(QItemSelectionModel *sm)
+    : QObject(sm),
+      m_selectionModel(sm)
+{
+    connect(sm, &QItemSelectionModel::selectionChanged, this, &SelectionCounters::selectionChanged);
+    connect(sm, &QItemSelectionModel::modelChanged, this, [this](QAbstractItemModel *model) {
+        invalidate();
+        connectModel(model);
+    });
+    connectModel(sm->model());
+}
+
+void SelectionCounters::invalidate()
+{
+    m_dirty = true;
+}
+
+void SelectionCounters::connectModel(const QAbstractItemModel *model)
+{
+    if (!model) {
+        return;
+    }
+    connect(model, &QAbstractItemModel::modelReset, this, &SelectionCounters::invalidate);
+    connect(model, &QAbstractItemModel::dataChanged, this, &SelectionCounters::invalidate);
+    // e.g. a proxy model whose filter changed
+    connect(model, &QAbstractItemModel::layoutChanged, this, &SelectionCounters::invalidate);
+    connect(model, &QAbstractItemModel::rowsMoved, this, &SelectionCounters::invalidate);
+    connect(model, &QAbstractItemModel::rowsRemoved, this, &SelectionCounters::invalidate);
+}
+
+void SelectionCounters::selectionChanged(const QItemSelection &selected, const QItemSelection &deselected)
+{
+    if (m_dirty) {
+        return;
+    }
+    if (const auto m = dynamic_cast<const KeyListModelInterface *>(m_selectionModel->model())) {
+        update(m, deselected, -1);
+        update(m, selected, +1);
+    } else {
+        m_dirty = true;
+    }
+}
+
+void SelectionCounters::count(const Key &key, int delta)
+{
+    if (key.isNull()) {
+        return;
+    }
+    m_keys += delta;
+    if (key.hasSecret()) {
+        m_secret += delta;
+        if (key.ownerTrust() == Key::Ultimate) {
+            m_secretWithUltimateOwnerTrust += delta;
+        }
+    }
+    if (key.protocol() == OpenPGP) {
+        m_openpgp += delta;
+    } else if (key.protocol() == CMS) {
+        m_cms += delta;
+    }
+    if (!key.isRoot()) {
+        m_nonRoot += delta;
+    } else if (key.userID(0).validity() == UserID::Ultimate) {
+        m_trustedRoot += delta;
+    } else {
+        m_untrustedRoot += delta;
+    }
+}
+
+void SelectionCounters::update(const KeyListModelInterface *m, const QItemSelection &selection, int delta)
+{
+    for (const QItemSelectionRange &range : selection) {
+        // key lists select whole rows; count each row only once, like
+        // QItemSelectionModel::selectedRows()
+        if (range.left() != 0) {
+            continue;
+        }
+        const QAbstractItemModel *const model = range.model();
+        for (int row = range.top(), bottom = range.bottom(); row <= bottom; ++row) {
+            count(m->key(model->index(row, 0, range.parent())), delta);
+        }
+    }
+}
+
+void SelectionCounters::recount(const KeyListModelInterface *m)
+{
+    m_keys = m_secret = m_openpgp = m_cms = 0;
+    m_secretWithUltimateOwnerTrust = m_nonRoot = m_trustedRoot = m_untrustedRoot = 0;
+    for (const Key &key : m->keys(m_selectionModel->selectedRows())) {
+        count(key, 1);
+    }
+    m_dirty = false;
+}
+
+Command::Restrictions SelectionCounters::restrictions()
+{
+    const auto m = dynamic_cast<const KeyListModelInterface *>(m_selectionModel->model());
+    if (!m) {
+        return Command::NoRestriction;
+    }
+    if (m_dirty) {
+        recount(m);
+    }
+
+    if (m_keys <= 0) {
+        return Command::NoRestriction;
+    }
+
+    Command::Restrictions result = Command::NeedSelection;
+
+    if (m_keys == 1) {
+        result |= Command::OnlyOneKey;
+    }
+
+    if (m_secret == m_keys) {
+        result |= Command::NeedSecretKey;
+    } else if (m_secret == 0) {
+        result |= Command::MustNotBeSecretKey;
+    }
+
+    if (m_openpgp == m_keys) {
+        result |= Command::MustBeOpenPGP;
+    } else if (m_cms == m_keys) {
+        result |= Command::MustBeCMS;
+    }
+
+    if (m_secretWithUltimateOwnerTrust == 0) {
+        result |= Command::MayOnlyBeSecretKeyIfOwnerTrustIsNotYetUltimate;
+    }
+
+    if (m_nonRoot == 0) {
+        if (m_trustedRoot > 0 && m_untrustedRoot == 0) {
+            result |= Command::MustBeTrustedRoot;
+        } else if (m_untrustedRoot > 0 && m_trustedRoot == 0) {
+            result |= Command::MustBeUntrustedRoot;
+        }
+    }
+
+    return result;
+}
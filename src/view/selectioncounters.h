@@ -0,0 +1,87 @@
+/* -*- mode: c++; c-basic-offset:4 -*-
+    view/selectioncounters.h
+
+    This file is part of Kleopatra, the KDE keymanager
+    SPDX-FileCopyrightText: 2021 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef __KLEOPATRA_VIEW_SELECTIONCOUNTERS_H__
+#define __KLEOPATRA_VIEW_SELECTIONCOUNTERS_H__
+
+#include <commands/command.h>
+
+#include <QObject>
+
+class QAbstractItemModel;
+class QItemSelection;
+class QItemSelectionModel;
+
+namespace GpgME
+{
+class Key;
+}
+
+namespace Kleo
+{
+
+class KeyListModelInterface;
+
+/*!
+ * Counts the properties of the selected keys that the command restrictions
+ * depend on. The counters are updated from the deltas reported by
+ * QItemSelectionModel::selectionChanged(), so that a change of the
+ * selection costs time proportional to the number of changed rows, and not
+ * to the number of selected rows.
+ *
+ * Changes of the model that are not reported as selection deltas (a reset,
+ * changed data, a new layout, moved or removed rows) make the counters
+ * dirty; they are recounted from the full selection on next use.
+ *
+ * The counters are a child of the selection model. They must be created
+ * before anybody else connects to the selectionChanged() signal of the
+ * selection model who wants to use them in the slot.
+ */
+class SelectionCounters : public QObject
+{
+    Q_OBJECT
+public:
+    explicit SelectionCounters(QItemSelectionModel *sm);
+
+    /*!
+     * Returns the restrictions that the selected keys fulfill, or
+     * Command::NoRestriction if nothing is selected or if the model is not
+     * a key list model.
+     */
+    Command::Restrictions restrictions();
+
+    bool isDirty() const
+    {
+        return m_dirty;
+    }
+
+private:
+    void invalidate();
+    void connectModel(const QAbstractItemModel *model);
+    void selectionChanged(const QItemSelection &selected, const QItemSelection &deselected);
+    void count(const GpgME::Key &key, int delta);
+    void update(const KeyListModelInterface *m, const QItemSelection &selection, int delta);
+    void recount(const KeyListModelInterface *m);
+
+private:
+    const QItemSelectionModel *const m_selectionModel;
+    int m_keys = 0;
+    int m_secret = 0;
+    int m_openpgp = 0;
+    int m_cms = 0;
+    int m_secretWithUltimateOwnerTrust = 0;
+    int m_nonRoot = 0;
+    int m_trustedRoot = 0;
+    int m_untrustedRoot = 0;
+    bool m_dirty = true;
+};
+
+}
+
+#endif // __KLEOPATRA_VIEW_SELECTIONCOUNTERS_H__
@@ -481,6 +481,13 @@ void TabWidget::Private::slotContextMenu(const QPoint &p)
 
 void TabWidget::Private::currentIndexChanged(int index)
 {
+    // only the visible page follows changes of the keys; the others catch
+    // up when they are shown again
+    for (int i = 0, end = tabWidget.count(); i != end; ++i) {
+        if (Page *const p = this->page(i)) {
+            p->setSuspended(i != index);
+        }
+    }
     const Page *const page = this->page(index);
     Q_EMIT q->currentViewChanged(page ? page->view() : nullptr);
     Q_EMIT q->keyFilterChanged(page ? page->keyFilter() : std::shared_ptr<KeyFilter>());
@@ -877,6 +884,7 @@ QTreeView *TabWidget::Private::addView(Page *page, Page *columnReference)
     if (previous != current) {
         currentIndexChanged(tabWidget.currentIndex());
     }
+    page->setSuspended(page != currentPage());
     enableDisableCurrentPageActions();
     QTreeView *view = page->view();
     Q_EMIT q->viewAdded(view);
@@ -0,0 +1,116 @@
+/*
+    This file is part of Kleopatra's test suite.
+    SPDX-FileCopyrightText: 2021 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <config-kleopatra.h>
+
+#include "utils/output.h"
+#include "utils/outputfile.h"
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QRandomGenerator>
+#include <QTemporaryDir>
+#include <QTest>
+
+#include <algorithm>
+#include <memory>
+
+using namespace Kleo;
+
+namespace
+{
+
+// gpgme hands the output to the data provider in chunks of this size
+const int chunkSize = 8 * 1024;
+
+qint64 outputSize()
+{
+    // KLEO_BENCH_FILEOUTPUT_MB allows testing with really large files
+    bool ok;
+    const int mb = qEnvironmentVariableIntValue("KLEO_BENCH_FILEOUTPUT_MB", &ok);
+    return qint64(ok && mb > 0 ? mb : 64) * 1024 * 1024;
+}
+
+}
+
+class FileOutputBenchmark : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase()
+    {
+        QVERIFY(mDir.isValid());
+        mChunk.resize(chunkSize);
+        QRandomGenerator::global()->fillRange(reinterpret_cast<quint32 *>(mChunk.data()), chunkSize / sizeof(quint32));
+    }
+
+    void write_data()
+    {
+        QTest::addColumn<bool>("outputFile");
+        QTest::addColumn<bool>("preallocate");
+        QTest::addColumn<int>("durability");
+
+        // what FileOutput did before: QTemporaryFile with its 16 KiB buffer
+        QTest::newRow("QTemporaryFile") << false << false << int(Output::NoSync);
+        QTest::newRow("no sync") << true << false << int(Output::NoSync);
+        QTest::newRow("no sync, preallocated") << true << true << int(Output::NoSync);
+        QTest::newRow("sync file") << true << true << int(Output::SyncFile);
+        QTest::newRow("sync file and directory") << true << true << int(Output::SyncFileAndDirectory);
+    }
+
+    void write()
+    {
+        QFETCH(bool, outputFile);
+        QFETCH(bool, preallocate);
+        QFETCH(int, durability);
+
+        const qint64 size = outputSize();
+        const QString target = mDir.filePath(QStringLiteral("output"));
+        QFile::remove(target);
+
+        QElapsedTimer timer;
+        timer.start();
+
+        std::unique_ptr<QTemporaryFile> file(outputFile ? new OutputFile(target) : new QTemporaryFile(target));
+        QVERIFY(file->open());
+        if (preallocate) {
+            if (!static_cast<OutputFile *>(file.get())->preallocate(size)) {
+                qInfo() << "preallocation is not supported here";
+            }
+        }
+        for (qint64 written = 0; written < size; written += chunkSize) {
+            QCOMPARE(file->write(mChunk), qint64(chunkSize));
+        }
+        if (durability != Output::NoSync) {
+            QVERIFY(static_cast<OutputFile *>(file.get())->sync(durability == Output::SyncFile));
+        }
+        file->setAutoRemove(false);
+        const QString tmpFileName = file->fileName();
+        file->close();
+        file.reset();
+        QVERIFY(QFile::rename(tmpFileName, target));
+        if (durability == Output::SyncFileAndDirectory) {
+            QVERIFY(OutputFile::syncDirectory(mDir.path()));
+        }
+
+        const qint64 elapsed = std::max<qint64>(timer.elapsed(), 1);
+        QCOMPARE(QFileInfo(target).size(), size);
+        qInfo().noquote() << QTest::currentDataTag() << ":" << size / (1024 * 1024) << "MiB in" << elapsed << "ms ="
+                          << (size / 1024 * 1000 / elapsed) / 1024 << "MiB/s";
+        QTest::setBenchmarkResult(elapsed, QTest::WalltimeMilliseconds);
+    }
+
+private:
+    QTemporaryDir mDir;
+    QByteArray mChunk;
+};
+
+QTEST_GUILESS_MAIN(FileOutputBenchmark)
+
+#include "bench_fileoutput.moc"
@@ -0,0 +1,263 @@
+/*
+    This file is part of Kleopatra's test suite.
+    SPDX-FileCopyrightText: 2021 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <config-kleopatra.h>
+
+#include "fakegpgagent.h"
+
+#include "smartcard/readerstatus.h"
+
+#include <gpgme++/error.h>
+#include <gpgme++/global.h>
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QSignalSpy>
+#include <QTemporaryDir>
+#include <QTest>
+#include <QTimer>
+
+#include <algorithm>
+#include <memory>
+
+using namespace Kleo::SmartCard;
+
+namespace
+{
+
+// Measures how long the event loop of the GUI thread is blocked at most.
+class EventLoopProbe
+{
+public:
+    EventLoopProbe()
+    {
+        m_timer.setInterval(1);
+        QObject::connect(&m_timer, &QTimer::timeout, [this]() {
+            m_maxGap = std::max(m_maxGap, m_lastTick.restart());
+        });
+    }
+
+    void start()
+    {
+        m_maxGap = 0;
+        m_lastTick.start();
+        m_timer.start();
+    }
+
+    qint64 stop()
+    {
+        m_timer.stop();
+        return std::max(m_maxGap, m_lastTick.elapsed());
+    }
+
+private:
+    QTimer m_timer;
+    QElapsedTimer m_lastTick;
+    qint64 m_maxGap = 0;
+};
+
+QVector<FakeGpgAgent::Card> mixedCards(int count)
+{
+    QVector<FakeGpgAgent::Card> cards;
+    for (int i = 0; i < count; ++i) {
+        cards.push_back(i % 2 ? FakeGpgAgent::pivCard(i) : FakeGpgAgent::openPGPCard(i));
+    }
+    return cards;
+}
+
+// Every complete update of all cards or of a single card ends with this signal.
+bool waitForUpdate(QSignalSpy &spy, int timeout = 60000)
+{
+    return !spy.isEmpty() || spy.wait(timeout);
+}
+
+}
+
+class ReaderStatusBenchmark : public QObject
+{
+    Q_OBJECT
+public Q_SLOTS:
+    void transactionDone(const GpgME::Error &err)
+    {
+        Q_UNUSED(err)
+        mLearnCountAtTransactionDone = mAgent.commandCount("SCD LEARN");
+    }
+
+private Q_SLOTS:
+    void initTestCase()
+    {
+        if (!mAgent.listen()) {
+            QSKIP("Failed to start the fake gpg-agent");
+        }
+        mScript = qEnvironmentVariable("KLEO_FAKE_GPG_AGENT_SCRIPT");
+        if (!mScript.isEmpty()) {
+            QString errorMessage;
+            QVERIFY2(mAgent.loadScript(mScript, &errorMessage), qPrintable(errorMessage));
+        } else {
+            // roughly the timings of a USB token
+            mAgent.setLatency("", 1);
+            mAgent.setLatency("SCD GETATTR", 3);
+            mAgent.setLatency("SCD READCERT", 10);
+            mAgent.setLatency("SCD LEARN", 40);
+        }
+    }
+
+    void cleanup()
+    {
+        mReaderStatus.reset();
+        mAgent.resetCommandCounts();
+    }
+
+    void updateLatency_data()
+    {
+        QTest::addColumn<int>("numCards");
+        if (!mScript.isEmpty()) {
+            QTest::newRow("script") << -1;
+            return;
+        }
+        for (int numCards : { 1, 5, 10, 25, 50 }) {
+            QTest::newRow(qPrintable(QStringLiteral("%1 cards").arg(numCards))) << numCards;
+        }
+    }
+
+    void updateLatency()
+    {
+        QFETCH(int, numCards);
+        if (numCards >= 0) {
+            mAgent.setCards(mixedCards(numCards));
+        } else {
+            numCards = mAgent.cards().size();
+        }
+
+        QElapsedTimer timer;
+        EventLoopProbe probe;
+        startReaderStatus();
+        QSignalSpy spy(mReaderStatus.get(), &ReaderStatus::anyCardCanLearnKeysChanged);
+        probe.start();
+        timer.start();
+        mReaderStatus->startMonitoring();
+        QVERIFY(waitForUpdate(spy));
+        const qint64 elapsed = timer.elapsed();
+        const qint64 maxBlocking = probe.stop();
+
+        QCOMPARE(int(mReaderStatus->getCards().size()), numCards);
+        qInfo() << numCards << "cards: initial update took" << elapsed << "ms;"
+                << mAgent.commandCount("SCD LEARN") << "x SCD LEARN;"
+                << "GUI thread blocked for at most" << maxBlocking << "ms";
+        QTest::setBenchmarkResult(elapsed, QTest::WalltimeMilliseconds);
+        waitUntilIdle();
+    }
+
+    void burstOfUpdatesIsMerged()
+    {
+        const int numCards = 5;
+        mAgent.setCards(mixedCards(numCards));
+        startReaderStatus();
+        QSignalSpy spy(mReaderStatus.get(), &ReaderStatus::anyCardCanLearnKeysChanged);
+        mReaderStatus->startMonitoring();
+        QVERIFY(waitForUpdate(spy));
+        waitUntilIdle();
+
+        mAgent.resetCommandCounts();
+        spy.clear();
+        for (int i = 0; i < 20; ++i) {
+            mReaderStatus->updateStatus();
+        }
+        QVERIFY(waitForUpdate(spy));
+        waitUntilIdle();
+
+        // one update may already be running while the others are requested
+        qInfo() << "20 update requests resulted in" << mAgent.commandCount("SCD LEARN") << "x SCD LEARN";
+        QVERIFY(mAgent.commandCount("SCD LEARN") <= 2 * numCards);
+    }
+
+    void singleCardUpdate()
+    {
+        const int numCards = 10;
+        mAgent.setCards(mixedCards(numCards));
+        startReaderStatus();
+        QSignalSpy spy(mReaderStatus.get(), &ReaderStatus::anyCardCanLearnKeysChanged);
+        mReaderStatus->startMonitoring();
+        QVERIFY(waitForUpdate(spy));
+        waitUntilIdle();
+
+        mAgent.resetCommandCounts();
+        spy.clear();
+        const auto card = mReaderStatus->getCards().back();
+        QElapsedTimer timer;
+        timer.start();
+        mReaderStatus->updateCard(card->serialNumber(), card->appName());
+        QVERIFY(waitForUpdate(spy));
+        qInfo() << "updating a single card of" << numCards << "took" << timer.elapsed() << "ms";
+        QCOMPARE(mAgent.commandCount("SCD LEARN"), 1);
+        QCOMPARE(int(mReaderStatus->getCards().size()), numCards);
+    }
+
+    void cardCommandsOvertakeUpdates()
+    {
+        const int numCards = 10;
+        mAgent.setCards(mixedCards(numCards));
+        startReaderStatus();
+        QSignalSpy spy(mReaderStatus.get(), &ReaderStatus::anyCardCanLearnKeysChanged);
+        mReaderStatus->startMonitoring();
+        QVERIFY(waitForUpdate(spy));
+        waitUntilIdle();
+
+        mAgent.resetCommandCounts();
+        mLearnCountAtTransactionDone = -1;
+        const auto card = mReaderStatus->getCards().front();
+        mReaderStatus->updateStatus();
+        QTest::qWait(10);
+        mReaderStatus->updateStatus();
+        QElapsedTimer timer;
+        timer.start();
+        mReaderStatus->startSimpleTransaction(card, "SCD CHECKPIN " + QByteArray::fromStdString(card->serialNumber()),
+                                              this, "transactionDone");
+        QTRY_VERIFY_WITH_TIMEOUT(mLearnCountAtTransactionDone >= 0, 60000);
+        qInfo() << "card command finished after" << timer.elapsed() << "ms";
+        // the command must not wait for the second update of all cards
+        QVERIFY(mLearnCountAtTransactionDone < 2 * numCards);
+        waitUntilIdle();
+    }
+
+private:
+    void startReaderStatus()
+    {
+        mReaderStatus.reset(new ReaderStatus);
+    }
+
+    // Waits until the reader status thread didn't talk to the agent for a while.
+    void waitUntilIdle()
+    {
+        int count = -1;
+        while (count != mAgent.commandCount("")) {
+            count = mAgent.commandCount("");
+            QTest::qWait(200);
+        }
+    }
+
+private:
+    FakeGpgAgent mAgent;
+    std::unique_ptr<ReaderStatus> mReaderStatus;
+    QString mScript;
+    int mLearnCountAtTransactionDone = -1;
+};
+
+int main(int argc, char *argv[])
+{
+    // gpgme must connect to the fake agent; use a fresh home directory
+    QTemporaryDir gnupgHome;
+    qputenv("GNUPGHOME", QFile::encodeName(gnupgHome.path()));
+    qputenv("LC_ALL", "C");
+    QCoreApplication app(argc, argv);
+    GpgME::initializeLibrary();
+    ReaderStatusBenchmark benchmark;
+    return QTest::qExec(&benchmark, argc, argv);
+}
+
+#include "bench_readerstatus.moc"
@@ -0,0 +1,614 @@
+/*
+    This file is part of Kleopatra's test suite.
+    SPDX-FileCopyrightText: 2021 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "fakegpgagent.h"
+
+#include <Libkleo/GnuPG>
+
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QFile>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QProcess>
+
+#include <gpg-error.h>
+
+#include <algorithm>
+
+namespace
+{
+
+QByteArray hexDigest(const QByteArray &data, QCryptographicHash::Algorithm algorithm = QCryptographicHash::Sha1)
+{
+    return QCryptographicHash::hash(data, algorithm).toHex().toUpper();
+}
+
+QByteArray keyPairInfo(const QByteArray &grip, const QByteArray &keyRef, const QByteArray &usage, const QByteArray &algorithm)
+{
+    return grip + ' ' + keyRef + ' ' + usage + " - " + algorithm;
+}
+
+// Assuan requires '%', CR and LF to be percent-escaped in data and status lines.
+QByteArray escaped(const QByteArray &data)
+{
+    QByteArray result;
+    result.reserve(data.size());
+    for (const char c : data) {
+        if (c == '%' || c == '\r' || c == '\n') {
+            result += '%' + QByteArray(1, c).toHex().toUpper();
+        } else {
+            result += c;
+        }
+    }
+    return result;
+}
+
+const FakeGpgAgent::Card *findCard(const QVector<FakeGpgAgent::Card> &cards, const QByteArray &serialNumber)
+{
+    const auto it = std::find_if(cards.cbegin(), cards.cend(), [&serialNumber](const FakeGpgAgent::Card &card) {
+        return card.serialNumber == serialNumber;
+    });
+    return it != cards.cend() ? &*it : nullptr;
+}
+
+const FakeGpgAgent::App *findApp(const FakeGpgAgent::Card &card, const QByteArray &appName)
+{
+    const auto it = std::find_if(card.apps.cbegin(), card.apps.cend(), [&appName](const FakeGpgAgent::App &app) {
+        return app.name == appName;
+    });
+    return it != card.apps.cend() ? &*it : nullptr;
+}
+
+QByteArray appNames(const FakeGpgAgent::Card &card)
+{
+    QByteArray result;
+    for (const FakeGpgAgent::App &app : card.apps) {
+        result += ' ' + app.name;
+    }
+    return result;
+}
+
+}
+
+class FakeGpgAgent::Connection : public QObject
+{
+public:
+    Connection(FakeGpgAgent *agent, QLocalSocket *socket)
+        : QObject(socket), m_agent(agent), m_socket(socket)
+    {
+        connect(socket, &QLocalSocket::readyRead, this, [this]() { readCommands(); });
+        m_socket->write("OK Pleased to meet you\n");
+        m_socket->flush();
+    }
+
+    bool isWatching() const
+    {
+        return m_watching;
+    }
+
+    void sendStatus(const QByteArray &keyword, const QByteArray &args)
+    {
+        m_socket->write("S " + keyword + ' ' + escaped(args) + '\n');
+    }
+
+    void flush()
+    {
+        m_socket->flush();
+    }
+
+private:
+    void readCommands()
+    {
+        while (m_socket->canReadLine()) {
+            QByteArray line = m_socket->readLine();
+            while (line.endsWith('\n') || line.endsWith('\r')) {
+                line.chop(1);
+            }
+            if (!line.isEmpty() && !line.startsWith('#')) {
+                handle(line);
+            }
+        }
+        m_socket->flush();
+    }
+
+    void handle(const QByteArray &line)
+    {
+        m_agent->countCommand(line);
+        const int delay = m_agent->latency(line);
+        if (delay > 0) {
+            QThread::msleep(delay);
+        }
+
+        if (line == "BYE") {
+            sendOk();
+            m_socket->disconnectFromServer();
+        } else if (line.startsWith("OPTION ") || line == "RESET" || line == "NOP") {
+            sendOk();
+        } else if (line.startsWith("SCD ")) {
+            handleScdCommand(line.mid(4).split(' '));
+        } else {
+            sendError(GPG_ERR_SOURCE_GPGAGENT, GPG_ERR_ASS_UNKNOWN_CMD, "Unknown IPC command");
+        }
+    }
+
+    void handleScdCommand(const QList<QByteArray> &args)
+    {
+        const QVector<Card> cards = m_agent->cards();
+        const QByteArray &command = args.front();
+
+        if (command == "GETINFO" && args.value(1) == "all_active_apps") {
+            for (const Card &card : cards) {
+                sendStatus("SERIALNO", card.serialNumber + appNames(card));
+            }
+            sendOk();
+            return;
+        }
+        if (command == "DEVINFO" && args.value(1) == "--watch") {
+            // the answer is never finished; status lines are sent on changes
+            m_watching = true;
+            for (const Card &card : cards) {
+                sendStatus("DEVINFO_STATUS", "new " + card.serialNumber + appNames(card));
+            }
+            return;
+        }
+
+        const Card *card = findCard(cards, m_serialNumber);
+        if (!card && !cards.empty()) {
+            // like scdaemon, fall back to the first card
+            card = &cards.front();
+            m_serialNumber = card->serialNumber;
+            m_appName = card->apps.empty() ? QByteArray() : card->apps.front().name;
+        }
+        if (!card) {
+            sendError(GPG_ERR_SOURCE_SCD, GPG_ERR_CARD_NOT_PRESENT, "Card not present");
+            return;
+        }
+
+        if (command == "SERIALNO") {
+            sendStatus("SERIALNO", card->serialNumber);
+            sendOk();
+            return;
+        }
+        if (command == "SWITCHCARD") {
+            const Card *newCard = findCard(cards, args.value(1));
+            if (!newCard) {
+                sendError(GPG_ERR_SOURCE_SCD, GPG_ERR_CARD_NOT_PRESENT, "Card not present");
+                return;
+            }
+            m_serialNumber = newCard->serialNumber;
+            m_appName = newCard->apps.empty() ? QByteArray() : newCard->apps.front().name;
+            sendStatus("SERIALNO", m_serialNumber);
+            sendOk();
+            return;
+        }
+        if (command == "SWITCHAPP") {
+            const App *newApp = findApp(*card, args.value(1));
+            if (!newApp) {
+                sendError(GPG_ERR_SOURCE_SCD, GPG_ERR_NOT_SUPPORTED, "Not supported");
+                return;
+            }
+            m_appName = newApp->name;
+            QByteArray otherApps;
+            for (const App &app : card->apps) {
+                if (app.name != m_appName) {
+                    otherApps += ' ' + app.name;
+                }
+            }
+            sendStatus("SERIALNO", card->serialNumber + ' ' + m_appName + otherApps);
+            sendOk();
+            return;
+        }
+
+        const App *app = findApp(*card, m_appName);
+        if (!app) {
+            sendError(GPG_ERR_SOURCE_SCD, GPG_ERR_CARD, "General error");
+            return;
+        }
+
+        if (command == "GETATTR") {
+            const QByteArray name = args.value(1);
+            if (name == "SERIALNO") {
+                sendStatus(name, card->serialNumber);
+                sendOk();
+                return;
+            }
+            if (name == "APPTYPE") {
+                sendStatus(name, app->name.toUpper());
+                sendOk();
+                return;
+            }
+            const auto it = std::find_if(app->attributes.cbegin(), app->attributes.cend(),
+                                         [&name](const QPair<QByteArray, QByteArray> &attribute) {
+                                             return attribute.first == name;
+                                         });
+            if (it == app->attributes.cend()) {
+                sendError(GPG_ERR_SOURCE_SCD, GPG_ERR_INV_NAME, "Invalid name");
+                return;
+            }
+            sendStatus(name, it->second);
+            sendOk();
+        } else if (command == "LEARN") {
+            sendStatus("SERIALNO", card->serialNumber);
+            sendStatus("APPTYPE", app->name.toUpper());
+            for (const auto &status : app->learnStatus) {
+                sendStatus(status.first, status.second);
+            }
+            sendOk();
+        } else if (command == "READKEY") {
+            const QByteArray keyInfo = app->keyPairInfos.value(args.back());
+            if (keyInfo.isEmpty()) {
+                sendError(GPG_ERR_SOURCE_SCD, GPG_ERR_NOT_FOUND, "Not found");
+                return;
+            }
+            sendStatus("KEYPAIRINFO", keyInfo);
+            sendOk();
+        } else if (command == "READCERT") {
+            const QByteArray certificate = app->certificates.value(args.value(1));
+            if (certificate.isEmpty()) {
+                sendError(GPG_ERR_SOURCE_SCD, GPG_ERR_NOT_FOUND, "Not found");
+                return;
+            }
+            sendData(certificate);
+            sendOk();
+        } else {
+            // card commands (PASSWD, GENKEY, WRITEKEY, ...) simply succeed
+            sendOk();
+        }
+    }
+
+    void sendData(const QByteArray &data)
+    {
+        // Assuan lines must not be longer than 1000 bytes
+        const QByteArray escapedData = escaped(data);
+        int pos = 0;
+        while (pos < escapedData.size()) {
+            int length = std::min(escapedData.size() - pos, 900);
+            // don't split escape sequences
+            if (pos + length < escapedData.size()) {
+                const int percent = escapedData.lastIndexOf('%', pos + length - 1);
+                if (percent >= pos + length - 2) {
+                    length = percent - pos;
+                }
+            }
+            m_socket->write("D " + escapedData.mid(pos, length) + '\n');
+            pos += length;
+        }
+    }
+
+    void sendOk()
+    {
+        m_socket->write("OK\n");
+    }
+
+    void sendError(gpg_err_source_t source, gpg_err_code_t code, const char *description)
+    {
+        m_socket->write("ERR " + QByteArray::number(gpg_err_make(source, code)) + ' ' + description + '\n');
+    }
+
+private:
+    FakeGpgAgent *const m_agent;
+    QLocalSocket *const m_socket;
+    QByteArray m_serialNumber;
+    QByteArray m_appName;
+    bool m_watching = false;
+};
+
+// static
+FakeGpgAgent::Card FakeGpgAgent::openPGPCard(int index)
+{
+    const QByteArray id = QByteArray::number(index, 16).rightJustified(8, '0').toUpper();
+    const QByteArray seed = "openpgp-" + QByteArray::number(index);
+
+    App app;
+    app.name = "openpgp";
+    app.attributes = {
+        { "MANUFACTURER", "6 Yubico" },
+        { "$DISPSERIALNO", "0006" + id },
+        { "$SIGNKEYID", "OPENPGP.1" },
+        { "$ENCRKEYID", "OPENPGP.2" },
+    };
+    app.learnStatus = {
+        { "APPVERSION", "304" },
+        { "DISP-NAME", "Doe<<Jane" },
+        { "CHV-STATUS", "+1 127 127 127 3 0 3" },
+        { "SIG-COUNTER", "0" },
+    };
+    for (int key = 1; key <= 3; ++key) {
+        const QByteArray keyNumber = QByteArray::number(key);
+        const QByteArray keyRef = "OPENPGP." + keyNumber;
+        app.learnStatus.push_back({ "KEY-FPR", keyNumber + ' ' + hexDigest(seed + keyRef) });
+        app.learnStatus.push_back({ "KEYPAIRINFO", keyPairInfo(hexDigest(seed + "grip" + keyRef), keyRef,
+                                                               key == 2 ? "e" : key == 1 ? "sc" : "a", "ed25519") });
+    }
+
+    return { "D2760001240103040006" + id + "0000", { app } };
+}
+
+// static
+FakeGpgAgent::Card FakeGpgAgent::pivCard(int index)
+{
+    const QByteArray seed = "piv-" + QByteArray::number(index);
+
+    App app;
+    app.name = "piv";
+    app.attributes = {
+        { "$DISPSERIALNO", QByteArray::number(10000000 + index) },
+        { "$SIGNKEYID", "PIV.9C" },
+        { "$ENCRKEYID", "PIV.9D" },
+    };
+    app.learnStatus = {
+        { "APPVERSION", "500" },
+        { "CHV-STATUS", "3 3" },
+    };
+    const QVector<QPair<QByteArray, QByteArray> > keys = {
+        { "PIV.9A", "a" },
+        { "PIV.9C", "sc" },
+        { "PIV.9D", "e" },
+    };
+    for (const auto &key : keys) {
+        const QByteArray info = keyPairInfo(hexDigest(seed + "grip" + key.first), key.first, key.second, "rsa2048");
+        app.learnStatus.push_back({ "KEYPAIRINFO", info });
+        app.keyPairInfos.insert(key.first, info);
+        // the content doesn't matter; ReaderStatus only stores it
+        app.certificates.insert(key.first, QCryptographicHash::hash(seed + key.first, QCryptographicHash::Sha512).repeated(16));
+    }
+
+    return { "FF7F0000" + QByteArray::number(index, 16).rightJustified(8, '0').toUpper(), { app } };
+}
+
+// static
+FakeGpgAgent::Card FakeGpgAgent::netKeyCard(int index)
+{
+    const QByteArray seed = "nks-" + QByteArray::number(index);
+
+    App app;
+    app.name = "nks";
+    app.attributes = {
+        { "NKS-VERSION", "3" },
+        { "CHV-STATUS", "3 3 3 3" },
+        { "$DISPSERIALNO", QByteArray::number(20000000 + index) },
+    };
+    for (const QByteArray &keyRef : { QByteArray("NKS-NKS3.4531"), QByteArray("NKS-NKS3.45B1") }) {
+        app.learnStatus.push_back({ "KEYPAIRINFO", keyPairInfo(hexDigest(seed + "grip" + keyRef), keyRef, "sc", "rsa2048") });
+    }
+
+    return { "D2760000254E4B53" + QByteArray::number(index, 16).rightJustified(16, '0').toUpper(), { app } };
+}
+
+FakeGpgAgent::FakeGpgAgent(QObject *parent)
+    : QThread(parent)
+{
+}
+
+FakeGpgAgent::~FakeGpgAgent()
+{
+    shutdown();
+}
+
+// static
+QString FakeGpgAgent::agentSocketPath()
+{
+    // gpgconf may place the sockets of non-default home directories below /run/user
+    const QString gpgconf = Kleo::gpgConfPath();
+    if (!gpgconf.isEmpty()) {
+        QProcess::execute(gpgconf, { QStringLiteral("--create-socketdir") });
+        QProcess process;
+        process.start(gpgconf, { QStringLiteral("--list-dirs"), QStringLiteral("agent-socket") });
+        if (process.waitForFinished()) {
+            const QByteArray path = QByteArray::fromPercentEncoding(process.readAllStandardOutput().trimmed());
+            if (!path.isEmpty()) {
+                return QFile::decodeName(path);
+            }
+        }
+    }
+    return Kleo::gnupgHomeDirectory() + QLatin1String("/S.gpg-agent");
+}
+
+bool FakeGpgAgent::listen(const QString &socketPath)
+{
+    {
+        const QMutexLocker locker(&m_mutex);
+        m_socketPath = socketPath;
+    }
+    start();
+    m_started.acquire();
+    const QMutexLocker locker(&m_mutex);
+    return m_listening;
+}
+
+void FakeGpgAgent::shutdown()
+{
+    if (isRunning()) {
+        quit();
+        wait();
+    }
+}
+
+void FakeGpgAgent::run()
+{
+    QLocalServer server;
+    QString socketPath;
+    {
+        const QMutexLocker locker(&m_mutex);
+        socketPath = m_socketPath;
+    }
+
+    QLocalServer::removeServer(socketPath);
+    const bool listening = server.listen(socketPath);
+    if (!listening) {
+        qWarning() << "FakeGpgAgent: listening on" << socketPath << "failed:" << server.errorString();
+    }
+    {
+        const QMutexLocker locker(&m_mutex);
+        m_listening = listening;
+        m_serverContext = listening ? &server : nullptr;
+    }
+    m_started.release();
+    if (!listening) {
+        return;
+    }
+
+    connect(&server, &QLocalServer::newConnection, &server, [this, &server]() {
+        while (QLocalSocket *const socket = server.nextPendingConnection()) {
+            auto connection = new Connection(this, socket);
+            m_connections.push_back(connection);
+            connect(socket, &QLocalSocket::disconnected, &server, [this, socket, connection]() {
+                m_connections.removeAll(connection);
+                socket->deleteLater();
+            });
+        }
+    });
+
+    exec();
+
+    {
+        const QMutexLocker locker(&m_mutex);
+        m_listening = false;
+        m_serverContext = nullptr;
+    }
+    m_connections.clear();
+    server.close();
+}
+
+void FakeGpgAgent::setCards(const QVector<Card> &cards)
+{
+    QVector<Card> oldCards;
+    QObject *context;
+    {
+        const QMutexLocker locker(&m_mutex);
+        oldCards = m_cards;
+        m_cards = cards;
+        context = m_serverContext;
+    }
+    if (context) {
+        QMetaObject::invokeMethod(context, [this, oldCards, cards]() {
+            notifyWatchers(oldCards, cards);
+        }, Qt::QueuedConnection);
+    }
+}
+
+QVector<FakeGpgAgent::Card> FakeGpgAgent::cards() const
+{
+    const QMutexLocker locker(&m_mutex);
+    return m_cards;
+}
+
+void FakeGpgAgent::setLatency(const QByteArray &commandPrefix, int msecs)
+{
+    const QMutexLocker locker(&m_mutex);
+    m_latencies.insert(commandPrefix, msecs);
+}
+
+int FakeGpgAgent::latency(const QByteArray &command) const
+{
+    const QMutexLocker locker(&m_mutex);
+    int result = 0;
+    int matchLength = -1;
+    for (auto it = m_latencies.cbegin(); it != m_latencies.cend(); ++it) {
+        if (it.key().size() > matchLength && command.startsWith(it.key())) {
+            matchLength = it.key().size();
+            result = it.value();
+        }
+    }
+    return result;
+}
+
+void FakeGpgAgent::countCommand(const QByteArray &command)
+{
+    const QMutexLocker locker(&m_mutex);
+    ++m_commandCounts[command];
+}
+
+int FakeGpgAgent::commandCount(const QByteArray &commandPrefix) const
+{
+    const QMutexLocker locker(&m_mutex);
+    int result = 0;
+    for (auto it = m_commandCounts.cbegin(); it != m_commandCounts.cend(); ++it) {
+        if (it.key().startsWith(commandPrefix)) {
+            result += it.value();
+        }
+    }
+    return result;
+}
+
+void FakeGpgAgent::resetCommandCounts()
+{
+    const QMutexLocker locker(&m_mutex);
+    m_commandCounts.clear();
+}
+
+void FakeGpgAgent::notifyWatchers(const QVector<Card> &oldCards, const QVector<Card> &newCards)
+{
+    for (Connection *connection : qAsConst(m_connections)) {
+        if (!connection->isWatching()) {
+            continue;
+        }
+        for (const Card &card : oldCards) {
+            if (!findCard(newCards, card.serialNumber)) {
+                connection->sendStatus("DEVINFO_STATUS", "removal " + card.serialNumber);
+            }
+        }
+        for (const Card &card : newCards) {
+            if (!findCard(oldCards, card.serialNumber)) {
+                connection->sendStatus("DEVINFO_STATUS", "new " + card.serialNumber + appNames(card));
+            }
+        }
+        connection->flush();
+    }
+}
+
+bool FakeGpgAgent::loadScript(const QString &fileName, QString *errorMessage)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        if (errorMessage) {
+            *errorMessage = file.errorString();
+        }
+        return false;
+    }
+
+    QVector<Card> cards;
+    int lineNumber = 0;
+    while (!file.atEnd()) {
+        ++lineNumber;
+        const QByteArray line = file.readLine().simplified();
+        if (line.isEmpty() || line.startsWith('#')) {
+            continue;
+        }
+        const QList<QByteArray> words = line.split(' ');
+        bool ok = false;
+        if (words[0] == "latency" && words.size() >= 2) {
+            const int msecs = words[1].toInt(&ok);
+            if (ok) {
+                setLatency(words.mid(2).join(' '), msecs);
+            }
+        } else if (words[0] == "card" && (words.size() == 2 || words.size() == 3)) {
+            const int count = words.size() == 3 ? words[2].toInt(&ok) : 1;
+            ok = count > 0 && (words.size() == 2 || ok);
+            for (int i = 0; ok && i < count; ++i) {
+                if (words[1] == "openpgp") {
+                    cards.push_back(openPGPCard(cards.size()));
+                } else if (words[1] == "piv") {
+                    cards.push_back(pivCard(cards.size()));
+                } else if (words[1] == "nks") {
+                    cards.push_back(netKeyCard(cards.size()));
+                } else {
+                    ok = false;
+                }
+            }
+        }
+        if (!ok) {
+            if (errorMessage) {
+                *errorMessage = QStringLiteral("%1:%2: invalid line").arg(fileName).arg(lineNumber);
+            }
+            return false;
+        }
+    }
+    setCards(cards);
+    return true;
+}
@@ -0,0 +1,121 @@
+/*
+    This file is part of Kleopatra's test suite.
+    SPDX-FileCopyrightText: 2021 g10 Code GmbH
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef KLEO_TEST_FAKEGPGAGENT_H
+#define KLEO_TEST_FAKEGPGAGENT_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QPair>
+#include <QSemaphore>
+#include <QString>
+#include <QThread>
+#include <QVector>
+
+/*!
+ * A stand-in for gpg-agent and scdaemon that answers the Assuan commands
+ * ReaderStatus and DeviceInfoWatcher send (SCD SERIALNO, SCD GETINFO
+ * all_active_apps, SCD SWITCHCARD/SWITCHAPP, SCD GETATTR, SCD LEARN --force,
+ * SCD READKEY --info-only, SCD READCERT and SCD DEVINFO --watch) for a
+ * configurable population of simulated cards.
+ *
+ * The server runs in its own thread and handles one command at a time, like
+ * scdaemon does. Each command can be delayed by a configurable latency to
+ * simulate slow readers. All public functions are thread-safe.
+ *
+ * Point GNUPGHOME to an otherwise unused directory before gpgme is
+ * initialized and before calling listen().
+ */
+class FakeGpgAgent : public QThread
+{
+    Q_OBJECT
+public:
+    struct App {
+        QByteArray name;
+        /* answers to SCD GETATTR */
+        QVector<QPair<QByteArray, QByteArray> > attributes;
+        /* status lines sent for SCD LEARN --force */
+        QVector<QPair<QByteArray, QByteArray> > learnStatus;
+        /* KEYPAIRINFO sent for SCD READKEY --info-only, by key ref */
+        QHash<QByteArray, QByteArray> keyPairInfos;
+        /* data sent for SCD READCERT, by key ref */
+        QHash<QByteArray, QByteArray> certificates;
+    };
+
+    struct Card {
+        QByteArray serialNumber;
+        QVector<App> apps;
+    };
+
+    static Card openPGPCard(int index);
+    static Card pivCard(int index);
+    static Card netKeyCard(int index);
+
+    explicit FakeGpgAgent(QObject *parent = nullptr);
+    ~FakeGpgAgent() override;
+
+    /*! Returns the path of the agent socket gpgme uses for the current GNUPGHOME. */
+    static QString agentSocketPath();
+
+    /*! Starts the server thread and returns when the server listens (or failed to). */
+    bool listen(const QString &socketPath = agentSocketPath());
+    /*! Stops the server and closes all connections. */
+    void shutdown();
+
+    /*!
+     * Replaces the simulated cards. Connections waiting in SCD DEVINFO --watch
+     * are notified about added and removed cards.
+     */
+    void setCards(const QVector<Card> &cards);
+    QVector<Card> cards() const;
+
+    /*!
+     * Delays the answer to all commands starting with \a commandPrefix by
+     * \a msecs milliseconds. The latency of the longest matching prefix is
+     * used; an empty prefix sets the default latency.
+     */
+    void setLatency(const QByteArray &commandPrefix, int msecs);
+
+    /*!
+     * Configures latencies and cards from a script. Each line of the script
+     * is one of
+     *     latency <msecs> [<command prefix>]
+     *     card openpgp|piv|nks [<count>]
+     * Empty lines and lines starting with '#' are ignored.
+     */
+    bool loadScript(const QString &fileName, QString *errorMessage = nullptr);
+
+    /*! Returns the number of received commands starting with \a commandPrefix. */
+    int commandCount(const QByteArray &commandPrefix) const;
+    void resetCommandCounts();
+
+private:
+    void run() override;
+
+    class Connection;
+    friend class Connection;
+
+    int latency(const QByteArray &command) const;
+    void countCommand(const QByteArray &command);
+    void notifyWatchers(const QVector<Card> &oldCards, const QVector<Card> &newCards);
+
+private:
+    mutable QMutex m_mutex;
+    // protected by m_mutex:
+    QString m_socketPath;
+    QVector<Card> m_cards;
+    QHash<QByteArray, int> m_latencies;
+    QHash<QByteArray, int> m_commandCounts;
+    QObject *m_serverContext = nullptr;
+    bool m_listening = false;
+    QSemaphore m_started;
+    // only used in the server thread:
+    QVector<Connection *> m_connections;
+};
+
+#endif // KLEO_TEST_FAKEGPGAGENT_H